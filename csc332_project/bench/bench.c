@@ -0,0 +1,670 @@
+// bench.c
+// Benchmark driver for the five CSC 332 tools.
+// Generates reproducible inputs at several sizes (logs, binaries, key
+// files, command lists, a process of known size), runs each tool's cases
+// on them as separate processes with perf_event_open counters attached,
+// and prints one CSV row per case and size: median wall time, throughput,
+// CPU time, peak RSS, cycles, instructions, cache misses and page faults.
+// With a baseline, each row is compared against it and regressions are
+// flagged.
+//
+// Usage:
+//   bench [-s SIZES] [-n COUNTS] [-T TOOLS] [-r N] [-o FILE] [-b BASELINE [-x PCT]]
+//   bench -c RESULTS -b BASELINE [-x PCT]
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "datasets.h"
+#include "perf.h"
+#include "results.h"
+
+#ifndef BENCH_TAG
+#define BENCH_TAG "unknown"
+#endif
+
+#define MAX_LIST 16
+#define MAX_REPS 64
+#define MAX_ARGS 16
+
+/* Exit status when a row regressed against the baseline */
+#define EXIT_REGRESSION 2
+
+typedef struct {
+    const char *name;
+    const char *dir;            // under the project root; the binary is in build/
+} Tool;
+
+static const Tool tools[] = {
+    { "loganalyzer", "loganalyzer_raian" },
+    { "filediffadvanced", "filediffadvanced_mahdi" },
+    { "filecrypt", "filecrypt_mir" },
+    { "memview", "memview_atif" },
+    { "timedexec", "timedexec_ibsan" },
+};
+#define TOOL_COUNT (int)(sizeof(tools) / sizeof(tools[0]))
+
+/* Inputs a case needs, made once per size for every case that runs */
+enum {
+    NEED_LOG = 1 << 0,          // {log}: log lines
+    NEED_DATA = 1 << 1,         // {data}: random bytes
+    NEED_COPY = 1 << 2,         // {copy}: the same bytes again
+    NEED_MUTATED = 1 << 3,      // {mutated}: with a byte changed every 64 KB
+    NEED_KEY = 1 << 4,          // {key}: a 32 byte key file
+    NEED_SEALED = 1 << 5,       // {sealed}: {data} encrypted with chacha
+    NEED_BALLAST = 1 << 6,      // {pid}: a process with that much heap
+    NEED_COMMANDS = 1 << 7,     // {commands}: that many lines of "true"
+};
+
+typedef struct {
+    const char *tool;
+    const char *name;
+    int by_count;               // sized by -n (commands), not -s (bytes)
+    unsigned needs;
+    int expect_exit;            // filediffadvanced exits 1 when files differ
+    const char *args[MAX_ARGS]; // after argv[0]; "{...}" are the inputs
+} BenchCase;
+
+static const BenchCase cases[] = {
+    { "loganalyzer", "summary", 0, NEED_LOG, 0, { "-f", "{log}" } },
+    { "loganalyzer", "errors_on_date", 0, NEED_LOG, 0, { "-f", "{log}", "-E", "-d", "2025-03-01" } },
+    { "loganalyzer", "substring", 0, NEED_LOG, 0, { "-f", "{log}", "-s", "user42" } },
+    { "loganalyzer", "summary_uring", 0, NEED_LOG, 0, { "-f", "{log}", "--io=uring" } },
+    { "filediffadvanced", "identical", 0, NEED_DATA | NEED_COPY, 0, { "-b", "{data}", "{copy}" } },
+    { "filediffadvanced", "sparse_changes", 0, NEED_DATA | NEED_MUTATED, 1, { "-s", "{data}", "{mutated}" } },
+    { "filediffadvanced", "sparse_changes_uring", 0, NEED_DATA | NEED_MUTATED, 1,
+      { "-s", "--io=uring", "{data}", "{mutated}" } },
+    { "filecrypt", "xor_encrypt", 0, NEED_DATA | NEED_KEY, 0,
+      { "-e", "-a", "xor", "-k", "{key}", "-i", "{data}", "-o", "{out}" } },
+    { "filecrypt", "chacha_encrypt", 0, NEED_DATA | NEED_KEY, 0,
+      { "-e", "-a", "chacha", "-k", "{key}", "-i", "{data}", "-o", "{out}" } },
+    { "filecrypt", "chacha_decrypt", 0, NEED_SEALED | NEED_KEY, 0,
+      { "-d", "-a", "chacha", "-k", "{key}", "-i", "{sealed}", "-o", "{out}" } },
+    { "filecrypt", "chacha_encrypt_uring", 0, NEED_DATA | NEED_KEY, 0,
+      { "-e", "-a", "chacha", "-k", "{key}", "-i", "{data}", "-o", "{out}", "--io=uring" } },
+    { "filecrypt", "chacha_encrypt_read", 0, NEED_DATA | NEED_KEY, 0,
+      { "-e", "-a", "chacha", "-k", "{key}", "-i", "{data}", "-o", "{out}", "--io=read" } },
+    { "memview", "maps", 0, NEED_BALLAST, 0, { "-p", "{pid}", "-m" } },
+    { "memview", "residency", 0, NEED_BALLAST, 0, { "-p", "{pid}", "-R" } },
+    { "timedexec", "batch_j1", 1, NEED_COMMANDS, 0, { "-t", "10", "-f", "{commands}", "-j", "1" } },
+    { "timedexec", "batch_j8", 1, NEED_COMMANDS, 0, { "-t", "10", "-f", "{commands}", "-j", "8" } },
+};
+#define CASE_COUNT (int)(sizeof(cases) / sizeof(cases[0]))
+
+/* The generated inputs for one size */
+typedef struct {
+    char log[4096];
+    char data[4096];
+    char copy[4096];
+    char mutated[4096];
+    char key[4096];
+    char sealed[4096];
+    char commands[4096];
+    char out[4096];             // where filecrypt writes
+    char pid[16];
+    pid_t ballast;
+    unsigned made;              // NEED_* that exist
+} Inputs;
+
+typedef struct {
+    long long items[MAX_LIST];
+    int count;
+} NumberList;
+
+typedef struct {
+    double wall_ms;
+    double user_ms;
+    double sys_ms;
+    long long max_rss_kb;
+    long long counters[COUNTER_COUNT];
+} Sample;
+
+typedef struct {
+    const char *root;           // the project directory
+    const char *dir;            // for the inputs
+    const char *tag;
+    int reps;
+    int selected[TOOL_COUNT];
+    FILE *copy;                 // -o, NULL for none
+    const RowSet *baseline;     // -b, NULL for none
+    double threshold_pct;
+    int rows;
+    int regressions;
+    int faster;
+} Bench;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [OPTIONS]\n"
+        "       %s -c RESULTS -b BASELINE [-x PCT]\n"
+        "Run the CSC 332 tools on generated inputs and print CSV on stdout.\n"
+        "  -s LIST  : input sizes for loganalyzer, filediffadvanced, filecrypt and\n"
+        "             memview (default 1M,16M,128M)\n"
+        "  -n LIST  : command counts for timedexec (default 100,1000)\n"
+        "  -T LIST  : only these tools, e.g. filecrypt,memview (default all)\n"
+        "  -r N     : runs per case, the median is reported (default 3)\n"
+        "  -C DIR   : project directory with the tools' build/ (default .)\n"
+        "  -d DIR   : directory for the generated inputs (default $TMPDIR or /tmp)\n"
+        "  -o FILE  : also write the CSV to FILE\n"
+        "  -b FILE  : compare each row with this earlier CSV; exit %d on a regression\n"
+        "  -x PCT   : how much slower, or how many more instructions, is a\n"
+        "             regression (default 10)\n"
+        "  -c FILE  : compare this earlier CSV with -b instead of running anything\n"
+        "  -t TAG   : version label for the tag column (default " BENCH_TAG ")\n"
+        "Sizes accept K, M and G suffixes.\n",
+        prog, prog, EXIT_REGRESSION);
+}
+
+/* -s and -n: up to MAX_LIST comma-separated numbers, each from 1 to 2^40.
+ * With sizes set, a K, M or G suffix multiplies by 1024, 1024^2 or 1024^3
+ * (checked against the same bound). Zero is refused: every case needs an
+ * input, and every run at least one command. */
+static int parse_number_list(const char *text, NumberList *list, int sizes)
+{
+    char *copy = strdup(text);
+    if (!copy)
+        return -1;
+    list->count = 0;
+    for (char *token = strtok(copy, ","); token; token = strtok(NULL, ",")) {
+        char *end;
+        long long value = strtoll(token, &end, 10);
+        long long scale = 1;
+        if (sizes && (*end == 'k' || *end == 'K'))
+            scale = 1LL << 10;
+        else if (sizes && (*end == 'm' || *end == 'M'))
+            scale = 1LL << 20;
+        else if (sizes && (*end == 'g' || *end == 'G'))
+            scale = 1LL << 30;
+        if (scale > 1)
+            end++;
+        if (end == token || *end != '\0' || value <= 0 || value > (1LL << 40) / scale ||
+            list->count == MAX_LIST) {
+            free(copy);
+            return -1;
+        }
+        list->items[list->count++] = value * scale;
+    }
+    free(copy);
+    return list->count > 0 ? 0 : -1;
+}
+
+static int parse_tool_list(const char *text, int *selected)
+{
+    char *copy = strdup(text);
+    if (!copy)
+        return -1;
+    memset(selected, 0, TOOL_COUNT * sizeof(int));
+    int count = 0;
+    for (char *token = strtok(copy, ","); token; token = strtok(NULL, ",")) {
+        int found = 0;
+        for (int t = 0; t < TOOL_COUNT; t++) {
+            if (strcmp(token, tools[t].name) == 0) {
+                selected[t] = found = 1;
+                count++;
+            }
+        }
+        if (!found) {
+            free(copy);
+            return -1;
+        }
+    }
+    free(copy);
+    return count > 0 ? 0 : -1;
+}
+
+static const Tool *find_tool(const char *name)
+{
+    for (int t = 0; t < TOOL_COUNT; t++) {
+        if (strcmp(tools[t].name, name) == 0)
+            return &tools[t];
+    }
+    return NULL;
+}
+
+static int case_selected(const Bench *bench, const BenchCase *c)
+{
+    return bench->selected[find_tool(c->tool) - tools];
+}
+
+static void tool_path(const Bench *bench, const char *name, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%s/build/%s", bench->root, find_tool(name)->dir, name);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double timeval_ms(struct timeval tv)
+{
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+/* Run path with argv, its output thrown away, and measure it. The child
+ * waits on a pipe until its counters are open, so they see all of the tool
+ * and none of the setup. Returns the exit status, or -1. */
+static int run_tool(const char *path, char **argv, Sample *sample)
+{
+    int go[2];
+    if (pipe2(go, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(go[0]);
+        close(go[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        char byte;
+        if (read(go[0], &byte, 1) != 1)
+            _exit(127);         // the driver went away
+        execv(path, argv);
+        _exit(127);
+    }
+
+    close(go[0]);
+    PerfCounters counters;
+    perf_open(&counters, pid);
+    double start = now_ms();
+    if (write(go[1], "x", 1) != 1)
+        perror("write");
+    close(go[1]);
+
+    int status;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) == -1) {
+        if (errno != EINTR) {
+            perror("wait4");
+            perf_read_close(&counters, sample->counters);
+            return -1;
+        }
+    }
+    sample->wall_ms = now_ms() - start;
+    perf_read_close(&counters, sample->counters);
+    sample->user_ms = timeval_ms(usage.ru_utime);
+    sample->sys_ms = timeval_ms(usage.ru_stime);
+    sample->max_rss_kb = usage.ru_maxrss;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+/* argv for a case, with "{log}" and the like replaced by the input paths */
+static void build_argv(const char *path, const BenchCase *c, Inputs *inputs, char **argv)
+{
+    static const struct {
+        const char *name;
+        size_t offset;
+    } slots[] = {
+        { "{log}", offsetof(Inputs, log) },
+        { "{data}", offsetof(Inputs, data) },
+        { "{copy}", offsetof(Inputs, copy) },
+        { "{mutated}", offsetof(Inputs, mutated) },
+        { "{key}", offsetof(Inputs, key) },
+        { "{sealed}", offsetof(Inputs, sealed) },
+        { "{commands}", offsetof(Inputs, commands) },
+        { "{out}", offsetof(Inputs, out) },
+        { "{pid}", offsetof(Inputs, pid) },
+    };
+
+    int argc = 0;
+    argv[argc++] = (char *)path;
+    for (int i = 0; i < MAX_ARGS - 1 && c->args[i]; i++) {
+        argv[argc] = (char *)c->args[i];
+        for (size_t s = 0; s < sizeof(slots) / sizeof(slots[0]); s++) {
+            if (strcmp(c->args[i], slots[s].name) == 0)
+                argv[argc] = (char *)inputs + slots[s].offset;
+        }
+        argc++;
+    }
+    argv[argc] = NULL;
+}
+
+static int compare_wall(const void *a, const void *b)
+{
+    double x = ((const Sample *)a)->wall_ms, y = ((const Sample *)b)->wall_ms;
+    return (x > y) - (x < y);
+}
+
+/* Run one case at one size reps times and print the median run */
+static int bench_case(Bench *bench, const BenchCase *c, long long size, Inputs *inputs)
+{
+    char path[4096];
+    char *argv[MAX_ARGS + 1];
+    Sample samples[MAX_REPS];
+
+    tool_path(bench, c->tool, path, sizeof(path));
+    build_argv(path, c, inputs, argv);
+    fprintf(stderr, "bench: %s %s, %lld%s\n", c->tool, c->name, size, c->by_count ? " commands" : " bytes");
+
+    for (int r = 0; r < bench->reps; r++) {
+        int code = run_tool(path, argv, &samples[r]);
+        if (code != c->expect_exit) {
+            fprintf(stderr, "bench: %s %s: exit status %d, expected %d; by hand:\n ",
+                    c->tool, c->name, code, c->expect_exit);
+            for (int i = 0; argv[i]; i++)
+                fprintf(stderr, " %s", argv[i]);
+            fprintf(stderr, "\n");
+            return -1;
+        }
+    }
+
+    double min_wall = samples[0].wall_ms;
+    for (int r = 1; r < bench->reps; r++) {
+        if (samples[r].wall_ms < min_wall)
+            min_wall = samples[r].wall_ms;
+    }
+    qsort(samples, (size_t)bench->reps, sizeof(Sample), compare_wall);
+    const Sample *median = &samples[bench->reps / 2];
+
+    Row row;
+    memset(&row, 0, sizeof(row));
+    snprintf(row.tag, sizeof(row.tag), "%s", bench->tag);
+    snprintf(row.tool, sizeof(row.tool), "%s", c->tool);
+    snprintf(row.name, sizeof(row.name), "%s", c->name);
+    snprintf(row.rate_unit, sizeof(row.rate_unit), "%s", c->by_count ? "cmd/s" : "MB/s");
+    row.size = size;
+    row.reps = bench->reps;
+    row.wall_ms = median->wall_ms;
+    row.wall_min_ms = min_wall;
+    if (median->wall_ms > 0)
+        row.rate = (c->by_count ? size : size / (1024.0 * 1024.0)) / (median->wall_ms / 1e3);
+    row.user_ms = median->user_ms;
+    row.sys_ms = median->sys_ms;
+    row.max_rss_kb = median->max_rss_kb;
+    memcpy(row.counters, median->counters, sizeof(row.counters));
+
+    Verdict verdict = results_print_row(stdout, &row, bench->baseline, bench->threshold_pct);
+    fflush(stdout);
+    if (bench->copy) {
+        results_print_row(bench->copy, &row, bench->baseline, bench->threshold_pct);
+        fflush(bench->copy);
+    }
+    bench->rows++;
+    bench->regressions += verdict == VERDICT_REGRESSION;
+    bench->faster += verdict == VERDICT_FASTER;
+    return 0;
+}
+
+/* Make what needs asks for at this size */
+static int make_inputs(const Bench *bench, Inputs *inputs, unsigned needs, long long size)
+{
+    const char *dir = bench->dir;
+    int pid = (int)getpid();
+    memset(inputs, 0, sizeof(*inputs));
+    snprintf(inputs->log, sizeof(inputs->log), "%s/csc332_bench.%d.log", dir, pid);
+    snprintf(inputs->data, sizeof(inputs->data), "%s/csc332_bench.%d.bin", dir, pid);
+    snprintf(inputs->copy, sizeof(inputs->copy), "%s/csc332_bench.%d.copy", dir, pid);
+    snprintf(inputs->mutated, sizeof(inputs->mutated), "%s/csc332_bench.%d.mutated", dir, pid);
+    snprintf(inputs->key, sizeof(inputs->key), "%s/csc332_bench.%d.key", dir, pid);
+    snprintf(inputs->sealed, sizeof(inputs->sealed), "%s/csc332_bench.%d.sealed", dir, pid);
+    snprintf(inputs->commands, sizeof(inputs->commands), "%s/csc332_bench.%d.commands", dir, pid);
+    snprintf(inputs->out, sizeof(inputs->out), "%s/csc332_bench.%d.out", dir, pid);
+
+    // what the others are made from
+    if (needs & (NEED_COPY | NEED_MUTATED | NEED_SEALED))
+        needs |= NEED_DATA;
+    if (needs & NEED_SEALED)
+        needs |= NEED_KEY;
+
+    fprintf(stderr, "bench: generating inputs, %lld%s\n", size, needs & NEED_COMMANDS ? " commands" : " bytes");
+    if ((needs & NEED_LOG) && dataset_log(inputs->log, size) != 0)
+        return -1;
+    inputs->made |= needs & NEED_LOG;
+    if ((needs & NEED_DATA) && dataset_binary(inputs->data, size, 1) != 0)
+        return -1;
+    inputs->made |= needs & NEED_DATA;
+    // a second file, not a link: both sides of the diff are read for real
+    if ((needs & NEED_COPY) && dataset_binary(inputs->copy, size, 1) != 0)
+        return -1;
+    inputs->made |= needs & NEED_COPY;
+    if ((needs & NEED_MUTATED) && dataset_mutate(inputs->data, inputs->mutated, 64 * 1024) != 0)
+        return -1;
+    inputs->made |= needs & NEED_MUTATED;
+    if ((needs & NEED_KEY) && dataset_key(inputs->key, 32) != 0)
+        return -1;
+    inputs->made |= needs & NEED_KEY;
+    if ((needs & NEED_COMMANDS) && dataset_commands(inputs->commands, size, "true") != 0)
+        return -1;
+    inputs->made |= needs & NEED_COMMANDS;
+
+    if (needs & NEED_SEALED) {
+        // made by the tool itself, since the container format is its own
+        char path[4096];
+        char *argv[] = { path, "-e", "-a", "chacha", "-k", inputs->key, "-i", inputs->data,
+                         "-o", inputs->sealed, NULL };
+        Sample sample;
+        tool_path(bench, "filecrypt", path, sizeof(path));
+        inputs->made |= NEED_SEALED;
+        if (run_tool(path, argv, &sample) != 0) {
+            fprintf(stderr, "bench: could not encrypt the input for the decrypt case\n");
+            return -1;
+        }
+    }
+
+    if (needs & NEED_BALLAST) {
+        inputs->ballast = dataset_ballast(size);
+        if (inputs->ballast == -1)
+            return -1;
+        snprintf(inputs->pid, sizeof(inputs->pid), "%d", (int)inputs->ballast);
+        inputs->made |= NEED_BALLAST;
+    }
+    return 0;
+}
+
+static void remove_inputs(Inputs *inputs)
+{
+    const struct {
+        unsigned need;
+        const char *path;
+    } files[] = {
+        { NEED_LOG, inputs->log }, { NEED_DATA, inputs->data }, { NEED_COPY, inputs->copy },
+        { NEED_MUTATED, inputs->mutated }, { NEED_KEY, inputs->key }, { NEED_SEALED, inputs->sealed },
+        { NEED_COMMANDS, inputs->commands },
+    };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        if (inputs->made & files[i].need)
+            unlink(files[i].path);
+    }
+    unlink(inputs->out);
+    if (inputs->made & NEED_BALLAST) {
+        kill(inputs->ballast, SIGKILL);
+        waitpid(inputs->ballast, NULL, 0);
+    }
+    inputs->made = 0;
+}
+
+/* Every selected case sized by bytes (by_count 0) or by commands, for each
+ * size in the list */
+static int bench_sizes(Bench *bench, const NumberList *sizes, int by_count)
+{
+    unsigned needs = 0;
+    for (int i = 0; i < CASE_COUNT; i++) {
+        if (cases[i].by_count == by_count && case_selected(bench, &cases[i]))
+            needs |= cases[i].needs;
+    }
+    if (!needs)
+        return 0;
+
+    for (int s = 0; s < sizes->count; s++) {
+        Inputs inputs;
+        int status = make_inputs(bench, &inputs, needs, sizes->items[s]);
+        for (int i = 0; i < CASE_COUNT && status == 0; i++) {
+            if (cases[i].by_count == by_count && case_selected(bench, &cases[i]))
+                status = bench_case(bench, &cases[i], sizes->items[s], &inputs);
+        }
+        remove_inputs(&inputs);
+        if (status != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* -c: print an earlier results file compared with the baseline */
+static int compare_only(Bench *bench, const char *path)
+{
+    RowSet results = { 0 };
+    if (results_load(path, &results) != 0)
+        return -1;
+    results_print_header(stdout, 1);
+    for (int i = 0; i < results.count; i++) {
+        Verdict verdict = results_print_row(stdout, &results.rows[i], bench->baseline, bench->threshold_pct);
+        bench->rows++;
+        bench->regressions += verdict == VERDICT_REGRESSION;
+        bench->faster += verdict == VERDICT_FASTER;
+    }
+    results_free(&results);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    Bench bench;
+    memset(&bench, 0, sizeof(bench));
+    bench.root = ".";
+    bench.tag = BENCH_TAG;
+    bench.reps = 3;
+    bench.threshold_pct = 10.0;
+    bench.dir = getenv("TMPDIR");
+    if (!bench.dir || !*bench.dir)
+        bench.dir = "/tmp";
+    for (int t = 0; t < TOOL_COUNT; t++)
+        bench.selected[t] = 1;
+
+    NumberList sizes, counts;
+    parse_number_list("1M,16M,128M", &sizes, 1);
+    parse_number_list("100,1000", &counts, 0);
+    const char *copy_path = NULL;
+    const char *baseline_path = NULL;
+    const char *compare_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:T:r:C:d:o:b:x:c:t:h")) != -1) {
+        int bad = 0;
+        switch (opt) {
+        case 's':
+            bad = parse_number_list(optarg, &sizes, 1);
+            break;
+        case 'n':
+            bad = parse_number_list(optarg, &counts, 0);
+            break;
+        case 'T':
+            bad = parse_tool_list(optarg, bench.selected);
+            break;
+        case 'r':
+            bench.reps = atoi(optarg);
+            bad = bench.reps <= 0 || bench.reps > MAX_REPS;
+            break;
+        case 'C':
+            bench.root = optarg;
+            break;
+        case 'd':
+            bench.dir = optarg;
+            break;
+        case 'o':
+            copy_path = optarg;
+            break;
+        case 'b':
+            baseline_path = optarg;
+            break;
+        case 'x':
+            bench.threshold_pct = atof(optarg);
+            bad = bench.threshold_pct <= 0;
+            break;
+        case 'c':
+            compare_path = optarg;
+            break;
+        case 't':
+            bench.tag = optarg;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+        if (bad) {
+            fprintf(stderr, "bench: invalid value for -%c: %s\n", opt, optarg);
+            return 1;
+        }
+    }
+    if (compare_path && !baseline_path) {
+        fprintf(stderr, "bench: -c needs -b\n");
+        usage(argv[0]);
+        return 1;
+    }
+
+    RowSet baseline = { 0 };
+    if (baseline_path) {
+        if (results_load(baseline_path, &baseline) != 0)
+            return 1;
+        bench.baseline = &baseline;
+    }
+
+    int status = 0;
+    if (compare_path) {
+        status = compare_only(&bench, compare_path);
+    } else {
+        for (int t = 0; t < TOOL_COUNT; t++) {
+            char path[4096];
+            tool_path(&bench, tools[t].name, path, sizeof(path));
+            if (bench.selected[t] && access(path, X_OK) != 0) {
+                fprintf(stderr, "bench: %s: %s (run make first)\n", path, strerror(errno));
+                return 1;
+            }
+        }
+        if (copy_path) {
+            bench.copy = fopen(copy_path, "w");
+            if (!bench.copy) {
+                perror(copy_path);
+                return 1;
+            }
+            results_print_header(bench.copy, bench.baseline != NULL);
+        }
+        results_print_header(stdout, bench.baseline != NULL);
+        fflush(stdout);
+
+        PerfCounters probe;
+        if (perf_open(&probe, getpid()) < COUNTER_COUNT)
+            fprintf(stderr, "bench: some perf counters are not available here; their columns stay empty\n");
+        long long unused[COUNTER_COUNT];
+        perf_read_close(&probe, unused);
+
+        status = bench_sizes(&bench, &sizes, 0);
+        if (status == 0)
+            status = bench_sizes(&bench, &counts, 1);
+        if (bench.copy)
+            fclose(bench.copy);
+    }
+
+    if (bench.baseline)
+        fprintf(stderr, "bench: %d rows against %s: %d regressions, %d faster (threshold %.0f%%)\n",
+                bench.rows, baseline_path, bench.regressions, bench.faster, bench.threshold_pct);
+    results_free(&baseline);
+    if (status != 0)
+        return 1;
+    return bench.regressions > 0 ? EXIT_REGRESSION : 0;
+}
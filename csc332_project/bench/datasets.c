@@ -0,0 +1,242 @@
+// datasets.c
+// Reproducible benchmark inputs: see datasets.h.
+
+#define _GNU_SOURCE
+
+#include "datasets.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/prctl.h>
+
+#define WRITE_BLOCK (1 << 20)
+
+/* xorshift64: fast, and the same sequence everywhere */
+static unsigned long long next_random(unsigned long long *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static int write_all(int fd, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+static int create(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+        perror(path);
+    return fd;
+}
+
+/* Close fd, reporting a failed write (or close) against path */
+static int finish(int fd, const char *path, int failed)
+{
+    if (close(fd) != 0)
+        failed = 1;
+    if (failed)
+        perror(path);
+    return failed ? -1 : 0;
+}
+
+int dataset_log(const char *path, long long size)
+{
+    static const char *const messages[] = {
+        "User user%u logged in",
+        "Request %u served in %u ms",
+        "Disk space at %u%%",
+        "Cache miss for key item-%u",
+        "Failed to read database table t%u",
+        "Connection from 10.0.%u.%u closed",
+        "Job %u finished with status %u",
+        "Retrying upload %u, attempt %u",
+    };
+    static const int days_in_month[] = { 31, 28, 31, 30, 31, 30 };
+
+    int fd = create(path);
+    if (fd == -1)
+        return -1;
+
+    char *block = malloc(WRITE_BLOCK + 256);
+    unsigned long long state = 0x2545f4914f6cdd1dULL ^ (unsigned long long)size;
+    long long written = 0;
+    int failed = block == NULL;
+
+    while (!failed && written < size) {
+        size_t used = 0;
+        while (used < WRITE_BLOCK && written + (long long)used < size) {
+            unsigned long long r = next_random(&state);
+            int month = (int)(r % 6);
+            int day = (int)(r >> 8) % days_in_month[month] + 1;
+            unsigned seconds = (unsigned)(r >> 16) % 86400;
+            unsigned roll = (unsigned)(r >> 40) % 10;
+            const char *level = roll < 7 ? "INFO" : roll < 9 ? "WARNING" : "ERROR";
+            const char *message = messages[(r >> 48) % (sizeof(messages) / sizeof(messages[0]))];
+            unsigned a = (unsigned)(next_random(&state) % 1000), b = (unsigned)(state >> 32) % 100;
+
+            used += (size_t)snprintf(block + used, 64, "2025-%02d-%02d %02u:%02u:%02u %s ",
+                                     month + 1, day, seconds / 3600, seconds / 60 % 60, seconds % 60, level);
+            used += (size_t)snprintf(block + used, 128, message, a, b);
+            block[used++] = '\n';
+        }
+        // the last line is cut short so the file is exactly size bytes
+        if (written + (long long)used > size)
+            used = (size_t)(size - written);
+        failed = write_all(fd, block, used) != 0;
+        written += (long long)used;
+    }
+    free(block);
+    return finish(fd, path, failed);
+}
+
+int dataset_binary(const char *path, long long size, unsigned seed)
+{
+    int fd = create(path);
+    if (fd == -1)
+        return -1;
+
+    unsigned long long *block = malloc(WRITE_BLOCK);
+    unsigned long long state = 0x9e3779b97f4a7c15ULL ^ ((unsigned long long)seed << 32) ^ (unsigned long long)size;
+    long long left = size;
+    int failed = block == NULL;
+
+    while (!failed && left > 0) {
+        for (size_t i = 0; i < WRITE_BLOCK / sizeof(*block); i++)
+            block[i] = next_random(&state);
+        size_t n = left < WRITE_BLOCK ? (size_t)left : WRITE_BLOCK;
+        failed = write_all(fd, (const char *)block, n) != 0;
+        left -= (long long)n;
+    }
+    free(block);
+    return finish(fd, path, failed);
+}
+
+int dataset_mutate(const char *from, const char *path, long long stride)
+{
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    if (in == -1) {
+        perror(from);
+        return -1;
+    }
+    int fd = create(path);
+    if (fd == -1) {
+        close(in);
+        return -1;
+    }
+
+    char *block = malloc(WRITE_BLOCK);
+    long long offset = 0;
+    long long next_change = stride / 2;
+    int failed = block == NULL;
+    ssize_t n = 0;
+
+    while (!failed && (n = read(in, block, WRITE_BLOCK)) > 0) {
+        while (next_change < offset + n) {
+            block[next_change - offset] ^= 0x5a;
+            next_change += stride;
+        }
+        failed = write_all(fd, block, (size_t)n) != 0;
+        offset += n;
+    }
+    if (n < 0)
+        failed = 1;
+    free(block);
+    close(in);
+    return finish(fd, path, failed);
+}
+
+int dataset_key(const char *path, int length)
+{
+    int fd = create(path);
+    if (fd == -1)
+        return -1;
+
+    char key[4096];
+    unsigned long long state = 0x853c49e6748fea9bULL ^ (unsigned long long)length;
+    if (length > (int)sizeof(key))
+        length = (int)sizeof(key);
+    for (int i = 0; i < length; i++)
+        key[i] = (char)('!' + next_random(&state) % 94);
+    return finish(fd, path, write_all(fd, key, (size_t)length) != 0);
+}
+
+int dataset_commands(const char *path, long long count, const char *command)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    for (long long i = 0; i < count; i++)
+        fprintf(fp, "%s\n", command);
+    if (fclose(fp) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+pid_t dataset_ballast(long long size)
+{
+    int ready[2];
+    if (pipe2(ready, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(ready[0]);
+        close(ready[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // gone with the driver, however it ends
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        close(ready[0]);
+        char *heap = malloc((size_t)size);
+        if (!heap)
+            _exit(1);
+        // every page, with varied contents so nothing can share them
+        for (long long i = 0; i < size; i += 4096)
+            heap[i] = (char)(i >> 12);
+        char ok = 1;
+        if (write(ready[1], &ok, 1) != 1)
+            _exit(1);
+        close(ready[1]);
+        for (;;)
+            pause();
+    }
+
+    close(ready[1]);
+    char ok = 0;
+    ssize_t n;
+    while ((n = read(ready[0], &ok, 1)) < 0 && errno == EINTR)
+        ;
+    close(ready[0]);
+    if (n != 1) {
+        fprintf(stderr, "bench: the %lld byte ballast process did not start\n", size);
+        kill(pid, SIGKILL);
+        return -1;
+    }
+    return pid;
+}
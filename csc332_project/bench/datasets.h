@@ -0,0 +1,34 @@
+// datasets.h
+// Synthetic inputs for the benchmarks. Every generator is seeded from its
+// arguments alone, so the same size always gives the same bytes and runs
+// on different machines or versions measure the same work.
+
+#ifndef DATASETS_H
+#define DATASETS_H
+
+#include <sys/types.h>
+
+/* Log lines in the format loganalyzer reads,
+ * "2025-03-01 09:00:02 WARNING Disk space at 85%": dates spread over
+ * January to June 2025, about 70% INFO, 20% WARNING and 10% ERROR */
+int dataset_log(const char *path, long long size);
+
+/* Pseudo-random bytes; the same seed gives the same file */
+int dataset_binary(const char *path, long long size, unsigned seed);
+
+/* A copy of from with one byte changed every stride bytes, for a diff
+ * that has to look at everything and finds a few differences */
+int dataset_mutate(const char *from, const char *path, long long stride);
+
+/* length printable key bytes, as filecrypt reads a key file */
+int dataset_key(const char *path, int length);
+
+/* count lines of the same command, for timedexec -f */
+int dataset_commands(const char *path, long long count, const char *command);
+
+/* A child that allocates and touches size bytes of heap, then sleeps until
+ * killed: something of a known size for memview to look at. Returns its
+ * pid once the memory is in place, or -1. */
+pid_t dataset_ballast(long long size);
+
+#endif
@@ -0,0 +1,79 @@
+// perf.c
+// Per-run counters through perf_event_open: see perf.h.
+
+#define _GNU_SOURCE
+
+#include "perf.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+const char *const counter_names[COUNTER_COUNT] = {
+    "cycles", "instructions", "cache_misses", "page_faults"
+};
+
+static const struct {
+    unsigned type;
+    unsigned long long config;
+} counter_events[COUNTER_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+/* glibc has no wrapper */
+static int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int group_fd, unsigned long flags)
+{
+    return (int)syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+int perf_open(PerfCounters *counters, pid_t pid)
+{
+    int opened = 0;
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counter_events[i].type;
+        attr.config = counter_events[i].config;
+        attr.disabled = 1;
+        attr.enable_on_exec = 1;        // not the fork and setup in between
+        attr.inherit = 1;               // timedexec's children, loganalyzer's threads
+        attr.exclude_kernel = 0;        // page faults are the kernel's work
+        attr.exclude_hv = 1;
+        // kept separate, not a group: inherited groups cannot be read as one
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        counters->fds[i] = perf_event_open(&attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        if (counters->fds[i] == -1 && attr.type == PERF_TYPE_HARDWARE) {
+            // user space only is allowed at a stricter perf_event_paranoid
+            attr.exclude_kernel = 1;
+            counters->fds[i] = perf_event_open(&attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        }
+        opened += counters->fds[i] >= 0;
+    }
+    return opened;
+}
+
+void perf_read_close(PerfCounters *counters, long long values[COUNTER_COUNT])
+{
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        // value, time enabled, time running
+        unsigned long long data[3];
+        values[i] = -1;
+        if (counters->fds[i] < 0)
+            continue;
+        if (read(counters->fds[i], data, sizeof(data)) == sizeof(data)) {
+            if (data[2] > 0 && data[2] < data[1])
+                values[i] = (long long)((double)data[0] * data[1] / data[2]);
+            else if (data[2] > 0 || data[1] == 0)
+                values[i] = (long long)data[0];     // never enabled: the exec failed
+            // enabled but never scheduled on a PMU: unknown
+        }
+        close(counters->fds[i]);
+        counters->fds[i] = -1;
+    }
+}
@@ -0,0 +1,35 @@
+// perf.h
+// Hardware and software counters for a child process through
+// perf_event_open(2): opened on the child before it execs, enabled by the
+// exec itself and inherited by everything it starts, so the counts cover
+// the tool and nothing of the driver.
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <sys/types.h>
+
+enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,
+    COUNTER_PAGE_FAULTS,
+    COUNTER_COUNT
+};
+
+extern const char *const counter_names[COUNTER_COUNT];
+
+typedef struct {
+    int fds[COUNTER_COUNT];     // -1 for a counter the system does not offer
+} PerfCounters;
+
+/* Open every counter on pid, which must not have exec'd yet. Counters the
+ * kernel refuses (no PMU in a VM, perf_event_paranoid) are left out;
+ * returns how many could be opened. */
+int perf_open(PerfCounters *counters, pid_t pid);
+
+/* Once pid has been reaped: the counts, scaled up if the kernel had to
+ * multiplex the counters, and -1 for those not opened. Closes them. */
+void perf_read_close(PerfCounters *counters, long long values[COUNTER_COUNT]);
+
+#endif
@@ -0,0 +1,226 @@
+// results.c
+// CSV rows and baseline comparison: see results.h.
+
+#define _GNU_SOURCE
+
+#include "results.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Columns, in order */
+enum {
+    COL_TAG, COL_TOOL, COL_CASE, COL_SIZE, COL_REPS, COL_WALL, COL_WALL_MIN, COL_RATE,
+    COL_RATE_UNIT, COL_USER, COL_SYS, COL_MAX_RSS, COL_CYCLES, COL_INSTRUCTIONS, COL_IPC,
+    COL_CACHE_MISSES, COL_PAGE_FAULTS, COLUMN_COUNT
+};
+
+static const char *const columns[COLUMN_COUNT] = {
+    "tag", "tool", "case", "size", "reps", "wall_ms", "wall_min_ms", "rate",
+    "rate_unit", "user_ms", "sys_ms", "max_rss_kb", "cycles", "instructions", "ipc",
+    "cache_misses", "page_faults"
+};
+
+static const char *const verdict_names[] = { "", "new", "ok", "faster", "regression" };
+
+void results_print_header(FILE *out, int compare)
+{
+    for (int i = 0; i < COLUMN_COUNT; i++)
+        fprintf(out, "%s%s", i ? "," : "", columns[i]);
+    if (compare)
+        fprintf(out, ",baseline_wall_ms,wall_change_pct,baseline_instructions,instructions_change_pct,verdict");
+    fprintf(out, "\n");
+}
+
+/* Unknown counters are empty fields */
+static void put_count(FILE *out, long long value)
+{
+    if (value >= 0)
+        fprintf(out, ",%lld", value);
+    else
+        fputc(',', out);
+}
+
+static const Row *find_row(const RowSet *set, const Row *row)
+{
+    for (int i = 0; i < set->count; i++) {
+        const Row *other = &set->rows[i];
+        if (other->size == row->size && strcmp(other->tool, row->tool) == 0 &&
+            strcmp(other->name, row->name) == 0)
+            return other;
+    }
+    return NULL;
+}
+
+static double change_pct(double now, double before)
+{
+    return before > 0 ? (now - before) * 100.0 / before : 0.0;
+}
+
+Verdict results_print_row(FILE *out, const Row *row, const RowSet *baseline, double threshold_pct)
+{
+    long long instructions = row->counters[COUNTER_INSTRUCTIONS];
+    long long cycles = row->counters[COUNTER_CYCLES];
+
+    fprintf(out, "%s,%s,%s,%lld,%d,%.3f,%.3f,%.2f,%s,%.3f,%.3f,%lld",
+            row->tag, row->tool, row->name, row->size, row->reps, row->wall_ms, row->wall_min_ms,
+            row->rate, row->rate_unit, row->user_ms, row->sys_ms, row->max_rss_kb);
+    put_count(out, cycles);
+    put_count(out, instructions);
+    if (cycles > 0 && instructions >= 0)
+        fprintf(out, ",%.3f", (double)instructions / cycles);
+    else
+        fputc(',', out);
+    put_count(out, row->counters[COUNTER_CACHE_MISSES]);
+    put_count(out, row->counters[COUNTER_PAGE_FAULTS]);
+
+    if (!baseline) {
+        fputc('\n', out);
+        return VERDICT_NONE;
+    }
+
+    const Row *before = find_row(baseline, row);
+    Verdict verdict = VERDICT_NEW;
+    if (before) {
+        double wall_change = change_pct(row->wall_ms, before->wall_ms);
+        long long before_instructions = before->counters[COUNTER_INSTRUCTIONS];
+        int counted = instructions >= 0 && before_instructions > 0;
+        double instruction_change = counted ? change_pct((double)instructions, (double)before_instructions) : 0.0;
+        int slower = wall_change > threshold_pct && row->wall_ms - before->wall_ms > NOISE_FLOOR_MS;
+
+        // the instruction count hardly varies from run to run, so it
+        // catches a regression that noisy wall times hide
+        if (slower || (counted && instruction_change > threshold_pct))
+            verdict = VERDICT_REGRESSION;
+        else if (wall_change < -threshold_pct && before->wall_ms - row->wall_ms > NOISE_FLOOR_MS)
+            verdict = VERDICT_FASTER;
+        else
+            verdict = VERDICT_OK;
+
+        fprintf(out, ",%.3f,%.1f", before->wall_ms, wall_change);
+        put_count(out, before_instructions);
+        if (counted)
+            fprintf(out, ",%.1f", instruction_change);
+        else
+            fputc(',', out);
+    } else {
+        fprintf(out, ",,,,");
+    }
+    fprintf(out, ",%s\n", verdict_names[verdict]);
+    return verdict;
+}
+
+int results_add(RowSet *set, const Row *row)
+{
+    if (set->count == set->capacity) {
+        int capacity = set->capacity ? set->capacity * 2 : 64;
+        Row *grown = realloc(set->rows, (size_t)capacity * sizeof(Row));
+        if (!grown)
+            return -1;
+        set->rows = grown;
+        set->capacity = capacity;
+    }
+    set->rows[set->count++] = *row;
+    return 0;
+}
+
+void results_free(RowSet *set)
+{
+    free(set->rows);
+    set->rows = NULL;
+    set->count = set->capacity = 0;
+}
+
+/* Split a CSV line (no quoting: none of our fields has a comma) in place */
+static int split_fields(char *line, char **fields, int max)
+{
+    int count = 0;
+    line[strcspn(line, "\r\n")] = '\0';
+    for (char *p = line; count < max; ) {
+        fields[count++] = p;
+        p = strchr(p, ',');
+        if (!p)
+            break;
+        *p++ = '\0';
+    }
+    return count;
+}
+
+static void copy_field(char *to, size_t size, const char *from)
+{
+    snprintf(to, size, "%s", from);
+}
+
+/* An empty field is an unknown value */
+static long long count_field(const char *text)
+{
+    return *text ? atoll(text) : -1;
+}
+
+int results_load(const char *path, RowSet *set)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t capacity = 0;
+    char *fields[64];
+    int index[COLUMN_COUNT];        // column -> field number, -1 if absent
+    int status = 0;
+
+    if (getline(&line, &capacity, fp) == -1) {
+        fprintf(stderr, "bench: %s: empty file\n", path);
+        status = -1;
+    } else {
+        int count = split_fields(line, fields, 64);
+        for (int c = 0; c < COLUMN_COUNT; c++) {
+            index[c] = -1;
+            for (int f = 0; f < count; f++) {
+                if (strcmp(fields[f], columns[c]) == 0)
+                    index[c] = f;
+            }
+        }
+        if (index[COL_TOOL] < 0 || index[COL_CASE] < 0 || index[COL_SIZE] < 0 || index[COL_WALL] < 0) {
+            fprintf(stderr, "bench: %s: not a benchmark results file\n", path);
+            status = -1;
+        }
+    }
+
+    while (status == 0 && getline(&line, &capacity, fp) != -1) {
+        int count = split_fields(line, fields, 64);
+        const char *value[COLUMN_COUNT];
+        for (int c = 0; c < COLUMN_COUNT; c++)
+            value[c] = index[c] >= 0 && index[c] < count ? fields[index[c]] : "";
+        if (!*value[COL_TOOL])
+            continue;
+
+        Row row;
+        memset(&row, 0, sizeof(row));
+        copy_field(row.tag, sizeof(row.tag), value[COL_TAG]);
+        copy_field(row.tool, sizeof(row.tool), value[COL_TOOL]);
+        copy_field(row.name, sizeof(row.name), value[COL_CASE]);
+        copy_field(row.rate_unit, sizeof(row.rate_unit), value[COL_RATE_UNIT]);
+        row.size = atoll(value[COL_SIZE]);
+        row.reps = atoi(value[COL_REPS]);
+        row.wall_ms = atof(value[COL_WALL]);
+        row.wall_min_ms = atof(value[COL_WALL_MIN]);
+        row.rate = atof(value[COL_RATE]);
+        row.user_ms = atof(value[COL_USER]);
+        row.sys_ms = atof(value[COL_SYS]);
+        row.max_rss_kb = count_field(value[COL_MAX_RSS]);
+        row.counters[COUNTER_CYCLES] = count_field(value[COL_CYCLES]);
+        row.counters[COUNTER_INSTRUCTIONS] = count_field(value[COL_INSTRUCTIONS]);
+        row.counters[COUNTER_CACHE_MISSES] = count_field(value[COL_CACHE_MISSES]);
+        row.counters[COUNTER_PAGE_FAULTS] = count_field(value[COL_PAGE_FAULTS]);
+        if (results_add(set, &row) != 0) {
+            fprintf(stderr, "bench: out of memory\n");
+            status = -1;
+        }
+    }
+    free(line);
+    fclose(fp);
+    return status;
+}
@@ -0,0 +1,61 @@
+// results.h
+// Benchmark rows as CSV, and the comparison against a saved baseline: a
+// row regresses when its median wall time or its instruction count grew
+// by more than the threshold.
+
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stdio.h>
+
+#include "perf.h"
+
+/* Wall time changes smaller than this are noise, whatever the percentage */
+#define NOISE_FLOOR_MS 0.5
+
+typedef struct {
+    char tag[64];
+    char tool[32];
+    char name[48];              // the case, e.g. "summary" or "chacha_encrypt"
+    long long size;             // bytes of input, or commands for timedexec
+    int reps;
+    double wall_ms;             // median
+    double wall_min_ms;
+    double rate;                // size per second of the median run
+    char rate_unit[8];          // "MB/s" or "cmd/s"
+    double user_ms;
+    double sys_ms;
+    long long max_rss_kb;
+    long long counters[COUNTER_COUNT];      // -1 where unknown
+} Row;
+
+typedef struct {
+    Row *rows;
+    int count;
+    int capacity;
+} RowSet;
+
+typedef enum {
+    VERDICT_NONE,               // not compared
+    VERDICT_NEW,                // no baseline row
+    VERDICT_OK,
+    VERDICT_FASTER,
+    VERDICT_REGRESSION
+} Verdict;
+
+/* The header; with compare set, the baseline columns too */
+void results_print_header(FILE *out, int compare);
+
+/* One row; with baseline (the set, NULL for none), its baseline values and
+ * verdict as well. Returns the verdict. */
+Verdict results_print_row(FILE *out, const Row *row, const RowSet *baseline, double threshold_pct);
+
+/* Read a CSV written by results_print_*(): columns are found by name, so
+ * files from older versions with fewer columns still load. Returns -1 with
+ * a message on failure. */
+int results_load(const char *path, RowSet *set);
+
+int results_add(RowSet *set, const Row *row);
+void results_free(RowSet *set);
+
+#endif
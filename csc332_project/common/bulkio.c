@@ -0,0 +1,609 @@
+// bulkio.c
+// Bulk sequential readers over io_uring, a pread() pool or mmap(): see bulkio.h.
+#define _GNU_SOURCE
+
+#include "bulkio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// No liburing: the three system calls are made directly, so the tools
+// build anywhere and simply fall back to pread() where the headers are old
+#if defined(__NR_io_uring_setup) && defined(IORING_OFF_SQ_RING)
+#define HAVE_URING 1
+#else
+#define HAVE_URING 0
+#endif
+
+// read() takes at most about 2 GiB at once and an SQE length is 32 bits
+#define BULKIO_MAX_BUFFER ((size_t)1 << 30)
+
+#define SLOT_IDLE   0   // nothing left in the range for it
+#define SLOT_QUEUED 1   // waiting for a pool worker (or for bulkio_next at depth 1)
+#define SLOT_BUSY   2   // read in flight
+#define SLOT_DONE   3   // result is in
+
+typedef struct {
+    off_t offset;
+    size_t length;      // bytes asked for
+    ssize_t result;     // bytes read, or -errno
+    int state;
+} bulk_slot;
+
+#if HAVE_URING
+typedef struct {
+    int fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned unsubmitted;   // SQEs queued that the kernel has not taken yet
+    int fixed;              // buffers registered: READ_FIXED instead of READV
+} bulk_ring;
+#endif
+
+struct bulk_reader {
+    bulkio_engine engine;
+    int fd;
+    off_t end;              // end of the range
+    off_t next_read;        // start of the next piece to read (or, for mmap, to hand out)
+    size_t piece;           // bytes per piece
+    int finished;           // the end, an early end of file or an error was handed out
+
+    // uring and read: depth buffers used round-robin, so slot i always holds
+    // a piece whose index is i modulo depth and pieces come back in order
+    unsigned depth;
+    unsigned char *buffers;     // depth buffers of stride bytes
+    size_t stride;
+    bulk_slot *slots;
+    unsigned head;              // slot handed out next
+    int held;                   // the caller has the slot before head
+
+    // read: pool of pread() workers, none at depth 1
+    int pool;
+    pthread_t threads[BULKIO_MAX_THREADS];
+    unsigned thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    int stopping;
+
+    // mmap
+    unsigned char *map;
+    size_t map_length;
+    off_t map_start;            // page-aligned file offset of map
+    off_t advised;              // prefetched with MADV_WILLNEED up to here
+
+#if HAVE_URING
+    bulk_ring ring;
+    struct iovec *iovecs;       // one per buffer
+#endif
+};
+
+// pread() until len bytes or EOF; returns bytes read or -1
+static ssize_t pread_full(int fd, unsigned char *buf, size_t len, off_t offset) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = pread(fd, buf + total, len - total, offset + (off_t)total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        total += (size_t)n;
+    }
+    return (ssize_t)total;
+}
+
+int bulkio_parse_engine(const char *name, bulkio_engine *engine) {
+    if (strcmp(name, "uring") == 0) *engine = BULKIO_URING;
+    else if (strcmp(name, "mmap") == 0) *engine = BULKIO_MMAP;
+    else if (strcmp(name, "read") == 0) *engine = BULKIO_READ;
+    else return -1;
+    return 0;
+}
+
+const char *bulkio_engine_name(bulkio_engine engine) {
+    switch (engine) {
+    case BULKIO_URING: return "uring";
+    case BULKIO_MMAP:  return "mmap";
+    default:           return "read";
+    }
+}
+
+int bulkio_parse_depth(const char *text, unsigned *depth) {
+    char *end;
+    errno = 0;
+    long v = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || v < 1 || v > BULKIO_MAX_DEPTH)
+        return -1;
+    *depth = (unsigned)v;
+    return 0;
+}
+
+bulkio_engine bulkio_reader_engine(const bulk_reader *reader) {
+    return reader->engine;
+}
+
+/* ---- io_uring ---- */
+
+#if HAVE_URING
+static void ring_free(bulk_reader *r) {
+    bulk_ring *ring = &r->ring;
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd != -1) close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+static int ring_setup(bulk_reader *r) {
+    bulk_ring *ring = &r->ring;
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    ring->fd = (int)syscall(__NR_io_uring_setup, r->depth, &p);
+    if (ring->fd < 0) {
+        ring->fd = -1;
+        return -1;
+    }
+
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            goto fail;
+        }
+    }
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        goto fail;
+    }
+
+    unsigned char *sq = ring->sq_ring;
+    unsigned char *cq = ring->cq_ring;
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // register the buffers once so the kernel does not pin them for every
+    // read; over RLIMIT_MEMLOCK this fails and READV into them still works
+    for (unsigned i = 0; i < r->depth; i++) {
+        r->iovecs[i].iov_base = r->buffers + i * r->stride;
+        r->iovecs[i].iov_len = r->stride;
+    }
+    ring->fixed = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS,
+                          r->iovecs, r->depth) == 0;
+    return 0;
+
+fail: {
+        int saved = errno;
+        ring_free(r);
+        errno = saved;
+        return -1;
+    }
+}
+
+static void ring_queue(bulk_reader *r, unsigned i) {
+    bulk_ring *ring = &r->ring;
+    bulk_slot *s = &r->slots[i];
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = r->fd;
+    sqe->off = (uint64_t)s->offset;
+    sqe->user_data = i;
+    if (ring->fixed) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->addr = (uint64_t)(uintptr_t)(r->buffers + i * r->stride);
+        sqe->len = (uint32_t)s->length;
+        sqe->buf_index = (uint16_t)i;
+    } else {
+        r->iovecs[i].iov_len = s->length;
+        sqe->opcode = IORING_OP_READV;
+        sqe->addr = (uint64_t)(uintptr_t)&r->iovecs[i];
+        sqe->len = 1;
+    }
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->unsubmitted++;
+}
+
+// Hand queued reads to the kernel and, with wait, block for a completion
+static int ring_enter(bulk_reader *r, int wait) {
+    bulk_ring *ring = &r->ring;
+    if (!wait && ring->unsubmitted == 0) return 0;
+
+    for (;;) {
+        long n = syscall(__NR_io_uring_enter, ring->fd, ring->unsubmitted, wait ? 1 : 0,
+                         wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        ring->unsubmitted -= (unsigned)n;
+        return 0;
+    }
+}
+
+// Collect completions; with wait, block until there is at least one
+static int ring_reap(bulk_reader *r, int wait) {
+    bulk_ring *ring = &r->ring;
+    unsigned head = *ring->cq_head;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) && ring_enter(r, wait) != 0)
+        return -1;
+
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    int requeued = 0;
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        unsigned i = (unsigned)cqe->user_data;
+        if (cqe->res == -EINTR || cqe->res == -EAGAIN) {
+            ring_queue(r, i);
+            requeued = 1;
+            continue;
+        }
+        r->slots[i].result = cqe->res;
+        r->slots[i].state = SLOT_DONE;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    return requeued ? ring_enter(r, 0) : 0;
+}
+#endif
+
+/* ---- pread() pool ---- */
+
+static void *pool_worker(void *arg) {
+    bulk_reader *r = arg;
+
+    pthread_mutex_lock(&r->lock);
+    while (!r->stopping) {
+        // the queued piece nearest the head first, so reads stay in file order
+        bulk_slot *s = NULL;
+        unsigned i = 0;
+        for (unsigned n = 0; n < r->depth && !s; n++) {
+            i = (r->head + n) % r->depth;
+            if (r->slots[i].state == SLOT_QUEUED) s = &r->slots[i];
+        }
+        if (!s) {
+            pthread_cond_wait(&r->work, &r->lock);
+            continue;
+        }
+
+        s->state = SLOT_BUSY;
+        pthread_mutex_unlock(&r->lock);
+        ssize_t n = pread_full(r->fd, r->buffers + i * r->stride, s->length, s->offset);
+        int saved = errno;
+        pthread_mutex_lock(&r->lock);
+
+        s->result = n < 0 ? -saved : n;
+        s->state = SLOT_DONE;
+        pthread_cond_broadcast(&r->done);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+static void pool_start(bulk_reader *r) {
+    if (pthread_mutex_init(&r->lock, NULL) != 0) return;
+    pthread_cond_init(&r->work, NULL);
+    pthread_cond_init(&r->done, NULL);
+    r->pool = 1;
+
+    unsigned wanted = r->depth < BULKIO_MAX_THREADS ? r->depth : BULKIO_MAX_THREADS;
+    while (r->thread_count < wanted &&
+           pthread_create(&r->threads[r->thread_count], NULL, pool_worker, r) == 0)
+        r->thread_count++;
+    // with no workers at all the reads are simply done inline
+}
+
+/* ---- slots (uring and read) ---- */
+
+// Start reading the next piece of the range into slot i
+static int slot_fill(bulk_reader *r, unsigned i) {
+    bulk_slot *s = &r->slots[i];
+
+    if (r->next_read >= r->end) {
+        s->state = SLOT_IDLE;
+        return 0;
+    }
+    s->offset = r->next_read;
+    s->length = (size_t)(r->end - r->next_read) < r->piece ? (size_t)(r->end - r->next_read) : r->piece;
+    s->result = 0;
+    r->next_read += (off_t)s->length;
+
+#if HAVE_URING
+    if (r->engine == BULKIO_URING) {
+        s->state = SLOT_BUSY;
+        ring_queue(r, i);
+        return ring_enter(r, 0);
+    }
+#endif
+    if (r->thread_count) {
+        pthread_mutex_lock(&r->lock);
+        s->state = SLOT_QUEUED;
+        pthread_cond_signal(&r->work);
+        pthread_mutex_unlock(&r->lock);
+    } else {
+        s->state = SLOT_QUEUED;
+    }
+    return 0;
+}
+
+static int slot_wait(bulk_reader *r, unsigned i) {
+    bulk_slot *s = &r->slots[i];
+
+#if HAVE_URING
+    if (r->engine == BULKIO_URING) {
+        while (s->state != SLOT_DONE)
+            if (ring_reap(r, 1) != 0) return -1;
+        return 0;
+    }
+#endif
+    if (r->thread_count == 0) {
+        ssize_t n = pread_full(r->fd, r->buffers + i * r->stride, s->length, s->offset);
+        s->result = n < 0 ? -errno : n;
+        s->state = SLOT_DONE;
+        return 0;
+    }
+
+    pthread_mutex_lock(&r->lock);
+    while (s->state != SLOT_DONE)
+        pthread_cond_wait(&r->done, &r->lock);
+    pthread_mutex_unlock(&r->lock);
+    return 0;
+}
+
+static ssize_t slot_next(bulk_reader *r, const unsigned char **data) {
+    // the piece handed out last time is done with: its buffer takes the
+    // piece depth places further on
+    if (r->held) {
+        r->held = 0;
+        unsigned previous = (r->head + r->depth - 1) % r->depth;
+        if (slot_fill(r, previous) != 0) {
+            r->finished = 1;
+            return -1;
+        }
+    }
+
+    unsigned i = r->head;
+    bulk_slot *s = &r->slots[i];
+    if (s->state == SLOT_IDLE) {
+        r->finished = 1;
+        return 0;
+    }
+    if (slot_wait(r, i) != 0) {
+        r->finished = 1;
+        return -1;
+    }
+    if (s->result < 0) {
+        r->finished = 1;
+        errno = (int)-s->result;
+        return -1;
+    }
+
+    // a short read is not the end of the file by itself: finish the piece here
+    unsigned char *buffer = r->buffers + i * r->stride;
+    size_t got = (size_t)s->result;
+    if (got < s->length) {
+        ssize_t more = pread_full(r->fd, buffer + got, s->length - got, s->offset + (off_t)got);
+        if (more < 0) {
+            r->finished = 1;
+            return -1;
+        }
+        got += (size_t)more;
+        if (got < s->length) r->finished = 1;   // the file is shorter than the range
+    }
+    if (got == 0) {
+        r->finished = 1;
+        return 0;
+    }
+
+    if (r->thread_count) pthread_mutex_lock(&r->lock);
+    r->head = (i + 1) % r->depth;
+    if (r->thread_count) pthread_mutex_unlock(&r->lock);
+    r->held = 1;
+
+    *data = buffer;
+    return (ssize_t)got;
+}
+
+/* ---- mmap ---- */
+
+static int map_open(bulk_reader *r, off_t offset) {
+    if (offset == r->end) return 0;     // nothing to map
+
+    off_t page = (off_t)sysconf(_SC_PAGESIZE);
+    r->map_start = offset - offset % page;
+    r->map_length = (size_t)(r->end - r->map_start);
+
+    void *map = mmap(NULL, r->map_length, PROT_READ, MAP_PRIVATE, r->fd, r->map_start);
+    if (map == MAP_FAILED) return -1;
+    r->map = map;
+    r->advised = r->map_start;
+    madvise(r->map, r->map_length, MADV_SEQUENTIAL);
+    return 0;
+}
+
+static ssize_t map_next(bulk_reader *r, const unsigned char **data) {
+    if (r->next_read >= r->end) return 0;
+
+    size_t length = (size_t)(r->end - r->next_read) < r->piece ? (size_t)(r->end - r->next_read) : r->piece;
+
+    // keep depth pieces ahead of the caller on their way in
+    if (r->depth > 1) {
+        off_t target = r->next_read + (off_t)(r->piece * r->depth);
+        if (target > r->end) target = r->end;
+        if (target > r->advised) {
+            off_t page = (off_t)sysconf(_SC_PAGESIZE);
+            off_t from = r->advised - (r->advised - r->map_start) % page;
+            madvise(r->map + (from - r->map_start), (size_t)(target - from), MADV_WILLNEED);
+            r->advised = target;
+        }
+    }
+
+    *data = r->map + (r->next_read - r->map_start);
+    r->next_read += (off_t)length;
+    return (ssize_t)length;
+}
+
+/* ---- readers ---- */
+
+bulk_reader *bulkio_open(int fd, off_t offset, off_t length, const bulkio_options *opts) {
+    struct stat st;
+
+    if (offset < 0 || length < 0 || length > INT64_MAX - offset) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1) return NULL;
+    if (!S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode)) {
+        errno = ESPIPE;
+        return NULL;
+    }
+
+    bulk_reader *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+#if HAVE_URING
+    r->ring.fd = -1;
+#endif
+    r->fd = fd;
+    r->engine = opts->engine;
+    r->next_read = offset;
+    r->end = offset + length;
+    r->piece = opts->buffer_size ? opts->buffer_size : BULKIO_BUFFER_SIZE;
+    if (r->piece > BULKIO_MAX_BUFFER) r->piece = BULKIO_MAX_BUFFER;
+    r->depth = opts->queue_depth ? opts->queue_depth : BULKIO_QUEUE_DEPTH;
+    if (r->depth > BULKIO_MAX_DEPTH) r->depth = BULKIO_MAX_DEPTH;
+
+    if (r->engine == BULKIO_MMAP) {
+        if (map_open(r, offset) == 0) return r;
+        r->engine = BULKIO_READ;        // cannot be mapped: read it instead
+    }
+    posix_fadvise(fd, offset, length, POSIX_FADV_SEQUENTIAL);
+
+    // no more buffers than pieces, and none bigger than the whole range
+    uint64_t pieces = ((uint64_t)length + r->piece - 1) / r->piece;
+    if (pieces < r->depth) r->depth = pieces ? (unsigned)pieces : 1;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t used = (uint64_t)length < r->piece ? (size_t)length : r->piece;
+    r->stride = (used ? (used + page - 1) / page : 1) * page;
+
+    void *buffers = mmap(NULL, r->stride * r->depth, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    r->slots = calloc(r->depth, sizeof(bulk_slot));
+    if (buffers == MAP_FAILED || !r->slots) {
+        if (buffers != MAP_FAILED) munmap(buffers, r->stride * r->depth);
+        free(r->slots);
+        free(r);
+        errno = ENOMEM;
+        return NULL;
+    }
+    r->buffers = buffers;
+
+#if HAVE_URING
+    r->iovecs = calloc(r->depth, sizeof(struct iovec));
+    if (r->engine == BULKIO_URING && (!r->iovecs || ring_setup(r) != 0))
+        r->engine = BULKIO_READ;
+#else
+    if (r->engine == BULKIO_URING)
+        r->engine = BULKIO_READ;
+#endif
+
+    if (r->engine == BULKIO_READ && r->depth > 1)
+        pool_start(r);
+
+    for (unsigned i = 0; i < r->depth; i++) {
+        if (slot_fill(r, i) != 0) {
+            int saved = errno;
+            bulkio_close(r);
+            errno = saved;
+            return NULL;
+        }
+    }
+    return r;
+}
+
+ssize_t bulkio_next(bulk_reader *reader, const unsigned char **data) {
+    if (reader->engine == BULKIO_MMAP) return map_next(reader, data);
+    if (reader->finished) return 0;
+    return slot_next(reader, data);
+}
+
+void bulkio_close(bulk_reader *reader) {
+    if (!reader) return;
+
+#if HAVE_URING
+    if (reader->engine == BULKIO_URING) {
+        // the kernel may still be writing into the buffers
+        for (;;) {
+            int busy = 0;
+            for (unsigned i = 0; i < reader->depth; i++)
+                if (reader->slots[i].state == SLOT_BUSY) busy = 1;
+            if (!busy || ring_reap(reader, 1) != 0) break;
+        }
+        ring_free(reader);
+    }
+    free(reader->iovecs);
+#endif
+    if (reader->pool) {
+        pthread_mutex_lock(&reader->lock);
+        reader->stopping = 1;
+        pthread_cond_broadcast(&reader->work);
+        pthread_mutex_unlock(&reader->lock);
+        for (unsigned i = 0; i < reader->thread_count; i++)
+            pthread_join(reader->threads[i], NULL);
+        pthread_cond_destroy(&reader->work);
+        pthread_cond_destroy(&reader->done);
+        pthread_mutex_destroy(&reader->lock);
+    }
+    if (reader->buffers) munmap(reader->buffers, reader->stride * reader->depth);
+    if (reader->map) munmap(reader->map, reader->map_length);
+    free(reader->slots);
+    free(reader);
+}
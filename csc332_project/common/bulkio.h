@@ -0,0 +1,58 @@
+// bulkio.h
+// Bulk sequential reads of a file range, shared by filecrypt,
+// filediffadvanced and loganalyzer (--io=uring|mmap|read).
+//
+// A reader hands out the range in file order, in pieces of buffer_size
+// bytes (only the last one may be shorter). Pieces live in a fixed set of
+// queue_depth reusable buffers: while the caller works on one piece, the
+// reads for the next ones are already in flight. Engines:
+//   uring  io_uring, with the buffers registered once (IORING_OP_READ_FIXED)
+//   read   pread() from a small thread pool, or inline pread() at depth 1
+//   mmap   windows into one read-only mapping, the next ones prefetched
+// uring falls back to read where io_uring cannot be set up (old kernel,
+// io_uring_disabled, seccomp), and mmap where the file cannot be mapped.
+
+#ifndef BULKIO_H
+#define BULKIO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define BULKIO_BUFFER_SIZE (1024 * 1024)
+#define BULKIO_QUEUE_DEPTH 8
+#define BULKIO_MAX_DEPTH   64
+#define BULKIO_MAX_THREADS 4      // pread workers for the read engine
+
+typedef enum { BULKIO_READ, BULKIO_MMAP, BULKIO_URING } bulkio_engine;
+
+typedef struct {
+    bulkio_engine engine;
+    size_t buffer_size;       // bytes per piece, 0 = BULKIO_BUFFER_SIZE
+    unsigned queue_depth;     // buffers per reader, 0 = BULKIO_QUEUE_DEPTH
+} bulkio_options;
+
+typedef struct bulk_reader bulk_reader;
+
+// "uring", "mmap" or "read"; returns 0, or -1 for anything else
+int bulkio_parse_engine(const char *name, bulkio_engine *engine);
+const char *bulkio_engine_name(bulkio_engine engine);
+
+// A queue depth from 1 to BULKIO_MAX_DEPTH; returns 0, or -1 if out of range
+int bulkio_parse_depth(const char *text, unsigned *depth);
+
+// Read bytes [offset, offset + length) of fd, which must support pread()
+// (a regular file or block device). Returns NULL with errno set on failure.
+bulk_reader *bulkio_open(int fd, off_t offset, off_t length, const bulkio_options *opts);
+
+// The next piece in file order; *data stays valid until the next call.
+// Returns its length, 0 at the end of the range (or earlier, if the file
+// turned out to be shorter), or -1 with errno set when a read failed.
+ssize_t bulkio_next(bulk_reader *reader, const unsigned char **data);
+
+// The engine actually in use, after any fallback
+bulkio_engine bulkio_reader_engine(const bulk_reader *reader);
+
+// Waits for reads still in flight, then frees everything
+void bulkio_close(bulk_reader *reader);
+
+#endif
@@ -0,0 +1,381 @@
+// filecrypt_bench.c
+// Throughput benchmark for the filecrypt algorithms.
+// Generates synthetic inputs, runs every combination of algorithm, key
+// length, buffer size and I/O path through the same crypt.c code the tool
+// uses, and prints one CSV row per combination and direction.
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/resource.h>
+
+#include "crypt.h"
+
+#ifndef BENCH_TAG
+#define BENCH_TAG "unknown"
+#endif
+
+#define MAX_LIST 16
+#define MAX_REPS 64
+
+#define ENGINE_READ  0   // streaming read()/write(), as filecrypt runs by default
+#define ENGINE_PREAD 1   // pread() from offset 0, as --offset/--length runs
+
+static const char *engine_names[] = { "read", "pread" };
+
+typedef struct {
+    uint64_t items[MAX_LIST];
+    int count;
+} size_list;
+
+typedef struct {
+    double wall;
+    double user;
+    double sys;
+    long long syscr;
+    long long syscw;
+} run_sample;
+
+static void print_usage(const char *prog){
+    fprintf(stderr,
+        "Usage: %s [OPTIONS]\n"
+        "Benchmark filecrypt algorithms and print CSV to stdout.\n\n"
+        "Options:\n"
+        "  -s LIST   Input sizes (default 4K,64K,1M,16M,256M)\n"
+        "  -a LIST   Algorithms (default xor,rol,chacha)\n"
+        "  -k LIST   Key lengths for xor (default 16,256)\n"
+        "  -b LIST   Buffer sizes; chunk sizes for chacha (default 4K,64K,1M)\n"
+        "  -e LIST   I/O paths: read,pread (default both)\n"
+        "  -r N      Repetitions per case (1-64), the median is reported (default 3)\n"
+        "  -d DIR    Directory for generated files (default $TMPDIR or /tmp)\n"
+        "  -c        Cold cache: drop the input from the page cache before each run\n"
+        "  -t TAG    Version label for the tag column (default " BENCH_TAG ")\n"
+        "  -h        Show this help\n"
+        "Sizes accept K, M and G suffixes.\n",
+        prog);
+}
+
+static int parse_size(const char *text, uint64_t *value){
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (errno != 0 || end == text || text[0] == '-') return -1;
+
+    unsigned long long scale = 1;
+    if (*end == 'k' || *end == 'K') { scale = 1ULL << 10; end++; }
+    else if (*end == 'm' || *end == 'M') { scale = 1ULL << 20; end++; }
+    else if (*end == 'g' || *end == 'G') { scale = 1ULL << 30; end++; }
+    if (*end != '\0' || v == 0 || v > UINT64_MAX / scale) return -1;
+
+    *value = (uint64_t)(v * scale);
+    return 0;
+}
+
+static int parse_size_list(const char *text, size_list *list){
+    char *copy = strdup(text);
+    if (!copy) return -1;
+
+    list->count = 0;
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")){
+        if (list->count == MAX_LIST || parse_size(tok, &list->items[list->count]) != 0){
+            free(copy);
+            return -1;
+        }
+        list->count++;
+    }
+    free(copy);
+    return list->count > 0 ? 0 : -1;
+}
+
+// Comma list of names from `names`, stored as indexes
+static int parse_name_list(const char *text, const char *const *names, int name_count, int *out, int *count){
+    char *copy = strdup(text);
+    if (!copy) return -1;
+
+    *count = 0;
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")){
+        int found = -1;
+        for (int i = 0; i < name_count; i++){
+            if (strcmp(tok, names[i]) == 0) found = i;
+        }
+        if (found < 0 || *count == MAX_LIST){
+            free(copy);
+            return -1;
+        }
+        out[(*count)++] = found;
+    }
+    free(copy);
+    return *count > 0 ? 0 : -1;
+}
+
+static double now_sec(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double timeval_sec(struct timeval tv){
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+// read/write syscall counters of this process, -1 if /proc is unavailable
+static void read_syscall_counts(long long *syscr, long long *syscw){
+    char buf[512];
+    *syscr = *syscw = -1;
+
+    int fd = open("/proc/self/io", O_RDONLY);
+    if (fd == -1) return;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return;
+    buf[n] = '\0';
+
+    char *p = strstr(buf, "syscr:");
+    if (p) *syscr = strtoll(p + 6, NULL, 10);
+    p = strstr(buf, "syscw:");
+    if (p) *syscw = strtoll(p + 6, NULL, 10);
+}
+
+// Fill a file with pseudo-random bytes (xorshift, fast and reproducible)
+static int generate_input(const char *path, uint64_t size){
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1){
+        perror("open bench input");
+        return -1;
+    }
+
+    uint64_t state = 0x9e3779b97f4a7c15ULL ^ size;
+    uint64_t block[8192];
+    uint64_t left = size;
+
+    while (left > 0){
+        for (size_t i = 0; i < sizeof(block) / sizeof(block[0]); i++){
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            block[i] = state;
+        }
+        size_t n = left < sizeof(block) ? (size_t)left : sizeof(block);
+        if (write_full(fd, (unsigned char *)block, n) != (ssize_t)n){
+            perror("write bench input");
+            close(fd);
+            return -1;
+        }
+        left -= n;
+    }
+
+    close(fd);
+    return 0;
+}
+
+static int run_once(const crypt_config *cfg, int engine, const char *in_path, const char *out_path,
+                    int cold, run_sample *sample){
+    int inputFd = open(in_path, O_RDONLY);
+    if (inputFd == -1){ perror("open input"); return -1; }
+
+    int outputFd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (outputFd == -1){ perror("open output"); close(inputFd); return -1; }
+
+    if (cold){
+        // dirty pages are not dropped: the input was written moments ago
+        fdatasync(inputFd);
+        posix_fadvise(inputFd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    crypt_ctx ctx;
+    if (crypt_ctx_init(&ctx, cfg) != CRYPT_OK){
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        close(inputFd);
+        close(outputFd);
+        return -1;
+    }
+
+    struct rusage ru_start, ru_end;
+    long long r0, w0, r1, w1;
+
+    read_syscall_counts(&r0, &w0);
+    getrusage(RUSAGE_SELF, &ru_start);
+    double start = now_sec();
+
+    int rc;
+    if (engine == ENGINE_PREAD && cfg->decrypt)
+        rc = crypt_range(cfg, &ctx, inputFd, outputFd, 0, UINT64_MAX);
+    else
+        rc = crypt_fd(cfg, &ctx, inputFd, outputFd);
+
+    double end = now_sec();
+    getrusage(RUSAGE_SELF, &ru_end);
+    read_syscall_counts(&r1, &w1);
+
+    crypt_ctx_free(&ctx);
+    if (cold){
+        // outside the timing: leave what we wrote clean and out of the
+        // cache too, for the case that reads it back
+        fdatasync(outputFd);
+        posix_fadvise(outputFd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    close(inputFd);
+    close(outputFd);
+
+    if (rc != CRYPT_OK){
+        fprintf(stderr, "filecrypt_bench: %s: %s\n", in_path, crypt_strerror(rc));
+        return -1;
+    }
+
+    sample->wall = end - start;
+    sample->user = timeval_sec(ru_end.ru_utime) - timeval_sec(ru_start.ru_utime);
+    sample->sys = timeval_sec(ru_end.ru_stime) - timeval_sec(ru_start.ru_stime);
+    // the first /proc/self/io read is itself counted in r1
+    sample->syscr = (r0 < 0 || r1 < 0) ? -1 : r1 - r0 - 1;
+    sample->syscw = (w0 < 0 || w1 < 0) ? -1 : w1 - w0;
+    return 0;
+}
+
+static int compare_wall(const void *a, const void *b){
+    double x = ((const run_sample *)a)->wall;
+    double y = ((const run_sample *)b)->wall;
+    return (x > y) - (x < y);
+}
+
+// Run one case `reps` times and print the median run as a CSV row
+static int bench_case(const char *tag, const crypt_config *cfg, const char *alg_name, int engine,
+                      uint64_t size, uint64_t buffer_size, const char *in_path, const char *out_path,
+                      int reps, int cold){
+    run_sample samples[MAX_REPS];
+
+    double min_wall = 0.0;
+    for (int r = 0; r < reps; r++){
+        if (run_once(cfg, engine, in_path, out_path, cold, &samples[r]) != 0) return -1;
+        if (r == 0 || samples[r].wall < min_wall) min_wall = samples[r].wall;
+    }
+    qsort(samples, reps, sizeof(run_sample), compare_wall);
+    const run_sample *median = &samples[reps / 2];
+
+    double mb = (double)size / (1024.0 * 1024.0);
+    printf("%s,%s,%s,%s,%llu,%zu,%llu,%d,%d,%.6f,%.6f,%.2f,%.6f,%.6f,%lld,%lld\n",
+           tag, alg_name, cfg->decrypt ? "decrypt" : "encrypt", engine_names[engine],
+           (unsigned long long)size, cfg->key_length, (unsigned long long)buffer_size,
+           reps, cold, median->wall, min_wall,
+           median->wall > 0.0 ? mb / median->wall : 0.0,
+           median->user, median->sys, median->syscr, median->syscw);
+    fflush(stdout);
+    return 0;
+}
+
+int main(int argc, char *argv[]){
+    static const char *const alg_names[] = { "xor", "rol", "chacha" };
+    size_list sizes, key_lengths, buffers;
+    int algs[MAX_LIST], alg_count;
+    int engines[MAX_LIST], engine_count;
+    int reps = 3, cold = 0;
+    const char *tag = BENCH_TAG;
+    const char *dir = getenv("TMPDIR");
+    if (!dir || !*dir) dir = "/tmp";
+
+    parse_size_list("4K,64K,1M,16M,256M", &sizes);
+    parse_size_list("16,256", &key_lengths);
+    parse_size_list("4K,64K,1M", &buffers);
+    parse_name_list("xor,rol,chacha", alg_names, 3, algs, &alg_count);
+    parse_name_list("read,pread", engine_names, 2, engines, &engine_count);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:a:k:b:e:r:d:ct:h")) != -1){
+        int bad = 0;
+        switch (opt){
+            case 's': bad = parse_size_list(optarg, &sizes); break;
+            case 'k': bad = parse_size_list(optarg, &key_lengths); break;
+            case 'b': bad = parse_size_list(optarg, &buffers); break;
+            case 'a': bad = parse_name_list(optarg, alg_names, 3, algs, &alg_count); break;
+            case 'e': bad = parse_name_list(optarg, engine_names, 2, engines, &engine_count); break;
+            case 'r': reps = atoi(optarg); bad = (reps <= 0 || reps > MAX_REPS) ? -1 : 0; break;
+            case 'd': dir = optarg; break;
+            case 'c': cold = 1; break;
+            case 't': tag = optarg; break;
+            case 'h': print_usage(argv[0]); return 0;
+            default: print_usage(argv[0]); return 1;
+        }
+        if (bad){
+            fprintf(stderr, "Error: Invalid value for -%c: %s\n", opt, optarg);
+            return 1;
+        }
+    }
+
+    for (int b = 0; b < buffers.count; b++){
+        if (buffers.items[b] > CONTAINER_MAX_CHUNK){
+            fprintf(stderr, "Error: Buffer sizes must be at most %d bytes.\n", CONTAINER_MAX_CHUNK);
+            return 1;
+        }
+    }
+
+    char in_path[4096], enc_path[4096], dec_path[4096];
+    snprintf(enc_path, sizeof(enc_path), "%s/filecrypt_bench.%d.enc", dir, (int)getpid());
+    snprintf(dec_path, sizeof(dec_path), "%s/filecrypt_bench.%d.dec", dir, (int)getpid());
+
+    // the largest key we need, filled with fixed bytes
+    uint64_t max_key = 1;
+    for (int k = 0; k < key_lengths.count; k++){
+        if (key_lengths.items[k] > max_key) max_key = key_lengths.items[k];
+    }
+    unsigned char *key = malloc(max_key);
+    if (!key){ fprintf(stderr, "Error: Memory allocation failed.\n"); return 1; }
+    for (uint64_t i = 0; i < max_key; i++) key[i] = (unsigned char)(i * 131 + 7);
+
+    printf("tag,algorithm,op,engine,size_bytes,key_length,buffer_size,reps,cold,"
+           "wall_s,wall_min_s,mb_per_s,user_s,sys_s,read_syscalls,write_syscalls\n");
+
+    int status = 0;
+    for (int s = 0; s < sizes.count && status == 0; s++){
+        uint64_t size = sizes.items[s];
+        snprintf(in_path, sizeof(in_path), "%s/filecrypt_bench.%d.in", dir, (int)getpid());
+        fprintf(stderr, "filecrypt_bench: %llu byte input\n", (unsigned long long)size);
+        if (generate_input(in_path, size) != 0){ status = 1; break; }
+
+        for (int a = 0; a < alg_count && status == 0; a++){
+            int alg = algs[a];
+            // only xor depends on the key length
+            int key_cases = (alg == ALG_XOR) ? key_lengths.count : 1;
+
+            for (int k = 0; k < key_cases && status == 0; k++){
+                for (int b = 0; b < buffers.count && status == 0; b++){
+                    uint64_t buffer_size = buffers.items[b];
+                    crypt_config enc, dec;
+
+                    if (crypt_config_init(&enc, alg, 0, key, key_lengths.items[k], (uint32_t)buffer_size) != CRYPT_OK ||
+                        crypt_config_init(&dec, alg, 1, key, key_lengths.items[k], (uint32_t)buffer_size) != CRYPT_OK){
+                        fprintf(stderr, "filecrypt_bench: out of memory\n");
+                        status = 1;
+                        break;
+                    }
+                    enc.io_size = dec.io_size = buffer_size;
+
+                    for (int e = 0; e < engine_count && status == 0; e++){
+                        // encryption always streams; the engine only changes decryption
+                        if (e == 0 && bench_case(tag, &enc, alg_names[alg], ENGINE_READ, size, buffer_size,
+                                                 in_path, enc_path, reps, cold) != 0){
+                            status = 1;
+                        }
+                        if (status == 0 && bench_case(tag, &dec, alg_names[alg], engines[e], size, buffer_size,
+                                                      enc_path, dec_path, reps, cold) != 0){
+                            status = 1;
+                        }
+                    }
+                    crypt_config_wipe(&enc);
+                    crypt_config_wipe(&dec);
+                }
+            }
+        }
+        unlink(in_path);
+    }
+
+    unlink(enc_path);
+    unlink(dec_path);
+    free(key);
+    return status;
+}
@@ -0,0 +1,371 @@
+#include "aead.h"
+
+#include <string.h>
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define ROTR32(v, n) (((v) >> (n)) | ((v) << (32 - (n))))
+
+static uint32_t load32_le(const unsigned char *p){
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void store32_le(unsigned char *p, uint32_t v){
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static void store64_le(unsigned char *p, uint64_t v){
+    store32_le(p, (uint32_t)v);
+    store32_le(p + 4, (uint32_t)(v >> 32));
+}
+
+/* ---------------- SHA-256 ---------------- */
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void sha256_block(uint32_t state[8], const unsigned char block[64]){
+    uint32_t w[64];
+
+    for (int i = 0; i < 16; i++){
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++){
+        uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++){
+        uint32_t S1 = ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + S1 + ch + sha256_k[i] + w[i];
+        uint32_t S0 = ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = S0 + maj;
+
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void sha256_init(sha256_ctx *ctx){
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+void sha256_update(sha256_ctx *ctx, const unsigned char *data, size_t length){
+    ctx->length += length;
+
+    if (ctx->used > 0){
+        size_t take = 64 - ctx->used;
+        if (take > length) take = length;
+        memcpy(ctx->block + ctx->used, data, take);
+        ctx->used += take;
+        data += take;
+        length -= take;
+        if (ctx->used < 64) return;
+        sha256_block(ctx->state, ctx->block);
+        ctx->used = 0;
+    }
+
+    while (length >= 64){
+        sha256_block(ctx->state, data);
+        data += 64;
+        length -= 64;
+    }
+
+    memcpy(ctx->block, data, length);
+    ctx->used = length;
+}
+
+void sha256_final(sha256_ctx *ctx, unsigned char out[SHA256_SIZE]){
+    uint64_t bits = ctx->length * 8;
+    size_t used = ctx->used;
+
+    ctx->block[used++] = 0x80;
+    if (used > 56){
+        memset(ctx->block + used, 0, 64 - used);
+        sha256_block(ctx->state, ctx->block);
+        used = 0;
+    }
+    memset(ctx->block + used, 0, 56 - used);
+    for (int i = 0; i < 8; i++){
+        ctx->block[63 - i] = (unsigned char)(bits >> (8 * i));
+    }
+    sha256_block(ctx->state, ctx->block);
+
+    for (int i = 0; i < 8; i++){
+        out[i * 4]     = (unsigned char)(ctx->state[i] >> 24);
+        out[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 16);
+        out[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 8);
+        out[i * 4 + 3] = (unsigned char)ctx->state[i];
+    }
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void sha256(const unsigned char *data, size_t length, unsigned char out[SHA256_SIZE]){
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, length);
+    sha256_final(&ctx, out);
+}
+
+/* ---------------- ChaCha20 ---------------- */
+
+#define QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = ROTL32(d, 16); \
+    c += d; b ^= c; b = ROTL32(b, 12); \
+    a += b; d ^= a; d = ROTL32(d, 8);  \
+    c += d; b ^= c; b = ROTL32(b, 7);
+
+static void chacha20_init(uint32_t state[16], const unsigned char key[AEAD_KEY_SIZE],
+                          const unsigned char nonce[AEAD_NONCE_SIZE], uint32_t counter){
+    state[0] = 0x61707865;  // "expand 32-byte k"
+    state[1] = 0x3320646e;
+    state[2] = 0x79622d32;
+    state[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++){
+        state[4 + i] = load32_le(key + i * 4);
+    }
+    state[12] = counter;
+    state[13] = load32_le(nonce);
+    state[14] = load32_le(nonce + 4);
+    state[15] = load32_le(nonce + 8);
+}
+
+static void chacha20_block(const uint32_t state[16], unsigned char out[64]){
+    uint32_t x[16];
+    memcpy(x, state, sizeof(x));
+
+    for (int i = 0; i < 10; i++){
+        QUARTER_ROUND(x[0], x[4], x[8],  x[12]);
+        QUARTER_ROUND(x[1], x[5], x[9],  x[13]);
+        QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        QUARTER_ROUND(x[2], x[7], x[8],  x[13]);
+        QUARTER_ROUND(x[3], x[4], x[9],  x[14]);
+    }
+
+    for (int i = 0; i < 16; i++){
+        store32_le(out + i * 4, x[i] + state[i]);
+    }
+}
+
+void chacha20_xor(const unsigned char key[AEAD_KEY_SIZE],
+                  const unsigned char nonce[AEAD_NONCE_SIZE],
+                  uint32_t counter, unsigned char *data, size_t length){
+    uint32_t state[16];
+    unsigned char stream[64];
+
+    chacha20_init(state, key, nonce, counter);
+
+    while (length > 0){
+        chacha20_block(state, stream);
+        state[12]++;
+
+        size_t n = length < 64 ? length : 64;
+        for (size_t i = 0; i < n; i++){
+            data[i] ^= stream[i];
+        }
+        data += n;
+        length -= n;
+    }
+}
+
+/* ---------------- Poly1305 (26-bit limbs) ---------------- */
+
+typedef struct {
+    uint32_t r[5];
+    uint32_t h[5];
+    uint32_t pad[4];
+} poly1305_state;
+
+static void poly1305_init(poly1305_state *st, const unsigned char key[32]){
+    st->r[0] = (load32_le(key + 0))      & 0x3ffffff;
+    st->r[1] = (load32_le(key + 3) >> 2) & 0x3ffff03;
+    st->r[2] = (load32_le(key + 6) >> 4) & 0x3ffc0ff;
+    st->r[3] = (load32_le(key + 9) >> 6) & 0x3f03fff;
+    st->r[4] = (load32_le(key + 12) >> 8) & 0x00fffff;
+
+    memset(st->h, 0, sizeof(st->h));
+
+    for (int i = 0; i < 4; i++){
+        st->pad[i] = load32_le(key + 16 + i * 4);
+    }
+}
+
+// Absorb whole 16-byte blocks (every block gets the 2^128 bit)
+static void poly1305_blocks(poly1305_state *st, const unsigned char *m, size_t bytes){
+    const uint32_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2], r3 = st->r[3], r4 = st->r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], h3 = st->h[3], h4 = st->h[4];
+
+    while (bytes >= 16){
+        h0 += (load32_le(m + 0))      & 0x3ffffff;
+        h1 += (load32_le(m + 3) >> 2) & 0x3ffffff;
+        h2 += (load32_le(m + 6) >> 4) & 0x3ffffff;
+        h3 += (load32_le(m + 9) >> 6) & 0x3ffffff;
+        h4 += (load32_le(m + 12) >> 8) | (1 << 24);
+
+        uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+        uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+        uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+        uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+        uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+        uint32_t c;
+        c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & 0x3ffffff;
+        d1 += c; c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & 0x3ffffff;
+        d2 += c; c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & 0x3ffffff;
+        d3 += c; c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & 0x3ffffff;
+        d4 += c; c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & 0x3ffffff;
+        h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+        h1 += c;
+
+        m += 16;
+        bytes -= 16;
+    }
+
+    st->h[0] = h0; st->h[1] = h1; st->h[2] = h2; st->h[3] = h3; st->h[4] = h4;
+}
+
+// Absorb data and zero-pad the last partial block (the AEAD pad16 rule)
+static void poly1305_update_padded(poly1305_state *st, const unsigned char *m, size_t bytes){
+    size_t whole = bytes & ~(size_t)15;
+    poly1305_blocks(st, m, whole);
+
+    if (bytes > whole){
+        unsigned char block[16] = {0};
+        memcpy(block, m + whole, bytes - whole);
+        poly1305_blocks(st, block, 16);
+    }
+}
+
+static void poly1305_finish(poly1305_state *st, unsigned char mac[16]){
+    uint32_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], h3 = st->h[3], h4 = st->h[4];
+    uint32_t c;
+
+    c = h1 >> 26; h1 &= 0x3ffffff;
+    h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+    h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+    h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+
+    // compute h - p and keep it if it did not underflow
+    uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+    uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+    uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+    uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+    uint32_t g4 = h4 + c - (1UL << 26);
+
+    uint32_t mask = (g4 >> 31) - 1;
+    g0 &= mask; g1 &= mask; g2 &= mask; g3 &= mask; g4 &= mask;
+    mask = ~mask;
+    h0 = (h0 & mask) | g0;
+    h1 = (h1 & mask) | g1;
+    h2 = (h2 & mask) | g2;
+    h3 = (h3 & mask) | g3;
+    h4 = (h4 & mask) | g4;
+
+    h0 = (h0 | (h1 << 26));
+    h1 = ((h1 >> 6) | (h2 << 20));
+    h2 = ((h2 >> 12) | (h3 << 14));
+    h3 = ((h3 >> 18) | (h4 << 8));
+
+    uint64_t f;
+    f = (uint64_t)h0 + st->pad[0];             h0 = (uint32_t)f;
+    f = (uint64_t)h1 + st->pad[1] + (f >> 32); h1 = (uint32_t)f;
+    f = (uint64_t)h2 + st->pad[2] + (f >> 32); h2 = (uint32_t)f;
+    f = (uint64_t)h3 + st->pad[3] + (f >> 32); h3 = (uint32_t)f;
+
+    store32_le(mac + 0, h0);
+    store32_le(mac + 4, h1);
+    store32_le(mac + 8, h2);
+    store32_le(mac + 12, h3);
+
+    memset(st, 0, sizeof(*st));
+}
+
+/* ---------------- ChaCha20-Poly1305 ---------------- */
+
+static void aead_tag(const unsigned char key[AEAD_KEY_SIZE],
+                     const unsigned char nonce[AEAD_NONCE_SIZE],
+                     const unsigned char *aad, size_t aad_length,
+                     const unsigned char *ciphertext, size_t length,
+                     unsigned char tag[AEAD_TAG_SIZE]){
+    unsigned char poly_key[64] = {0};
+    unsigned char lengths[16];
+    poly1305_state st;
+
+    // one-time Poly1305 key is the first half of keystream block 0
+    chacha20_xor(key, nonce, 0, poly_key, sizeof(poly_key));
+    poly1305_init(&st, poly_key);
+
+    poly1305_update_padded(&st, aad, aad_length);
+    poly1305_update_padded(&st, ciphertext, length);
+
+    store64_le(lengths, aad_length);
+    store64_le(lengths + 8, length);
+    poly1305_blocks(&st, lengths, sizeof(lengths));
+
+    poly1305_finish(&st, tag);
+    memset(poly_key, 0, sizeof(poly_key));
+}
+
+void aead_seal(const unsigned char key[AEAD_KEY_SIZE],
+               const unsigned char nonce[AEAD_NONCE_SIZE],
+               const unsigned char *aad, size_t aad_length,
+               unsigned char *data, size_t length,
+               unsigned char tag[AEAD_TAG_SIZE]){
+    chacha20_xor(key, nonce, 1, data, length);
+    aead_tag(key, nonce, aad, aad_length, data, length, tag);
+}
+
+int aead_open(const unsigned char key[AEAD_KEY_SIZE],
+              const unsigned char nonce[AEAD_NONCE_SIZE],
+              const unsigned char *aad, size_t aad_length,
+              unsigned char *data, size_t length,
+              const unsigned char tag[AEAD_TAG_SIZE]){
+    unsigned char expected[AEAD_TAG_SIZE];
+    unsigned char diff = 0;
+
+    aead_tag(key, nonce, aad, aad_length, data, length, expected);
+
+    // constant-time compare
+    for (int i = 0; i < AEAD_TAG_SIZE; i++){
+        diff |= expected[i] ^ tag[i];
+    }
+    if (diff != 0){
+        return -1;
+    }
+
+    chacha20_xor(key, nonce, 1, data, length);
+    return 0;
+}
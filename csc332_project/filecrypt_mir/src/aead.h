@@ -0,0 +1,46 @@
+#ifndef AEAD_H
+#define AEAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AEAD_KEY_SIZE   32
+#define AEAD_NONCE_SIZE 12
+#define AEAD_TAG_SIZE   16
+#define SHA256_SIZE     32
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    size_t used;
+} sha256_ctx;
+
+// SHA-256, one-shot (used to turn key material into a 256-bit key) or incremental
+void sha256(const unsigned char *data, size_t length, unsigned char out[SHA256_SIZE]);
+void sha256_init(sha256_ctx *ctx);
+void sha256_update(sha256_ctx *ctx, const unsigned char *data, size_t length);
+void sha256_final(sha256_ctx *ctx, unsigned char out[SHA256_SIZE]);
+
+// ChaCha20 (RFC 8439): XOR data with the keystream starting at block `counter`
+void chacha20_xor(const unsigned char key[AEAD_KEY_SIZE],
+                  const unsigned char nonce[AEAD_NONCE_SIZE],
+                  uint32_t counter, unsigned char *data, size_t length);
+
+// ChaCha20-Poly1305 (RFC 8439), in place.
+// aead_seal encrypts data and writes the tag.
+// aead_open checks the tag first and only decrypts when it matches.
+// Returns 0 on success, -1 if the tag does not match.
+void aead_seal(const unsigned char key[AEAD_KEY_SIZE],
+               const unsigned char nonce[AEAD_NONCE_SIZE],
+               const unsigned char *aad, size_t aad_length,
+               unsigned char *data, size_t length,
+               unsigned char tag[AEAD_TAG_SIZE]);
+
+int aead_open(const unsigned char key[AEAD_KEY_SIZE],
+              const unsigned char nonce[AEAD_NONCE_SIZE],
+              const unsigned char *aad, size_t aad_length,
+              unsigned char *data, size_t length,
+              const unsigned char tag[AEAD_TAG_SIZE]);
+
+#endif
@@ -0,0 +1,283 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "agent.h"
+#include "crypt.h"
+#include "secmem.h"
+
+#define AGENT_OP_FIND 'F'   // any key for this passphrase and cost
+#define AGENT_OP_GET  'G'   // the key for this passphrase, cost and salt
+#define AGENT_OP_PUT  'P'
+
+#define AGENT_HIT  0
+#define AGENT_MISS 1
+
+// One fixed-size message per connection in each direction
+typedef struct {
+    unsigned char op;
+    unsigned char status;
+    unsigned char log_n;
+    unsigned char r;
+    unsigned char p;
+    unsigned char salt[KDF_SALT_SIZE];
+    unsigned char id[KDF_ID_SIZE];
+    unsigned char key[AEAD_KEY_SIZE];
+} agent_msg;
+
+static volatile sig_atomic_t agent_stop = 0;
+
+static void agent_signal(int sig){
+    (void)sig;
+    agent_stop = 1;
+}
+
+int agent_socket_path(char *buf, size_t len){
+    const char *env = getenv("FILECRYPT_AGENT_SOCK");
+    if (env && *env){
+        return snprintf(buf, len, "%s", env) < (int)len ? 0 : -1;
+    }
+
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime){
+        return snprintf(buf, len, "%s/filecrypt-agent.sock", runtime) < (int)len ? 0 : -1;
+    }
+
+    return snprintf(buf, len, "/tmp/filecrypt-%u/agent.sock", (unsigned)getuid()) < (int)len ? 0 : -1;
+}
+
+// 0 if the directory holding the socket is a real directory (not a
+// symlink) owned by us with mode 0700, so no one else can have put the
+// socket there
+static int socket_dir_private(const char *path){
+    char dir[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    struct stat st;
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) snprintf(dir, sizeof(dir), ".");
+    else if (slash == dir) slash[1] = '\0';
+    else *slash = '\0';
+
+    if (lstat(dir, &st) == -1) return -1;
+    if (!S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077) != 0) return -1;
+    return 0;
+}
+
+// 0 if the process on the other end of fd runs as us
+static int peer_is_us(int fd){
+    struct ucred cred;
+    socklen_t cred_length = sizeof(cred);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_length) == -1) return -1;
+    return cred.uid == getuid() ? 0 : -1;
+}
+
+static int agent_connect(void){
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    struct sockaddr_un addr;
+
+    if (agent_socket_path(path, sizeof(path)) != 0) return -1;
+    // keys go out with PUT and come back with FIND: only to our own agent
+    if (socket_dir_private(path) != 0) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path));
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || peer_is_us(fd) != 0){
+        close(fd);
+        return -1;
+    }
+
+    // never let a stuck agent hold up encryption
+    struct timeval tv = { .tv_sec = 2, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+static int agent_roundtrip(agent_msg *msg){
+    int fd = agent_connect();
+    if (fd == -1) return -1;
+
+    // MSG_NOSIGNAL: an agent that went away must not kill us with SIGPIPE
+    int rc = -1;
+    if (send(fd, msg, sizeof(*msg), MSG_NOSIGNAL) == (ssize_t)sizeof(*msg) &&
+        read_full(fd, (unsigned char *)msg, sizeof(*msg)) == (ssize_t)sizeof(*msg)){
+        rc = 0;
+    }
+    close(fd);
+    return rc;
+}
+
+int agent_fetch(const unsigned char id[KDF_ID_SIZE], kdf_params *params, int match_salt,
+                unsigned char key[AEAD_KEY_SIZE]){
+    agent_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.op = match_salt ? AGENT_OP_GET : AGENT_OP_FIND;
+    msg.log_n = params->log_n;
+    msg.r = params->r;
+    msg.p = params->p;
+    memcpy(msg.salt, params->salt, KDF_SALT_SIZE);
+    memcpy(msg.id, id, KDF_ID_SIZE);
+
+    int rc = -1;
+    if (agent_roundtrip(&msg) == 0 && msg.status == AGENT_HIT){
+        memcpy(params->salt, msg.salt, KDF_SALT_SIZE);
+        memcpy(key, msg.key, AEAD_KEY_SIZE);
+        rc = 0;
+    }
+    secure_zero(&msg, sizeof(msg));
+    return rc;
+}
+
+void agent_store(const unsigned char id[KDF_ID_SIZE], const kdf_params *params,
+                 const unsigned char key[AEAD_KEY_SIZE]){
+    agent_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.op = AGENT_OP_PUT;
+    msg.log_n = params->log_n;
+    msg.r = params->r;
+    msg.p = params->p;
+    memcpy(msg.salt, params->salt, KDF_SALT_SIZE);
+    memcpy(msg.id, id, KDF_ID_SIZE);
+    memcpy(msg.key, key, AEAD_KEY_SIZE);
+
+    agent_roundtrip(&msg);
+    secure_zero(&msg, sizeof(msg));
+}
+
+// The socket needs a private directory we own; clients refuse any other
+static int prepare_socket_dir(const char *path){
+    char dir[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash && slash != dir){
+        *slash = '\0';
+        if (mkdir(dir, 0700) == -1 && errno != EEXIST){
+            perror("mkdir agent directory");
+            return -1;
+        }
+    }
+    if (socket_dir_private(path) != 0){
+        fprintf(stderr, "Error: The directory of %s must be owned by you with mode 0700.\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static void agent_handle(int client, kdf_cache_entry *entries, int *next_victim){
+    agent_msg msg;
+
+    if (peer_is_us(client) != 0) return;
+
+    struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    if (read_full(client, (unsigned char *)&msg, sizeof(msg)) != (ssize_t)sizeof(msg)){
+        return;
+    }
+
+    kdf_params params;
+    memcpy(params.salt, msg.salt, KDF_SALT_SIZE);
+    params.log_n = msg.log_n;
+    params.r = msg.r;
+    params.p = msg.p;
+
+    if (msg.op == AGENT_OP_PUT){
+        kdf_cache_put(entries, KDF_CACHE_ENTRIES, next_victim, msg.id, &params, msg.key);
+        msg.status = AGENT_HIT;
+    } else {
+        kdf_cache_entry *e = kdf_cache_find(entries, KDF_CACHE_ENTRIES, msg.id, &params, msg.op == AGENT_OP_GET);
+        if (e){
+            memcpy(msg.salt, e->params.salt, KDF_SALT_SIZE);
+            memcpy(msg.key, e->key, AEAD_KEY_SIZE);
+            msg.status = AGENT_HIT;
+        } else {
+            memset(msg.key, 0, AEAD_KEY_SIZE);
+            msg.status = AGENT_MISS;
+        }
+    }
+
+    write_full(client, (unsigned char *)&msg, sizeof(msg));
+    secure_zero(&msg, sizeof(msg));
+}
+
+int agent_serve(const char *path){
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path)){
+        fprintf(stderr, "Error: Agent socket path is too long.\n");
+        return 1;
+    }
+    if (prepare_socket_dir(path) != 0) return 1;
+
+    kdf_cache_entry *entries = secure_alloc(KDF_CACHE_ENTRIES * sizeof(kdf_cache_entry));
+    if (!entries){
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        return 1;
+    }
+    int next_victim = 0;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1){
+        perror("socket");
+        secure_free(entries);
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path));
+
+    unlink(path);
+    mode_t old_mask = umask(0077);
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound == -1 || listen(fd, 64) == -1){
+        perror("bind agent socket");
+        close(fd);
+        secure_free(entries);
+        return 1;
+    }
+
+    // no SA_RESTART: a signal interrupts accept() and ends the loop
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = agent_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "filecrypt agent listening on %s\n", path);
+
+    while (!agent_stop){
+        int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client == -1){
+            if (errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+        agent_handle(client, entries, &next_victim);
+        close(client);
+    }
+
+    close(fd);
+    unlink(path);
+    secure_free(entries);
+    fprintf(stderr, "filecrypt agent stopped, keys wiped\n");
+    return 0;
+}
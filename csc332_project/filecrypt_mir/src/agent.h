@@ -0,0 +1,22 @@
+#ifndef AGENT_H
+#define AGENT_H
+
+#include "kdf.h"
+
+// Socket of the key agent: $FILECRYPT_AGENT_SOCK, else
+// $XDG_RUNTIME_DIR/filecrypt-agent.sock, else /tmp/filecrypt-<uid>/agent.sock
+int agent_socket_path(char *buf, size_t len);
+
+// Run the agent in the foreground until SIGINT/SIGTERM. Derived keys are held
+// in locked memory and only served to clients with the same uid.
+int agent_serve(const char *path);
+
+// Client side. Both quietly do nothing when no agent is listening, or when the
+// socket's directory is not ours with mode 0700 or the agent runs as another user.
+// agent_fetch returns 0 on a hit (filling params->salt when !match_salt).
+int agent_fetch(const unsigned char id[KDF_ID_SIZE], kdf_params *params, int match_salt,
+                unsigned char key[AEAD_KEY_SIZE]);
+void agent_store(const unsigned char id[KDF_ID_SIZE], const kdf_params *params,
+                 const unsigned char key[AEAD_KEY_SIZE]);
+
+#endif
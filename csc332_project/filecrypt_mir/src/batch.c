@@ -0,0 +1,301 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+
+#define BATCH_ERR_OPEN_INPUT  -100
+#define BATCH_ERR_OPEN_OUTPUT -101
+
+typedef struct {
+    char *input;
+    char *output;
+    int status;
+    int saved_errno;
+    uint32_t failed_chunk;
+    uint64_t bytes;
+} batch_job;
+
+typedef struct {
+    const crypt_config *cfg;
+    batch_job *jobs;
+    size_t job_count;
+    size_t next_job;    // shared work counter, claimed with an atomic add
+} batch_pool;
+
+static int add_job(batch_job **jobs, size_t *count, size_t *capacity, char *input, char *output){
+    if (*count == *capacity){
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        batch_job *grown = realloc(*jobs, new_capacity * sizeof(batch_job));
+        if (!grown) return -1;
+        *jobs = grown;
+        *capacity = new_capacity;
+    }
+    memset(&(*jobs)[*count], 0, sizeof(batch_job));
+    (*jobs)[*count].input = input;
+    (*jobs)[*count].output = output;
+    (*count)++;
+    return 0;
+}
+
+// Directory source: every regular file in it goes to output_dir/<same name>
+static int load_directory(const char *dir, const char *output_dir, batch_job **jobs, size_t *count){
+    size_t capacity = 0;
+    char in_real[PATH_MAX], out_real[PATH_MAX];
+
+    if (!output_dir){
+        fprintf(stderr, "Error: -B with a directory needs an output directory with -o.\n");
+        return -1;
+    }
+    if (mkdir(output_dir, 0755) == -1 && errno != EEXIST){
+        perror("mkdir output directory");
+        return -1;
+    }
+    if (realpath(dir, in_real) && realpath(output_dir, out_real) && strcmp(in_real, out_real) == 0){
+        fprintf(stderr, "Error: Output directory must differ from the input directory.\n");
+        return -1;
+    }
+
+    DIR *d = opendir(dir);
+    if (!d){
+        perror("opendir");
+        return -1;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL){
+        if (entry->d_name[0] == '.') continue;
+
+        char *input = NULL, *output = NULL;
+        if (asprintf(&input, "%s/%s", dir, entry->d_name) < 0){ input = NULL; goto nomem; }
+
+        struct stat st;
+        if (stat(input, &st) == -1 || !S_ISREG(st.st_mode)){
+            free(input);
+            continue;
+        }
+
+        if (asprintf(&output, "%s/%s", output_dir, entry->d_name) < 0){ output = NULL; goto nomem; }
+        if (add_job(jobs, count, &capacity, input, output) == -1) goto nomem;
+        continue;
+
+    nomem:
+        free(input);
+        free(output);
+        closedir(d);
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        return -1;
+    }
+
+    closedir(d);
+    return 0;
+}
+
+// Manifest source: one "input<TAB>output" (or "input output") pair per line,
+// blank lines and lines starting with '#' are skipped
+static int load_manifest(const char *path, batch_job **jobs, size_t *count){
+    size_t capacity = 0;
+    FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!fp){
+        perror("open manifest");
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+    long line_number = 0;
+    int rc = 0;
+
+    while ((length = getline(&line, &line_capacity, fp)) != -1){
+        line_number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+
+        char *split = strchr(line, '\t');
+        if (!split) split = strchr(line, ' ');
+        if (!split || split == line || split[1] == '\0'){
+            fprintf(stderr, "Error: %s:%ld: expected \"input output\".\n", path, line_number);
+            rc = -1;
+            break;
+        }
+        *split = '\0';
+
+        char *input = strdup(line);
+        char *output = strdup(split + 1);
+        if (!input || !output || add_job(jobs, count, &capacity, input, output) == -1){
+            free(input);
+            free(output);
+            fprintf(stderr, "Error: Memory allocation failed.\n");
+            rc = -1;
+            break;
+        }
+    }
+
+    free(line);
+    if (fp != stdin) fclose(fp);
+    return rc;
+}
+
+static void run_job(const crypt_config *cfg, crypt_ctx *ctx, batch_job *job){
+    int inputFd = open(job->input, O_RDONLY);
+    if (inputFd == -1){
+        job->status = BATCH_ERR_OPEN_INPUT;
+        job->saved_errno = errno;
+        return;
+    }
+
+    int outputFd = open(job->output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (outputFd == -1){
+        job->status = BATCH_ERR_OPEN_OUTPUT;
+        job->saved_errno = errno;
+        close(inputFd);
+        return;
+    }
+
+    job->status = crypt_fd(cfg, ctx, inputFd, outputFd);
+    job->saved_errno = errno;
+    job->failed_chunk = ctx->failed_chunk;
+    job->bytes = ctx->bytes_in;
+
+    close(inputFd);
+    if (close(outputFd) == -1 && job->status == CRYPT_OK){
+        job->status = CRYPT_ERR_WRITE;
+        job->saved_errno = errno;
+    }
+}
+
+static void *batch_worker(void *arg){
+    batch_pool *pool = arg;
+    crypt_ctx ctx;
+
+    // buffers are allocated once per thread and reused for every file
+    int init = crypt_ctx_init(&ctx, pool->cfg);
+
+    for (;;){
+        size_t i = __atomic_fetch_add(&pool->next_job, 1, __ATOMIC_RELAXED);
+        if (i >= pool->job_count) break;
+
+        if (init != CRYPT_OK){
+            pool->jobs[i].status = init;
+            continue;
+        }
+        run_job(pool->cfg, &ctx, &pool->jobs[i]);
+    }
+
+    crypt_ctx_free(&ctx);
+    return NULL;
+}
+
+static void report_failure(const batch_job *job){
+    switch (job->status){
+        case BATCH_ERR_OPEN_INPUT:
+            fprintf(stderr, "filecrypt: %s: open input: %s\n", job->input, strerror(job->saved_errno));
+            break;
+        case BATCH_ERR_OPEN_OUTPUT:
+            fprintf(stderr, "filecrypt: %s: open output %s: %s\n", job->input, job->output, strerror(job->saved_errno));
+            break;
+        case CRYPT_ERR_READ:
+        case CRYPT_ERR_WRITE:
+            fprintf(stderr, "filecrypt: %s: %s: %s\n", job->input, crypt_strerror(job->status), strerror(job->saved_errno));
+            break;
+        case CRYPT_ERR_AUTH:
+            fprintf(stderr, "filecrypt: %s: chunk %u %s\n", job->input, job->failed_chunk, crypt_strerror(job->status));
+            break;
+        default:
+            fprintf(stderr, "filecrypt: %s: %s\n", job->input, crypt_strerror(job->status));
+            break;
+    }
+}
+
+int run_batch(const crypt_config *cfg, const batch_options *opts){
+    batch_job *jobs = NULL;
+    size_t job_count = 0;
+    struct stat st;
+
+    if (stat(opts->source, &st) == 0 && S_ISDIR(st.st_mode)){
+        if (load_directory(opts->source, opts->output_dir, &jobs, &job_count) == -1) goto fail;
+    } else {
+        if (load_manifest(opts->source, &jobs, &job_count) == -1) goto fail;
+    }
+
+    long workers = opts->workers;
+    if (workers <= 0){
+        workers = sysconf(_SC_NPROCESSORS_ONLN);
+        if (workers <= 0) workers = 1;
+    }
+    if ((size_t)workers > job_count) workers = job_count ? (long)job_count : 1;
+
+    batch_pool pool = { .cfg = cfg, .jobs = jobs, .job_count = job_count, .next_job = 0 };
+    pthread_t *threads = malloc(workers * sizeof(pthread_t));
+    if (!threads){
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        goto fail;
+    }
+
+    struct timespec start_ts, end_ts;
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+
+    long started = 0;
+    for (; started < workers; started++){
+        if (pthread_create(&threads[started], NULL, batch_worker, &pool) != 0){
+            if (started == 0){
+                fprintf(stderr, "Error: Couldn't create worker thread.\n");
+                free(threads);
+                goto fail;
+            }
+            break;  // run with the threads we have
+        }
+    }
+    for (long i = 0; i < started; i++){
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    free(threads);
+
+    size_t failed = 0;
+    uint64_t total_bytes = 0;
+    for (size_t i = 0; i < job_count; i++){
+        total_bytes += jobs[i].bytes;
+        if (jobs[i].status != CRYPT_OK){
+            report_failure(&jobs[i]);
+            failed++;
+        }
+    }
+
+    double elapsed_sec = (double)(end_ts.tv_sec - start_ts.tv_sec) +
+                         (double)(end_ts.tv_nsec - start_ts.tv_nsec) / 1e9;
+    double mb = (double)total_bytes / (1024.0 * 1024.0);
+
+    printf("Batch: %zu files (%zu ok, %zu failed) with %ld workers\n",
+           job_count, job_count - failed, failed, started);
+    printf("Processed: %.3f MB in %.3f s (%.1f MB/s, %.1f files/s)\n",
+           mb, elapsed_sec,
+           elapsed_sec > 0.0 ? mb / elapsed_sec : 0.0,
+           elapsed_sec > 0.0 ? (double)job_count / elapsed_sec : 0.0);
+
+    for (size_t i = 0; i < job_count; i++){
+        free(jobs[i].input);
+        free(jobs[i].output);
+    }
+    free(jobs);
+    return failed ? 1 : 0;
+
+fail:
+    for (size_t i = 0; i < job_count; i++){
+        free(jobs[i].input);
+        free(jobs[i].output);
+    }
+    free(jobs);
+    return 1;
+}
@@ -0,0 +1,17 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "crypt.h"
+
+typedef struct {
+    const char *source;      // directory of input files, or a manifest ("-" = stdin)
+    const char *output_dir;  // where outputs go when source is a directory
+    int workers;             // worker threads, 0 = one per online CPU
+} batch_options;
+
+// Run every file in the batch through crypt_fd on a pool of worker threads.
+// Prints one line per failed file and an aggregate summary.
+// Returns 0 if every file succeeded, 1 otherwise.
+int run_batch(const crypt_config *cfg, const batch_options *opts);
+
+#endif
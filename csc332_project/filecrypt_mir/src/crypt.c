@@ -0,0 +1,743 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+
+#include "crypt.h"
+#include "secmem.h"
+
+// read() until len bytes or EOF; returns bytes read or -1
+ssize_t read_full(int fd, unsigned char *buf, size_t len){
+    size_t total = 0;
+    while (total < len){
+        ssize_t n = read(fd, buf + total, len - total);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        total += (size_t)n;
+    }
+    return (ssize_t)total;
+}
+
+// pread() until len bytes or EOF; returns bytes read or -1
+ssize_t pread_full(int fd, unsigned char *buf, size_t len, off_t offset){
+    size_t total = 0;
+    while (total < len){
+        ssize_t n = pread(fd, buf + total, len - total, offset + (off_t)total);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        total += (size_t)n;
+    }
+    return (ssize_t)total;
+}
+
+// write() all of buf, retrying short writes; returns len or -1
+ssize_t write_full(int fd, const unsigned char *buf, size_t len){
+    size_t total = 0;
+    while (total < len){
+        ssize_t n = write(fd, buf + total, len - total);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        total += (size_t)n;
+    }
+    return (ssize_t)total;
+}
+
+// keyIndex carries the keystream position across buffers; out may be in
+static void xor_buffer(unsigned char *out, const unsigned char *in, size_t length,
+                       const unsigned char *key, size_t key_length, size_t *keyIndex){
+    size_t k = *keyIndex;
+    for (size_t i = 0; i < length; i++){
+        out[i] = in[i] ^ key[k];
+        if (++k == key_length) k = 0;
+    }
+    *keyIndex = k;
+}
+
+static int xor_crypt(int input_descriptor, int output_descriptor, const crypt_config *cfg, crypt_ctx *ctx){
+    unsigned char *buffer = ctx->current;
+    ssize_t bytesread;
+    size_t keyIndex = 0;
+
+    while ((bytesread = read(input_descriptor, buffer, ctx->buffer_size)) > 0) {
+        xor_buffer(buffer, buffer, bytesread, cfg->key, cfg->key_length, &keyIndex);
+        if (write_full(output_descriptor, buffer, bytesread) != bytesread){
+            return CRYPT_ERR_WRITE;
+        }
+        ctx->bytes_in += bytesread;
+    }
+    if (bytesread < 0){
+        return CRYPT_ERR_READ;
+    }
+    return CRYPT_OK;
+}
+
+static unsigned char roll_left(unsigned char temp, int set){
+    set = set % 8;
+
+    for (int i = 0; i < set; i++) {
+        unsigned char carry = (temp & 0x80) >> 7;  // bit 7
+        temp = (unsigned char)((temp << 1) | carry);
+    }
+    return temp;
+}
+
+static unsigned char roll_right(unsigned char temp, int set){
+    set = set % 8;
+
+    for (int i = 0; i < set; i++) {
+        unsigned char carry = (temp & 0x01) << 7;  // bit 0
+        temp = (unsigned char)((temp >> 1) | carry);
+    }
+    return temp;
+}
+
+
+static int rol_shift(const crypt_config *cfg){
+    int shift = cfg->key[0] % 8;
+    if (shift == 0) { shift = 1; }
+    return shift;
+}
+
+static void rol_buffer(unsigned char *out, const unsigned char *in, size_t length, int shift, int decrypt_flag){
+    for (size_t i = 0; i < length; i++){
+        if (decrypt_flag)
+            out[i] = roll_right(in[i], shift);
+        else
+            out[i] = roll_left(in[i], shift);
+    }
+}
+
+static int bit_crypt(int input_descriptor, int output_descriptor, const crypt_config *cfg, crypt_ctx *ctx){
+    unsigned char *buffer = ctx->current;
+    ssize_t bytesread;
+    int shift = rol_shift(cfg);
+
+    while ((bytesread = read(input_descriptor, buffer, ctx->buffer_size)) > 0) {
+        rol_buffer(buffer, buffer, bytesread, shift, cfg->decrypt);
+
+        if (write_full(output_descriptor, buffer, bytesread) != bytesread){
+            return CRYPT_ERR_WRITE;
+        }
+        ctx->bytes_in += bytesread;
+    }
+
+    if (bytesread < 0){
+        return CRYPT_ERR_READ;
+    }
+    return CRYPT_OK;
+}
+
+// With --io a regular input file is read from its current position to the
+// end by a bulkio reader (common/bulkio.h) in pieces of piece_size bytes;
+// NULL means use the read() loops (no --io, a pipe, or the reader failed).
+// *total is the number of bytes the reader will hand out.
+static bulk_reader *open_bulk(const crypt_config *cfg, int input_descriptor, size_t piece_size, uint64_t *total){
+    struct stat st;
+
+    if (!cfg->bulk_io) return NULL;
+    if (fstat(input_descriptor, &st) == -1 || !S_ISREG(st.st_mode)) return NULL;
+
+    off_t start = lseek(input_descriptor, 0, SEEK_CUR);
+    if (start < 0 || start > st.st_size) return NULL;
+
+    bulkio_options io = cfg->io;
+    io.buffer_size = piece_size;
+    *total = (uint64_t)(st.st_size - start);
+    return bulkio_open(input_descriptor, start, st.st_size - start, &io);
+}
+
+// xor/rol from a bulkio reader; its pieces are read-only (they may be the
+// page cache itself with mmap), so they are transformed into ctx->current
+static int stream_bulk(bulk_reader *reader, int output_descriptor, const crypt_config *cfg, crypt_ctx *ctx){
+    const unsigned char *piece;
+    ssize_t length;
+    size_t keyIndex = 0;
+    int shift = rol_shift(cfg);
+
+    while ((length = bulkio_next(reader, &piece)) > 0){
+        for (size_t done = 0; done < (size_t)length; ){
+            size_t n = (size_t)length - done;
+            if (n > ctx->buffer_size) n = ctx->buffer_size;
+
+            if (cfg->algorithm == ALG_XOR)
+                xor_buffer(ctx->current, piece + done, n, cfg->key, cfg->key_length, &keyIndex);
+            else
+                rol_buffer(ctx->current, piece + done, n, shift, cfg->decrypt);
+
+            if (write_full(output_descriptor, ctx->current, n) != (ssize_t)n){
+                return CRYPT_ERR_WRITE;
+            }
+            done += n;
+        }
+        ctx->bytes_in += length;
+    }
+    return length < 0 ? CRYPT_ERR_READ : CRYPT_OK;
+}
+
+// Container format for -a chacha (integers are little-endian):
+//   header : magic "FCRY" | version u8 | flags u8 | reserved u16 | chunk_size u32 | nonce_prefix[8]
+//   kdf    : salt[16] | log2(N) u8 | r u8 | p u8 | reserved u8, only if flags has CONTAINER_FLAG_KDF
+//   chunk i: ciphertext (chunk_size bytes, the last chunk may be shorter) | tag[16]
+// Chunk i is sealed with nonce = nonce_prefix || i and the whole header plus a
+// final-chunk flag as associated data, so every chunk can be verified on its
+// own (reordering, truncation and header edits all break a tag) and chunk i
+// starts at header size + i * (chunk_size + AEAD_TAG_SIZE).
+#define CONTAINER_MAGIC    "FCRY"
+#define CONTAINER_VERSION  1
+#define CONTAINER_FLAG_KDF 0x01
+
+typedef struct {
+    unsigned char raw[CONTAINER_MAX_HEADER];
+    size_t size;
+    uint32_t chunk_size;
+} container_header;
+
+static void chunk_nonce(const container_header *hdr, uint32_t index, unsigned char nonce[AEAD_NONCE_SIZE]){
+    memcpy(nonce, hdr->raw + 12, 8);
+    nonce[8]  = (unsigned char)index;
+    nonce[9]  = (unsigned char)(index >> 8);
+    nonce[10] = (unsigned char)(index >> 16);
+    nonce[11] = (unsigned char)(index >> 24);
+}
+
+// Returns the AAD length
+static size_t chunk_aad(const container_header *hdr, int is_final, unsigned char aad[CONTAINER_MAX_HEADER + 1]){
+    memcpy(aad, hdr->raw, hdr->size);
+    aad[hdr->size] = is_final ? 1 : 0;
+    return hdr->size + 1;
+}
+
+static int container_new_header(container_header *hdr, uint32_t chunk_size, const kdf_params *kdf){
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->raw, CONTAINER_MAGIC, 4);
+    hdr->raw[4] = CONTAINER_VERSION;
+    hdr->size = CONTAINER_HEADER_SIZE;
+    if (kdf){
+        hdr->raw[5] = CONTAINER_FLAG_KDF;
+        memcpy(hdr->raw + CONTAINER_HEADER_SIZE, kdf->salt, KDF_SALT_SIZE);
+        hdr->raw[CONTAINER_HEADER_SIZE + 16] = kdf->log_n;
+        hdr->raw[CONTAINER_HEADER_SIZE + 17] = kdf->r;
+        hdr->raw[CONTAINER_HEADER_SIZE + 18] = kdf->p;
+        hdr->size += CONTAINER_KDF_SIZE;
+    }
+    hdr->raw[8]  = (unsigned char)chunk_size;
+    hdr->raw[9]  = (unsigned char)(chunk_size >> 8);
+    hdr->raw[10] = (unsigned char)(chunk_size >> 16);
+    hdr->raw[11] = (unsigned char)(chunk_size >> 24);
+    hdr->chunk_size = chunk_size;
+
+    if (getrandom(hdr->raw + 12, 8, 0) != 8){
+        return CRYPT_ERR_RANDOM;
+    }
+    return CRYPT_OK;
+}
+
+// Checks the fixed part and sets hdr->size; the caller then reads the rest
+static int container_parse_header(container_header *hdr){
+    if (memcmp(hdr->raw, CONTAINER_MAGIC, 4) != 0 || hdr->raw[4] != CONTAINER_VERSION){
+        return CRYPT_ERR_FORMAT;
+    }
+    if (hdr->raw[5] & ~CONTAINER_FLAG_KDF){
+        return CRYPT_ERR_FORMAT;
+    }
+    hdr->size = CONTAINER_HEADER_SIZE;
+    if (hdr->raw[5] & CONTAINER_FLAG_KDF){
+        hdr->size += CONTAINER_KDF_SIZE;
+    }
+    hdr->chunk_size = (uint32_t)hdr->raw[8] | ((uint32_t)hdr->raw[9] << 8) |
+                      ((uint32_t)hdr->raw[10] << 16) | ((uint32_t)hdr->raw[11] << 24);
+    if (hdr->chunk_size == 0 || hdr->chunk_size > CONTAINER_MAX_CHUNK){
+        return CRYPT_ERR_FORMAT;
+    }
+    return CRYPT_OK;
+}
+
+// Open one chunk record (ciphertext followed by its tag) in place.
+// Returns the plaintext length, or -1 if the tag does not verify.
+static ssize_t container_open_chunk(const container_header *hdr, const unsigned char *aead_key,
+                                    uint32_t index, int is_final, unsigned char *record, size_t record_length){
+    unsigned char nonce[AEAD_NONCE_SIZE];
+    unsigned char aad[CONTAINER_MAX_HEADER + 1];
+
+    if (record_length < AEAD_TAG_SIZE) return -1;
+    size_t length = record_length - AEAD_TAG_SIZE;
+
+    chunk_nonce(hdr, index, nonce);
+    size_t aad_length = chunk_aad(hdr, is_final, aad);
+    if (aead_open(aead_key, nonce, aad, aad_length, record, length, record + length) != 0){
+        return -1;
+    }
+    return (ssize_t)length;
+}
+
+// Read the rest of the header (the kdf block) after the fixed part
+static int container_read_rest(int fd, container_header *hdr, int positional){
+    size_t rest = hdr->size - CONTAINER_HEADER_SIZE;
+    if (rest == 0) return CRYPT_OK;
+
+    ssize_t got = positional
+        ? pread_full(fd, hdr->raw + CONTAINER_HEADER_SIZE, rest, CONTAINER_HEADER_SIZE)
+        : read_full(fd, hdr->raw + CONTAINER_HEADER_SIZE, rest);
+    if (got < 0) return CRYPT_ERR_READ;
+    if ((size_t)got != rest) return CRYPT_ERR_FORMAT;
+    return CRYPT_OK;
+}
+
+// The key for an existing container: derived from the passphrase with the
+// header's scrypt salt and cost, or the plain SHA-256 key
+static int container_key(const crypt_config *cfg, const container_header *hdr, unsigned char *key){
+    if (!(hdr->raw[5] & CONTAINER_FLAG_KDF)){
+        memcpy(key, cfg->aead_key, AEAD_KEY_SIZE);
+        return CRYPT_OK;
+    }
+
+    kdf_params params;
+    const unsigned char *block = hdr->raw + CONTAINER_HEADER_SIZE;
+    memcpy(params.salt, block, KDF_SALT_SIZE);
+    params.log_n = block[16];
+    params.r = block[17];
+    params.p = block[18];
+    if (params.log_n == 0 || params.log_n > KDF_MAX_LOG_N || params.r == 0 || params.p == 0){
+        return CRYPT_ERR_FORMAT;
+    }
+
+    if (kdf_derive_key(cfg->key, cfg->key_length, &params, 0, key) != 0){
+        return CRYPT_ERR_KDF;
+    }
+    return CRYPT_OK;
+}
+
+// Grow the context buffers (a container may use a larger chunk than configured)
+static int ctx_reserve(crypt_ctx *ctx, size_t size){
+    if (ctx->buffer_size >= size) return CRYPT_OK;
+
+    unsigned char *current = realloc(ctx->current, size);
+    if (!current) return CRYPT_ERR_NOMEM;
+    ctx->current = current;
+
+    unsigned char *next = realloc(ctx->next, size);
+    if (!next) return CRYPT_ERR_NOMEM;
+    ctx->next = next;
+
+    ctx->buffer_size = size;
+    return CRYPT_OK;
+}
+
+// Encrypt from a bulkio reader that hands out one chunk per piece; the
+// size of the input is known, so no look-ahead is needed to find the last
+static int seal_bulk(bulk_reader *reader, uint64_t total, int output_descriptor,
+                     const container_header *hdr, crypt_ctx *ctx){
+    unsigned char nonce[AEAD_NONCE_SIZE];
+    unsigned char aad[CONTAINER_MAX_HEADER + 1];
+    const unsigned char *piece = NULL;
+
+    for (uint32_t index = 0; ; index++){
+        ssize_t length = bulkio_next(reader, &piece);
+        if (length < 0){
+            return CRYPT_ERR_READ;
+        }
+        ctx->bytes_in += length;
+
+        // an empty input is one empty final chunk; a piece of 0 also ends a
+        // file that shrank while we read it
+        int is_final = (length == 0 || ctx->bytes_in >= total);
+        if (!is_final && index == UINT32_MAX){
+            return CRYPT_ERR_TOOBIG;
+        }
+
+        // sealing works in place and the piece is read-only
+        if (length > 0) memcpy(ctx->current, piece, length);
+        chunk_nonce(hdr, index, nonce);
+        size_t aad_length = chunk_aad(hdr, is_final, aad);
+        aead_seal(ctx->file_key, nonce, aad, aad_length, ctx->current, length, ctx->current + length);
+
+        ssize_t record_length = length + AEAD_TAG_SIZE;
+        if (write_full(output_descriptor, ctx->current, record_length) != record_length){
+            return CRYPT_ERR_WRITE;
+        }
+        if (is_final) break;
+    }
+    return CRYPT_OK;
+}
+
+// Decrypt the records after the header from a bulkio reader, one per piece
+static int open_bulk_records(bulk_reader *reader, uint64_t total, int output_descriptor,
+                             const container_header *hdr, crypt_ctx *ctx){
+    const unsigned char *piece = NULL;
+    uint64_t consumed = 0;
+
+    for (uint32_t index = 0; ; index++){
+        ssize_t record_length = bulkio_next(reader, &piece);
+        if (record_length < 0){
+            return CRYPT_ERR_READ;
+        }
+        consumed += record_length;
+        ctx->bytes_in += record_length;
+
+        int is_final = (record_length == 0 || consumed >= total);
+
+        if (record_length > 0) memcpy(ctx->current, piece, record_length);
+        ssize_t plain_length = container_open_chunk(hdr, ctx->file_key, index, is_final, ctx->current, record_length);
+        if (plain_length < 0){
+            ctx->failed_chunk = index;
+            if (ftruncate(output_descriptor, 0) == -1) { /* output may be a pipe */ }
+            return CRYPT_ERR_AUTH;
+        }
+
+        if (write_full(output_descriptor, ctx->current, plain_length) != plain_length){
+            return CRYPT_ERR_WRITE;
+        }
+        if (is_final) break;
+    }
+    return CRYPT_OK;
+}
+
+static int chacha_encrypt(int input_descriptor, int output_descriptor, const crypt_config *cfg, crypt_ctx *ctx){
+    unsigned char nonce[AEAD_NONCE_SIZE];
+    unsigned char aad[CONTAINER_MAX_HEADER + 1];
+    container_header hdr;
+    uint32_t chunk_size = cfg->chunk_size;
+    int rc;
+
+    if ((rc = ctx_reserve(ctx, (size_t)chunk_size + AEAD_TAG_SIZE)) != CRYPT_OK) return rc;
+
+    if (cfg->kdf){
+        kdf_params params = { .log_n = cfg->kdf_log_n, .r = KDF_R, .p = KDF_P };
+        if (kdf_derive_key(cfg->key, cfg->key_length, &params, 1, ctx->file_key) != 0){
+            return CRYPT_ERR_KDF;
+        }
+        rc = container_new_header(&hdr, chunk_size, &params);
+    } else {
+        memcpy(ctx->file_key, cfg->aead_key, AEAD_KEY_SIZE);
+        rc = container_new_header(&hdr, chunk_size, NULL);
+    }
+    if (rc != CRYPT_OK) return rc;
+
+    if (write_full(output_descriptor, hdr.raw, hdr.size) != (ssize_t)hdr.size){
+        return CRYPT_ERR_WRITE;
+    }
+
+    uint64_t total;
+    bulk_reader *reader = open_bulk(cfg, input_descriptor, chunk_size, &total);
+    if (reader){
+        rc = seal_bulk(reader, total, output_descriptor, &hdr, ctx);
+        bulkio_close(reader);
+        return rc;
+    }
+
+    // two buffers so we can look one chunk ahead and flag the last one
+    unsigned char *current = ctx->current;
+    unsigned char *next = ctx->next;
+
+    ssize_t current_length = read_full(input_descriptor, current, chunk_size);
+    for (uint32_t index = 0; ; index++){
+        if (current_length < 0){
+            return CRYPT_ERR_READ;
+        }
+        ctx->bytes_in += current_length;
+
+        ssize_t next_length = 0;
+        if ((size_t)current_length == chunk_size){
+            next_length = read_full(input_descriptor, next, chunk_size);
+            if (next_length < 0){
+                return CRYPT_ERR_READ;
+            }
+        }
+        int is_final = (next_length == 0);
+
+        if (!is_final && index == UINT32_MAX){
+            return CRYPT_ERR_TOOBIG;
+        }
+
+        chunk_nonce(&hdr, index, nonce);
+        size_t aad_length = chunk_aad(&hdr, is_final, aad);
+        aead_seal(ctx->file_key, nonce, aad, aad_length, current, current_length, current + current_length);
+
+        ssize_t record_length = current_length + AEAD_TAG_SIZE;
+        if (write_full(output_descriptor, current, record_length) != record_length){
+            return CRYPT_ERR_WRITE;
+        }
+
+        if (is_final) break;
+
+        unsigned char *swap = current;
+        current = next;
+        next = swap;
+        current_length = next_length;
+    }
+
+    return CRYPT_OK;
+}
+
+static int chacha_decrypt(int input_descriptor, int output_descriptor, const crypt_config *cfg, crypt_ctx *ctx){
+    container_header hdr;
+    int rc;
+
+    ssize_t got = read_full(input_descriptor, hdr.raw, CONTAINER_HEADER_SIZE);
+    if (got < 0){
+        return CRYPT_ERR_READ;
+    }
+    if (got != CONTAINER_HEADER_SIZE || container_parse_header(&hdr) != CRYPT_OK){
+        return CRYPT_ERR_FORMAT;
+    }
+    if ((rc = container_read_rest(input_descriptor, &hdr, 0)) != CRYPT_OK) return rc;
+    if ((rc = container_key(cfg, &hdr, ctx->file_key)) != CRYPT_OK) return rc;
+    ctx->bytes_in += hdr.size;
+
+    size_t record_size = (size_t)hdr.chunk_size + AEAD_TAG_SIZE;
+    if ((rc = ctx_reserve(ctx, record_size)) != CRYPT_OK) return rc;
+
+    uint64_t total;
+    bulk_reader *reader = open_bulk(cfg, input_descriptor, record_size, &total);
+    if (reader){
+        rc = open_bulk_records(reader, total, output_descriptor, &hdr, ctx);
+        bulkio_close(reader);
+        return rc;
+    }
+
+    unsigned char *current = ctx->current;
+    unsigned char *next = ctx->next;
+
+    ssize_t current_length = read_full(input_descriptor, current, record_size);
+    for (uint32_t index = 0; ; index++){
+        if (current_length < 0){
+            return CRYPT_ERR_READ;
+        }
+        ctx->bytes_in += current_length;
+
+        ssize_t next_length = 0;
+        if ((size_t)current_length == record_size){
+            next_length = read_full(input_descriptor, next, record_size);
+            if (next_length < 0){
+                return CRYPT_ERR_READ;
+            }
+        }
+        int is_final = (next_length == 0);
+
+        ssize_t plain_length = container_open_chunk(&hdr, ctx->file_key, index, is_final, current, current_length);
+        if (plain_length < 0){
+            ctx->failed_chunk = index;
+            // never leave partially decrypted output behind
+            if (ftruncate(output_descriptor, 0) == -1) { /* output may be a pipe */ }
+            return CRYPT_ERR_AUTH;
+        }
+
+        if (write_full(output_descriptor, current, plain_length) != plain_length){
+            return CRYPT_ERR_WRITE;
+        }
+
+        if (is_final) break;
+
+        unsigned char *swap = current;
+        current = next;
+        next = swap;
+        current_length = next_length;
+    }
+
+    return CRYPT_OK;
+}
+
+// xor/rol have no state beyond the byte position (key index = offset % key_length),
+// so a range is just pread() from the offset
+static int stream_range(int input_descriptor, int output_descriptor, const crypt_config *cfg, crypt_ctx *ctx,
+                        uint64_t offset, uint64_t end){
+    unsigned char *buffer = ctx->current;
+    size_t keyIndex = offset % cfg->key_length;
+    int shift = rol_shift(cfg);
+    uint64_t pos = offset;
+
+    while (pos < end){
+        size_t want = ctx->buffer_size;
+        if (end - pos < want) want = (size_t)(end - pos);
+
+        ssize_t bytesread = pread_full(input_descriptor, buffer, want, (off_t)pos);
+        if (bytesread < 0) return CRYPT_ERR_READ;
+        if (bytesread == 0) break;
+
+        if (cfg->algorithm == ALG_XOR)
+            xor_buffer(buffer, buffer, bytesread, cfg->key, cfg->key_length, &keyIndex);
+        else
+            rol_buffer(buffer, buffer, bytesread, shift, cfg->decrypt);
+
+        if (write_full(output_descriptor, buffer, bytesread) != bytesread){
+            return CRYPT_ERR_WRITE;
+        }
+        ctx->bytes_in += bytesread;
+        pos += bytesread;
+    }
+    return CRYPT_OK;
+}
+
+// Only the chunks that overlap [offset, end) are read and verified
+static int chacha_range(int input_descriptor, int output_descriptor, const crypt_config *cfg, crypt_ctx *ctx,
+                        uint64_t offset, uint64_t end){
+    container_header hdr;
+    struct stat st;
+    int rc;
+
+    ssize_t got = pread_full(input_descriptor, hdr.raw, CONTAINER_HEADER_SIZE, 0);
+    if (got < 0) return CRYPT_ERR_READ;
+    if (got != CONTAINER_HEADER_SIZE || container_parse_header(&hdr) != CRYPT_OK){
+        return CRYPT_ERR_FORMAT;
+    }
+    if ((rc = container_read_rest(input_descriptor, &hdr, 1)) != CRYPT_OK) return rc;
+    if (fstat(input_descriptor, &st) == -1) return CRYPT_ERR_READ;
+    if ((uint64_t)st.st_size < hdr.size + AEAD_TAG_SIZE) return CRYPT_ERR_FORMAT;
+
+    uint64_t chunk_size = hdr.chunk_size;
+    uint64_t record_size = chunk_size + AEAD_TAG_SIZE;
+    uint64_t payload = (uint64_t)st.st_size - hdr.size;
+    uint64_t records = (payload + record_size - 1) / record_size;
+    if (records == 0 || payload - (records - 1) * record_size < AEAD_TAG_SIZE){
+        return CRYPT_ERR_FORMAT;
+    }
+    uint64_t plain_size = payload - records * AEAD_TAG_SIZE;
+
+    if (end > plain_size) end = plain_size;
+    if (offset >= end) return CRYPT_OK;
+
+    if ((rc = ctx_reserve(ctx, record_size)) != CRYPT_OK) return rc;
+    if ((rc = container_key(cfg, &hdr, ctx->file_key)) != CRYPT_OK) return rc;
+
+    uint64_t first = offset / chunk_size;
+    uint64_t last = (end - 1) / chunk_size;
+
+    for (uint64_t index = first; index <= last; index++){
+        off_t record_offset = (off_t)(hdr.size + index * record_size);
+        ssize_t record_length = pread_full(input_descriptor, ctx->current, record_size, record_offset);
+        if (record_length < 0) return CRYPT_ERR_READ;
+        ctx->bytes_in += record_length;
+
+        int is_final = (index == records - 1);
+        ssize_t plain_length = container_open_chunk(&hdr, ctx->file_key, (uint32_t)index, is_final,
+                                                    ctx->current, record_length);
+        if (plain_length < 0){
+            ctx->failed_chunk = (uint32_t)index;
+            if (ftruncate(output_descriptor, 0) == -1) { /* output may be a pipe */ }
+            return CRYPT_ERR_AUTH;
+        }
+
+        uint64_t chunk_start = index * chunk_size;
+        size_t from = (index == first) ? (size_t)(offset - chunk_start) : 0;
+        size_t to = (index == last) ? (size_t)(end - chunk_start) : (size_t)plain_length;
+
+        if (write_full(output_descriptor, ctx->current + from, to - from) != (ssize_t)(to - from)){
+            return CRYPT_ERR_WRITE;
+        }
+    }
+    return CRYPT_OK;
+}
+
+int crypt_range(const crypt_config *cfg, crypt_ctx *ctx, int input_descriptor, int output_descriptor,
+                uint64_t offset, uint64_t length){
+    uint64_t end = (length > UINT64_MAX - offset) ? UINT64_MAX : offset + length;
+
+    ctx->bytes_in = 0;
+    if (cfg->algorithm == ALG_CHACHA){
+        return chacha_range(input_descriptor, output_descriptor, cfg, ctx, offset, end);
+    }
+    return stream_range(input_descriptor, output_descriptor, cfg, ctx, offset, end);
+}
+
+int crypt_parse_algorithm(const char *name){
+    if (!name) return -1;
+    if (strcmp(name, "xor") == 0) return ALG_XOR;
+    if (strcmp(name, "rol") == 0) return ALG_ROL;
+    if (strcmp(name, "chacha") == 0) return ALG_CHACHA;
+    return -1;
+}
+
+int crypt_config_init(crypt_config *cfg, int algorithm, int decrypt,
+                      const unsigned char *key, size_t key_length, uint32_t chunk_size){
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->algorithm = algorithm;
+    cfg->decrypt = decrypt;
+    cfg->key = key;
+    cfg->key_length = key_length;
+    cfg->chunk_size = chunk_size;
+    cfg->kdf_log_n = KDF_DEFAULT_LOG_N;
+
+    // hash the key once here instead of once per file
+    if (algorithm == ALG_CHACHA){
+        cfg->aead_key = secure_alloc(AEAD_KEY_SIZE);
+        if (!cfg->aead_key) return CRYPT_ERR_NOMEM;
+        sha256(key, key_length, cfg->aead_key);
+    }
+    return CRYPT_OK;
+}
+
+void crypt_config_wipe(crypt_config *cfg){
+    secure_free(cfg->aead_key);
+    cfg->aead_key = NULL;
+}
+
+int crypt_ctx_init(crypt_ctx *ctx, const crypt_config *cfg){
+    memset(ctx, 0, sizeof(*ctx));
+
+    size_t size = cfg->io_size ? cfg->io_size : CRYPT_IO_SIZE;
+    if (cfg->algorithm == ALG_CHACHA){
+        size = (size_t)(cfg->decrypt ? CONTAINER_CHUNK_SIZE : cfg->chunk_size) + AEAD_TAG_SIZE;
+        ctx->file_key = secure_alloc(AEAD_KEY_SIZE);
+        if (!ctx->file_key) return CRYPT_ERR_NOMEM;
+    }
+    return ctx_reserve(ctx, size);
+}
+
+void crypt_ctx_free(crypt_ctx *ctx){
+    free(ctx->current);
+    free(ctx->next);
+    secure_free(ctx->file_key);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+int crypt_fd(const crypt_config *cfg, crypt_ctx *ctx, int input_descriptor, int output_descriptor){
+    ctx->bytes_in = 0;
+
+    if (cfg->algorithm != ALG_CHACHA){
+        uint64_t total;
+        bulk_reader *reader = open_bulk(cfg, input_descriptor, 0, &total);
+        if (reader){
+            int rc = stream_bulk(reader, output_descriptor, cfg, ctx);
+            bulkio_close(reader);
+            return rc;
+        }
+    }
+
+    switch (cfg->algorithm){
+        case ALG_XOR:
+            return xor_crypt(input_descriptor, output_descriptor, cfg, ctx);
+        case ALG_ROL:
+            return bit_crypt(input_descriptor, output_descriptor, cfg, ctx);
+        default:
+            if (cfg->decrypt)
+                return chacha_decrypt(input_descriptor, output_descriptor, cfg, ctx);
+            return chacha_encrypt(input_descriptor, output_descriptor, cfg, ctx);
+    }
+}
+
+const char *crypt_strerror(int code){
+    switch (code){
+        case CRYPT_OK:         return "success";
+        case CRYPT_ERR_READ:   return "read failed";
+        case CRYPT_ERR_WRITE:  return "write failed";
+        case CRYPT_ERR_NOMEM:  return "memory allocation failed";
+        case CRYPT_ERR_FORMAT: return "input is not a filecrypt chacha container";
+        case CRYPT_ERR_AUTH:   return "authentication failed (wrong key or corrupted file)";
+        case CRYPT_ERR_TOOBIG: return "input too large for the chunk size";
+        case CRYPT_ERR_RANDOM: return "could not get random bytes";
+        case CRYPT_ERR_KDF:    return "key derivation failed";
+        default:               return "unknown error";
+    }
+}
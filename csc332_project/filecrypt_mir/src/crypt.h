@@ -0,0 +1,84 @@
+#ifndef CRYPT_H
+#define CRYPT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "aead.h"
+#include "kdf.h"
+#include "bulkio.h"
+
+#define ALG_XOR    0
+#define ALG_ROL    1
+#define ALG_CHACHA 2
+
+#define CRYPT_IO_SIZE         (64 * 1024)
+#define CONTAINER_HEADER_SIZE 20
+#define CONTAINER_KDF_SIZE    20   // salt[16] | log2(N) | r | p | reserved
+#define CONTAINER_MAX_HEADER  (CONTAINER_HEADER_SIZE + CONTAINER_KDF_SIZE)
+#define CONTAINER_CHUNK_SIZE  (64 * 1024)
+#define CONTAINER_MAX_CHUNK   (64 * 1024 * 1024)
+
+// Return codes of the crypt functions (errno is kept for READ/WRITE)
+#define CRYPT_OK          0
+#define CRYPT_ERR_READ   -1
+#define CRYPT_ERR_WRITE  -2
+#define CRYPT_ERR_NOMEM  -3
+#define CRYPT_ERR_FORMAT -4
+#define CRYPT_ERR_AUTH   -5
+#define CRYPT_ERR_TOOBIG -6
+#define CRYPT_ERR_RANDOM -7
+#define CRYPT_ERR_KDF    -8
+
+// Everything that is the same for every file: algorithm, direction and key.
+// Read-only once built, so batch workers can share one.
+typedef struct {
+    int algorithm;
+    int decrypt;
+    const unsigned char *key;                // key material, or the passphrase with kdf
+    size_t key_length;
+    unsigned char *aead_key;                 // SHA-256 of key, for chacha (locked memory)
+    int kdf;                                 // chacha encryption: derive the key with scrypt
+    uint8_t kdf_log_n;
+    uint32_t chunk_size;                     // chacha encryption chunk size
+    size_t io_size;                          // xor/rol read size, 0 = CRYPT_IO_SIZE
+    int bulk_io;                             // --io: read regular input files with a bulkio reader
+    bulkio_options io;                       // its engine and queue depth (the piece size is set per algorithm)
+} crypt_config;
+
+// Per-thread working state: two reusable buffers plus details of the last call
+typedef struct {
+    unsigned char *current;
+    unsigned char *next;
+    size_t buffer_size;
+    unsigned char *file_key;  // per-file chacha key (locked memory)
+    uint64_t bytes_in;       // input bytes consumed by the last crypt_fd()
+    uint32_t failed_chunk;   // chunk that failed for CRYPT_ERR_AUTH
+} crypt_ctx;
+
+int crypt_parse_algorithm(const char *name);
+// Returns CRYPT_OK or CRYPT_ERR_NOMEM; crypt_config_wipe zeroes and frees the key copy
+int crypt_config_init(crypt_config *cfg, int algorithm, int decrypt,
+                      const unsigned char *key, size_t key_length, uint32_t chunk_size);
+void crypt_config_wipe(crypt_config *cfg);
+
+int crypt_ctx_init(crypt_ctx *ctx, const crypt_config *cfg);
+void crypt_ctx_free(crypt_ctx *ctx);
+
+// Encrypt or decrypt everything from input_descriptor into output_descriptor
+int crypt_fd(const crypt_config *cfg, crypt_ctx *ctx, int input_descriptor, int output_descriptor);
+
+// Decrypt only plaintext bytes [offset, offset + length) using pread(), so
+// the input must be seekable; for chacha only the chunks covering the range
+// are read and verified
+int crypt_range(const crypt_config *cfg, crypt_ctx *ctx, int input_descriptor, int output_descriptor,
+                uint64_t offset, uint64_t length);
+
+const char *crypt_strerror(int code);
+
+ssize_t read_full(int fd, unsigned char *buf, size_t len);
+ssize_t pread_full(int fd, unsigned char *buf, size_t len, off_t offset);
+ssize_t write_full(int fd, const unsigned char *buf, size_t len);
+
+#endif
@@ -5,91 +5,87 @@
 #include <string.h>     
 #include <stdint.h>     
 #include <errno.h>      
+#include <getopt.h>
+#include <limits.h>
 
-void xor_crypt(int input_descriptor, int output_descriptor, unsigned char *key, size_t key_length){
-    unsigned char buffer[4096]; 
-    ssize_t bytesread; 
-    size_t keyIndex = 0; 
+#include "crypt.h"
+#include "batch.h"
+#include "secmem.h"
+#include "agent.h"
 
-    while ((bytesread = read(input_descriptor, buffer, sizeof(buffer))) > 0) {
-        for (ssize_t i = 0; i < bytesread; i++){
-            buffer[i] ^= key[keyIndex % key_length];
-            keyIndex++; 
-        }
-        if (write(output_descriptor, buffer, bytesread) != bytesread){
-            perror("write");
-            exit(1); 
-        }
-    }
-    if (bytesread < 0){
+static void report_crypt_error(int rc, const crypt_ctx *ctx){
+    if (rc == CRYPT_ERR_READ){
         perror("read");
-        exit(1); 
-    }
-}
-
-unsigned char roll_left(unsigned char temp, int set){
-    set = set % 8;
-
-    for (int i = 0; i < set; i++) {
-        unsigned char carry = (temp & 0x80) >> 7;  // bit 7
-        temp = (unsigned char)((temp << 1) | carry);
+    } else if (rc == CRYPT_ERR_WRITE){
+        perror("write");
+    } else if (rc == CRYPT_ERR_AUTH){
+        fprintf(stderr, "Error: Chunk %u failed authentication (wrong key or corrupted file).\n", ctx->failed_chunk);
+    } else {
+        fprintf(stderr, "Error: %s.\n", crypt_strerror(rc));
     }
-    return temp;
 }
 
-unsigned char roll_right(unsigned char temp, int set){
-    set = set % 8;
-
-    for (int i = 0; i < set; i++) {
-        unsigned char carry = (temp & 0x01) << 7;  // bit 0
-        temp = (unsigned char)((temp >> 1) | carry);
-    }
-    return temp;
+// Parse a byte count with an optional K/M/G (binary) suffix
+static int parse_size(const char *text, uint64_t *value){
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (errno != 0 || end == text || text[0] == '-') return -1;
+
+    unsigned long long scale = 1;
+    if (*end == 'k' || *end == 'K') { scale = 1ULL << 10; end++; }
+    else if (*end == 'm' || *end == 'M') { scale = 1ULL << 20; end++; }
+    else if (*end == 'g' || *end == 'G') { scale = 1ULL << 30; end++; }
+    if (*end != '\0' || v > UINT64_MAX / scale) return -1;
+
+    *value = (uint64_t)(v * scale);
+    return 0;
 }
 
+// Parse a whole decimal number in [min, max]; trailing junk is an error
+static int parse_int(const char *text, long min, long max, long *value){
+    char *end;
+    errno = 0;
+    long v = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || v < min || v > max) return -1;
 
-void bit_crypt(int input_descriptor, int output_descriptor, unsigned char *key, size_t key_length, int decrypt_flag){
-    (void)key_length;
-    unsigned char buffer[4096];
-    ssize_t bytesread; 
-
-    int shift = key[0] % 8;
-    if (shift == 0) { shift = 1; }
-
-    while ((bytesread = read(input_descriptor, buffer, sizeof(buffer))) > 0) {
-        for (ssize_t i = 0; i < bytesread; i++){
-            if (decrypt_flag)
-                buffer[i] = roll_right(buffer[i], shift);
-            else
-                buffer[i] = roll_left(buffer[i], shift);
-        }
-
-        if (write(output_descriptor, buffer, bytesread) != bytesread){
-            perror("write");
-            exit(1); 
-        }
-    }
-
-    if (bytesread < 0){
-        perror("read");
-        exit(1); 
-    }
+    *value = v;
+    return 0;
 }
 
-
-
 int main(int argc, char *argv[]){
 
     int opt; 
     int inputFd, outputFd; 
     int encrypt = 0, decrypt = 0, prompt = 0;
+    int workers = 0;
 
     char *input = NULL;
     char *output = NULL;
     char *key = NULL;
     char *algorithm = NULL;
-
-    while ((opt = getopt(argc, argv, "eda:i:o:k:P")) != -1){
+    char *batch = NULL;
+    uint32_t chunk_size = CONTAINER_CHUNK_SIZE;
+    uint64_t range_offset = 0, range_length = UINT64_MAX;
+    int use_range = 0;
+    int use_kdf = 0, run_agent = 0;
+    int kdf_cost = KDF_DEFAULT_LOG_N;
+    int bulk_io = 0;
+    bulkio_options io = { .engine = BULKIO_READ };
+
+    enum { OPT_OFFSET = 256, OPT_LENGTH, OPT_KDF, OPT_KDF_COST, OPT_AGENT, OPT_IO, OPT_IO_DEPTH };
+    const struct option long_options[] = {
+        {"offset",   required_argument, NULL, OPT_OFFSET},
+        {"length",   required_argument, NULL, OPT_LENGTH},
+        {"kdf",      no_argument,       NULL, OPT_KDF},
+        {"kdf-cost", required_argument, NULL, OPT_KDF_COST},
+        {"agent",    no_argument,       NULL, OPT_AGENT},
+        {"io",       required_argument, NULL, OPT_IO},
+        {"io-depth", required_argument, NULL, OPT_IO_DEPTH},
+        {0, 0, 0, 0}
+    };
+
+    while ((opt = getopt_long(argc, argv, "eda:i:o:k:Pc:B:j:", long_options, NULL)) != -1){
         switch (opt) {
             case 'e': encrypt = 1; break;
             case 'd': decrypt = 1; break;
@@ -98,15 +94,99 @@ int main(int argc, char *argv[]){
             case 'a': algorithm = optarg; break;
             case 'k': key = optarg; break;
             case 'P': prompt = 1; break;
+            case 'c': {
+                long kib;
+                if (parse_int(optarg, 1, CONTAINER_MAX_CHUNK / 1024, &kib) != 0){
+                    fprintf(stderr, "Error: Invalid chunk size: %s KiB.\n", optarg);
+                    exit(1);
+                }
+                chunk_size = (uint32_t)kib * 1024;
+                break;
+            }
+            case 'B': batch = optarg; break;
+            case OPT_OFFSET:
+                if (parse_size(optarg, &range_offset) != 0){
+                    fprintf(stderr, "Error: Invalid offset: %s.\n", optarg);
+                    exit(1);
+                }
+                use_range = 1;
+                break;
+            case OPT_LENGTH:
+                if (parse_size(optarg, &range_length) != 0 || range_length == 0){
+                    fprintf(stderr, "Error: Invalid length: %s.\n", optarg);
+                    exit(1);
+                }
+                use_range = 1;
+                break;
+            case OPT_KDF: use_kdf = 1; break;
+            case OPT_KDF_COST: {
+                long cost;
+                if (parse_int(optarg, 1, KDF_MAX_LOG_N, &cost) != 0){
+                    fprintf(stderr, "Error: Invalid KDF cost: %s (1-%d).\n", optarg, KDF_MAX_LOG_N);
+                    exit(1);
+                }
+                kdf_cost = (int)cost;
+                use_kdf = 1;
+                break;
+            }
+            case OPT_AGENT: run_agent = 1; break;
+            case OPT_IO:
+                if (bulkio_parse_engine(optarg, &io.engine) != 0){
+                    fprintf(stderr, "Error: Invalid I/O engine: %s (uring, mmap or read).\n", optarg);
+                    exit(1);
+                }
+                bulk_io = 1;
+                break;
+            case OPT_IO_DEPTH:
+                if (bulkio_parse_depth(optarg, &io.queue_depth) != 0){
+                    fprintf(stderr, "Error: Invalid I/O queue depth: %s (1-%d).\n", optarg, BULKIO_MAX_DEPTH);
+                    exit(1);
+                }
+                bulk_io = 1;
+                break;
+            case 'j': {
+                long count;
+                if (parse_int(optarg, 1, INT_MAX, &count) != 0){
+                    fprintf(stderr, "Error: Invalid worker count: %s.\n", optarg);
+                    exit(1);
+                }
+                workers = (int)count;
+                break;
+            }
+            default:
+                // getopt has already said what was wrong with the option
+                fprintf(stderr, "Usage: %s [OPTIONS] -i infile -o outfile\n"
+                                "       %s [OPTIONS] -B directory|manifest [-o outdir] [-j N]\n"
+                                "See filecrypt(1) for the options.\n", argv[0], argv[0]);
+                exit(1);
+        }
+    }
+
+    if (run_agent){
+        char path[108];
+        if (agent_socket_path(path, sizeof(path)) != 0){
+            fprintf(stderr, "Error: Agent socket path is too long.\n");
+            exit(1);
         }
+        return agent_serve(path);
     }
 
-    if (!algorithm || (strcmp(algorithm, "xor") != 0 && strcmp(algorithm, "rol") != 0)) {
-        fprintf(stderr, "Error: You must specify -a xor or -a rol.\n");
+    int alg = crypt_parse_algorithm(algorithm);
+    if (alg < 0) {
+        fprintf(stderr, "Error: You must specify -a xor, -a rol or -a chacha.\n");
         exit(1);
     }
 
-    if (!input || !output){
+    if (batch){
+        if (input){
+            fprintf(stderr, "Error: -i cannot be used with -B.\n");
+            exit(1);
+        }
+        if (prompt && strcmp(batch, "-") == 0){
+            fprintf(stderr, "Error: -P cannot be used with a manifest on stdin.\n");
+            exit(1);
+        }
+    } else if (!input || !output){
         fprintf(stderr, "Error: You must provide input and output files.\n");
         exit(1);
     }
@@ -126,11 +206,16 @@ int main(int argc, char *argv[]){
         exit(1); 
     }
 
-    inputFd = open(input, O_RDONLY);
-    if (inputFd == -1) { perror("open input"); exit(1); }
+    if (use_range && (!decrypt || batch)){
+        fprintf(stderr, "Error: --offset/--length only work with -d on a single file.\n");
+        exit(1);
+    }
 
-    outputFd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (outputFd == -1) { perror("open output"); exit(1); }
+    // decryption reads the KDF settings from the container header
+    if (use_kdf && (alg != ALG_CHACHA || !encrypt)){
+        fprintf(stderr, "Error: --kdf only works with -e -a chacha.\n");
+        exit(1);
+    }
 
     unsigned char *keyBuf = NULL;
     size_t key_length = 0;
@@ -147,12 +232,12 @@ int main(int argc, char *argv[]){
         }
 
         lseek(keyFd, 0, SEEK_SET);
-        keyBuf = malloc(size);
+        keyBuf = secure_alloc(size);
         if (!keyBuf){ fprintf(stderr, "Error: Memory allocation failed.\n"); close(keyFd); exit(1); }
 
         if (read(keyFd, keyBuf, size) != size){
             perror("read keyFile");
-            free(keyBuf);
+            secure_free(keyBuf);
             close(keyFd);
             exit(1);
         }
@@ -176,21 +261,59 @@ int main(int argc, char *argv[]){
         key_length = strlen(temp);
         if (key_length == 0){ fprintf(stderr, "Error: Empty key not allowed.\n"); exit(1); }
 
-        keyBuf = malloc(key_length);
+        keyBuf = secure_alloc(key_length);
         if (!keyBuf){ fprintf(stderr, "Error: Memory allocation failed.\n"); exit(1); }
 
         memcpy(keyBuf, temp, key_length);
+        secure_zero(temp, sizeof(temp));
     }
 
-    if (strcmp(algorithm, "xor") == 0){
-        xor_crypt(inputFd, outputFd, keyBuf, key_length);
-    } else {
-        bit_crypt(inputFd, outputFd, keyBuf, key_length, decrypt);
+    // the key is loaded (and hashed for chacha) once, however many files follow
+    crypt_config cfg;
+    if (crypt_config_init(&cfg, alg, decrypt, keyBuf, key_length, chunk_size) != CRYPT_OK){
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        exit(1);
+    }
+    cfg.kdf = use_kdf;
+    cfg.kdf_log_n = (uint8_t)kdf_cost;
+    cfg.bulk_io = bulk_io;
+    cfg.io = io;
+
+    if (batch){
+        batch_options opts = { .source = batch, .output_dir = output, .workers = workers };
+        int status = run_batch(&cfg, &opts);
+        crypt_config_wipe(&cfg);
+        secure_free(keyBuf);
+        return status;
+    }
+
+    inputFd = open(input, O_RDONLY);
+    if (inputFd == -1) { perror("open input"); exit(1); }
+
+    outputFd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (outputFd == -1) { perror("open output"); exit(1); }
+
+    crypt_ctx ctx;
+    if (crypt_ctx_init(&ctx, &cfg) != CRYPT_OK){
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        exit(1);
+    }
+
+    int rc;
+    if (use_range)
+        rc = crypt_range(&cfg, &ctx, inputFd, outputFd, range_offset, range_length);
+    else
+        rc = crypt_fd(&cfg, &ctx, inputFd, outputFd);
+    if (rc != CRYPT_OK){
+        report_crypt_error(rc, &ctx);
+        exit(1);
     }
 
+    crypt_ctx_free(&ctx);
+    crypt_config_wipe(&cfg);
     close(inputFd);
     close(outputFd);
-    free(keyBuf);
+    secure_free(keyBuf);
 
     return 0; 
 }
\ No newline at end of file
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/random.h>
+
+#include "kdf.h"
+#include "secmem.h"
+#include "agent.h"
+
+/* ---------------- HMAC / PBKDF2 ---------------- */
+
+void hmac_sha256(const unsigned char *key, size_t key_length,
+                 const unsigned char *data, size_t length, unsigned char out[SHA256_SIZE]){
+    unsigned char block[64] = {0};
+    unsigned char inner[SHA256_SIZE];
+    sha256_ctx ctx;
+
+    if (key_length > sizeof(block)){
+        sha256(key, key_length, block);
+    } else {
+        memcpy(block, key, key_length);
+    }
+
+    for (int i = 0; i < 64; i++) block[i] ^= 0x36;
+    sha256_init(&ctx);
+    sha256_update(&ctx, block, sizeof(block));
+    sha256_update(&ctx, data, length);
+    sha256_final(&ctx, inner);
+
+    for (int i = 0; i < 64; i++) block[i] ^= 0x36 ^ 0x5c;
+    sha256_init(&ctx);
+    sha256_update(&ctx, block, sizeof(block));
+    sha256_update(&ctx, inner, sizeof(inner));
+    sha256_final(&ctx, out);
+
+    secure_zero(block, sizeof(block));
+    secure_zero(inner, sizeof(inner));
+}
+
+void pbkdf2_sha256(const unsigned char *pass, size_t pass_length,
+                   const unsigned char *salt, size_t salt_length,
+                   uint32_t iterations, unsigned char *out, size_t out_length){
+    unsigned char *msg = malloc(salt_length + 4);
+    unsigned char u[SHA256_SIZE], t[SHA256_SIZE];
+    if (!msg) abort();
+    memcpy(msg, salt, salt_length);
+
+    for (uint32_t block = 1; out_length > 0; block++){
+        msg[salt_length]     = (unsigned char)(block >> 24);
+        msg[salt_length + 1] = (unsigned char)(block >> 16);
+        msg[salt_length + 2] = (unsigned char)(block >> 8);
+        msg[salt_length + 3] = (unsigned char)block;
+
+        hmac_sha256(pass, pass_length, msg, salt_length + 4, u);
+        memcpy(t, u, sizeof(t));
+        for (uint32_t i = 1; i < iterations; i++){
+            hmac_sha256(pass, pass_length, u, sizeof(u), u);
+            for (int j = 0; j < SHA256_SIZE; j++) t[j] ^= u[j];
+        }
+
+        size_t n = out_length < SHA256_SIZE ? out_length : SHA256_SIZE;
+        memcpy(out, t, n);
+        out += n;
+        out_length -= n;
+    }
+
+    secure_zero(u, sizeof(u));
+    secure_zero(t, sizeof(t));
+    secure_zero(msg, salt_length + 4);
+    free(msg);
+}
+
+/* ---------------- scrypt ---------------- */
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+static void salsa20_8(uint32_t b[16]){
+    uint32_t x[16];
+    memcpy(x, b, sizeof(x));
+
+    for (int i = 0; i < 8; i += 2){
+        x[ 4] ^= ROTL32(x[ 0] + x[12],  7);  x[ 8] ^= ROTL32(x[ 4] + x[ 0],  9);
+        x[12] ^= ROTL32(x[ 8] + x[ 4], 13);  x[ 0] ^= ROTL32(x[12] + x[ 8], 18);
+        x[ 9] ^= ROTL32(x[ 5] + x[ 1],  7);  x[13] ^= ROTL32(x[ 9] + x[ 5],  9);
+        x[ 1] ^= ROTL32(x[13] + x[ 9], 13);  x[ 5] ^= ROTL32(x[ 1] + x[13], 18);
+        x[14] ^= ROTL32(x[10] + x[ 6],  7);  x[ 2] ^= ROTL32(x[14] + x[10],  9);
+        x[ 6] ^= ROTL32(x[ 2] + x[14], 13);  x[10] ^= ROTL32(x[ 6] + x[ 2], 18);
+        x[ 3] ^= ROTL32(x[15] + x[11],  7);  x[ 7] ^= ROTL32(x[ 3] + x[15],  9);
+        x[11] ^= ROTL32(x[ 7] + x[ 3], 13);  x[15] ^= ROTL32(x[11] + x[ 7], 18);
+        x[ 1] ^= ROTL32(x[ 0] + x[ 3],  7);  x[ 2] ^= ROTL32(x[ 1] + x[ 0],  9);
+        x[ 3] ^= ROTL32(x[ 2] + x[ 1], 13);  x[ 0] ^= ROTL32(x[ 3] + x[ 2], 18);
+        x[ 6] ^= ROTL32(x[ 5] + x[ 4],  7);  x[ 7] ^= ROTL32(x[ 6] + x[ 5],  9);
+        x[ 4] ^= ROTL32(x[ 7] + x[ 6], 13);  x[ 5] ^= ROTL32(x[ 4] + x[ 7], 18);
+        x[11] ^= ROTL32(x[10] + x[ 9],  7);  x[ 8] ^= ROTL32(x[11] + x[10],  9);
+        x[ 9] ^= ROTL32(x[ 8] + x[11], 13);  x[10] ^= ROTL32(x[ 9] + x[ 8], 18);
+        x[12] ^= ROTL32(x[15] + x[14],  7);  x[13] ^= ROTL32(x[12] + x[15],  9);
+        x[14] ^= ROTL32(x[13] + x[12], 13);  x[15] ^= ROTL32(x[14] + x[13], 18);
+    }
+
+    for (int i = 0; i < 16; i++) b[i] += x[i];
+}
+
+// BlockMix over 2r 64-byte blocks (as 32-bit words); y is scratch of the same size
+static void block_mix(uint32_t *b, uint32_t *y, uint32_t r){
+    uint32_t x[16];
+    memcpy(x, &b[(2 * r - 1) * 16], sizeof(x));
+
+    for (uint32_t i = 0; i < 2 * r; i++){
+        for (int j = 0; j < 16; j++) x[j] ^= b[i * 16 + j];
+        salsa20_8(x);
+        // even blocks go to the first half, odd ones to the second
+        memcpy(&y[((i & 1) * r + i / 2) * 16], x, sizeof(x));
+    }
+    memcpy(b, y, 128 * r);
+}
+
+static void ro_mix(unsigned char *block, uint32_t r, uint64_t n, uint32_t *v, uint32_t *x, uint32_t *y){
+    size_t words = 32 * (size_t)r;
+
+    for (size_t i = 0; i < words; i++){
+        const unsigned char *p = block + i * 4;
+        x[i] = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    for (uint64_t i = 0; i < n; i++){
+        memcpy(&v[i * words], x, words * 4);
+        block_mix(x, y, r);
+    }
+    for (uint64_t i = 0; i < n; i++){
+        uint64_t j = (((uint64_t)x[(2 * r - 1) * 16 + 1] << 32) | x[(2 * r - 1) * 16]) & (n - 1);
+        for (size_t k = 0; k < words; k++) x[k] ^= v[j * words + k];
+        block_mix(x, y, r);
+    }
+
+    for (size_t i = 0; i < words; i++){
+        unsigned char *p = block + i * 4;
+        p[0] = (unsigned char)x[i];
+        p[1] = (unsigned char)(x[i] >> 8);
+        p[2] = (unsigned char)(x[i] >> 16);
+        p[3] = (unsigned char)(x[i] >> 24);
+    }
+}
+
+int scrypt_kdf(const unsigned char *pass, size_t pass_length,
+               const unsigned char *salt, size_t salt_length,
+               uint64_t n, uint32_t r, uint32_t p, unsigned char *out, size_t out_length){
+    if (n < 2 || (n & (n - 1)) != 0 || r == 0 || p == 0 ||
+        (uint64_t)r * p >= (1u << 30) || n > SIZE_MAX / 128 / r){
+        return -1;
+    }
+
+    size_t block_size = 128 * (size_t)r;
+    unsigned char *b = malloc(block_size * p);
+    uint32_t *xy = malloc(2 * block_size);
+    uint32_t *v = malloc(block_size * n);
+    if (!b || !xy || !v){
+        free(b);
+        free(xy);
+        free(v);
+        return -1;
+    }
+
+    pbkdf2_sha256(pass, pass_length, salt, salt_length, 1, b, block_size * p);
+    for (uint32_t i = 0; i < p; i++){
+        ro_mix(b + i * block_size, r, n, v, xy, xy + 32 * r);
+    }
+    pbkdf2_sha256(pass, pass_length, b, block_size * p, 1, out, out_length);
+
+    secure_zero(b, block_size * p);
+    secure_zero(xy, 2 * block_size);
+    secure_zero(v, block_size * n);
+    free(b);
+    free(xy);
+    free(v);
+    return 0;
+}
+
+/* ---------------- key cache ---------------- */
+
+void kdf_passphrase_id(const unsigned char *pass, size_t pass_length, unsigned char id[KDF_ID_SIZE]){
+    static const unsigned char label[] = "filecrypt-kdf-id";
+    hmac_sha256(label, sizeof(label) - 1, pass, pass_length, id);
+}
+
+kdf_cache_entry *kdf_cache_find(kdf_cache_entry *entries, int count, const unsigned char id[KDF_ID_SIZE],
+                                const kdf_params *params, int match_salt){
+    for (int i = 0; i < count; i++){
+        kdf_cache_entry *e = &entries[i];
+        if (!e->used || memcmp(e->id, id, KDF_ID_SIZE) != 0) continue;
+        if (e->params.log_n != params->log_n || e->params.r != params->r || e->params.p != params->p) continue;
+        if (match_salt && memcmp(e->params.salt, params->salt, KDF_SALT_SIZE) != 0) continue;
+        return e;
+    }
+    return NULL;
+}
+
+void kdf_cache_put(kdf_cache_entry *entries, int count, int *next_victim, const unsigned char id[KDF_ID_SIZE],
+                   const kdf_params *params, const unsigned char key[AEAD_KEY_SIZE]){
+    kdf_cache_entry *e = kdf_cache_find(entries, count, id, params, 1);
+
+    if (!e){
+        for (int i = 0; i < count && !e; i++){
+            if (!entries[i].used) e = &entries[i];
+        }
+    }
+    if (!e){
+        // full: replace entries round-robin
+        e = &entries[*next_victim];
+        *next_victim = (*next_victim + 1) % count;
+    }
+
+    e->used = 1;
+    memcpy(e->id, id, KDF_ID_SIZE);
+    e->params = *params;
+    memcpy(e->key, key, AEAD_KEY_SIZE);
+}
+
+static kdf_cache_entry *local_cache = NULL;
+static int local_victim = 0;
+static pthread_mutex_t local_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int kdf_derive_key(const unsigned char *pass, size_t pass_length, kdf_params *params, int new_salt,
+                   unsigned char key[AEAD_KEY_SIZE]){
+    unsigned char id[KDF_ID_SIZE];
+    int rc = 0;
+
+    kdf_passphrase_id(pass, pass_length, id);
+
+    // held across scrypt so batch workers that need the same key wait for
+    // the first derivation instead of repeating it
+    pthread_mutex_lock(&local_lock);
+
+    if (!local_cache){
+        local_cache = secure_alloc(KDF_CACHE_ENTRIES * sizeof(kdf_cache_entry));
+    }
+
+    kdf_cache_entry *hit = local_cache ? kdf_cache_find(local_cache, KDF_CACHE_ENTRIES, id, params, !new_salt) : NULL;
+    if (hit){
+        *params = hit->params;
+        memcpy(key, hit->key, AEAD_KEY_SIZE);
+        goto done;
+    }
+
+    if (agent_fetch(id, params, !new_salt, key) != 0){
+        if (new_salt && getrandom(params->salt, KDF_SALT_SIZE, 0) != KDF_SALT_SIZE){
+            rc = -1;
+            goto done;
+        }
+        if (scrypt_kdf(pass, pass_length, params->salt, KDF_SALT_SIZE, 1ULL << params->log_n,
+                       params->r, params->p, key, AEAD_KEY_SIZE) != 0){
+            rc = -1;
+            goto done;
+        }
+        agent_store(id, params, key);
+    }
+
+    if (local_cache){
+        kdf_cache_put(local_cache, KDF_CACHE_ENTRIES, &local_victim, id, params, key);
+    }
+
+done:
+    pthread_mutex_unlock(&local_lock);
+    secure_zero(id, sizeof(id));
+    return rc;
+}
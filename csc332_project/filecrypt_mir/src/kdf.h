@@ -0,0 +1,60 @@
+#ifndef KDF_H
+#define KDF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aead.h"
+
+#define KDF_SALT_SIZE      16
+#define KDF_ID_SIZE        32
+#define KDF_DEFAULT_LOG_N  15   // scrypt N = 2^15 with r = 8: 32 MiB, ~0.1 s
+#define KDF_MAX_LOG_N      22
+#define KDF_R              8
+#define KDF_P              1
+#define KDF_CACHE_ENTRIES  64
+
+typedef struct {
+    unsigned char salt[KDF_SALT_SIZE];
+    uint8_t log_n;
+    uint8_t r;
+    uint8_t p;
+} kdf_params;
+
+typedef struct {
+    int used;
+    unsigned char id[KDF_ID_SIZE];   // identifies the passphrase, see kdf_passphrase_id
+    kdf_params params;
+    unsigned char key[AEAD_KEY_SIZE];
+} kdf_cache_entry;
+
+void hmac_sha256(const unsigned char *key, size_t key_length,
+                 const unsigned char *data, size_t length, unsigned char out[SHA256_SIZE]);
+void pbkdf2_sha256(const unsigned char *pass, size_t pass_length,
+                   const unsigned char *salt, size_t salt_length,
+                   uint32_t iterations, unsigned char *out, size_t out_length);
+
+// scrypt (RFC 7914). Returns 0, or -1 for bad parameters or no memory.
+int scrypt_kdf(const unsigned char *pass, size_t pass_length,
+               const unsigned char *salt, size_t salt_length,
+               uint64_t n, uint32_t r, uint32_t p, unsigned char *out, size_t out_length);
+
+// Cache lookups shared by the in-process cache and the agent.
+// match_salt = 0 finds any entry with the same passphrase and cost.
+void kdf_passphrase_id(const unsigned char *pass, size_t pass_length, unsigned char id[KDF_ID_SIZE]);
+kdf_cache_entry *kdf_cache_find(kdf_cache_entry *entries, int count, const unsigned char id[KDF_ID_SIZE],
+                                const kdf_params *params, int match_salt);
+void kdf_cache_put(kdf_cache_entry *entries, int count, int *next_victim, const unsigned char id[KDF_ID_SIZE],
+                   const kdf_params *params, const unsigned char key[AEAD_KEY_SIZE]);
+
+// Passphrase to a 256-bit key, reusing earlier results from, in order:
+//   1. the in-process cache (locked memory, shared by batch workers)
+//   2. the filecrypt agent, if one is listening
+//   3. scrypt itself, after which both caches are filled
+// With new_salt set (encryption) params->salt is an output: a cached salt for
+// this passphrase and cost is reused, otherwise a random one is picked.
+// Returns 0, or -1 if the key could not be derived.
+int kdf_derive_key(const unsigned char *pass, size_t pass_length, kdf_params *params, int new_salt,
+                   unsigned char key[AEAD_KEY_SIZE]);
+
+#endif
@@ -0,0 +1,107 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "secmem.h"
+
+// The table of live regions starts with this many slots and doubles when
+// full: every batch worker holds one region for its per-file key
+#define SECMEM_INITIAL_REGIONS 64
+
+typedef struct {
+    void *base;
+    size_t length;
+} secure_region;
+
+static secure_region *regions;
+static int region_capacity = 0;
+static pthread_mutex_t regions_lock = PTHREAD_MUTEX_INITIALIZER;
+static int atexit_installed = 0;
+static int mlock_warned = 0;
+
+void secure_zero(void *ptr, size_t size){
+    explicit_bzero(ptr, size);
+}
+
+void secure_wipe_all(void){
+    pthread_mutex_lock(&regions_lock);
+    for (int i = 0; i < region_capacity; i++){
+        if (regions[i].base){
+            secure_zero(regions[i].base, regions[i].length);
+        }
+    }
+    pthread_mutex_unlock(&regions_lock);
+}
+
+void *secure_alloc(size_t size){
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0) page = 4096;
+    size_t length = (size + (size_t)page - 1) / (size_t)page * (size_t)page;
+    if (length == 0) length = (size_t)page;
+
+    void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED){
+        return NULL;
+    }
+
+    if (mlock(base, length) == -1 && !mlock_warned){
+        mlock_warned = 1;
+        perror("Warning: mlock (key memory may be swapped)");
+    }
+    madvise(base, length, MADV_DONTDUMP);
+
+    pthread_mutex_lock(&regions_lock);
+    if (!atexit_installed){
+        atexit(secure_wipe_all);
+        atexit_installed = 1;
+    }
+    int slot = -1;
+    for (int i = 0; i < region_capacity; i++){
+        if (!regions[i].base){
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0){
+        int capacity = region_capacity ? region_capacity * 2 : SECMEM_INITIAL_REGIONS;
+        secure_region *grown = realloc(regions, capacity * sizeof(secure_region));
+        if (grown){
+            memset(grown + region_capacity, 0, (capacity - region_capacity) * sizeof(secure_region));
+            slot = region_capacity;
+            regions = grown;
+            region_capacity = capacity;
+        }
+    }
+    if (slot >= 0){
+        regions[slot].base = base;
+        regions[slot].length = length;
+    }
+    pthread_mutex_unlock(&regions_lock);
+
+    if (slot < 0){
+        munmap(base, length);
+        return NULL;
+    }
+    return base;
+}
+
+void secure_free(void *ptr){
+    if (!ptr) return;
+
+    pthread_mutex_lock(&regions_lock);
+    for (int i = 0; i < region_capacity; i++){
+        if (regions[i].base == ptr){
+            secure_zero(ptr, regions[i].length);
+            munlock(ptr, regions[i].length);
+            munmap(ptr, regions[i].length);
+            regions[i].base = NULL;
+            regions[i].length = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&regions_lock);
+}
@@ -0,0 +1,18 @@
+#ifndef SECMEM_H
+#define SECMEM_H
+
+#include <stddef.h>
+
+// Memory for key material: page-aligned, mlock()ed so it is never swapped,
+// excluded from core dumps, and zeroed when freed or when the process exits.
+// If mlock() is not permitted the memory is still used (with a one-time warning).
+void *secure_alloc(size_t size);
+void secure_free(void *ptr);
+
+// Zero every live region now (also runs from atexit)
+void secure_wipe_all(void);
+
+// Overwrite memory in a way the compiler cannot optimize away
+void secure_zero(void *ptr, size_t size);
+
+#endif
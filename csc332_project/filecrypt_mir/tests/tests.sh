@@ -70,8 +70,137 @@ run_test \
   "input_multi.txt" \
   "out_rol_multi.txt"
 
-# 3) XOR with prompt key (shows -P usage)
-echo "---- Test 3: XOR using prompt key (-P) on small file ----"
+# 3) ChaCha20-Poly1305 container, small chunks so the file spans several
+run_test \
+  "Test 3: CHACHA on multi-line file (key from file, 1 KiB chunks)" \
+  "$CRYPT -e -a chacha -c 1 -i input_multi.txt -o enc_chacha_multi.bin -k key.txt" \
+  "$CRYPT -d -a chacha -i enc_chacha_multi.bin -o out_chacha_multi.txt -k key.txt" \
+  "input_multi.txt" \
+  "out_chacha_multi.txt"
+
+# 4) Tampered container must be rejected
+echo "---- Test 4: CHACHA detects a modified ciphertext byte ----"
+$CRYPT -e -a chacha -i input_small.txt -o enc_chacha_tamper.bin -k key.txt
+printf 'X' | dd of=enc_chacha_tamper.bin bs=1 seek=25 conv=notrunc 2>/dev/null
+if $CRYPT -d -a chacha -i enc_chacha_tamper.bin -o out_chacha_tamper.txt -k key.txt; then
+    echo "[FAIL] Test 4: tampered file was accepted"
+else
+    echo "[PASS] Test 4: tampered file was rejected"
+fi
+echo
+
+# 5) Batch mode: one process, key loaded once, files on a worker pool
+echo "---- Test 5: CHACHA batch over a directory (-B, -j 2) ----"
+rm -rf batch_in batch_enc batch_out
+rm -f input_range.txt enc_range.bin out_range.txt expect_range.txt
+rm -f enc_chacha_kdf.bin out_chacha_kdf.txt wrong_key.txt
+rm -f input_io.txt enc_io_ref.bin enc_io.bin out_io.txt
+rm -rf many_in many_enc many_out
+mkdir batch_in
+cp input_small.txt input_multi.txt batch_in/
+$CRYPT -e -a chacha -B batch_in -o batch_enc -k key.txt -j 2
+$CRYPT -d -a chacha -B batch_enc -o batch_out -k key.txt -j 2
+if diff -r batch_in batch_out >/dev/null 2>&1; then
+    echo "[PASS] Test 5: batch round-trip matches originals"
+else
+    echo "[FAIL] Test 5: batch round-trip failed"
+fi
+echo
+
+# 6) Range decrypt: only the chunks covering the slice are read
+echo "---- Test 6: CHACHA and XOR decrypt of a byte range (--offset/--length) ----"
+seq 1 20000 > input_range.txt
+range_ok=1
+for alg in chacha xor; do
+    $CRYPT -e -a $alg -c 4 -i input_range.txt -o enc_range.bin -k key.txt
+    $CRYPT -d -a $alg -i enc_range.bin -o out_range.txt -k key.txt --offset 5000 --length 10000
+    tail -c +5001 input_range.txt | head -c 10000 > expect_range.txt
+    if ! cmp -s expect_range.txt out_range.txt; then
+        range_ok=0
+        echo "  $alg range does NOT match"
+    fi
+done
+if [ $range_ok -eq 1 ]; then
+    echo "[PASS] Test 6: decrypted ranges match the original slice"
+else
+    echo "[FAIL] Test 6: range decrypt failed"
+fi
+echo
+
+# 7) CHACHA with an scrypt-derived key
+echo "---- Test 7: CHACHA with --kdf (scrypt key derivation) ----"
+$CRYPT -e -a chacha --kdf --kdf-cost 10 -i input_multi.txt -o enc_chacha_kdf.bin -k key.txt
+$CRYPT -d -a chacha -i enc_chacha_kdf.bin -o out_chacha_kdf.txt -k key.txt
+printf 'not-the-key' > wrong_key.txt
+if diff input_multi.txt out_chacha_kdf.txt >/dev/null 2>&1 && \
+   ! $CRYPT -d -a chacha -i enc_chacha_kdf.bin -o out_chacha_kdf.txt -k wrong_key.txt 2>/dev/null; then
+    echo "[PASS] Test 7: scrypt-keyed round-trip matches and a wrong key is rejected"
+else
+    echo "[FAIL] Test 7: scrypt-keyed round-trip failed"
+fi
+echo
+
+# 8) Every --io engine must give the same result as the read() loop
+echo "---- Test 8: --io=uring|mmap|read round-trips ----"
+seq 1 300000 > input_io.txt
+io_ok=1
+for alg in xor rol chacha; do
+    $CRYPT -e -a $alg -c 16 -i input_io.txt -o enc_io_ref.bin -k key.txt
+    for engine in uring mmap read; do
+        $CRYPT -e -a $alg -c 16 -i input_io.txt -o enc_io.bin -k key.txt --io=$engine --io-depth 4
+        $CRYPT -d -a $alg -i enc_io.bin -o out_io.txt -k key.txt --io=$engine
+        if ! cmp -s input_io.txt out_io.txt; then
+            io_ok=0
+            echo "  $alg with --io=$engine does NOT round-trip"
+        fi
+        # xor/rol output does not depend on how the input was read
+        if [ $alg != chacha ] && ! cmp -s enc_io_ref.bin enc_io.bin; then
+            io_ok=0
+            echo "  $alg with --io=$engine differs from the read() loop"
+        fi
+    done
+done
+if [ $io_ok -eq 1 ]; then
+    echo "[PASS] Test 8: all I/O engines round-trip and agree"
+else
+    echo "[FAIL] Test 8: an I/O engine gave different output"
+fi
+echo
+
+# 9) More batch workers than the locked-memory table starts with (64):
+#    every chacha worker holds a locked region for its per-file key
+echo "---- Test 9: CHACHA batch with 100 workers (-j 100) ----"
+rm -rf many_in many_enc many_out
+mkdir many_in
+for i in $(seq 1 100); do
+    seq 1 $((i * 50)) > many_in/file$i.txt
+done
+$CRYPT -e -a chacha -B many_in -o many_enc -k key.txt -j 100
+$CRYPT -d -a chacha -B many_enc -o many_out -k key.txt -j 100
+if diff -r many_in many_out >/dev/null 2>&1; then
+    echo "[PASS] Test 9: 100-worker batch round-trip matches originals"
+else
+    echo "[FAIL] Test 9: 100-worker batch round-trip failed"
+fi
+echo
+
+# 10) Numeric options must be whole numbers: 64abc is not 64
+echo "---- Test 10: trailing junk in -c, --kdf-cost and -j is rejected ----"
+rejected=0
+for opts in "-c 64abc" "--kdf-cost 3x" "-j 4q"; do
+    if ! $CRYPT -e -a chacha -i input_small.txt -o enc_junk.bin -k key.txt $opts 2>/dev/null; then
+        rejected=$((rejected + 1))
+    fi
+done
+if [ "$rejected" -eq 3 ]; then
+    echo "[PASS] Test 10: all three were rejected"
+else
+    echo "[FAIL] Test 10: only $rejected of 3 were rejected"
+fi
+echo
+
+# 11) XOR with prompt key (shows -P usage)
+echo "---- Test 11: XOR using prompt key (-P) on small file ----"
 echo "You will be asked for a key twice."
 echo "Type the SAME key both times to pass the test."
 echo
@@ -83,16 +212,23 @@ echo "Decrypting with prompt key..."
 $CRYPT -d -a xor -i enc_xor_prompt.bin -o out_xor_prompt.txt -P
 
 if diff input_small.txt out_xor_prompt.txt >/dev/null 2>&1; then
-    echo "[PASS] Test 3: prompt key round-trip matches original"
+    echo "[PASS] Test 11: prompt key round-trip matches original"
 else
-    echo "[FAIL] Test 3: prompt key round-trip failed"
+    echo "[FAIL] Test 11: prompt key round-trip failed"
 fi
 echo
 
 echo "Cleaning up temporary encrypted/decrypted files..."
 rm -f enc_xor_small.bin out_xor_small.txt \
       enc_rol_multi.bin out_rol_multi.txt \
-      enc_xor_prompt.bin out_xor_prompt.txt
+      enc_chacha_multi.bin out_chacha_multi.txt \
+      enc_chacha_tamper.bin out_chacha_tamper.txt \
+      enc_xor_prompt.bin out_xor_prompt.txt enc_junk.bin
+rm -rf batch_in batch_enc batch_out
+rm -f input_range.txt enc_range.bin out_range.txt expect_range.txt
+rm -f enc_chacha_kdf.bin out_chacha_kdf.txt wrong_key.txt
+rm -f input_io.txt enc_io_ref.bin enc_io.bin out_io.txt
+rm -rf many_in many_enc many_out
 
 echo
 echo "Kept:"
@@ -1,5 +1,6 @@
 // filediffadvanced.c
-// Advanced diff tool: binary-safe compare with statistics using mmap().
+// Advanced diff tool: binary-safe compare with statistics, reading both
+// files through bulkio (mmap() by default, or io_uring / pread()).
 #define _XOPEN_SOURCE 700
 
 #include <stdio.h>
@@ -8,7 +9,6 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
 #include <signal.h>
@@ -16,11 +16,14 @@
 #include <time.h>
 #include <ctype.h>
 
+#include "bulkio.h"
+
 typedef struct {
     int brief;
     int summary;
     int text_mode;     
     size_t max_report; 
+    bulkio_options io; // --io, --io-depth
 } diff_options;
 
 typedef struct {
@@ -46,16 +49,20 @@ static void handle_sigint(int sig) {
 static void print_usage(const char *prog) {
     fprintf(stderr,
         "Usage: %s [OPTIONS] file1 file2\n"
-        "Compare two files using mmap() and show binary differences.\n\n"
+        "Compare two files and show binary differences.\n\n"
         "Options:\n"
         "  -b, --brief        Only report whether files differ (no details)\n"
         "  -s, --summary      Print summary statistics (default)\n"
         "  -t, --text         Show textual info (line/column and characters) for differences\n"
         "  -o, --offset N     Show at most N differing positions (default 10)\n"
+        "      --io=ENGINE    Read with uring, mmap (default) or read (pread threads)\n"
+        "      --io-depth N   Buffers kept in flight per file (default 8)\n"
         "  -h, --help         Show this help message\n",
         prog);
 }
 
+enum { OPT_IO = 256, OPT_IO_DEPTH };
+
 static int parse_options(int argc, char *argv[], diff_options *opt,
                          int *file_index) {
     static struct option long_opts[] = {
@@ -64,6 +71,8 @@ static int parse_options(int argc, char *argv[], diff_options *opt,
         {"text",    no_argument,       0, 't'},
         {"offset",  required_argument, 0, 'o'},
         {"help",    no_argument,       0, 'h'},
+        {"io",       required_argument, 0, OPT_IO},
+        {"io-depth", required_argument, 0, OPT_IO_DEPTH},
         {0, 0, 0, 0}
     };
 
@@ -71,6 +80,8 @@ static int parse_options(int argc, char *argv[], diff_options *opt,
     opt->summary = 0;
     opt->text_mode = 0;
     opt->max_report = 10; // default
+    memset(&opt->io, 0, sizeof(opt->io));
+    opt->io.engine = BULKIO_MMAP;
 
     int c;
     while ((c = getopt_long(argc, argv, "bsto:h", long_opts, NULL)) != -1) {
@@ -93,6 +104,18 @@ static int parse_options(int argc, char *argv[], diff_options *opt,
             opt->max_report = (size_t)v;
             break;
         }
+        case OPT_IO:
+            if (bulkio_parse_engine(optarg, &opt->io.engine) != 0) {
+                fprintf(stderr, "Invalid value for --io: %s (uring, mmap or read)\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_IO_DEPTH:
+            if (bulkio_parse_depth(optarg, &opt->io.queue_depth) != 0) {
+                fprintf(stderr, "Invalid value for --io-depth: %s (1-%d)\n", optarg, BULKIO_MAX_DEPTH);
+                return -1;
+            }
+            break;
         case 'h':
             print_usage(argv[0]);
             exit(0);
@@ -111,13 +134,13 @@ static int parse_options(int argc, char *argv[], diff_options *opt,
     return 0;
 }
 
-//comparison using mmap()
+//comparison of the common part, piece by piece
 static int diff_files(const char *path1, const char *path2,
                       const diff_options *opt) {
     int fd1 = -1, fd2 = -1;
     struct stat st1, st2;
-    unsigned char *map1 = NULL;
-    unsigned char *map2 = NULL;
+    bulk_reader *reader1 = NULL;
+    bulk_reader *reader2 = NULL;
     diff_entry *entries = NULL;
     off_t size1 = 0, size2 = 0;
 
@@ -145,23 +168,6 @@ static int diff_files(const char *path1, const char *path2,
     size1 = st1.st_size;
     size2 = st2.st_size;
 
-    if (size1 > 0) {
-        map1 = mmap(NULL, size1, PROT_READ, MAP_PRIVATE, fd1, 0);
-        if (map1 == MAP_FAILED) {
-            perror("mmap file1");
-            map1 = NULL;
-            goto error;
-        }
-    }
-    if (size2 > 0) {
-        map2 = mmap(NULL, size2, PROT_READ, MAP_PRIVATE, fd2, 0);
-        if (map2 == MAP_FAILED) {
-            perror("mmap file2");
-            map2 = NULL;
-            goto error;
-        }
-    }
-
     off_t min_size = (size1 < size2) ? size1 : size2;
     off_t max_size = (size1 > size2) ? size1 : size2;
 
@@ -183,33 +189,68 @@ static int diff_files(const char *path1, const char *path2,
         goto error;
     }
 
+    // Both readers hand out the common part in pieces of the same size,
+    // so piece k of file1 lines up with piece k of file2
+    reader1 = bulkio_open(fd1, 0, min_size, &opt->io);
+    if (!reader1) {
+        perror("open reader file1");
+        goto error;
+    }
+    reader2 = bulkio_open(fd2, 0, min_size, &opt->io);
+    if (!reader2) {
+        perror("open reader file2");
+        goto error;
+    }
+
     // For text mode: track line/column in file1
     int line = 1;
     int col  = 1;
+    off_t base = 0;
 
     // Compare common entries
-    for (off_t i = 0; i < min_size; ++i) {
-        if (map1 && map2 && map1[i] != map2[i]) {
-            diff_bytes++;
-            if (stored < opt->max_report && entries) {
-                entries[stored].offset = i;
-                entries[stored].b1 = map1[i];
-                entries[stored].b2 = map2[i];
-                entries[stored].line = line;
-                entries[stored].col = col;
-                stored++;
-            }
+    for (;;) {
+        const unsigned char *piece1, *piece2;
+        ssize_t n1 = bulkio_next(reader1, &piece1);
+        if (n1 < 0) {
+            perror("read file1");
+            goto error;
         }
+        if (n1 == 0) {
+            break;
+        }
+        ssize_t n2 = bulkio_next(reader2, &piece2);
+        if (n2 < 0) {
+            perror("read file2");
+            goto error;
+        }
+        // only shorter if a file shrank while we read it
+        ssize_t n = (n1 < n2) ? n1 : n2;
+
+        for (ssize_t j = 0; j < n; ++j) {
+            if (piece1[j] != piece2[j]) {
+                diff_bytes++;
+                if (stored < opt->max_report && entries) {
+                    entries[stored].offset = base + j;
+                    entries[stored].b1 = piece1[j];
+                    entries[stored].b2 = piece2[j];
+                    entries[stored].line = line;
+                    entries[stored].col = col;
+                    stored++;
+                }
+            }
 
-        // Next line/column based on file1 (for text mode)
-        if (map1) {
-            if (map1[i] == '\n') {
+            // Next line/column based on file1 (for text mode)
+            if (piece1[j] == '\n') {
                 line++;
                 col = 1;
             } else {
                 col++;
             }
         }
+        base += n;
+        if (n1 != n2) {
+            break;
+        }
     }
 
     // Extra bytes in longer file are also differences
@@ -292,8 +333,8 @@ static int diff_files(const char *path1, const char *path2,
 
     // Cleanup
     free(entries);
-    if (map1 && size1 > 0) munmap(map1, size1);
-    if (map2 && size2 > 0) munmap(map2, size2);
+    bulkio_close(reader1);
+    bulkio_close(reader2);
     if (fd1 != -1) close(fd1);
     if (fd2 != -1) close(fd2);
 
@@ -301,8 +342,8 @@ static int diff_files(const char *path1, const char *path2,
 
 error:
     if (entries) free(entries);
-    if (map1 && size1 > 0) munmap(map1, size1);
-    if (map2 && size2 > 0) munmap(map2, size2);
+    bulkio_close(reader1);
+    bulkio_close(reader2);
     if (fd1 != -1) close(fd1);
     if (fd2 != -1) close(fd2);
     return 2;
@@ -328,4 +369,4 @@ int main(int argc, char *argv[]) {
     const char *file2 = argv[file_index + 1];
 
     return diff_files(file1, file2, &opt);
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -53,8 +53,27 @@ $CMD no_read.txt t1_a.txt
 echo "Exit code: $?"
 chmod 644 no_read.txt
 
-# --- TEST 8: SIGINT interruption ---
-echo -e "\nTEST 8: SIGINT interruption (Press CTRL+C)"
+# --- TEST 8: I/O engines ---
+echo -e "\nTEST 8: Same report with --io=uring, --io=mmap and --io=read"
+seq 1 400000 > io_a.txt
+cp io_a.txt io_b.txt
+printf "X" | dd of=io_b.txt bs=1 seek=2000000 count=1 conv=notrunc 2>/dev/null
+for engine in uring mmap read; do
+    $CMD -t -o 3 --io=$engine --io-depth 2 io_a.txt io_b.txt | grep -v -e "time" -e "Throughput" > io_$engine.out
+    echo "--io=$engine exit code: ${PIPESTATUS[0]}"
+done
+if cmp -s io_uring.out io_mmap.out && cmp -s io_read.out io_mmap.out; then
+    echo "All engines agree:"
+    cat io_mmap.out
+else
+    echo "Engines DISAGREE"
+fi
+$CMD --io=bogus io_a.txt io_b.txt
+echo "Exit code: $?"
+rm -f io_a.txt io_b.txt io_uring.out io_mmap.out io_read.out
+
+# --- TEST 9: SIGINT interruption ---
+echo -e "\nTEST 9: SIGINT interruption (Press CTRL+C)"
 yes "abcdefghij" | head -n 200000 > big1.txt
 cp big1.txt big2.txt
 printf "X" | dd of=big2.txt bs=1 seek=0 count=1 conv=notrunc 2>/dev/null
@@ -4,10 +4,12 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/mman.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
+#include <getopt.h>
+
+#include "bulkio.h"
 
 static volatile sig_atomic_t stop_requested = 0;
 
@@ -26,6 +28,14 @@ struct LogStats {
     long pattern_matches;
 };
 
+// The file is read in pieces: a line cut off at the end of one piece is
+// kept here until the next piece (or the end of the file) completes it
+struct LineCarry {
+    char *data;
+    size_t length;
+    size_t capacity;
+};
+
 static int date_mode = DATE_NONE;
 static char date_filter[11]; // "YYYY-MM-DD" + '\0'
 
@@ -140,44 +150,81 @@ static void process_line(const char *line, struct LogStats *stats, const char *p
     }
 }
 
-// Analyze the log file content stored in memory 
-static void analyze_buffer(const char *buf, size_t size,
-                           struct LogStats *stats, const char *pattern) {
-    size_t line_start = 0;
+// Copy one line (without its '\n') so it can be NUL-terminated, then count it
+static int analyze_line(const char *start, size_t line_len,
+                        struct LogStats *stats, const char *pattern) {
+    if (line_len == 0) {
+        // Empty line 
+        return 0;
+    }
 
-    for (size_t i = 0; i <= size && !stop_requested; i++) {
-        char c;
-        if (i == size) {
-            // newline at the end of file
-            c = '\n';
-        } else {
-            c = buf[i];
-        }
+    char *line_copy = (char *)malloc(line_len + 1);
+    if (line_copy == NULL) {
+        fprintf(stderr, "malloc failed while copying line\n");
+        return -1;
+    }
 
-        if (c == '\n') {
-            size_t line_len = i - line_start;
-            if (line_len > 0) {
-                char *line_copy = (char *)malloc(line_len + 1);
-                if (line_copy == NULL) {
-                    fprintf(stderr, "malloc failed while copying line\n");
-                    return;
-                }
+    memcpy(line_copy, start, line_len);
+    line_copy[line_len] = '\0';
+
+    trim_newline(line_copy);
 
-                memcpy(line_copy, buf + line_start, line_len);
-                line_copy[line_len] = '\0';
+    process_line(line_copy, stats, pattern);
 
-                trim_newline(line_copy);
+    free(line_copy);
+    return 0;
+}
+
+static int carry_append(struct LineCarry *carry, const char *data, size_t size) {
+    if (size == 0) {
+        return 0;   // a piece that ended on '\n': nothing to carry
+    }
+    if (carry->length + size > carry->capacity) {
+        size_t capacity = carry->capacity ? carry->capacity : 256;
+        while (capacity < carry->length + size) {
+            capacity *= 2;
+        }
+        char *grown = realloc(carry->data, capacity);
+        if (grown == NULL) {
+            fprintf(stderr, "realloc failed while joining a line\n");
+            return -1;
+        }
+        carry->data = grown;
+        carry->capacity = capacity;
+    }
+    memcpy(carry->data + carry->length, data, size);
+    carry->length += size;
+    return 0;
+}
 
-                process_line(line_copy, stats, pattern);
+// Analyze one piece of the log file; the last line may continue in the next
+static int analyze_piece(const char *buf, size_t size, struct LineCarry *carry,
+                         struct LogStats *stats, const char *pattern) {
+    size_t line_start = 0;
 
-                free(line_copy);
-            } else {
-                // Empty line 
-            }
+    for (size_t i = 0; i < size && !stop_requested; i++) {
+        if (buf[i] != '\n') {
+            continue;
+        }
 
-            line_start = i + 1;
+        if (carry->length > 0) {
+            // the first line of this piece started in an earlier one
+            if (carry_append(carry, buf, i) != 0 ||
+                analyze_line(carry->data, carry->length, stats, pattern) != 0) {
+                return -1;
+            }
+            carry->length = 0;
+        } else if (analyze_line(buf + line_start, i - line_start, stats, pattern) != 0) {
+            return -1;
         }
+
+        line_start = i + 1;
+    }
+
+    if (stop_requested) {
+        return 0;
     }
+    return carry_append(carry, buf + line_start, size - line_start);
 }
 
 static void print_usage(const char *progname) {
@@ -196,6 +243,8 @@ static void print_usage(const char *progname) {
         "  -E                Only include ERROR lines\n"
         "  -W                Only include WARNING lines\n"
         "  -I                Only include INFO lines\n"
+        "  --io=<engine>     Read with uring, mmap (default) or read (pread threads)\n"
+        "  --io-depth <n>    Buffers kept in flight (default 8)\n"
         "\n"
         "Examples:\n"
         "  %s -f master_log.txt\n"
@@ -212,9 +261,20 @@ int main(int argc, char *argv[]) {
     // Initialize date_filter to empty string
     date_filter[0] = '\0';
 
+    bulkio_options io;
+    memset(&io, 0, sizeof(io));
+    io.engine = BULKIO_MMAP;
+
+    enum { OPT_IO = 256, OPT_IO_DEPTH };
+    static const struct option long_options[] = {
+        {"io",       required_argument, NULL, OPT_IO},
+        {"io-depth", required_argument, NULL, OPT_IO_DEPTH},
+        {NULL, 0, NULL, 0}
+    };
+
     int opt;
-    // Options: f, s, d, b, a, E, W, I, p
-    while ((opt = getopt(argc, argv, "f:s:d:b:a:EWIp")) != -1) {
+    // Options: f, s, d, b, a, E, W, I, p, --io, --io-depth
+    while ((opt = getopt_long(argc, argv, "f:s:d:b:a:EWIp", long_options, NULL)) != -1) {
         switch (opt) {
             case 'f':
                 filename = optarg;
@@ -249,6 +309,18 @@ int main(int argc, char *argv[]) {
             case 'p':
                 print_matching_lines = 1;
                 break;
+            case OPT_IO:
+                if (bulkio_parse_engine(optarg, &io.engine) != 0) {
+                    fprintf(stderr, "Error: unknown I/O engine '%s' (uring, mmap or read).\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_IO_DEPTH:
+                if (bulkio_parse_depth(optarg, &io.queue_depth) != 0) {
+                    fprintf(stderr, "Error: I/O queue depth must be 1-%d.\n", BULKIO_MAX_DEPTH);
+                    return EXIT_FAILURE;
+                }
+                break;
             default:
                 print_usage(argv[0]);
                 return EXIT_FAILURE;
@@ -290,26 +362,46 @@ int main(int argc, char *argv[]) {
         return EXIT_SUCCESS;
     }
 
-    size_t filesize = (size_t)st.st_size;
-
-    // Map the file into memory
-    char *mapped = mmap(NULL, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (mapped == MAP_FAILED) {
-        fprintf(stderr, "Error: mmap failed on '%s': %s\n", filename, strerror(errno));
+    // Read the file in large pieces (a window of a mapping with mmap)
+    bulk_reader *reader = bulkio_open(fd, 0, st.st_size, &io);
+    if (reader == NULL) {
+        fprintf(stderr, "Error: cannot read '%s': %s\n", filename, strerror(errno));
         close(fd);
         return EXIT_FAILURE;
     }
 
     struct LogStats stats;
     memset(&stats, 0, sizeof(stats));
+    struct LineCarry carry;
+    memset(&carry, 0, sizeof(carry));
+
+    const unsigned char *piece;
+    ssize_t got = 0;
+    int failed = 0;
+    while (!stop_requested && (got = bulkio_next(reader, &piece)) > 0) {
+        if (analyze_piece((const char *)piece, (size_t)got, &carry, &stats, pattern) != 0) {
+            failed = 1;
+            break;
+        }
+    }
+    if (!stop_requested && !failed && got < 0) {
+        fprintf(stderr, "Error: read failed on '%s': %s\n", filename, strerror(errno));
+        failed = 1;
+    }
 
-    analyze_buffer(mapped, filesize, &stats, pattern);
-
-    if (munmap(mapped, filesize) == -1) {
-        fprintf(stderr, "Warning: munmap failed: %s\n", strerror(errno));
+    // the last line need not end with a newline
+    if (!stop_requested && !failed) {
+        analyze_line(carry.data, carry.length, &stats, pattern);
     }
+
+    free(carry.data);
+    bulkio_close(reader);
     close(fd);
 
+    if (failed) {
+        return EXIT_FAILURE;
+    }
+
     printf("Total lines            : %ld\n", stats.total_lines);
     printf("Lines with 'ERROR'     : %ld\n", stats.error_lines);
     printf("Lines with 'WARNING'   : %ld\n", stats.warning_lines);
@@ -51,6 +51,21 @@ echo "======================================="
 $PROGRAM -f "$LOGFILE" -E -p -s ERROR
 echo
 
+echo "======================================="
+echo " Test 9: Same counts with every --io engine "
+echo "======================================="
+for engine in uring mmap read; do
+    $PROGRAM -f "$LOGFILE" -W -s User --io=$engine --io-depth 2 > io_$engine.out
+done
+if cmp -s io_uring.out io_mmap.out && cmp -s io_read.out io_mmap.out; then
+    echo "All engines agree:"
+    cat io_mmap.out
+else
+    echo "Engines DISAGREE"
+fi
+rm -f io_uring.out io_mmap.out io_read.out
+echo
+
 echo "======================================="
 echo " Error Test 1: Missing -f Option "
 echo "======================================="
@@ -0,0 +1,238 @@
+#include "cgroup.h"
+#include "procfile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+
+// mount points are looked up once; "" = not mounted
+static char v2_mount[4096];
+static char v1_memory_mount[4096];
+static int mounts_loaded = 0;
+
+// Return the n-th blank-separated word of a line (0-based)
+static const char *line_word(const char *line, const char *end, int n, size_t *length) {
+    const char *pos = line;
+    for (int i = 0; pos < end; i++) {
+        while (pos < end && *pos == ' ')
+            pos++;
+        const char *word = pos;
+        while (pos < end && *pos != ' ')
+            pos++;
+        if (i == n) {
+            *length = pos - word;
+            return word;
+        }
+    }
+    *length = 0;
+    return NULL;
+}
+
+static void copy_word(char *out, size_t size, const char *word, size_t length) {
+    if (length >= size)
+        length = size - 1;
+    memcpy(out, word, length);
+    out[length] = '\0';
+}
+
+// /proc/self/mountinfo: "id parent dev root mountpoint options [tags] - fstype source superoptions"
+static void load_mounts(void) {
+    ProcBuffer buffer = {0};
+    mounts_loaded = 1;
+    if (proc_buffer_read_file(&buffer, AT_FDCWD, "/proc/self/mountinfo") < 0)
+        return;
+
+    const char *pos = buffer.data;
+    const char *end = buffer.data + buffer.length;
+    while (pos < end) {
+        const char *line_end = memchr(pos, '\n', end - pos);
+        if (!line_end)
+            line_end = end;
+
+        const char *separator = strstr(pos, " - ");
+        if (separator && separator < line_end) {
+            size_t mount_length, type_length, options_length;
+            const char *mount = line_word(pos, line_end, 4, &mount_length);
+            const char *type = line_word(separator + 3, line_end, 0, &type_length);
+            const char *options = line_word(separator + 3, line_end, 2, &options_length);
+
+            if (mount && type && type_length == 7 && memcmp(type, "cgroup2", 7) == 0 && !v2_mount[0]) {
+                copy_word(v2_mount, sizeof(v2_mount), mount, mount_length);
+            } else if (mount && type && options && type_length == 6 && memcmp(type, "cgroup", 6) == 0 &&
+                       !v1_memory_mount[0]) {
+                // the controllers are listed in the super options, e.g. "rw,memory"
+                char list[256];
+                copy_word(list, sizeof(list), options, options_length);
+                for (char *save = NULL, *option = strtok_r(list, ",", &save); option;
+                     option = strtok_r(NULL, ",", &save)) {
+                    if (strcmp(option, "memory") == 0)
+                        copy_word(v1_memory_mount, sizeof(v1_memory_mount), mount, mount_length);
+                }
+            }
+        }
+        pos = line_end + 1;
+    }
+    proc_buffer_free(&buffer);
+}
+
+int cgroup_v2_mount(char *path, size_t size) {
+    if (!mounts_loaded)
+        load_mounts();
+    if (!v2_mount[0])
+        return -1;
+    snprintf(path, size, "%s", v2_mount);
+    return 0;
+}
+
+int cgroup_v1_memory_mount(char *path, size_t size) {
+    if (!mounts_loaded)
+        load_mounts();
+    if (!v1_memory_mount[0])
+        return -1;
+    snprintf(path, size, "%s", v1_memory_mount);
+    return 0;
+}
+
+static int dir_has(const char *dir, const char *file) {
+    char path[4352];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    return access(path, F_OK) == 0;
+}
+
+int cgroup_memory_version(const char *dir) {
+    if (dir_has(dir, "memory.events"))
+        return 2;
+    if (dir_has(dir, "memory.pressure_level"))
+        return 1;
+    return -1;
+}
+
+// /proc/<pid>/cgroup: "0::/path" for v2, "N:controller,...:/path" for v1
+int cgroup_memory_dir(int pid, char *path, size_t size) {
+    char file_path[64];
+    char v2_path[4096] = "", v1_path[4096] = "";
+    ProcBuffer buffer = {0};
+
+    snprintf(file_path, sizeof(file_path), "/proc/%d/cgroup", pid);
+    if (proc_buffer_read_file(&buffer, AT_FDCWD, file_path) < 0)
+        return -1;
+
+    const char *pos = buffer.data;
+    const char *end = buffer.data + buffer.length;
+    while (pos < end) {
+        const char *line_end = memchr(pos, '\n', end - pos);
+        if (!line_end)
+            line_end = end;
+        const char *first = memchr(pos, ':', line_end - pos);
+        const char *second = first ? memchr(first + 1, ':', line_end - first - 1) : NULL;
+        if (second) {
+            size_t controllers_length = second - first - 1;
+            if (controllers_length == 0) {
+                copy_word(v2_path, sizeof(v2_path), second + 1, line_end - second - 1);
+            } else {
+                char list[256];
+                copy_word(list, sizeof(list), first + 1, controllers_length);
+                for (char *save = NULL, *name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+                    if (strcmp(name, "memory") == 0)
+                        copy_word(v1_path, sizeof(v1_path), second + 1, line_end - second - 1);
+                }
+            }
+        }
+        pos = line_end + 1;
+    }
+    proc_buffer_free(&buffer);
+
+    char mount[4096];
+    if (v2_path[0] && cgroup_v2_mount(mount, sizeof(mount)) == 0) {
+        snprintf(path, size, "%s%s", mount, v2_path);
+        if (cgroup_memory_version(path) == 2)
+            return 2;
+    }
+    if (v1_path[0] && cgroup_v1_memory_mount(mount, sizeof(mount)) == 0) {
+        snprintf(path, size, "%s%s", mount, v1_path);
+        if (cgroup_memory_version(path) == 1)
+            return 1;
+    }
+    return -1;
+}
+
+int cgroup_resolve(const char *name, char *path, size_t size) {
+    char mount[4096];
+
+    if (name[0] == '/' && cgroup_memory_version(name) > 0) {
+        snprintf(path, size, "%s", name);
+        return cgroup_memory_version(path);
+    }
+    while (name[0] == '/')
+        name++;
+    if (cgroup_v2_mount(mount, sizeof(mount)) == 0) {
+        snprintf(path, size, "%s/%s", mount, name);
+        if (cgroup_memory_version(path) == 2)
+            return 2;
+    }
+    if (cgroup_v1_memory_mount(mount, sizeof(mount)) == 0) {
+        snprintf(path, size, "%s/%s", mount, name);
+        if (cgroup_memory_version(path) == 1)
+            return 1;
+    }
+    return -1;
+}
+
+int cgroup_read_pids(const char *dir, int **pids) {
+    char path[4352];
+    ProcBuffer buffer = {0};
+
+    *pids = NULL;
+    snprintf(path, sizeof(path), "%s/cgroup.procs", dir);
+    if (proc_buffer_read_file(&buffer, AT_FDCWD, path) < 0)
+        return -1;
+
+    int count = 0, capacity = 0;
+    const char *pos = buffer.data;
+    const char *end = buffer.data + buffer.length;
+    while (pos < end) {
+        char *next;
+        long pid = strtol(pos, &next, 10);
+        if (next == pos)
+            break;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            int *grown = realloc(*pids, capacity * sizeof(int));
+            if (!grown) {
+                free(*pids);
+                *pids = NULL;
+                proc_buffer_free(&buffer);
+                return -1;
+            }
+            *pids = grown;
+        }
+        (*pids)[count++] = (int)pid;
+        pos = next;
+    }
+    proc_buffer_free(&buffer);
+    return count;
+}
+
+int cgroup_memory_hierarchy(char *path, size_t size) {
+    char file_path[4352];
+    ProcBuffer buffer = {0};
+
+    // v2 when its root lists the memory controller, otherwise the v1 memory mount
+    if (cgroup_v2_mount(path, size) == 0) {
+        snprintf(file_path, sizeof(file_path), "%s/cgroup.controllers", path);
+        if (proc_buffer_read_file(&buffer, AT_FDCWD, file_path) > 0) {
+            for (char *save = NULL, *name = strtok_r(buffer.data, " \n", &save); name;
+                 name = strtok_r(NULL, " \n", &save)) {
+                if (strcmp(name, "memory") == 0) {
+                    proc_buffer_free(&buffer);
+                    return 2;
+                }
+            }
+        }
+        proc_buffer_free(&buffer);
+    }
+    if (cgroup_v1_memory_mount(path, size) == 0)
+        return 1;
+    return -1;
+}
@@ -0,0 +1,33 @@
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <stddef.h>
+
+// Mount point of the cgroup v2 hierarchy; 0 on success, -1 if not mounted
+int cgroup_v2_mount(char *path, size_t size);
+
+// Mount point of the cgroup v1 hierarchy that has the memory controller
+int cgroup_v1_memory_mount(char *path, size_t size);
+
+// Root of the hierarchy that carries the memory controller: the v2 mount
+// when memory is enabled there (returns 2), else the v1 memory mount (1)
+int cgroup_memory_hierarchy(char *path, size_t size);
+
+// 2 if dir is a cgroup v2 directory with the memory controller enabled
+// (it has memory.events), 1 if it is a v1 memory cgroup, -1 otherwise
+int cgroup_memory_version(const char *dir);
+
+// Directory of the memory cgroup of a process: the v2 cgroup when the memory
+// controller is enabled there, otherwise its v1 memory cgroup. Returns the
+// version like cgroup_memory_version.
+int cgroup_memory_dir(int pid, char *path, size_t size);
+
+// An absolute directory is used as is; anything else is taken relative to
+// the v2 mount (or the v1 memory mount when v2 has no such directory)
+int cgroup_resolve(const char *name, char *path, size_t size);
+
+// PIDs listed in dir/cgroup.procs (direct members only); returns the count
+// or -1, and *pids must be freed
+int cgroup_read_pids(const char *dir, int **pids);
+
+#endif
@@ -0,0 +1,555 @@
+#include "cgview.h"
+#include "cgroup.h"
+#include "sampler.h"
+#include "scan.h"
+#include "helpers.h"
+#include "output.h"
+#include "procfile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#define MAX_WORKERS 64
+#define PID_TABLE_MIN 1024
+
+// memory.stat values, in bytes
+typedef struct {
+    long anon;
+    long file;
+    long shmem;
+    long swap;
+    long kernel;
+} CgroupStat;
+
+static const FieldSpec v2_stat_fields[] = {
+    {"anon",   offsetof(CgroupStat, anon)},
+    {"file",   offsetof(CgroupStat, file)},
+    {"shmem",  offsetof(CgroupStat, shmem)},
+    {"kernel", offsetof(CgroupStat, kernel)},
+};
+
+// v1 usage is hierarchical, so use the total_ (hierarchical) counters too
+static const FieldSpec v1_stat_fields[] = {
+    {"total_rss",   offsetof(CgroupStat, anon)},
+    {"total_cache", offsetof(CgroupStat, file)},
+    {"total_shmem", offsetof(CgroupStat, shmem)},
+    {"total_swap",  offsetof(CgroupStat, swap)},
+};
+
+typedef struct {
+    char *path;            // relative to the mount ("/" for the root)
+    int dir_fd;
+    int parent;            // index into the node array, -1 for the walk root
+    nlink_t links;         // 2 + subdirectories when the tree was walked
+
+    long usage;            // bytes
+    long limit;            // bytes, -1 = unlimited
+    CgroupStat stat;
+    int readable;          // the files were read on this pass
+
+    int *pids;             // direct members
+    int pid_count;
+    int pid_capacity;
+
+    int procs;             // processes here and below
+    long rss;              // kB, summed over procs
+    long pss;
+} CgroupNode;
+
+typedef struct {
+    int version;
+    char mount[4096];      // mount point of the hierarchy
+    char root[4096];       // absolute directory the walk starts at
+    CgroupNode *nodes;
+    int count;
+    int capacity;
+    int walks;             // how many times the tree was (re)built
+} CgroupTree;
+
+typedef struct {
+    CgroupTree *tree;
+    atomic_int next;
+} ReadJob;
+
+static void free_nodes(CgroupTree *tree) {
+    for (int i = 0; i < tree->count; i++) {
+        free(tree->nodes[i].path);
+        free(tree->nodes[i].pids);
+        if (tree->nodes[i].dir_fd != -1)
+            close(tree->nodes[i].dir_fd);
+    }
+    tree->count = 0;
+}
+
+static int add_node(CgroupTree *tree, const char *path, int dir_fd, int parent) {
+    if (tree->count == tree->capacity) {
+        int capacity = tree->capacity ? tree->capacity * 2 : 256;
+        CgroupNode *nodes = realloc(tree->nodes, capacity * sizeof(CgroupNode));
+        if (!nodes)
+            return -1;
+        tree->nodes = nodes;
+        tree->capacity = capacity;
+    }
+
+    struct stat info;
+    CgroupNode *node = &tree->nodes[tree->count];
+    memset(node, 0, sizeof(*node));
+    node->path = strdup(path);
+    node->dir_fd = dir_fd;
+    node->parent = parent;
+    node->links = fstat(dir_fd, &info) == 0 ? info.st_nlink : 0;
+    if (!node->path)
+        return -1;
+    return tree->count++;
+}
+
+// Depth-first, so a parent always comes before its children
+static int walk_dir(CgroupTree *tree, int index) {
+    int fd = openat(tree->nodes[index].dir_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return 0;
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return 0;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_type != DT_DIR || entry->d_name[0] == '.')
+            continue;
+
+        int child_fd = openat(tree->nodes[index].dir_fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (child_fd == -1)
+            continue;
+
+        const char *parent_path = tree->nodes[index].path;
+        size_t length = strlen(parent_path) + strlen(entry->d_name) + 2;
+        char *path = malloc(length);
+        if (!path) {
+            close(child_fd);
+            closedir(dir);
+            return -1;
+        }
+        snprintf(path, length, "%s%s%s", parent_path,
+                 strcmp(parent_path, "/") == 0 ? "" : "/", entry->d_name);
+
+        int child = add_node(tree, path, child_fd, index);
+        free(path);
+        if (child < 0) {
+            close(child_fd);
+            closedir(dir);
+            return -1;
+        }
+        if (walk_dir(tree, child) != 0) {
+            closedir(dir);
+            return -1;
+        }
+    }
+    closedir(dir);
+    return 0;
+}
+
+static int build_tree(CgroupTree *tree) {
+    free_nodes(tree);
+
+    int fd = open(tree->root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "Couldn't open %s: %s\n", tree->root, strerror(errno));
+        return -1;
+    }
+
+    // show paths relative to the mount, like /proc/<pid>/cgroup does
+    const char *relative = tree->root;
+    size_t mount_length = strlen(tree->mount);
+    if (strncmp(tree->root, tree->mount, mount_length) == 0)
+        relative = tree->root[mount_length] ? tree->root + mount_length : "/";
+
+    if (add_node(tree, relative, fd, -1) < 0 || walk_dir(tree, 0) != 0) {
+        fprintf(stderr, "Out of memory walking %s\n", tree->root);
+        return -1;
+    }
+    tree->walks++;
+    return 0;
+}
+
+// "key value" lines (memory.stat has no colons)
+static void parse_stat(const char *data, size_t length, const FieldSpec *fields, int field_count, void *out) {
+    const char *pos = data;
+    const char *end = data + length;
+    while (pos < end) {
+        const char *line_end = memchr(pos, '\n', end - pos);
+        if (!line_end)
+            line_end = end;
+        const char *space = memchr(pos, ' ', line_end - pos);
+        if (space) {
+            size_t key_length = space - pos;
+            for (int i = 0; i < field_count; i++) {
+                if (strlen(fields[i].key) == key_length && memcmp(pos, fields[i].key, key_length) == 0) {
+                    *(long *)((char *)out + fields[i].offset) = strtol(space + 1, NULL, 10);
+                    break;
+                }
+            }
+        }
+        pos = line_end + 1;
+    }
+}
+
+static long read_number(int dir_fd, const char *name, ProcBuffer *buffer) {
+    if (proc_buffer_read_file(buffer, dir_fd, name) <= 0)
+        return -1;
+    if (strncmp(buffer->data, "max", 3) == 0)
+        return -1;
+    long long value = strtoll(buffer->data, NULL, 10);
+    // v1 reports "no limit" as a huge page-aligned number
+    return value >= (1LL << 62) ? -1 : (long)value;
+}
+
+static void read_pids(CgroupNode *node, ProcBuffer *buffer) {
+    node->pid_count = 0;
+    if (proc_buffer_read_file(buffer, node->dir_fd, "cgroup.procs") <= 0)
+        return;
+
+    const char *pos = buffer->data;
+    for (;;) {
+        char *next;
+        long pid = strtol(pos, &next, 10);
+        if (next == pos)
+            break;
+        if (node->pid_count == node->pid_capacity) {
+            int capacity = node->pid_capacity ? node->pid_capacity * 2 : 16;
+            int *pids = realloc(node->pids, capacity * sizeof(int));
+            if (!pids)
+                break;
+            node->pids = pids;
+            node->pid_capacity = capacity;
+        }
+        node->pids[node->pid_count++] = (int)pid;
+        pos = next;
+    }
+}
+
+// One fstat per cgroup instead of a readdir: a directory's link count is 2 +
+// its subdirectories, so a change means cgroups were created or removed below
+// it (and a removed cgroup's count drops to 0)
+static int tree_changed(const CgroupTree *tree) {
+    struct stat info;
+    for (int i = 0; i < tree->count; i++) {
+        if (fstat(tree->nodes[i].dir_fd, &info) != 0 || info.st_nlink != tree->nodes[i].links)
+            return 1;
+    }
+    return 0;
+}
+
+static void read_node(CgroupTree *tree, CgroupNode *node, ProcBuffer *buffer) {
+    memset(&node->stat, 0, sizeof(node->stat));
+    node->readable = 0;
+
+    if (tree->version == 2) {
+        node->usage = read_number(node->dir_fd, "memory.current", buffer);
+        node->limit = read_number(node->dir_fd, "memory.max", buffer);
+        long swap = read_number(node->dir_fd, "memory.swap.current", buffer);
+        ssize_t length = proc_buffer_read_file(buffer, node->dir_fd, "memory.stat");
+        if (length > 0)
+            parse_stat(buffer->data, length, v2_stat_fields, FIELD_COUNT(v2_stat_fields), &node->stat);
+        node->stat.swap = swap > 0 ? swap : 0;
+    } else {
+        node->usage = read_number(node->dir_fd, "memory.usage_in_bytes", buffer);
+        node->limit = read_number(node->dir_fd, "memory.limit_in_bytes", buffer);
+        ssize_t length = proc_buffer_read_file(buffer, node->dir_fd, "memory.stat");
+        if (length > 0)
+            parse_stat(buffer->data, length, v1_stat_fields, FIELD_COUNT(v1_stat_fields), &node->stat);
+    }
+    // the v2 root has no memory.current; it is still useful for its members
+    node->readable = node->usage >= 0;
+    read_pids(node, buffer);
+}
+
+static void* read_worker(void *args) {
+    ReadJob *job = (ReadJob*)args;
+    ProcBuffer *buffer = proc_thread_buffer();
+
+    for (;;) {
+        int index = atomic_fetch_add(&job->next, 1);
+        if (index >= job->tree->count)
+            break;
+        if (buffer)
+            read_node(job->tree, &job->tree->nodes[index], buffer);
+    }
+    return NULL;
+}
+
+// Read every cgroup on a pool of threads; returns the number of threads used
+static int read_tree(CgroupTree *tree, int workers) {
+    ReadJob job = { .tree = tree };
+    atomic_init(&job.next, 0);
+
+    if (workers <= 0)
+        workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers > MAX_WORKERS)
+        workers = MAX_WORKERS;
+    if (workers > tree->count)
+        workers = tree->count > 0 ? tree->count : 1;
+
+    pthread_t threads[MAX_WORKERS];
+    int started = 0;
+    for (int i = 1; i < workers; i++) {
+        if (pthread_create(&threads[started], NULL, read_worker, &job) != 0)
+            break;
+        started++;
+    }
+    read_worker(&job);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    return started + 1;
+}
+
+// Open-addressing PID -> entry index table
+typedef struct {
+    int *keys;
+    int *values;
+    size_t capacity;
+} PidTable;
+
+static int pid_table_build(PidTable *table, const ProcEntry *entries, int count) {
+    table->capacity = PID_TABLE_MIN;
+    while (table->capacity < (size_t)count * 2)
+        table->capacity *= 2;
+    table->keys = calloc(table->capacity, sizeof(int));
+    table->values = malloc(table->capacity * sizeof(int));
+    if (!table->keys || !table->values)
+        return -1;
+
+    for (int i = 0; i < count; i++) {
+        size_t slot = (size_t)entries[i].pid & (table->capacity - 1);
+        while (table->keys[slot] != 0)
+            slot = (slot + 1) & (table->capacity - 1);
+        table->keys[slot] = entries[i].pid;
+        table->values[slot] = i;
+    }
+    return 0;
+}
+
+static int pid_table_find(const PidTable *table, int pid) {
+    size_t slot = (size_t)pid & (table->capacity - 1);
+    while (table->keys[slot] != 0) {
+        if (table->keys[slot] == pid)
+            return table->values[slot];
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    return -1;
+}
+
+// Sum the members' RSS/PSS into each cgroup, then up the tree
+static void aggregate(CgroupTree *tree, const ScanResult *scan) {
+    PidTable table = {0};
+    int have_table = pid_table_build(&table, scan->entries, scan->kept) == 0;
+
+    for (int i = 0; i < tree->count; i++) {
+        CgroupNode *node = &tree->nodes[i];
+        node->procs = 0;
+        node->rss = 0;
+        node->pss = 0;
+        for (int p = 0; have_table && p < node->pid_count; p++) {
+            int index = pid_table_find(&table, node->pids[p]);
+            if (index < 0)
+                continue;
+            node->procs++;
+            node->rss += scan->entries[index].rss;
+            if (scan->entries[index].pss > 0)
+                node->pss += scan->entries[index].pss;
+        }
+    }
+    // children come after their parents, so one backwards pass is enough
+    for (int i = tree->count - 1; i > 0; i--) {
+        CgroupNode *parent = &tree->nodes[tree->nodes[i].parent];
+        parent->procs += tree->nodes[i].procs;
+        parent->rss += tree->nodes[i].rss;
+        parent->pss += tree->nodes[i].pss;
+    }
+
+    free(table.keys);
+    free(table.values);
+}
+
+static int compare_usage(const void *a, const void *b) {
+    const CgroupNode *na = *(const CgroupNode * const *)a, *nb = *(const CgroupNode * const *)b;
+    if (na->usage != nb->usage)
+        return na->usage < nb->usage ? 1 : -1;
+    if (na->rss != nb->rss)
+        return na->rss < nb->rss ? 1 : -1;
+    return strcmp(na->path, nb->path);
+}
+
+static void print_tree(const CgroupTree *tree, int top) {
+    CgroupNode **order = malloc(tree->count * sizeof(CgroupNode *));
+    if (!order) {
+        fprintf(stderr, "Out of memory\n");
+        return;
+    }
+    for (int i = 0; i < tree->count; i++)
+        order[i] = &tree->nodes[i];
+    qsort(order, tree->count, sizeof(CgroupNode *), compare_usage);
+
+    int shown = (top > 0 && top < tree->count) ? top : tree->count;
+    if (!output_structured()) {
+        printf("\n---- Top %d of %d Cgroups by Usage (v%d: %s) ----\n", shown, tree->count, tree->version, tree->mount);
+        printf("%-40s %6s %10s %10s %10s %10s %9s %9s %10s %10s\n", "CGROUP", "PROCS", "USAGE_kB", "LIMIT_kB",
+               "ANON_kB", "FILE_kB", "SHMEM_kB", "SWAP_kB", "RSS_kB", "PSS_kB");
+    }
+
+    for (int i = 0; i < shown; i++) {
+        const CgroupNode *node = order[i];
+        long usage = node->usage >= 0 ? node->usage / 1024 : -1;
+        long limit = node->limit >= 0 ? node->limit / 1024 : -1;
+
+        if (output_structured()) {
+            output_begin("cgroup");
+            output_string("path", node->path, strlen(node->path));
+            output_long("procs", node->procs);
+            output_long("usage_kB", usage);
+            output_long("limit_kB", limit);
+            output_long("anon_kB", node->stat.anon / 1024);
+            output_long("file_kB", node->stat.file / 1024);
+            output_long("shmem_kB", node->stat.shmem / 1024);
+            output_long("swap_kB", node->stat.swap / 1024);
+            output_long("kernel_kB", node->stat.kernel / 1024);
+            output_long("rss_kB", node->rss);
+            output_long("pss_kB", node->pss);
+            output_end();
+            continue;
+        }
+
+        // keep the end of long paths, which names the container
+        const char *name = node->path;
+        size_t length = strlen(name);
+        if (length > 40)
+            name += length - 40;
+        char usage_text[24] = "-", limit_text[24] = "max";
+        if (usage >= 0)
+            snprintf(usage_text, sizeof(usage_text), "%ld", usage);
+        if (limit >= 0)
+            snprintf(limit_text, sizeof(limit_text), "%ld", limit);
+        printf("%-40s %6d %10s %10s %10ld %10ld %9ld %9ld %10ld %10ld\n", name, node->procs, usage_text, limit_text,
+               node->stat.anon / 1024, node->stat.file / 1024, node->stat.shmem / 1024, node->stat.swap / 1024,
+               node->rss, node->pss);
+    }
+    free(order);
+}
+
+static double ms_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int view_pass(CgroupTree *tree, const CgroupViewOptions *options) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // walk the hierarchy only the first time and when cgroups came or went
+    int walked = 0;
+    if (tree->count == 0 || tree_changed(tree)) {
+        if (build_tree(tree) != 0)
+            return -1;
+        walked = 1;
+    }
+    int workers = read_tree(tree, options->workers);
+    double read_ms = ms_since(&start);
+
+    struct timespec scan_start;
+    clock_gettime(CLOCK_MONOTONIC, &scan_start);
+    ScanOptions scan_options = { .workers = options->workers };
+    ScanResult scan;
+    if (scan_processes(&scan_options, &scan) != 0)
+        return -1;
+    aggregate(tree, &scan);
+    double scan_ms = ms_since(&scan_start);
+
+    print_tree(tree, options->top);
+
+    if (output_structured()) {
+        output_begin("cgroup_summary");
+        output_long("cgroups", tree->count);
+        output_long("walked", walked);
+        output_long("workers", workers);
+        output_double("read_ms", read_ms);
+        output_long("processes", scan.kept);
+        output_double("scan_ms", scan_ms);
+        output_end();
+    } else {
+        printf("\nRead %d cgroups (%s) with %d workers in %.1f ms; mapped %d processes in %.1f ms\n",
+               tree->count, walked ? "tree walked" : "cached tree", workers, read_ms, scan.kept, scan_ms);
+        if (scan.pss_denied > 0)
+            printf("PSS unavailable for %d processes (permission denied)\n", scan.pss_denied);
+    }
+    free(scan.entries);
+    return 0;
+}
+
+int run_cgroup_view(const CgroupViewOptions *options) {
+    CgroupTree tree;
+    memset(&tree, 0, sizeof(tree));
+
+    tree.version = cgroup_memory_hierarchy(tree.mount, sizeof(tree.mount));
+    if (tree.version < 0) {
+        fprintf(stderr, "No cgroup hierarchy with the memory controller is mounted\n");
+        return -1;
+    }
+    if (options->root) {
+        int version = cgroup_resolve(options->root, tree.root, sizeof(tree.root));
+        if (version < 0) {
+            fprintf(stderr, "%s is not a memory cgroup\n", options->root);
+            return -1;
+        }
+        if (version != tree.version) {
+            tree.version = version;
+            if (version == 2)
+                cgroup_v2_mount(tree.mount, sizeof(tree.mount));
+            else
+                cgroup_v1_memory_mount(tree.mount, sizeof(tree.mount));
+        }
+    } else {
+        snprintf(tree.root, sizeof(tree.root), "%s", tree.mount);
+    }
+
+    int status = 0, passes = 0;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!interrupted) {
+        if (view_pass(&tree, options) != 0) {
+            status = -1;
+            break;
+        }
+        output_flush();
+        passes++;
+        if (options->interval_ms <= 0 || (options->count > 0 && passes >= options->count))
+            break;
+
+        next.tv_sec += options->interval_ms / 1000;
+        next.tv_nsec += (long)(options->interval_ms % 1000) * 1000000L;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        while (!interrupted && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+            ;
+    }
+
+    if (passes > 1 && !output_structured())
+        printf("\n%d passes, tree walked %d times\n", passes, tree.walks);
+
+    free_nodes(&tree);
+    free(tree.nodes);
+    return status;
+}
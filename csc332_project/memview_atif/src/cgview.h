@@ -0,0 +1,19 @@
+#ifndef CGVIEW_H
+#define CGVIEW_H
+
+typedef struct {
+    const char *root;       // subtree to walk (see cgroup_resolve), NULL = whole hierarchy
+    int top;                // rows to print, 0 = all
+    int workers;
+    int interval_ms;        // > 0: repeat every interval_ms, reusing the cached tree
+    int count;              // passes when repeating (0 = until interrupted)
+} CgroupViewOptions;
+
+// Memory per cgroup: usage, limit and the anon/file/shmem/swap split from
+// memory.stat, plus the RSS/PSS of the processes in each cgroup and its
+// descendants. The directory tree is kept (with an open fd per cgroup)
+// between passes and only walked again when a directory's link count shows
+// that cgroups were created or removed.
+int run_cgroup_view(const CgroupViewOptions *options);
+
+#endif
@@ -1,4 +1,7 @@
 #include "helpers.h"
+#include "regions.h"
+#include "procfile.h"
+#include "output.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -6,12 +9,14 @@
 #include <signal.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <sys/mman.h>
 #include <errno.h>
 
+volatile sig_atomic_t interrupted = 0;
+
 static void handle_interrupt(int signal_num) {
     const char *interrupt_msg = "Caught interrupt signal, cleaning up...\n";
     write(STDERR_FILENO, interrupt_msg, strlen(interrupt_msg));
+    interrupted = 1;
 }
 
 void install_signal_handlers() {
@@ -19,126 +24,170 @@ void install_signal_handlers() {
     signal(SIGTERM, handle_interrupt);
 }
 
-int read_process_status(int process_id) {
-    char file_path[64];
-    snprintf(file_path, sizeof(file_path), "/proc/%d/status", process_id);
-    
-    int file_desc = open(file_path, O_RDONLY);
-    if (file_desc == -1) {
-        fprintf(stderr, "Couldn't open %s: %s\n", file_path, strerror(errno));
-        return -1;
+// Read a whole /proc file into the calling thread's shared buffer
+static ProcBuffer *read_whole_file(const char *file_path) {
+    ProcBuffer *buffer = proc_thread_buffer();
+    if (!buffer) {
+        fprintf(stderr, "Out of memory reading %s\n", file_path);
+        return NULL;
     }
-    
-    char data_buffer[4096];
-    int bytes_read = read(file_desc, data_buffer, sizeof(data_buffer) - 1);
-    if (bytes_read < 0) {
-        fprintf(stderr, "Failed to read %s: %s\n", file_path, strerror(errno));
-        close(file_desc);
-        return -1;
+
+    if (proc_buffer_read_file(buffer, AT_FDCWD, file_path) < 0) {
+        fprintf(stderr, "Couldn't read %s: %s\n", file_path, strerror(errno));
+        return NULL;
     }
-    data_buffer[bytes_read] = '\0';
-    
-    printf("\n---- Process Status (PID: %d) ----\n", process_id);
-    printf("%s\n", data_buffer);
-    
-    close(file_desc);
-    return 0;
+    return buffer;
 }
 
-int read_process_maps(int process_id) {
-    char file_path[64];
-    snprintf(file_path, sizeof(file_path), "/proc/%d/maps", process_id);
-    
-    int file_desc = open(file_path, O_RDONLY);
-    if (file_desc == -1) {
-        fprintf(stderr, "Couldn't open %s: %s\n", file_path, strerror(errno));
-        return -1;
+// "1234" or "1234 kB" -> 1 with the number in *value, anything else -> 0.
+// Zero-padded values are hex masks or octal (SigIgn, CapEff, Umask) and the
+// CPU/node masks and lists stay text even when they happen to be all digits.
+static int numeric_value(const ProcField *field, long *value) {
+    size_t digits = 0;
+    while (digits < field->value_length && field->value[digits] >= '0' && field->value[digits] <= '9')
+        digits++;
+    if (digits == 0 || (digits > 1 && field->value[0] == '0'))
+        return 0;
+    if (digits != field->value_length &&
+        !(field->value_length == digits + 3 && memcmp(field->value + digits, " kB", 3) == 0))
+        return 0;
+    if (field->key_length >= 12 &&
+        (memcmp(field->key, "Cpus_allowed", 12) == 0 || memcmp(field->key, "Mems_allowed", 12) == 0))
+        return 0;
+    *value = proc_field_long(field);
+    return 1;
+}
+
+// One record per file with a field per "Key: value" line (sizes in kB)
+static void emit_key_values(const char *kind, int process_id, const ProcBuffer *buffer) {
+    ProcTokenizer tokenizer;
+    ProcField field;
+    char name[64];
+
+    output_begin(kind);
+    if (process_id >= 0)
+        output_long("pid", process_id);
+
+    proc_tokenizer_init(&tokenizer, buffer->data, buffer->length);
+    while (proc_next_field(&tokenizer, &field)) {
+        size_t length = field.key_length < sizeof(name) - 1 ? field.key_length : sizeof(name) - 1;
+        memcpy(name, field.key, length);
+        name[length] = '\0';
+
+        long value;
+        if (numeric_value(&field, &value))
+            output_long(name, value);
+        else
+            output_string(name, field.value, field.value_length);
     }
-    
-    printf("\n---- Memory Map Layout (PID: %d) ----\n", process_id);
-    
-    char buffer[4096];
-    ssize_t bytes_read;
-    while ((bytes_read = read(file_desc, buffer, sizeof(buffer))) > 0) {
-        write(STDOUT_FILENO, buffer, bytes_read);
+    output_end();
+}
+
+// One record per segment, named after the columns of the header line
+static void emit_shm_table(const ProcBuffer *buffer) {
+    char names[32][16];
+    int columns = 0;
+    const char *pos = buffer->data;
+    const char *end = buffer->data + buffer->length;
+    int header = 1;
+
+    while (pos < end) {
+        const char *line_end = memchr(pos, '\n', end - pos);
+        if (!line_end)
+            line_end = end;
+
+        int column = 0;
+        const char *word = pos;
+        while (word < line_end) {
+            while (word < line_end && *word == ' ')
+                word++;
+            if (word == line_end)
+                break;
+            const char *word_end = word;
+            while (word_end < line_end && *word_end != ' ')
+                word_end++;
+
+            if (header) {
+                if (columns < 32) {
+                    size_t length = word_end - word < 15 ? (size_t)(word_end - word) : 15;
+                    memcpy(names[columns], word, length);
+                    names[columns][length] = '\0';
+                    columns++;
+                }
+            } else if (column < columns) {
+                if (column == 0)
+                    output_begin("shm");
+                // every column is numeric except perms, which is octal text
+                if (strcmp(names[column], "perms") == 0)
+                    output_string(names[column], word, word_end - word);
+                else
+                    output_long(names[column], strtol(word, NULL, 10));
+            }
+            column++;
+            word = word_end;
+        }
+        if (!header && column > 0)
+            output_end();
+
+        header = 0;
+        pos = line_end + 1;
     }
-    
-    if (bytes_read < 0) {
-        fprintf(stderr, "Failed to read %s: %s\n", file_path, strerror(errno));
-        close(file_desc);
+}
+
+int read_process_status(int process_id) {
+    char file_path[64];
+    snprintf(file_path, sizeof(file_path), "/proc/%d/status", process_id);
+
+    ProcBuffer *buffer = read_whole_file(file_path);
+    if (!buffer)
         return -1;
+
+    if (output_structured()) {
+        emit_key_values("status", process_id, buffer);
+        return 0;
     }
-    
-    close(file_desc);
+
+    FILE *out = output_stream();
+    fprintf(out, "\n---- Process Status (PID: %d) ----\n", process_id);
+    fwrite(buffer->data, 1, buffer->length, out);
+    fprintf(out, "\n");
     return 0;
 }
 
+int read_process_maps(int process_id, int summary_only) {
+    return report_regions(process_id, summary_only);
+}
+
 int read_system_meminfo() {
-    const char *meminfo_path = "/proc/meminfo";
-    
-    int file_desc = open(meminfo_path, O_RDONLY);
-    if (file_desc == -1) {
-        fprintf(stderr, "Couldn't open %s: %s\n", meminfo_path, strerror(errno));
-        return -1;
-    }
-    
-    char data_buffer[4096];
-    int bytes_read = read(file_desc, data_buffer, sizeof(data_buffer) - 1);
-    if (bytes_read < 0) {
-        fprintf(stderr, "Failed to read %s: %s\n", meminfo_path, strerror(errno));
-        close(file_desc);
+    ProcBuffer *buffer = read_whole_file("/proc/meminfo");
+    if (!buffer)
         return -1;
+
+    if (output_structured()) {
+        emit_key_values("meminfo", -1, buffer);
+        return 0;
     }
-    
-    data_buffer[bytes_read] = '\0';
-    
-    printf("\n---- System-Wide Memory Stats ----\n");
-    printf("%s\n", data_buffer);
-    
-    close(file_desc);
+
+    FILE *out = output_stream();
+    fprintf(out, "\n---- System-Wide Memory Stats ----\n");
+    fwrite(buffer->data, 1, buffer->length, out);
+    fprintf(out, "\n");
     return 0;
 }
 
 int read_shared_memory() {
-    const char *shm_path = "/proc/sysvipc/shm";
-    
-    int file_desc = open(shm_path, O_RDONLY);
-    if (file_desc == -1) {
-        fprintf(stderr, "Couldn't open %s: %s\n", shm_path, strerror(errno));
-        return -1;
-    }
-    
-    char data_buffer[4096];
-    int bytes_read = read(file_desc, data_buffer, sizeof(data_buffer) - 1);
-    if (bytes_read < 0) {
-        fprintf(stderr, "Failed to read %s: %s\n", shm_path, strerror(errno));
-        close(file_desc);
+    ProcBuffer *buffer = read_whole_file("/proc/sysvipc/shm");
+    if (!buffer)
         return -1;
+
+    if (output_structured()) {
+        emit_shm_table(buffer);
+        return 0;
     }
-    
-    data_buffer[bytes_read] = '\0';
-    
-    printf("\n---- Shared Memory Segments ----\n");
-    printf("%s\n", data_buffer);
-    
-    close(file_desc);
-    return 0;
-}
 
-void* thread_worker(void *args) {
-    TaskArgs *job = (TaskArgs*)args;
-    
-    if (job->show_sysinfo)
-        read_system_meminfo();
-    
-    if (job->show_status)
-        read_process_status(job->pid);
-    
-    if (job->show_maps)
-        read_process_maps(job->pid);
-    
-    if (job->show_shm)
-        read_shared_memory();
-    
-    return NULL;
+    FILE *out = output_stream();
+    fprintf(out, "\n---- Shared Memory Segments ----\n");
+    fwrite(buffer->data, 1, buffer->length, out);
+    fprintf(out, "\n");
+    return 0;
 }
\ No newline at end of file
@@ -2,22 +2,27 @@
 #define HELPERS_H
 
 #include <pthread.h>
+#include <signal.h>
 
 typedef struct {
     int pid;
     int show_status;
     int show_maps;
+    int maps_summary;
+    int show_residency;
+    int idle_ms;
     int show_shm;
     int show_sysinfo;
 } TaskArgs;
 
+// Set by SIGINT/SIGTERM; long-running modes stop when it becomes nonzero
+extern volatile sig_atomic_t interrupted;
+
 void install_signal_handlers();
 
 int read_process_status(int process_id);
-int read_process_maps(int process_id);
+int read_process_maps(int process_id, int summary_only);
 int read_system_meminfo();
 int read_shared_memory();
 
-void* thread_worker(void *args);
-
 #endif
\ No newline at end of file
@@ -1,20 +1,53 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
 #include <getopt.h>
-#include <pthread.h>
 
 #include "helpers.h"
+#include "sampler.h"
+#include "scan.h"
+#include "output.h"
+#include "timeseries.h"
+#include "watch.h"
+#include "cgview.h"
+#include "tasks.h"
+#include "snapshot.h"
 
 void display_usage() {
     printf(
         "Usage: memview [OPTIONS]\n"
         "Options:\n"
         "  -p, --pid <pid>        Display memory details for a process\n"
-        "  -m, --maps             Display memory map layout\n"
+        "  -p <pid,pid,...|all>   Scan several processes and list the top consumers\n"
+        "  -f, --filter <name>    Scan processes whose name contains <name>\n"
+        "  -N, --top <n>          Rows to show when scanning (default: 20, 0 = all)\n"
+        "  -r, --sort <key>       Sort scan by rss, pss or swap (default: rss)\n"
+        "  -w, --workers <n>      Scan with <n> threads (default: one per CPU)\n"
+        "  -m, --maps             Display memory regions with RSS/PSS/dirty/swap and totals\n"
+        "  -A, --summary          With -m, show only the totals by type and path\n"
+        "  -R, --residency        Show resident/swapped/shared pages per mapping (pagemap)\n"
+        "      --idle <ms>        With -R, also measure the working set over <ms>\n"
         "  -s, --system           Display system-wide memory stats\n"
         "  -S, --shared           Display shared memory segments\n"
-        "  -t, --threads          Run operations in a separate thread\n"
+        "  -t, --threads          Run the -s/-p/-m/-R/-S collectors concurrently, one thread each\n"
+        "      --timing           Report per-task and end-to-end time (with -t, against a serial run)\n"
+        "  -i, --interval <ms>    Sample the process (-p) every <ms> milliseconds\n"
+        "  -n, --count <n>        Stop after <n> samples (default: until interrupted)\n"
+        "      --record <file>    With -i/-n, append the samples to a binary time-series file\n"
+        "      --replay <file>    Print the samples stored in a time-series file\n"
+        "      --snapshot <file>  Save the region table of the process (-p) to a binary snapshot\n"
+        "      --diff <old> [new] Show regions that appeared, vanished, grew or shrank since the\n"
+        "                         snapshot <old>, up to snapshot <new> or now (-p)\n"
+        "      --growth           Snapshot the process (-p) every -i ms (default: 1000) and show\n"
+        "                         what changed each time and over the whole run, with rates\n"
+        "  -o, --format <fmt>     Output as text, json (one object per line) or csv\n"
+        "  -W, --watch            Wait for memory pressure events and list the top consumers\n"
+        "                         each time one fires (-p watches that process's cgroup)\n"
+        "  -C, --cgroups          Show memory per cgroup with the RSS/PSS of its processes\n"
+        "      --cgroup <path>    With -W, watch this memory cgroup; with -C, show only its subtree\n"
+        "      --stall <us>       With -W, PSI stall time per window that fires (default: 100000)\n"
+        "      --window <ms>      With -W, PSI window and minimum gap between snapshots (default: 1000)\n"
         "  -h, --help             Display this help\n"
     );
 }
@@ -25,30 +58,126 @@ int main(int argc, char *argv[]) {
     int process_id = -1;
     int display_status = 0;
     int display_memory_map = 0;
+    int maps_summary = 0;
+    int display_residency = 0;
+    int idle_ms = 0;
     int display_system_info = 0;
     int display_shared_mem = 0;
     int run_threaded = 0;
+    int show_timing = 0;
+    int interval_ms = 0;
+    int sample_count = 0;
+    int *scan_pids = NULL;
+    int scan_pid_count = 0;
+    int scan_mode = 0;
+    const char *name_filter = NULL;
+    int top_count = 20;
+    int sort_key = SORT_RSS;
+    int worker_count = 0;
+    int output_format = OUTPUT_TEXT;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    int watch_mode = 0;
+    int cgroup_mode = 0;
+    const char *watch_cgroup = NULL;
+    int stall_us = 100000;
+    int window_ms = 1000;
+    const char *snapshot_path = NULL;
+    const char *diff_path = NULL;
+    int growth_mode = 0;
 
+    enum { OPT_IDLE = 256, OPT_RECORD, OPT_REPLAY, OPT_CGROUP, OPT_STALL, OPT_WINDOW, OPT_TIMING,
+           OPT_SNAPSHOT, OPT_DIFF, OPT_GROWTH };
     const struct option long_options[] = {
         {"pid", required_argument, NULL, 'p'},
         {"maps", no_argument, NULL, 'm'},
+        {"summary", no_argument, NULL, 'A'},
+        {"residency", no_argument, NULL, 'R'},
+        {"idle", required_argument, NULL, OPT_IDLE},
         {"system", no_argument, NULL, 's'},
         {"shared", no_argument, NULL, 'S'},
         {"threads", no_argument, NULL, 't'},
+        {"timing", no_argument, NULL, OPT_TIMING},
+        {"interval", required_argument, NULL, 'i'},
+        {"count", required_argument, NULL, 'n'},
+        {"filter", required_argument, NULL, 'f'},
+        {"top", required_argument, NULL, 'N'},
+        {"sort", required_argument, NULL, 'r'},
+        {"workers", required_argument, NULL, 'w'},
+        {"format", required_argument, NULL, 'o'},
+        {"record", required_argument, NULL, OPT_RECORD},
+        {"replay", required_argument, NULL, OPT_REPLAY},
+        {"watch", no_argument, NULL, 'W'},
+        {"cgroups", no_argument, NULL, 'C'},
+        {"cgroup", required_argument, NULL, OPT_CGROUP},
+        {"stall", required_argument, NULL, OPT_STALL},
+        {"window", required_argument, NULL, OPT_WINDOW},
+        {"snapshot", required_argument, NULL, OPT_SNAPSHOT},
+        {"diff", required_argument, NULL, OPT_DIFF},
+        {"growth", no_argument, NULL, OPT_GROWTH},
         {"help", no_argument, NULL, 'h'},
         {0, 0, 0, 0}
     };
 
     int option;
-    while ((option = getopt_long(argc, argv, "p:msSth", long_options, NULL)) != -1) {
+    while ((option = getopt_long(argc, argv, "p:mARsSti:n:f:N:r:w:o:WCh", long_options, NULL)) != -1) {
         switch (option) {
             case 'p':
+                if (strcmp(optarg, "all") == 0 || strchr(optarg, ',')) {
+                    scan_pid_count = parse_pid_list(optarg, &scan_pids);
+                    if (scan_pid_count < 0) {
+                        fprintf(stderr, "Invalid PID list: %s\n", optarg);
+                        return 1;
+                    }
+                    scan_mode = 1;
+                    break;
+                }
                 process_id = atoi(optarg);
                 display_status = 1;
                 break;
+            case 'f':
+                name_filter = optarg;
+                scan_mode = 1;
+                break;
+            case 'N':
+                top_count = atoi(optarg);
+                if (top_count < 0) {
+                    fprintf(stderr, "Invalid row count: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'r':
+                sort_key = parse_sort_key(optarg);
+                if (sort_key < 0) {
+                    fprintf(stderr, "Invalid sort key: %s (use rss, pss or swap)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'w':
+                worker_count = atoi(optarg);
+                if (worker_count <= 0) {
+                    fprintf(stderr, "Invalid worker count: %s\n", optarg);
+                    return 1;
+                }
+                break;
             case 'm':
                 display_memory_map = 1;
                 break;
+            case 'A':
+                display_memory_map = 1;
+                maps_summary = 1;
+                break;
+            case 'R':
+                display_residency = 1;
+                break;
+            case OPT_IDLE:
+                idle_ms = atoi(optarg);
+                if (idle_ms <= 0) {
+                    fprintf(stderr, "Invalid idle window: %s\n", optarg);
+                    return 1;
+                }
+                display_residency = 1;
+                break;
             case 's':
                 display_system_info = 1;
                 break;
@@ -58,6 +187,69 @@ int main(int argc, char *argv[]) {
             case 't':
                 run_threaded = 1;
                 break;
+            case OPT_TIMING:
+                show_timing = 1;
+                break;
+            case 'i':
+                interval_ms = atoi(optarg);
+                if (interval_ms <= 0) {
+                    fprintf(stderr, "Invalid interval: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'n':
+                sample_count = atoi(optarg);
+                if (sample_count <= 0) {
+                    fprintf(stderr, "Invalid sample count: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o':
+                output_format = output_parse_format(optarg);
+                if (output_format < 0) {
+                    fprintf(stderr, "Invalid output format: %s (use text, json or csv)\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_RECORD:
+                record_path = optarg;
+                break;
+            case OPT_REPLAY:
+                replay_path = optarg;
+                break;
+            case 'W':
+                watch_mode = 1;
+                break;
+            case 'C':
+                cgroup_mode = 1;
+                break;
+            case OPT_CGROUP:
+                watch_cgroup = optarg;
+                break;
+            case OPT_STALL:
+                stall_us = atoi(optarg);
+                if (stall_us <= 0) {
+                    fprintf(stderr, "Invalid stall threshold: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_WINDOW:
+                window_ms = atoi(optarg);
+                // the kernel accepts PSI windows of 500 ms to 10 s
+                if (window_ms < 500 || window_ms > 10000) {
+                    fprintf(stderr, "Invalid window: %s (use 500 to 10000 ms)\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_SNAPSHOT:
+                snapshot_path = optarg;
+                break;
+            case OPT_DIFF:
+                diff_path = optarg;
+                break;
+            case OPT_GROWTH:
+                growth_mode = 1;
+                break;
             case 'h':
                 display_usage();
                 return 0;
@@ -67,40 +259,126 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    if ((display_memory_map || display_status) && process_id < 0) {
-        fprintf(stderr, "You need to specify a PID with -p when using -m\n");
+    output_init(output_format);
+
+    if (replay_path)
+        return replay_timeseries(replay_path) == 0 ? 0 : 1;
+
+    if (record_path && interval_ms == 0 && sample_count == 0) {
+        fprintf(stderr, "--record needs --interval or --count\n");
         return 1;
     }
 
-    TaskArgs arguments = {
-        .pid = process_id,
-        .show_status = display_status,
-        .show_maps = display_memory_map,
-        .show_shm = display_shared_mem,
-        .show_sysinfo = display_system_info
-    };
+    if (watch_mode) {
+        if (stall_us > window_ms * 1000) {
+            fprintf(stderr, "The stall threshold must not exceed the window\n");
+            return 1;
+        }
+        WatchOptions watch = {
+            .cgroup = watch_cgroup,
+            .pid = process_id,
+            .stall_us = stall_us,
+            .window_ms = window_ms,
+            .count = sample_count,
+            .snapshot = {
+                .name_filter = name_filter,
+                .top = top_count,
+                .sort_key = sort_key,
+                .workers = worker_count
+            }
+        };
+        return run_watch(&watch) == 0 ? 0 : 1;
+    }
+
+    if (cgroup_mode) {
+        CgroupViewOptions view = {
+            .root = watch_cgroup,
+            .top = top_count,
+            .workers = worker_count,
+            .interval_ms = interval_ms > 0 ? interval_ms : (sample_count > 1 ? 1000 : 0),
+            .count = sample_count
+        };
+        return run_cgroup_view(&view) == 0 ? 0 : 1;
+    }
 
-    if (run_threaded) {
-        pthread_t worker_thread;
-        if (pthread_create(&worker_thread, NULL, thread_worker, &arguments) != 0) {
-            fprintf(stderr, "Couldn't create worker thread\n");
+    if (watch_cgroup) {
+        fprintf(stderr, "--cgroup needs --watch or --cgroups\n");
+        return 1;
+    }
+
+    if (snapshot_path || diff_path || growth_mode) {
+        const char *diff_after = optind < argc ? argv[optind] : NULL;
+        if (growth_mode && diff_path) {
+            fprintf(stderr, "--growth cannot be combined with --diff\n");
+            return 1;
+        }
+        if (diff_after && !diff_path) {
+            fprintf(stderr, "Unexpected argument: %s\n", diff_after);
             return 1;
         }
-        pthread_join(worker_thread, NULL);
-        return 0;
+        if (!diff_after && process_id < 0) {
+            fprintf(stderr, "You need to specify a PID with -p when using --snapshot, --diff or --growth\n");
+            return 1;
+        }
+        SnapshotOptions snapshot = {
+            .pid = diff_after ? -1 : process_id,
+            .save_path = snapshot_path,
+            .before_path = diff_path,
+            .after_path = diff_after,
+            .interval_ms = growth_mode ? (interval_ms > 0 ? interval_ms : 1000) : 0,
+            .count = sample_count
+        };
+        return run_snapshot(&snapshot) == 0 ? 0 : 1;
     }
 
-    if (display_system_info)
-        read_system_meminfo();
+    if (scan_mode) {
+        if (display_status || display_memory_map) {
+            fprintf(stderr, "A single PID (-p <pid>) cannot be combined with a scan\n");
+            return 1;
+        }
+        ScanOptions scan = {
+            .pids = scan_pids,
+            .pid_count = scan_pid_count,
+            .name_filter = name_filter,
+            .top = top_count,
+            .sort_key = sort_key,
+            .workers = worker_count
+        };
+        int status = run_scan(&scan);
+        free(scan_pids);
+        return status == 0 ? 0 : 1;
+    }
 
-    if (display_status)
-        read_process_status(process_id);
+    if ((display_memory_map || display_status || display_residency) && process_id < 0) {
+        fprintf(stderr, "You need to specify a PID with -p when using -m\n");
+        return 1;
+    }
 
-    if (display_memory_map)
-        read_process_maps(process_id);
+    if (interval_ms > 0 || sample_count > 0) {
+        if (process_id < 0) {
+            fprintf(stderr, "You need to specify a PID with -p when using --interval or --count\n");
+            return 1;
+        }
+        SampleOptions sampling = {
+            .pid = process_id,
+            .interval_ms = interval_ms > 0 ? interval_ms : 1000,
+            .count = sample_count,
+            .with_system = display_system_info,
+            .record_path = record_path
+        };
+        return run_sampler(&sampling) == 0 ? 0 : 1;
+    }
 
-    if (display_shared_mem)
-        read_shared_memory();
+    TaskArgs arguments = {
+        .pid = process_id,
+        .show_status = display_status,
+        .show_maps = display_memory_map,
+        .maps_summary = maps_summary,
+        .show_residency = display_residency,
+        .idle_ms = idle_ms,
+        .show_shm = display_shared_mem,
+        .show_sysinfo = display_system_info
+    };
 
-    return 0;
+    return run_tasks(&arguments, run_threaded, show_timing) == 0 ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include "output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define OUTPUT_BUFFER_SIZE 65536
+#define OUTPUT_LINE_SIZE 16384
+
+static OutputFormat current_format = OUTPUT_TEXT;
+
+static char out_buffer[OUTPUT_BUFFER_SIZE];
+static size_t out_used = 0;
+static struct timespec last_flush;
+
+// the record being built (and, for CSV, its header); per thread so that
+// tasks writing into their own captures can build records concurrently
+static __thread char row[OUTPUT_LINE_SIZE];
+static __thread size_t row_used = 0;
+static __thread char header[OUTPUT_LINE_SIZE];
+static __thread size_t header_used = 0;
+static __thread int field_count = 0;
+static char last_header[OUTPUT_LINE_SIZE];
+static size_t last_header_used = 0;
+
+struct OutputCapture {
+    FILE *stream;               // open_memstream, closed by output_capture_end
+    char *data;
+    size_t length;
+    size_t leading_header;      // CSV: length of the header line the capture starts with
+    char last_header[OUTPUT_LINE_SIZE];
+    size_t last_header_used;
+};
+
+static __thread OutputCapture *capture = NULL;
+
+int output_parse_format(const char *text) {
+    if (strcmp(text, "text") == 0)
+        return OUTPUT_TEXT;
+    if (strcmp(text, "json") == 0)
+        return OUTPUT_JSON;
+    if (strcmp(text, "csv") == 0)
+        return OUTPUT_CSV;
+    return -1;
+}
+
+void output_init(OutputFormat format) {
+    current_format = format;
+    clock_gettime(CLOCK_MONOTONIC, &last_flush);
+    atexit(output_flush);
+}
+
+int output_structured(void) {
+    return current_format != OUTPUT_TEXT;
+}
+
+FILE *output_stream(void) {
+    return capture ? capture->stream : stdout;
+}
+
+OutputCapture *output_capture_begin(void) {
+    OutputCapture *started = calloc(1, sizeof(OutputCapture));
+    if (!started)
+        return NULL;
+    started->stream = open_memstream(&started->data, &started->length);
+    if (!started->stream) {
+        free(started);
+        return NULL;
+    }
+    capture = started;
+    return started;
+}
+
+void output_capture_end(OutputCapture *finished) {
+    if (capture == finished)
+        capture = NULL;
+    fclose(finished->stream);
+    finished->stream = NULL;
+}
+
+void output_flush(void) {
+    // anything printed with stdio before the records must come out first
+    fflush(stdout);
+
+    size_t written = 0;
+    while (written < out_used) {
+        ssize_t n = write(STDOUT_FILENO, out_buffer + written, out_used - written);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        written += n;
+    }
+    out_used = 0;
+    clock_gettime(CLOCK_MONOTONIC, &last_flush);
+}
+
+void output_tick(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (out_used > 0 && now.tv_sec - last_flush.tv_sec >= 1)
+        output_flush();
+}
+
+static void out_append(const char *data, size_t length) {
+    if (capture) {
+        fwrite(data, 1, length, capture->stream);
+        return;
+    }
+    // rows are at most OUTPUT_LINE_SIZE, so one flush always makes room
+    if (out_used + length > sizeof(out_buffer))
+        output_flush();
+    memcpy(out_buffer + out_used, data, length);
+    out_used += length;
+}
+
+void output_capture_emit(OutputCapture *finished) {
+    const char *data = finished->data;
+    size_t length = finished->length;
+
+    // the CSV header the capture opens with is redundant if the same
+    // columns are already in effect
+    if (finished->leading_header > 0 && finished->leading_header - 1 == last_header_used &&
+        memcmp(data, last_header, last_header_used) == 0) {
+        data += finished->leading_header;
+        length -= finished->leading_header;
+    }
+
+    if (current_format == OUTPUT_TEXT) {
+        fwrite(data, 1, length, stdout);
+    } else {
+        while (length > 0) {
+            size_t chunk = length < OUTPUT_LINE_SIZE ? length : OUTPUT_LINE_SIZE;
+            out_append(data, chunk);
+            data += chunk;
+            length -= chunk;
+        }
+        if (finished->last_header_used > 0) {
+            memcpy(last_header, finished->last_header, finished->last_header_used);
+            last_header_used = finished->last_header_used;
+        }
+    }
+}
+
+void output_capture_free(OutputCapture *finished) {
+    if (!finished)
+        return;
+    if (finished->stream)
+        output_capture_end(finished);
+    free(finished->data);
+    free(finished);
+}
+
+static void line_append(char *line, size_t *used, const char *data, size_t length) {
+    // leave room for the closing characters and the newline
+    if (*used >= OUTPUT_LINE_SIZE - 4)
+        return;
+    if (*used + length + 4 > OUTPUT_LINE_SIZE)
+        length = OUTPUT_LINE_SIZE - 4 - *used;
+    memcpy(line + *used, data, length);
+    *used += length;
+}
+
+static void row_append(const char *data, size_t length) {
+    line_append(row, &row_used, data, length);
+}
+
+static void row_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+static void row_printf(const char *format, ...) {
+    char text[64];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (n > 0)
+        row_append(text, (size_t)n < sizeof(text) ? (size_t)n : sizeof(text) - 1);
+}
+
+static void json_string(const char *value, size_t length) {
+    row_append("\"", 1);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)value[i];
+        if (c == '"' || c == '\\') {
+            char escaped[2] = {'\\', (char)c};
+            row_append(escaped, 2);
+        } else if (c < 0x20) {
+            row_printf("\\u%04x", c);
+        } else {
+            row_append(&value[i], 1);
+        }
+    }
+    row_append("\"", 1);
+}
+
+static void csv_string(const char *value, size_t length) {
+    int quote = 0;
+    for (size_t i = 0; i < length && !quote; i++) {
+        if (value[i] == ',' || value[i] == '"' || value[i] == '\n' || value[i] == '\r')
+            quote = 1;
+    }
+    if (!quote) {
+        row_append(value, length);
+        return;
+    }
+    row_append("\"", 1);
+    for (size_t i = 0; i < length; i++) {
+        if (value[i] == '"')
+            row_append("\"", 1);
+        row_append(&value[i], 1);
+    }
+    row_append("\"", 1);
+}
+
+// Field separator and name; for CSV the name goes to the header instead
+static void begin_field(const char *name) {
+    if (current_format == OUTPUT_JSON) {
+        row_append(",", 1);
+        json_string(name, strlen(name));
+        row_append(":", 1);
+    } else {
+        if (field_count > 0) {
+            row_append(",", 1);
+            line_append(header, &header_used, ",", 1);
+        }
+        line_append(header, &header_used, name, strlen(name));
+    }
+    field_count++;
+}
+
+void output_begin(const char *kind) {
+    row_used = 0;
+    header_used = 0;
+    field_count = 0;
+
+    if (current_format == OUTPUT_JSON) {
+        row_append("{\"kind\":", 8);
+        json_string(kind, strlen(kind));
+    } else {
+        line_append(header, &header_used, "kind", 4);
+        row_append(kind, strlen(kind));
+        field_count = 1;
+    }
+}
+
+void output_long(const char *name, long value) {
+    begin_field(name);
+    row_printf("%ld", value);
+}
+
+void output_double(const char *name, double value) {
+    begin_field(name);
+    row_printf("%.3f", value);
+}
+
+void output_string(const char *name, const char *value, size_t length) {
+    begin_field(name);
+    if (current_format == OUTPUT_JSON)
+        json_string(value, length);
+    else
+        csv_string(value, length);
+}
+
+void output_end(void) {
+    if (current_format == OUTPUT_JSON) {
+        row_append("}", 1);
+    } else {
+        char *previous = capture ? capture->last_header : last_header;
+        size_t *previous_used = capture ? &capture->last_header_used : &last_header_used;
+        if (header_used != *previous_used || memcmp(header, previous, header_used) != 0) {
+            // a record with different columns starts a new CSV table
+            memcpy(previous, header, header_used);
+            *previous_used = header_used;
+            header[header_used++] = '\n';
+            if (capture && ftell(capture->stream) == 0)
+                capture->leading_header = header_used;
+            out_append(header, header_used);
+        }
+    }
+    row[row_used++] = '\n';
+    out_append(row, row_used);
+
+    if (!capture && out_used > sizeof(out_buffer) / 2)
+        output_flush();
+}
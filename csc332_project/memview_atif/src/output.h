@@ -0,0 +1,47 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+typedef enum {
+    OUTPUT_TEXT,
+    OUTPUT_JSON,     // one JSON object per line
+    OUTPUT_CSV       // a header line whenever the columns change
+} OutputFormat;
+
+// "text", "json" or "csv"; returns -1 for anything else
+int output_parse_format(const char *text);
+
+void output_init(OutputFormat format);
+
+// Nonzero for json/csv: callers emit records instead of printing text
+int output_structured(void);
+
+// A record is a kind plus named fields, written in the order they are added
+void output_begin(const char *kind);
+void output_long(const char *name, long value);
+void output_double(const char *name, double value);
+void output_string(const char *name, const char *value, size_t length);
+void output_end(void);
+
+// Where text output goes: stdout, or the calling thread's capture
+FILE *output_stream(void);
+
+// A capture collects the text and records one thread writes between
+// output_capture_begin and output_capture_end in memory, so that tasks can
+// run concurrently and still be emitted in a fixed order. output_capture_emit
+// (from the main thread) writes it out; output_capture_free releases it.
+typedef struct OutputCapture OutputCapture;
+
+OutputCapture *output_capture_begin(void);
+void output_capture_end(OutputCapture *capture);
+void output_capture_emit(OutputCapture *capture);
+void output_capture_free(OutputCapture *capture);
+
+// Records are buffered; output_flush writes them out, output_tick only if
+// the last flush was more than a second ago (for long-running modes)
+void output_flush(void);
+void output_tick(void);
+
+#endif
@@ -0,0 +1,469 @@
+#include "pagemap.h"
+#include "regions.h"
+#include "helpers.h"
+#include "output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+// /proc/<pid>/pagemap entry bits (Documentation/admin-guide/mm/pagemap.rst)
+#define PM_PRESENT   (1ULL << 63)
+#define PM_SWAPPED   (1ULL << 62)
+#define PM_EXCLUSIVE (1ULL << 56)
+#define PM_PFN_MASK  ((1ULL << 55) - 1)
+
+// /proc/kpageflags bits
+#define KPF_KSM 21
+#define KPF_THP 22
+
+#define PAGEMAP_BATCH 65536          // entries per pread (512 KiB)
+#define MAP_WIDTH 32
+
+#define IDLE_NONE       0
+#define IDLE_PAGE_IDLE  1
+#define IDLE_REFERENCED 2
+
+// ---- run-length bitmap ----
+
+void run_bitmap_reset(RunBitmap *bitmap) {
+    bitmap->count = 0;
+}
+
+static int run_bitmap_push(RunBitmap *bitmap, uint32_t length) {
+    if (bitmap->count == bitmap->capacity) {
+        size_t capacity = bitmap->capacity ? bitmap->capacity * 2 : 64;
+        uint32_t *runs = realloc(bitmap->runs, capacity * sizeof(uint32_t));
+        if (!runs)
+            return -1;
+        bitmap->runs = runs;
+        bitmap->capacity = capacity;
+    }
+    bitmap->runs[bitmap->count++] = length;
+    return 0;
+}
+
+int run_bitmap_append(RunBitmap *bitmap, int bit, uint64_t length) {
+    // runs alternate starting with non-resident: slot i holds bit (i & 1)
+    if (bitmap->count == 0 && run_bitmap_push(bitmap, 0) != 0)
+        return -1;
+
+    while (length > 0) {
+        uint32_t *run = &bitmap->runs[bitmap->count - 1];
+        if ((int)((bitmap->count - 1) & 1) != bit) {
+            if (run_bitmap_push(bitmap, 0) != 0)
+                return -1;
+            continue;
+        }
+        if (*run == UINT32_MAX) {
+            // full: an empty run of the other bit keeps the alternation
+            if (run_bitmap_push(bitmap, 0) != 0 || run_bitmap_push(bitmap, 0) != 0)
+                return -1;
+            continue;
+        }
+        uint64_t room = UINT32_MAX - *run;
+        uint64_t take = length < room ? length : room;
+        *run += (uint32_t)take;
+        length -= take;
+    }
+    return 0;
+}
+
+void run_bitmap_free(RunBitmap *bitmap) {
+    free(bitmap->runs);
+    memset(bitmap, 0, sizeof(*bitmap));
+}
+
+// One character per bucket: how much of that slice of the mapping is resident
+static void render_map(const RunBitmap *bitmap, uint64_t pages, char *out) {
+    static const char levels[] = " .:o0#";
+    uint64_t ones[MAP_WIDTH] = {0};
+    int width = pages < MAP_WIDTH ? (int)pages : MAP_WIDTH;
+
+    uint64_t pos = 0;
+    int bucket = 0;
+    for (size_t i = 0; i < bitmap->count && width > 0; i++) {
+        uint64_t end = pos + bitmap->runs[i];
+        while (pos < end) {
+            uint64_t bucket_end = (uint64_t)(bucket + 1) * pages / width;
+            uint64_t take = (end < bucket_end ? end : bucket_end) - pos;
+            if (i & 1)
+                ones[bucket] += take;
+            pos += take;
+            if (pos == bucket_end && bucket < width - 1)
+                bucket++;
+        }
+    }
+
+    for (int b = 0; b < width; b++) {
+        uint64_t size = (uint64_t)(b + 1) * pages / width - (uint64_t)b * pages / width;
+        int level = 0;
+        if (ones[b] == size)
+            level = 5;
+        else if (ones[b] > 0)
+            level = 1 + (int)(ones[b] * 4 / size);
+        out[b] = levels[level];
+    }
+    out[width] = '\0';
+}
+
+// ---- pagemap walk ----
+
+typedef struct {
+    uint64_t pages;
+    uint64_t resident;
+    uint64_t swapped;
+    uint64_t shared;
+    uint64_t active;
+    uint64_t thp;
+    uint64_t ksm;
+} PageCounts;
+
+typedef struct {
+    int pid;
+    int pagemap_fd;
+    int kpagecount_fd;
+    int kpageflags_fd;
+    int idle_fd;
+    int idle_mode;
+    int marking;           // first page_idle pass: only set idle bits
+    int detailed;          // regions carry smaps usage
+    size_t page_size;
+    long page_kb;
+
+    uint64_t *entries;
+    uint64_t *pfns;
+    uint64_t *counts;
+    uint64_t *flags;
+    RunBitmap bitmap;
+
+    // idle bitmap word cache
+    uint64_t idle_word_index;
+    uint64_t idle_word;
+    int idle_word_valid;
+
+    PageCounts total;
+    uint64_t total_runs;
+    int read_errors;
+} ResidencyScan;
+
+static void flush_idle_word(ResidencyScan *scan) {
+    if (scan->idle_word_valid && scan->marking)
+        pwrite(scan->idle_fd, &scan->idle_word, sizeof(uint64_t), scan->idle_word_index * sizeof(uint64_t));
+    scan->idle_word_valid = 0;
+}
+
+// Pass 1 sets the idle bit of each PFN; pass 2 returns 1 if it is still set
+static int idle_bit(ResidencyScan *scan, uint64_t pfn) {
+    uint64_t index = pfn / 64;
+    if (!scan->idle_word_valid || index != scan->idle_word_index) {
+        flush_idle_word(scan);
+        scan->idle_word_index = index;
+        scan->idle_word = 0;
+        if (!scan->marking &&
+            pread(scan->idle_fd, &scan->idle_word, sizeof(uint64_t), index * sizeof(uint64_t)) != sizeof(uint64_t))
+            scan->idle_word = 0;
+        scan->idle_word_valid = 1;
+    }
+    if (scan->marking) {
+        scan->idle_word |= 1ULL << (pfn % 64);
+        return 1;
+    }
+    return (scan->idle_word >> (pfn % 64)) & 1;
+}
+
+// pread kpagecount/kpageflags for runs of consecutive PFNs instead of page by page
+static void read_pfn_info(int fd, const uint64_t *pfns, size_t count, uint64_t *out) {
+    size_t i = 0;
+    while (i < count) {
+        size_t run = 1;
+        while (i + run < count && pfns[i + run] == pfns[i] + run)
+            run++;
+        ssize_t got = pread(fd, &out[i], run * sizeof(uint64_t), pfns[i] * sizeof(uint64_t));
+        if (got != (ssize_t)(run * sizeof(uint64_t)))
+            memset(&out[i], 0, run * sizeof(uint64_t));
+        i += run;
+    }
+}
+
+static void scan_batch(ResidencyScan *scan, size_t count, PageCounts *counts) {
+    size_t pfn_count = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t entry = scan->entries[i];
+
+        // sparse mappings are mostly empty entries: add them as one run
+        if (entry == 0) {
+            size_t j = i + 1;
+            while (j < count && scan->entries[j] == 0)
+                j++;
+            if (!scan->marking)
+                run_bitmap_append(&scan->bitmap, 0, j - i);
+            i = j - 1;
+            continue;
+        }
+
+        int present = (entry & PM_PRESENT) != 0;
+
+        if (!scan->marking)
+            run_bitmap_append(&scan->bitmap, present, 1);
+        if (entry & PM_SWAPPED)
+            counts->swapped++;
+        if (!present)
+            continue;
+
+        counts->resident++;
+        uint64_t pfn = entry & PM_PFN_MASK;
+        if (pfn != 0)
+            scan->pfns[pfn_count++] = pfn;
+        // no PFNs or kpagecount without CAP_SYS_ADMIN: use the exclusive-mapping bit
+        if ((pfn == 0 || scan->kpagecount_fd == -1) && !(entry & PM_EXCLUSIVE))
+            counts->shared++;
+    }
+
+    if (pfn_count == 0)
+        return;
+
+    if (scan->idle_mode == IDLE_PAGE_IDLE) {
+        for (size_t i = 0; i < pfn_count; i++) {
+            if (!idle_bit(scan, scan->pfns[i]) && !scan->marking)
+                counts->active++;
+        }
+    }
+    if (scan->marking)
+        return;
+
+    if (scan->kpagecount_fd != -1) {
+        read_pfn_info(scan->kpagecount_fd, scan->pfns, pfn_count, scan->counts);
+        for (size_t i = 0; i < pfn_count; i++) {
+            if (scan->counts[i] > 1)
+                counts->shared++;
+        }
+    }
+    if (scan->kpageflags_fd != -1) {
+        read_pfn_info(scan->kpageflags_fd, scan->pfns, pfn_count, scan->flags);
+        for (size_t i = 0; i < pfn_count; i++) {
+            if (scan->flags[i] & (1ULL << KPF_THP))
+                counts->thp++;
+            if (scan->flags[i] & (1ULL << KPF_KSM))
+                counts->ksm++;
+        }
+    }
+}
+
+static int residency_region(const Region *region, void *context) {
+    ResidencyScan *scan = context;
+    PageCounts counts = {0};
+    uint64_t first_page = region->start / scan->page_size;
+
+    counts.pages = (region->end - region->start) / scan->page_size;
+    run_bitmap_reset(&scan->bitmap);
+
+    if (interrupted)
+        return 1;
+
+    // smaps already says nothing is there (guard pages, huge PROT_NONE
+    // reservations): skip the pagemap reads entirely
+    if (scan->detailed && region->rss == 0 && region->swap == 0) {
+        if (!scan->marking)
+            run_bitmap_append(&scan->bitmap, 0, counts.pages);
+    } else {
+        for (uint64_t done = 0; done < counts.pages; ) {
+            size_t batch = counts.pages - done < PAGEMAP_BATCH ? (size_t)(counts.pages - done) : PAGEMAP_BATCH;
+            ssize_t got = pread(scan->pagemap_fd, scan->entries, batch * sizeof(uint64_t),
+                                (first_page + done) * sizeof(uint64_t));
+            if (got <= 0) {
+                scan->read_errors++;
+                if (!scan->marking)
+                    run_bitmap_append(&scan->bitmap, 0, counts.pages - done);
+                break;
+            }
+            batch = got / sizeof(uint64_t);
+            scan_batch(scan, batch, &counts);
+            done += batch;
+        }
+    }
+
+    if (scan->marking)
+        return 0;
+
+    if (scan->idle_mode == IDLE_REFERENCED)
+        counts.active = region->referenced / scan->page_kb;
+
+    scan->total.pages += counts.pages;
+    scan->total.resident += counts.resident;
+    scan->total.swapped += counts.swapped;
+    scan->total.shared += counts.shared;
+    scan->total.active += counts.active;
+    scan->total.thp += counts.thp;
+    scan->total.ksm += counts.ksm;
+    scan->total_runs += scan->bitmap.count;
+
+    char map[MAP_WIDTH + 1];
+    render_map(&scan->bitmap, counts.pages, map);
+
+    long kb = scan->page_kb;
+    if (output_structured()) {
+        char address[32];
+        snprintf(address, sizeof(address), "%lx-%lx", region->start, region->end);
+        output_begin("residency");
+        output_long("pid", scan->pid);
+        output_string("address", address, strlen(address));
+        output_string("perms", region->perms, strlen(region->perms));
+        output_long("size_kB", (long)(counts.pages * kb));
+        output_long("resident_kB", (long)(counts.resident * kb));
+        output_long("swap_kB", (long)(counts.swapped * kb));
+        output_long("shared_kB", (long)(counts.shared * kb));
+        output_long("active_kB", scan->idle_mode != IDLE_NONE ? (long)(counts.active * kb) : -1);
+        output_long("runs", (long)scan->bitmap.count);
+        output_string("map", map, strlen(map));
+        output_string("path", region->path, region->path_length);
+        output_end();
+        return 0;
+    }
+    FILE *out = output_stream();
+    fprintf(out, "%012lx-%012lx %s %10lu %9lu %9lu %9lu",
+           region->start, region->end, region->perms, (unsigned long)(counts.pages * kb),
+           (unsigned long)(counts.resident * kb), (unsigned long)(counts.swapped * kb),
+           (unsigned long)(counts.shared * kb));
+    if (scan->idle_mode != IDLE_NONE)
+        fprintf(out, " %9lu", (unsigned long)(counts.active * kb));
+    fprintf(out, " %6zu |%-*s| %.*s\n", scan->bitmap.count, MAP_WIDTH, map,
+           (int)region->path_length, region->path);
+    return 0;
+}
+
+static void sleep_ms(int ms) {
+    struct timespec delay = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    while (!interrupted && nanosleep(&delay, &delay) == -1 && errno == EINTR)
+        ;
+}
+
+int report_residency(int process_id, int idle_ms) {
+    char file_path[64];
+    ResidencyScan scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.pid = process_id;
+
+    snprintf(file_path, sizeof(file_path), "/proc/%d/pagemap", process_id);
+    scan.pagemap_fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (scan.pagemap_fd == -1) {
+        fprintf(stderr, "Couldn't open %s: %s\n", file_path, strerror(errno));
+        return -1;
+    }
+    scan.kpagecount_fd = open("/proc/kpagecount", O_RDONLY | O_CLOEXEC);
+    scan.kpageflags_fd = open("/proc/kpageflags", O_RDONLY | O_CLOEXEC);
+    scan.idle_fd = -1;
+    scan.page_size = (size_t)sysconf(_SC_PAGESIZE);
+    scan.page_kb = (long)(scan.page_size / 1024);
+
+    if (idle_ms > 0) {
+        scan.idle_fd = open("/sys/kernel/mm/page_idle/bitmap", O_RDWR | O_CLOEXEC);
+        scan.idle_mode = scan.idle_fd != -1 ? IDLE_PAGE_IDLE : IDLE_REFERENCED;
+    }
+
+    scan.entries = malloc(PAGEMAP_BATCH * sizeof(uint64_t));
+    scan.pfns = malloc(PAGEMAP_BATCH * sizeof(uint64_t));
+    scan.counts = malloc(PAGEMAP_BATCH * sizeof(uint64_t));
+    scan.flags = malloc(PAGEMAP_BATCH * sizeof(uint64_t));
+    int status = 0;
+    if (!scan.entries || !scan.pfns || !scan.counts || !scan.flags) {
+        fprintf(stderr, "Out of memory\n");
+        status = -1;
+        goto done;
+    }
+
+    if (scan.idle_mode == IDLE_PAGE_IDLE) {
+        // pass 1: mark every resident page idle; any access in the window clears it
+        scan.marking = 1;
+        if (stream_regions(process_id, &scan.detailed, residency_region, &scan) != 0) {
+            status = -1;
+            goto done;
+        }
+        flush_idle_word(&scan);
+        scan.marking = 0;
+        sleep_ms(idle_ms);
+    } else if (scan.idle_mode == IDLE_REFERENCED) {
+        snprintf(file_path, sizeof(file_path), "/proc/%d/clear_refs", process_id);
+        int clear_fd = open(file_path, O_WRONLY | O_CLOEXEC);
+        if (clear_fd == -1 || write(clear_fd, "1", 1) != 1) {
+            fprintf(stderr, "Couldn't write %s: %s\n", file_path, strerror(errno));
+            if (clear_fd != -1)
+                close(clear_fd);
+            status = -1;
+            goto done;
+        }
+        close(clear_fd);
+        sleep_ms(idle_ms);
+    }
+
+    int structured = output_structured();
+    FILE *out = output_stream();
+    if (!structured) {
+        fprintf(out, "\n---- Page Residency (PID: %d) ----\n", process_id);
+        fprintf(out, "%-25s %-4s %10s %9s %9s %9s", "ADDRESS", "PERM", "SIZE_kB", "RES_kB", "SWAP_kB", "SHARED_kB");
+        if (scan.idle_mode != IDLE_NONE)
+            fprintf(out, " %9s", "ACTIVE_kB");
+        fprintf(out, " %6s  %-*s  %s\n", "RUNS", MAP_WIDTH, "RESIDENT (. < 25% ... # = 100%)", "PATH");
+    }
+
+    if (stream_regions(process_id, &scan.detailed, residency_region, &scan) != 0) {
+        status = -1;
+        goto done;
+    }
+
+    long kb = scan.page_kb;
+    if (structured) {
+        output_begin("residency_total");
+        output_long("pid", process_id);
+        output_long("size_kB", (long)(scan.total.pages * kb));
+        output_long("resident_kB", (long)(scan.total.resident * kb));
+        output_long("swap_kB", (long)(scan.total.swapped * kb));
+        output_long("shared_kB", (long)(scan.total.shared * kb));
+        output_long("thp_kB", scan.kpageflags_fd != -1 ? (long)(scan.total.thp * kb) : -1);
+        output_long("ksm_kB", scan.kpageflags_fd != -1 ? (long)(scan.total.ksm * kb) : -1);
+        output_long("active_kB", scan.idle_mode != IDLE_NONE ? (long)(scan.total.active * kb) : -1);
+        output_long("idle_ms", idle_ms);
+        output_long("runs", (long)scan.total_runs);
+        output_long("read_errors", scan.read_errors);
+        output_end();
+        goto done;
+    }
+
+    fprintf(out, "\nTotal: %lu kB mapped, %lu kB resident, %lu kB swapped, %lu kB shared",
+           (unsigned long)(scan.total.pages * kb), (unsigned long)(scan.total.resident * kb),
+           (unsigned long)(scan.total.swapped * kb), (unsigned long)(scan.total.shared * kb));
+    fprintf(out, " (%s)\n", scan.kpagecount_fd != -1 ? "kpagecount > 1" : "not exclusively mapped");
+    if (scan.kpageflags_fd != -1)
+        fprintf(out, "Transparent huge pages: %lu kB, KSM merged: %lu kB\n",
+               (unsigned long)(scan.total.thp * kb), (unsigned long)(scan.total.ksm * kb));
+    if (scan.idle_mode != IDLE_NONE) {
+        double percent = scan.total.resident ? 100.0 * scan.total.active / scan.total.resident : 0;
+        fprintf(out, "Working set over %d ms: %lu kB of %lu kB resident (%.1f%%, %s)\n",
+               idle_ms, (unsigned long)(scan.total.active * kb), (unsigned long)(scan.total.resident * kb),
+               percent, scan.idle_mode == IDLE_PAGE_IDLE ? "page_idle" : "smaps Referenced after clear_refs");
+    }
+    fprintf(out, "Residency bitmap: %lu pages in %lu runs (%lu bytes, %lu as a flat bitmap)\n",
+           (unsigned long)scan.total.pages, (unsigned long)scan.total_runs,
+           (unsigned long)(scan.total_runs * sizeof(uint32_t)), (unsigned long)((scan.total.pages + 7) / 8));
+    if (scan.read_errors > 0)
+        fprintf(out, "pagemap could not be read for %d mappings\n", scan.read_errors);
+
+done:
+    free(scan.entries);
+    free(scan.pfns);
+    free(scan.counts);
+    free(scan.flags);
+    run_bitmap_free(&scan.bitmap);
+    if (scan.idle_fd != -1)
+        close(scan.idle_fd);
+    if (scan.kpageflags_fd != -1)
+        close(scan.kpageflags_fd);
+    if (scan.kpagecount_fd != -1)
+        close(scan.kpagecount_fd);
+    close(scan.pagemap_fd);
+    return status;
+}
@@ -0,0 +1,26 @@
+#ifndef PAGEMAP_H
+#define PAGEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Page residency of one mapping as alternating run lengths, starting with a
+// run of non-resident pages (which may be 0). Memory use follows the number
+// of transitions, not the size of the mapping.
+typedef struct {
+    uint32_t *runs;
+    size_t count;
+    size_t capacity;
+} RunBitmap;
+
+void run_bitmap_reset(RunBitmap *bitmap);
+int run_bitmap_append(RunBitmap *bitmap, int bit, uint64_t length);
+void run_bitmap_free(RunBitmap *bitmap);
+
+// Print per-mapping resident/swapped/shared pages from /proc/<pid>/pagemap
+// (with kpagecount/kpageflags when readable). With idle_ms > 0 the working
+// set over that window is measured with page_idle, or with the smaps
+// Referenced counters after clear_refs when page_idle is not available.
+int report_residency(int process_id, int idle_ms);
+
+#endif
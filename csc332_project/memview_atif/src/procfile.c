@@ -0,0 +1,147 @@
+#include "procfile.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+#define PROC_BUFFER_INITIAL 8192
+
+static int proc_buffer_reserve(ProcBuffer *buffer, size_t needed) {
+    if (needed <= buffer->capacity)
+        return 0;
+
+    size_t capacity = buffer->capacity ? buffer->capacity : PROC_BUFFER_INITIAL;
+    while (capacity < needed)
+        capacity *= 2;
+
+    char *data = realloc(buffer->data, capacity);
+    if (!data)
+        return -1;
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+ssize_t proc_buffer_pread(ProcBuffer *buffer, int file_desc) {
+    buffer->length = 0;
+    if (proc_buffer_reserve(buffer, PROC_BUFFER_INITIAL) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // /proc files have no useful size, so keep reading until EOF and
+    // double the buffer whenever it fills up
+    for (;;) {
+        if (buffer->length + 1 == buffer->capacity &&
+            proc_buffer_reserve(buffer, buffer->capacity * 2) != 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        ssize_t bytes_read = pread(file_desc, buffer->data + buffer->length,
+                                   buffer->capacity - 1 - buffer->length, buffer->length);
+        if (bytes_read < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (bytes_read == 0)
+            break;
+        buffer->length += bytes_read;
+    }
+
+    buffer->data[buffer->length] = '\0';
+    return buffer->length;
+}
+
+ssize_t proc_buffer_read_file(ProcBuffer *buffer, int dir_fd, const char *path) {
+    int file_desc = openat(dir_fd, path, O_RDONLY | O_CLOEXEC);
+    if (file_desc == -1)
+        return -1;
+
+    ssize_t length = proc_buffer_pread(buffer, file_desc);
+    int saved = errno;
+    close(file_desc);
+    errno = saved;
+    return length;
+}
+
+void proc_buffer_free(ProcBuffer *buffer) {
+    free(buffer->data);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+static pthread_key_t thread_buffer_key;
+static pthread_once_t thread_buffer_once = PTHREAD_ONCE_INIT;
+
+static void free_thread_buffer(void *ptr) {
+    proc_buffer_free(ptr);
+    free(ptr);
+}
+
+static void create_thread_buffer_key(void) {
+    pthread_key_create(&thread_buffer_key, free_thread_buffer);
+}
+
+ProcBuffer *proc_thread_buffer(void) {
+    pthread_once(&thread_buffer_once, create_thread_buffer_key);
+
+    ProcBuffer *buffer = pthread_getspecific(thread_buffer_key);
+    if (!buffer) {
+        buffer = calloc(1, sizeof(ProcBuffer));
+        if (buffer)
+            pthread_setspecific(thread_buffer_key, buffer);
+    }
+    return buffer;
+}
+
+void proc_tokenizer_init(ProcTokenizer *tokenizer, const char *data, size_t length) {
+    tokenizer->pos = data;
+    tokenizer->end = data + length;
+}
+
+static int is_blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+int proc_next_field(ProcTokenizer *tokenizer, ProcField *field) {
+    while (tokenizer->pos < tokenizer->end) {
+        const char *line = tokenizer->pos;
+        const char *line_end = memchr(line, '\n', tokenizer->end - line);
+        if (!line_end)
+            line_end = tokenizer->end;
+        tokenizer->pos = line_end < tokenizer->end ? line_end + 1 : line_end;
+
+        const char *colon = memchr(line, ':', line_end - line);
+        if (!colon)
+            continue;
+
+        const char *value = colon + 1;
+        while (value < line_end && is_blank(*value))
+            value++;
+        const char *value_end = line_end;
+        while (value_end > value && is_blank(value_end[-1]))
+            value_end--;
+
+        field->key = line;
+        field->key_length = colon - line;
+        field->value = value;
+        field->value_length = value_end - value;
+        return 1;
+    }
+    return 0;
+}
+
+int proc_field_is(const ProcField *field, const char *key) {
+    size_t length = strlen(key);
+    return field->key_length == length && memcmp(field->key, key, length) == 0;
+}
+
+long proc_field_long(const ProcField *field) {
+    long value = 0;
+    for (size_t i = 0; i < field->value_length && field->value[i] >= '0' && field->value[i] <= '9'; i++)
+        value = value * 10 + (field->value[i] - '0');
+    return value;
+}
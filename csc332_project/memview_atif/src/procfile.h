@@ -0,0 +1,50 @@
+#ifndef PROCFILE_H
+#define PROCFILE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Growable buffer for whole /proc files. It only ever grows, so once it has
+// seen the largest file a caller reads, later reads allocate nothing.
+typedef struct {
+    char *data;       // always NUL terminated after a successful read
+    size_t length;
+    size_t capacity;
+} ProcBuffer;
+
+// Read an open file from offset 0 to EOF with pread (the fd can be kept open
+// and re-read, e.g. on every sampling tick). Returns the length or -1.
+ssize_t proc_buffer_pread(ProcBuffer *buffer, int file_desc);
+
+// Open path (relative to dir_fd, or AT_FDCWD), read it to EOF and close it
+ssize_t proc_buffer_read_file(ProcBuffer *buffer, int dir_fd, const char *path);
+
+void proc_buffer_free(ProcBuffer *buffer);
+
+// The calling thread's shared buffer, freed when the thread exits
+ProcBuffer *proc_thread_buffer(void);
+
+// "Key:   value" fields, pointing into the buffer (nothing is copied)
+typedef struct {
+    const char *key;
+    size_t key_length;
+    const char *value;        // leading and trailing blanks trimmed
+    size_t value_length;
+} ProcField;
+
+typedef struct {
+    const char *pos;
+    const char *end;
+} ProcTokenizer;
+
+void proc_tokenizer_init(ProcTokenizer *tokenizer, const char *data, size_t length);
+
+// Next line that has a ':'; returns 1 with *field filled in, 0 at the end
+int proc_next_field(ProcTokenizer *tokenizer, ProcField *field);
+
+int proc_field_is(const ProcField *field, const char *key);
+
+// Leading decimal number of the value ("1234 kB" -> 1234)
+long proc_field_long(const ProcField *field);
+
+#endif
@@ -0,0 +1,488 @@
+#include "regions.h"
+#include "output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+
+#define REGION_BUFFER_SIZE 65536
+#define REGION_TOP_PATHS 20
+
+static const char *region_type_names[REGION_TYPE_COUNT] = {
+    "heap", "stack", "anon", "file", "vdso"
+};
+
+const char *region_type_name(RegionType type) {
+    return region_type_names[type];
+}
+
+static RegionType classify_region(const char *path, size_t length) {
+    if (length == 0)
+        return REGION_ANON;
+    if (path[0] == '/')
+        return REGION_FILE;
+    if (length >= 6 && memcmp(path, "[heap]", 6) == 0)
+        return REGION_HEAP;
+    if (length >= 6 && memcmp(path, "[stack", 6) == 0)
+        return REGION_STACK;
+    if ((length >= 5 && memcmp(path, "[vdso", 5) == 0) ||
+        (length >= 5 && memcmp(path, "[vvar", 5) == 0) ||
+        (length >= 10 && memcmp(path, "[vsyscall]", 10) == 0))
+        return REGION_VDSO;
+    // [anon:name], [anon_shmem:name] and anything else the kernel labels
+    return REGION_ANON;
+}
+
+static unsigned long parse_hex(const char **cursor, const char *end) {
+    const char *p = *cursor;
+    unsigned long value = 0;
+    for (; p < end; p++) {
+        int digit;
+        if (*p >= '0' && *p <= '9')
+            digit = *p - '0';
+        else if (*p >= 'a' && *p <= 'f')
+            digit = *p - 'a' + 10;
+        else
+            break;
+        value = (value << 4) | digit;
+    }
+    *cursor = p;
+    return value;
+}
+
+static unsigned long parse_dec(const char **cursor, const char *end) {
+    const char *p = *cursor;
+    unsigned long value = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        value = value * 10 + (*p++ - '0');
+    *cursor = p;
+    return value;
+}
+
+static void skip_spaces(const char **cursor, const char *end) {
+    while (*cursor < end && (**cursor == ' ' || **cursor == '\t'))
+        (*cursor)++;
+}
+
+// "start-end perms offset major:minor inode   path"
+static int parse_region_header(const char *line, const char *end, Region *region) {
+    const char *p = line;
+
+    memset(region, 0, sizeof(*region));
+    region->start = parse_hex(&p, end);
+    if (p >= end || *p != '-')
+        return -1;
+    p++;
+    region->end = parse_hex(&p, end);
+    skip_spaces(&p, end);
+
+    if (end - p < 4)
+        return -1;
+    memcpy(region->perms, p, 4);
+    p += 4;
+    skip_spaces(&p, end);
+
+    region->offset = parse_hex(&p, end);
+    skip_spaces(&p, end);
+    region->dev_major = (unsigned int)parse_hex(&p, end);
+    if (p < end && *p == ':')
+        p++;
+    region->dev_minor = (unsigned int)parse_hex(&p, end);
+    skip_spaces(&p, end);
+    region->inode = parse_dec(&p, end);
+    skip_spaces(&p, end);
+
+    // the path runs to the end of the line and may contain spaces
+    region->path = p;
+    region->path_length = end - p;
+    region->type = classify_region(region->path, region->path_length);
+    return 0;
+}
+
+// "Key:     123 kB" lines inside an smaps block
+static void parse_region_field(const char *line, const char *end, Region *region) {
+    const char *colon = memchr(line, ':', end - line);
+    if (!colon)
+        return;
+
+    size_t key_length = colon - line;
+    const char *p = colon + 1;
+    skip_spaces(&p, end);
+
+    if (key_length == 3 && memcmp(line, "Rss", 3) == 0)
+        region->rss = parse_dec(&p, end);
+    else if (key_length == 3 && memcmp(line, "Pss", 3) == 0)
+        region->pss = parse_dec(&p, end);
+    else if (key_length == 4 && memcmp(line, "Swap", 4) == 0)
+        region->swap = parse_dec(&p, end);
+    else if (key_length == 10 && memcmp(line, "Referenced", 10) == 0)
+        region->referenced = parse_dec(&p, end);
+    else if ((key_length == 12 && memcmp(line, "Shared_Dirty", 12) == 0) ||
+             (key_length == 13 && memcmp(line, "Private_Dirty", 13) == 0))
+        region->dirty += parse_dec(&p, end);
+}
+
+// Header lines start with a lowercase hex address, field lines with a capitalised key
+static int is_region_header(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+}
+
+int stream_regions(int process_id, int *detailed, RegionCallback callback, void *context) {
+    char file_path[64];
+    snprintf(file_path, sizeof(file_path), "/proc/%d/smaps", process_id);
+
+    *detailed = 1;
+    int file_desc = open(file_path, O_RDONLY);
+    if (file_desc == -1 && errno == EACCES) {
+        *detailed = 0;
+        snprintf(file_path, sizeof(file_path), "/proc/%d/maps", process_id);
+        file_desc = open(file_path, O_RDONLY);
+    }
+    if (file_desc == -1) {
+        fprintf(stderr, "Couldn't open %s: %s\n", file_path, strerror(errno));
+        return -1;
+    }
+
+    // one buffer for the whole walk: lines are parsed in place and a partial
+    // line at the end of a read is moved to the front for the next one
+    char *buffer = malloc(REGION_BUFFER_SIZE);
+    if (!buffer) {
+        fprintf(stderr, "Out of memory reading %s\n", file_path);
+        close(file_desc);
+        return -1;
+    }
+
+    Region current;
+    // the path of the pending region must survive the buffer being refilled
+    char pending_path[4096 + 64];
+    int have_region = 0, stopped = 0, status = 0;
+    size_t filled = 0;
+
+    for (;;) {
+        ssize_t bytes_read = read(file_desc, buffer + filled, REGION_BUFFER_SIZE - filled);
+        if (bytes_read < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Failed to read %s: %s\n", file_path, strerror(errno));
+            status = -1;
+            break;
+        }
+        filled += bytes_read;
+
+        char *pos = buffer;
+        char *end = buffer + filled;
+        while (!stopped) {
+            char *line_end = memchr(pos, '\n', end - pos);
+            if (!line_end) {
+                if (bytes_read > 0 || pos == end)
+                    break;
+                line_end = end;   // last line without a newline
+            }
+
+            if (line_end > pos && is_region_header(*pos)) {
+                if (have_region && callback(&current, context) != 0)
+                    stopped = 1;
+                if (!stopped && parse_region_header(pos, line_end, &current) == 0) {
+                    size_t n = current.path_length < sizeof(pending_path) ? current.path_length : sizeof(pending_path) - 1;
+                    memcpy(pending_path, current.path, n);
+                    current.path = pending_path;
+                    current.path_length = n;
+                    have_region = 1;
+                }
+            } else if (have_region) {
+                parse_region_field(pos, line_end, &current);
+            }
+
+            pos = line_end < end ? line_end + 1 : end;
+        }
+
+        if (stopped || bytes_read == 0)
+            break;
+
+        filled = end - pos;
+        memmove(buffer, pos, filled);
+        if (filled == REGION_BUFFER_SIZE) {
+            fprintf(stderr, "Line too long in %s\n", file_path);
+            status = -1;
+            break;
+        }
+    }
+
+    if (status == 0 && !stopped && have_region)
+        callback(&current, context);
+
+    free(buffer);
+    close(file_desc);
+    return status;
+}
+
+// ---- aggregation ----
+
+typedef struct {
+    long regions;
+    long size;
+    long rss;
+    long pss;
+    long dirty;
+    long swap;
+} RegionTotals;
+
+typedef struct {
+    size_t name_offset;    // into the name arena
+    uint32_t hash;
+    RegionType type;
+    RegionTotals totals;
+} PathEntry;
+
+typedef struct {
+    int pid;
+    int summary_only;
+    RegionTotals by_type[REGION_TYPE_COUNT];
+    RegionTotals all;
+
+    // open addressing table of distinct paths; names are interned in one arena
+    PathEntry *paths;
+    size_t path_capacity;
+    size_t path_count;
+    char *names;
+    size_t names_used;
+    size_t names_capacity;
+    int out_of_memory;
+} RegionReport;
+
+static uint32_t hash_path(const char *path, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)path[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void add_totals(RegionTotals *totals, const Region *region) {
+    totals->regions++;
+    totals->size += (long)((region->end - region->start) / 1024);
+    totals->rss += region->rss;
+    totals->pss += region->pss;
+    totals->dirty += region->dirty;
+    totals->swap += region->swap;
+}
+
+static int grow_paths(RegionReport *report) {
+    size_t capacity = report->path_capacity ? report->path_capacity * 2 : 256;
+    PathEntry *table = calloc(capacity, sizeof(PathEntry));
+    if (!table)
+        return -1;
+
+    for (size_t i = 0; i < report->path_capacity; i++) {
+        PathEntry *e = &report->paths[i];
+        if (e->totals.regions == 0)
+            continue;
+        size_t slot = e->hash & (capacity - 1);
+        while (table[slot].totals.regions != 0)
+            slot = (slot + 1) & (capacity - 1);
+        table[slot] = *e;
+    }
+    free(report->paths);
+    report->paths = table;
+    report->path_capacity = capacity;
+    return 0;
+}
+
+static PathEntry *find_path(RegionReport *report, const char *path, size_t length, RegionType type) {
+    if ((report->path_count + 1) * 10 > report->path_capacity * 7 && grow_paths(report) != 0)
+        return NULL;
+
+    uint32_t hash = hash_path(path, length);
+    size_t slot = hash & (report->path_capacity - 1);
+    for (;;) {
+        PathEntry *e = &report->paths[slot];
+        if (e->totals.regions == 0)
+            break;
+        const char *name = report->names + e->name_offset;
+        if (e->hash == hash && strlen(name) == length && memcmp(name, path, length) == 0)
+            return e;
+        slot = (slot + 1) & (report->path_capacity - 1);
+    }
+
+    if (report->names_used + length + 1 > report->names_capacity) {
+        size_t capacity = report->names_capacity ? report->names_capacity * 2 : 16384;
+        while (capacity < report->names_used + length + 1)
+            capacity *= 2;
+        char *names = realloc(report->names, capacity);
+        if (!names)
+            return NULL;
+        report->names = names;
+        report->names_capacity = capacity;
+    }
+
+    PathEntry *e = &report->paths[slot];
+    e->name_offset = report->names_used;
+    e->hash = hash;
+    e->type = type;
+    memcpy(report->names + report->names_used, path, length);
+    report->names[report->names_used + length] = '\0';
+    report->names_used += length + 1;
+    report->path_count++;
+    return e;
+}
+
+static int report_region(const Region *region, void *context) {
+    RegionReport *report = context;
+
+    add_totals(&report->by_type[region->type], region);
+    add_totals(&report->all, region);
+
+    const char *key = region->path;
+    size_t key_length = region->path_length;
+    if (key_length == 0) {
+        key = "[anon]";
+        key_length = 6;
+    }
+    PathEntry *entry = find_path(report, key, key_length, region->type);
+    if (entry)
+        add_totals(&entry->totals, region);
+    else
+        report->out_of_memory = 1;
+
+    if (report->summary_only)
+        return 0;
+
+    if (output_structured()) {
+        char address[32];
+        snprintf(address, sizeof(address), "%lx-%lx", region->start, region->end);
+        output_begin("region");
+        output_long("pid", report->pid);
+        output_string("address", address, strlen(address));
+        output_string("perms", region->perms, strlen(region->perms));
+        output_long("offset", (long)region->offset);
+        output_long("inode", (long)region->inode);
+        output_long("size_kB", (long)((region->end - region->start) / 1024));
+        output_long("rss_kB", region->rss);
+        output_long("pss_kB", region->pss);
+        output_long("dirty_kB", region->dirty);
+        output_long("swap_kB", region->swap);
+        output_string("type", region_type_names[region->type], strlen(region_type_names[region->type]));
+        output_string("path", region->path, region->path_length);
+        output_end();
+    } else {
+        FILE *out = output_stream();
+        fprintf(out, "%012lx-%012lx %s %08lx %02x:%02x %-8lu %9lu %8ld %8ld %8ld %8ld %.*s\n",
+               region->start, region->end, region->perms, region->offset,
+               region->dev_major, region->dev_minor, region->inode,
+               (region->end - region->start) / 1024,
+               region->rss, region->pss, region->dirty, region->swap,
+               (int)region->path_length, region->path);
+    }
+    return 0;
+}
+
+static int compare_paths_by_rss(const void *a, const void *b) {
+    const PathEntry *pa = a, *pb = b;
+    if (pa->totals.rss != pb->totals.rss)
+        return pa->totals.rss < pb->totals.rss ? 1 : -1;
+    if (pa->totals.size != pb->totals.size)
+        return pa->totals.size < pb->totals.size ? 1 : -1;
+    return 0;
+}
+
+static void print_totals_row(FILE *out, const char *label, const RegionTotals *t) {
+    fprintf(out, "%-40s %8ld %10ld %9ld %9ld %9ld %9ld\n",
+           label, t->regions, t->size, t->rss, t->pss, t->dirty, t->swap);
+}
+
+static void emit_totals(const char *kind, int pid, const char *name, const RegionTotals *t) {
+    output_begin(kind);
+    output_long("pid", pid);
+    output_string("name", name, strlen(name));
+    output_long("regions", t->regions);
+    output_long("size_kB", t->size);
+    output_long("rss_kB", t->rss);
+    output_long("pss_kB", t->pss);
+    output_long("dirty_kB", t->dirty);
+    output_long("swap_kB", t->swap);
+    output_end();
+}
+
+static void print_types_table(FILE *out, const RegionReport *report) {
+    fprintf(out, "\n---- Regions by Type ----\n");
+    fprintf(out, "%-40s %8s %10s %9s %9s %9s %9s\n", "TYPE", "REGIONS", "SIZE_kB", "RSS_kB", "PSS_kB", "DIRTY_kB", "SWAP_kB");
+    for (int i = 0; i < REGION_TYPE_COUNT; i++) {
+        if (report->by_type[i].regions > 0)
+            print_totals_row(out, region_type_names[i], &report->by_type[i]);
+    }
+    print_totals_row(out, "total", &report->all);
+}
+
+int report_regions(int process_id, int summary_only) {
+    RegionReport report;
+    memset(&report, 0, sizeof(report));
+    report.pid = process_id;
+    report.summary_only = summary_only;
+    int structured = output_structured();
+    FILE *out = output_stream();
+
+    if (!structured)
+        fprintf(out, "\n---- Memory Regions (PID: %d) ----\n", process_id);
+    if (!structured && !summary_only) {
+        fprintf(out, "%-25s %-4s %-8s %-5s %-8s %9s %8s %8s %8s %8s %s\n",
+               "ADDRESS", "PERM", "OFFSET", "DEV", "INODE", "SIZE_kB", "RSS_kB", "PSS_kB", "DIRTY_kB", "SWAP_kB", "PATH");
+    }
+
+    int detailed;
+    if (stream_regions(process_id, &detailed, report_region, &report) != 0) {
+        free(report.paths);
+        free(report.names);
+        return -1;
+    }
+
+    if (!detailed)
+        fprintf(structured ? stderr : out,
+                "(smaps is not readable: RSS, PSS, dirty and swap are not available)\n");
+
+    if (structured) {
+        for (int i = 0; i < REGION_TYPE_COUNT; i++) {
+            if (report.by_type[i].regions > 0)
+                emit_totals("region_type", process_id, region_type_names[i], &report.by_type[i]);
+        }
+        emit_totals("region_type", process_id, "total", &report.all);
+    } else {
+        print_types_table(out, &report);
+    }
+
+    // compact the hash table in place and rank the paths
+    size_t count = 0;
+    for (size_t i = 0; i < report.path_capacity; i++) {
+        if (report.paths[i].totals.regions != 0)
+            report.paths[count++] = report.paths[i];
+    }
+    qsort(report.paths, count, sizeof(PathEntry), compare_paths_by_rss);
+
+    if (structured) {
+        // machine-readable output keeps every path, untruncated
+        for (size_t i = 0; i < count; i++)
+            emit_totals("region_path", process_id, report.names + report.paths[i].name_offset, &report.paths[i].totals);
+    } else {
+        size_t shown = count < REGION_TOP_PATHS ? count : REGION_TOP_PATHS;
+        fprintf(out, "\n---- Regions by Path (top %zu of %zu by RSS) ----\n", shown, count);
+        fprintf(out, "%-40s %8s %10s %9s %9s %9s %9s\n", "PATH", "REGIONS", "SIZE_kB", "RSS_kB", "PSS_kB", "DIRTY_kB", "SWAP_kB");
+        for (size_t i = 0; i < shown; i++) {
+            const char *name = report.names + report.paths[i].name_offset;
+            // keep the end of long paths, which is the part that identifies the file
+            size_t length = strlen(name);
+            if (length > 40)
+                name += length - 40;
+            print_totals_row(out, name, &report.paths[i].totals);
+        }
+    }
+
+    if (report.out_of_memory)
+        fprintf(stderr, "Out of memory: some paths are missing from the per-path totals\n");
+
+    free(report.paths);
+    free(report.names);
+    return 0;
+}
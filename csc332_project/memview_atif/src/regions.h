@@ -0,0 +1,48 @@
+#ifndef REGIONS_H
+#define REGIONS_H
+
+#include <stddef.h>
+
+typedef enum {
+    REGION_HEAP,
+    REGION_STACK,
+    REGION_ANON,
+    REGION_FILE,
+    REGION_VDSO,
+    REGION_TYPE_COUNT
+} RegionType;
+
+// One mapping from /proc/<pid>/smaps (or maps). Sizes are in kB; the usage
+// fields stay 0 when only maps could be read.
+typedef struct {
+    unsigned long start;
+    unsigned long end;
+    char perms[5];
+    unsigned long offset;
+    unsigned int dev_major;
+    unsigned int dev_minor;
+    unsigned long inode;
+    const char *path;        // points into the reader's buffer, valid during the callback
+    size_t path_length;      // 0 for anonymous mappings
+    RegionType type;
+    long rss;
+    long pss;
+    long dirty;
+    long swap;
+    long referenced;
+} Region;
+
+// Called once per region, in address order; a nonzero return stops the walk
+typedef int (*RegionCallback)(const Region *region, void *context);
+
+// Stream every region of a process in one pass over smaps (falling back to
+// maps if smaps is not readable). *detailed is set to 1 when usage came from
+// smaps. Memory use does not depend on the number of mappings.
+int stream_regions(int process_id, int *detailed, RegionCallback callback, void *context);
+
+const char *region_type_name(RegionType type);
+
+// Print the region table (unless summary_only) and totals by type and by path
+int report_regions(int process_id, int summary_only);
+
+#endif
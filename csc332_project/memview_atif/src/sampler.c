@@ -0,0 +1,295 @@
+#include "sampler.h"
+#include "helpers.h"
+#include "procfile.h"
+#include "output.h"
+#include "timeseries.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+
+static const FieldSpec status_fields[] = {
+    {"VmPeak",   offsetof(StatusSample, vm_peak)},
+    {"VmSize",   offsetof(StatusSample, vm_size)},
+    {"VmHWM",    offsetof(StatusSample, vm_hwm)},
+    {"VmRSS",    offsetof(StatusSample, vm_rss)},
+    {"RssAnon",  offsetof(StatusSample, rss_anon)},
+    {"RssFile",  offsetof(StatusSample, rss_file)},
+    {"RssShmem", offsetof(StatusSample, rss_shmem)},
+    {"VmData",   offsetof(StatusSample, vm_data)},
+    {"VmStk",    offsetof(StatusSample, vm_stk)},
+    {"VmSwap",   offsetof(StatusSample, vm_swap)},
+    {"Threads",  offsetof(StatusSample, threads)},
+};
+
+static const FieldSpec meminfo_fields[] = {
+    {"MemTotal",     offsetof(MeminfoSample, mem_total)},
+    {"MemFree",      offsetof(MeminfoSample, mem_free)},
+    {"MemAvailable", offsetof(MeminfoSample, mem_available)},
+    {"Cached",       offsetof(MeminfoSample, cached)},
+    {"SwapFree",     offsetof(MeminfoSample, swap_free)},
+};
+
+int parse_fields(const char *data, size_t length, const FieldSpec *fields, int field_count, void *out) {
+    ProcTokenizer tokenizer;
+    ProcField field;
+    int found = 0;
+
+    proc_tokenizer_init(&tokenizer, data, length);
+    while (found < field_count && proc_next_field(&tokenizer, &field)) {
+        for (int i = 0; i < field_count; i++) {
+            if (proc_field_is(&field, fields[i].key)) {
+                *(long *)((char *)out + fields[i].offset) = proc_field_long(&field);
+                found++;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+int parse_status_sample(const char *data, size_t length, StatusSample *out) {
+    memset(out, 0, sizeof(*out));
+    return parse_fields(data, length, status_fields, FIELD_COUNT(status_fields), out);
+}
+
+int parse_meminfo_sample(const char *data, size_t length, MeminfoSample *out) {
+    memset(out, 0, sizeof(*out));
+    return parse_fields(data, length, meminfo_fields, FIELD_COUNT(meminfo_fields), out);
+}
+
+static double elapsed_us(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static void add_ms(struct timespec *t, int ms) {
+    t->tv_sec += ms / 1000;
+    t->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (t->tv_nsec >= 1000000000L) {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000L;
+    }
+}
+
+void print_sample_header(const char *title, int with_meminfo) {
+    if (output_structured())
+        return;
+    printf("\n---- %s ----\n", title);
+    printf("%10s %10s %8s %10s %8s %9s %7s %10s %8s %7s",
+           "time_ms", "rss_kB", "delta", "anon_kB", "delta", "swap_kB", "delta", "vmsize_kB", "delta", "threads");
+    if (with_meminfo)
+        printf(" %10s %9s", "avail_kB", "delta");
+    printf("\n");
+}
+
+void print_sample_row(const SampleRecord *current, const SampleRecord *previous, double elapsed_ms) {
+    const StatusSample *now = &current->status, *before = &previous->status;
+
+    if (output_structured()) {
+        output_begin("sample");
+        output_long("time_ns", (long)current->time_ns);
+        output_long("pid", current->pid);
+        output_double("elapsed_ms", elapsed_ms);
+        output_long("rss_kB", now->vm_rss);
+        output_long("rss_delta", now->vm_rss - before->vm_rss);
+        output_long("hwm_kB", now->vm_hwm);
+        output_long("anon_kB", now->rss_anon);
+        output_long("anon_delta", now->rss_anon - before->rss_anon);
+        output_long("file_kB", now->rss_file);
+        output_long("shmem_kB", now->rss_shmem);
+        output_long("swap_kB", now->vm_swap);
+        output_long("swap_delta", now->vm_swap - before->vm_swap);
+        output_long("vmsize_kB", now->vm_size);
+        output_long("vmsize_delta", now->vm_size - before->vm_size);
+        output_long("threads", now->threads);
+        if (current->has_meminfo) {
+            output_long("avail_kB", current->meminfo.mem_available);
+            output_long("avail_delta", current->meminfo.mem_available - previous->meminfo.mem_available);
+        }
+        output_end();
+        output_tick();
+        return;
+    }
+
+    printf("%10.1f %10ld %+8ld %10ld %+8ld %9ld %+7ld %10ld %+8ld %7ld",
+           elapsed_ms,
+           now->vm_rss, now->vm_rss - before->vm_rss,
+           now->rss_anon, now->rss_anon - before->rss_anon,
+           now->vm_swap, now->vm_swap - before->vm_swap,
+           now->vm_size, now->vm_size - before->vm_size,
+           now->threads);
+    if (current->has_meminfo)
+        printf(" %10ld %+9ld", current->meminfo.mem_available,
+               current->meminfo.mem_available - previous->meminfo.mem_available);
+    printf("\n");
+}
+
+void print_sample_summary(const SampleRecord *first, const SampleRecord *last, int samples,
+                          double cost_total_us, double cost_max_us) {
+    const StatusSample *from = &first->status, *to = &last->status;
+    double span_ms = (last->time_ns - first->time_ns) / 1e6;
+
+    if (output_structured()) {
+        output_begin("sample_summary");
+        output_long("pid", last->pid);
+        output_long("samples", samples);
+        output_double("span_ms", span_ms);
+        output_long("rss_first_kB", from->vm_rss);
+        output_long("rss_last_kB", to->vm_rss);
+        output_long("hwm_kB", to->vm_hwm);
+        output_long("anon_change", to->rss_anon - from->rss_anon);
+        output_long("swap_change", to->vm_swap - from->vm_swap);
+        output_long("vmsize_change", to->vm_size - from->vm_size);
+        if (last->has_meminfo)
+            output_long("avail_change", last->meminfo.mem_available - first->meminfo.mem_available);
+        if (cost_max_us >= 0) {
+            output_double("cost_avg_us", cost_total_us / samples);
+            output_double("cost_max_us", cost_max_us);
+        }
+        output_end();
+        return;
+    }
+
+    printf("\n---- Sampling Summary (PID: %d) ----\n", last->pid);
+    printf("Samples: %d over %.2f s\n", samples, span_ms / 1000.0);
+    printf("RSS change: %+ld kB (%ld -> %ld), peak %ld kB\n",
+           to->vm_rss - from->vm_rss, from->vm_rss, to->vm_rss, to->vm_hwm);
+    printf("Anon change: %+ld kB, swap change: %+ld kB, size change: %+ld kB\n",
+           to->rss_anon - from->rss_anon, to->vm_swap - from->vm_swap, to->vm_size - from->vm_size);
+    if (last->has_meminfo)
+        printf("MemAvailable change: %+ld kB\n", last->meminfo.mem_available - first->meminfo.mem_available);
+    if (cost_max_us >= 0)
+        printf("Read+parse cost per sample: %.1f us average, %.1f us max\n", cost_total_us / samples, cost_max_us);
+}
+
+int run_sampler(const SampleOptions *options) {
+    char status_path[64];
+    snprintf(status_path, sizeof(status_path), "/proc/%d/status", options->pid);
+
+    // opened once; every tick is a pread plus a parse
+    int status_fd = open(status_path, O_RDONLY);
+    if (status_fd == -1) {
+        fprintf(stderr, "Couldn't open %s: %s\n", status_path, strerror(errno));
+        return -1;
+    }
+
+    int meminfo_fd = -1;
+    if (options->with_system) {
+        meminfo_fd = open("/proc/meminfo", O_RDONLY);
+        if (meminfo_fd == -1) {
+            fprintf(stderr, "Couldn't open /proc/meminfo: %s\n", strerror(errno));
+            close(status_fd);
+            return -1;
+        }
+    }
+
+    // grows to fit on the first tick, then every tick reuses it
+    ProcBuffer *buffer = proc_thread_buffer();
+    if (!buffer) {
+        fprintf(stderr, "Out of memory\n");
+        if (meminfo_fd != -1)
+            close(meminfo_fd);
+        close(status_fd);
+        return -1;
+    }
+
+    TimeseriesWriter *recorder = NULL;
+    if (options->record_path) {
+        recorder = timeseries_open(options->record_path);
+        if (!recorder) {
+            if (meminfo_fd != -1)
+                close(meminfo_fd);
+            close(status_fd);
+            return -1;
+        }
+    }
+
+    SampleRecord first, previous, current;
+    struct timespec start, next, before, after, wall;
+    double total_us = 0, max_us = 0;
+    int samples = 0;
+
+    memset(&current, 0, sizeof(current));
+    current.pid = options->pid;
+    current.has_meminfo = meminfo_fd != -1;
+
+    char title[PATH_MAX + 64];
+    int title_length = snprintf(title, sizeof(title), "%s PID %d every %d ms",
+                          recorder ? "Recording" : "Sampling", options->pid, options->interval_ms);
+    if (options->count > 0)
+        title_length += snprintf(title + title_length, sizeof(title) - title_length, " (%d samples)", options->count);
+    if (recorder) {
+        // rows go to the file only; --replay prints them
+        snprintf(title + title_length, sizeof(title) - title_length, " to %s", options->record_path);
+        if (!output_structured())
+            printf("\n---- %s ----\n", title);
+    } else {
+        print_sample_header(title, current.has_meminfo);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    next = start;
+
+    while (!interrupted && (options->count == 0 || samples < options->count)) {
+        clock_gettime(CLOCK_MONOTONIC, &before);
+        clock_gettime(CLOCK_REALTIME, &wall);
+
+        ssize_t length = proc_buffer_pread(buffer, status_fd);
+        if (length <= 0) {
+            // the process is gone: reads from its status file fail with ESRCH or return nothing
+            fprintf(output_structured() ? stderr : stdout, "Process %d exited\n", options->pid);
+            break;
+        }
+        parse_status_sample(buffer->data, length, &current.status);
+
+        if (meminfo_fd != -1) {
+            length = proc_buffer_pread(buffer, meminfo_fd);
+            if (length > 0)
+                parse_meminfo_sample(buffer->data, length, &current.meminfo);
+        }
+        current.time_ns = (int64_t)wall.tv_sec * 1000000000LL + wall.tv_nsec;
+
+        clock_gettime(CLOCK_MONOTONIC, &after);
+        double cost = elapsed_us(&before, &after);
+        total_us += cost;
+        if (cost > max_us)
+            max_us = cost;
+
+        if (samples == 0)
+            first = previous = current;
+
+        if (recorder) {
+            if (timeseries_append(recorder, &current) != 0)
+                break;
+        } else {
+            print_sample_row(&current, &previous, elapsed_us(&start, &before) / 1000.0);
+        }
+
+        previous = current;
+        samples++;
+
+        if (options->count > 0 && samples >= options->count)
+            break;
+
+        // absolute deadlines so the rate does not drift by the cost of each tick
+        add_ms(&next, options->interval_ms);
+        while (!interrupted && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+            ;
+    }
+
+    int status = samples > 0 ? 0 : -1;
+    if (recorder && timeseries_close(recorder) != 0)
+        status = -1;
+
+    if (samples > 0)
+        print_sample_summary(&first, &previous, samples, total_us, max_us);
+
+    if (meminfo_fd != -1)
+        close(meminfo_fd);
+    close(status_fd);
+    return status;
+}
@@ -0,0 +1,70 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fields parsed out of /proc/<pid>/status (kB, except threads)
+typedef struct {
+    long vm_peak;
+    long vm_size;
+    long vm_hwm;
+    long vm_rss;
+    long rss_anon;
+    long rss_file;
+    long rss_shmem;
+    long vm_data;
+    long vm_stk;
+    long vm_swap;
+    long threads;
+} StatusSample;
+
+// Fields parsed out of /proc/meminfo (kB)
+typedef struct {
+    long mem_total;
+    long mem_free;
+    long mem_available;
+    long cached;
+    long swap_free;
+} MeminfoSample;
+
+// One tick, as printed and as stored by --record
+typedef struct {
+    int64_t time_ns;      // CLOCK_REALTIME
+    int pid;
+    int has_meminfo;
+    StatusSample status;
+    MeminfoSample meminfo;
+} SampleRecord;
+
+typedef struct {
+    int pid;
+    int interval_ms;
+    int count;            // 0 = until interrupted
+    int with_system;      // also sample /proc/meminfo
+    const char *record_path;  // append samples to this time-series file instead of printing them
+} SampleOptions;
+
+// Parse "Key:   value kB" lines into longs at the given struct offsets
+typedef struct {
+    const char *key;
+    size_t offset;
+} FieldSpec;
+
+#define FIELD_COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+int parse_fields(const char *data, size_t length, const FieldSpec *fields, int field_count, void *out);
+
+int parse_status_sample(const char *data, size_t length, StatusSample *out);
+int parse_meminfo_sample(const char *data, size_t length, MeminfoSample *out);
+
+// Shared by live sampling and --replay; text, JSON or CSV depending on the
+// output format. cost_max_us < 0 leaves the read+parse cost out of the summary.
+void print_sample_header(const char *title, int with_meminfo);
+void print_sample_row(const SampleRecord *current, const SampleRecord *previous, double elapsed_ms);
+void print_sample_summary(const SampleRecord *first, const SampleRecord *last, int samples,
+                          double cost_total_us, double cost_max_us);
+
+int run_sampler(const SampleOptions *options);
+
+#endif
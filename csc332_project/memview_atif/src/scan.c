@@ -0,0 +1,357 @@
+#include "scan.h"
+#include "sampler.h"
+#include "procfile.h"
+#include "output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define MAX_WORKERS 64
+
+typedef struct {
+    long rss;
+    long pss;
+    long swap;
+} RollupFields;
+
+static const FieldSpec status_scan_fields[] = {
+    {"VmRSS",   offsetof(ProcEntry, rss)},
+    {"RssAnon", offsetof(ProcEntry, anon)},
+    {"VmSwap",  offsetof(ProcEntry, swap)},
+};
+
+static const FieldSpec rollup_fields[] = {
+    {"Rss",  offsetof(RollupFields, rss)},
+    {"Pss",  offsetof(RollupFields, pss)},
+    {"Swap", offsetof(RollupFields, swap)},
+};
+
+typedef struct {
+    int proc_fd;
+    const int *pids;
+    int count;
+    const char *name_filter;
+    ProcEntry *entries;
+    atomic_int next;
+    atomic_int pss_denied;
+} ScanJob;
+
+int parse_sort_key(const char *text) {
+    if (strcmp(text, "rss") == 0)
+        return SORT_RSS;
+    if (strcmp(text, "pss") == 0)
+        return SORT_PSS;
+    if (strcmp(text, "swap") == 0)
+        return SORT_SWAP;
+    return -1;
+}
+
+int parse_pid_list(const char *text, int **pids) {
+    *pids = NULL;
+    if (strcmp(text, "all") == 0)
+        return 0;
+
+    int capacity = 1;
+    for (const char *p = text; *p; p++) {
+        if (*p == ',')
+            capacity++;
+    }
+
+    int *list = malloc(capacity * sizeof(int));
+    if (!list)
+        return -1;
+
+    int count = 0;
+    const char *p = text;
+    while (*p) {
+        char *end;
+        long pid = strtol(p, &end, 10);
+        if (end == p || pid <= 0 || pid > 4194304 || (*end != ',' && *end != '\0')) {
+            free(list);
+            return -1;
+        }
+        list[count++] = (int)pid;
+        p = (*end == ',') ? end + 1 : end;
+    }
+    if (count == 0) {
+        free(list);
+        return -1;
+    }
+
+    *pids = list;
+    return count;
+}
+
+// Read a whole /proc/<pid>/<name> file relative to the open /proc directory
+static ssize_t read_proc_file(int proc_fd, int pid, const char *name, ProcBuffer *buffer) {
+    char path[48];
+    snprintf(path, sizeof(path), "%d/%s", pid, name);
+    return proc_buffer_read_file(buffer, proc_fd, path);
+}
+
+// Fill one entry; returns 0 to keep it, -1 to skip (gone, kernel thread, filtered out)
+static int scan_process(ScanJob *job, int pid, ProcEntry *entry, ProcBuffer *buffer) {
+    memset(entry, 0, sizeof(*entry));
+    entry->pid = pid;
+    entry->pss = -1;
+
+    ssize_t length = read_proc_file(job->proc_fd, pid, "status", buffer);
+    if (length <= 0)
+        return -1;
+
+    // "Name:\t<comm>" is always the first line
+    if (strncmp(buffer->data, "Name:", 5) == 0) {
+        const char *p = buffer->data + 5;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        size_t n = strcspn(p, "\n");
+        if (n >= sizeof(entry->name))
+            n = sizeof(entry->name) - 1;
+        memcpy(entry->name, p, n);
+    }
+    if (job->name_filter && !strstr(entry->name, job->name_filter))
+        return -1;
+
+    // kernel threads have no Vm* lines and no user memory to report
+    if (parse_fields(buffer->data, length, status_scan_fields, FIELD_COUNT(status_scan_fields), entry) == 0)
+        return -1;
+
+    length = read_proc_file(job->proc_fd, pid, "statm", buffer);
+    if (length > 0) {
+        long size_pages = 0, resident_pages = 0, shared_pages = 0;
+        if (sscanf(buffer->data, "%ld %ld %ld", &size_pages, &resident_pages, &shared_pages) == 3) {
+            long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+            entry->vm_size = size_pages * page_kb;
+            entry->shared = shared_pages * page_kb;
+        }
+    }
+
+    // the expensive one: the kernel walks every mapping to sum PSS
+    length = read_proc_file(job->proc_fd, pid, "smaps_rollup", buffer);
+    if (length > 0) {
+        RollupFields rollup = {0};
+        if (parse_fields(buffer->data, length, rollup_fields, FIELD_COUNT(rollup_fields), &rollup) > 0) {
+            entry->pss = rollup.pss;
+            entry->swap = rollup.swap;
+        }
+    } else if (length < 0 && errno == EACCES) {
+        atomic_fetch_add(&job->pss_denied, 1);
+    }
+    return 0;
+}
+
+static void* scan_worker(void *args) {
+    ScanJob *job = (ScanJob*)args;
+    // one growable buffer per worker, reused for every file it reads
+    ProcBuffer *buffer = proc_thread_buffer();
+
+    for (;;) {
+        int index = atomic_fetch_add(&job->next, 1);
+        if (index >= job->count)
+            break;
+        if (!buffer || scan_process(job, job->pids[index], &job->entries[index], buffer) != 0)
+            job->entries[index].pid = 0;
+    }
+    return NULL;
+}
+
+// Every numeric entry of /proc
+static int list_all_pids(int **pids) {
+    DIR *dir = opendir("/proc");
+    if (!dir) {
+        fprintf(stderr, "Couldn't open /proc: %s\n", strerror(errno));
+        return -1;
+    }
+
+    int count = 0, capacity = 1024;
+    int *list = malloc(capacity * sizeof(int));
+    struct dirent *ent;
+    while (list && (ent = readdir(dir)) != NULL) {
+        if (!isdigit((unsigned char)ent->d_name[0]))
+            continue;
+        if (count == capacity) {
+            capacity *= 2;
+            int *grown = realloc(list, capacity * sizeof(int));
+            if (!grown) {
+                free(list);
+                list = NULL;
+                break;
+            }
+            list = grown;
+        }
+        list[count++] = atoi(ent->d_name);
+    }
+    closedir(dir);
+
+    if (!list) {
+        fprintf(stderr, "Out of memory listing /proc\n");
+        return -1;
+    }
+    *pids = list;
+    return count;
+}
+
+static SortKey active_sort_key;
+
+static long sort_value(const ProcEntry *entry) {
+    switch (active_sort_key) {
+        case SORT_PSS:  return entry->pss;
+        case SORT_SWAP: return entry->swap;
+        default:        return entry->rss;
+    }
+}
+
+static int compare_entries(const void *a, const void *b) {
+    long va = sort_value(a), vb = sort_value(b);
+    if (va != vb)
+        return va < vb ? 1 : -1;
+    return ((const ProcEntry*)a)->pid - ((const ProcEntry*)b)->pid;
+}
+
+static void print_scan_table(const ProcEntry *entries, int shown, const char *sort_name) {
+    printf("\n---- Top %d Processes by %s ----\n", shown, sort_name);
+    printf("%8s  %-15s %10s %10s %10s %10s %10s %10s\n",
+           "PID", "NAME", "RSS_kB", "PSS_kB", "SWAP_kB", "ANON_kB", "SHARED_kB", "VSZ_kB");
+    for (int i = 0; i < shown; i++) {
+        const ProcEntry *e = &entries[i];
+        char pss[24];
+        if (e->pss < 0)
+            snprintf(pss, sizeof(pss), "-");
+        else
+            snprintf(pss, sizeof(pss), "%ld", e->pss);
+        printf("%8d  %-15s %10ld %10s %10ld %10ld %10ld %10ld\n",
+               e->pid, e->name, e->rss, pss, e->swap, e->anon, e->shared, e->vm_size);
+    }
+}
+
+int scan_processes(const ScanOptions *options, ScanResult *result) {
+    int *all_pids = NULL;
+    const int *pids = options->pids;
+    int count = options->pid_count;
+    if (!pids) {
+        count = list_all_pids(&all_pids);
+        if (count < 0)
+            return -1;
+        pids = all_pids;
+    }
+
+    ScanJob job = {
+        .pids = pids,
+        .count = count,
+        .name_filter = options->name_filter,
+        .entries = calloc(count > 0 ? count : 1, sizeof(ProcEntry)),
+    };
+    atomic_init(&job.next, 0);
+    atomic_init(&job.pss_denied, 0);
+
+    job.proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (job.proc_fd == -1 || !job.entries) {
+        fprintf(stderr, "Couldn't open /proc: %s\n", strerror(errno));
+        if (job.proc_fd != -1)
+            close(job.proc_fd);
+        free(job.entries);
+        free(all_pids);
+        return -1;
+    }
+
+    int workers = options->workers;
+    if (workers <= 0)
+        workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers > MAX_WORKERS)
+        workers = MAX_WORKERS;
+    if (workers > count)
+        workers = count > 0 ? count : 1;
+
+    pthread_t threads[MAX_WORKERS];
+    int started = 0;
+    for (int i = 1; i < workers; i++) {
+        if (pthread_create(&threads[started], NULL, scan_worker, &job) != 0)
+            break;
+        started++;
+    }
+    // the main thread is one of the workers
+    scan_worker(&job);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (job.entries[i].pid != 0)
+            job.entries[kept++] = job.entries[i];
+    }
+
+    close(job.proc_fd);
+    free(all_pids);
+    result->entries = job.entries;
+    result->count = count;
+    result->kept = kept;
+    result->workers = started + 1;
+    result->pss_denied = atomic_load(&job.pss_denied);
+    return 0;
+}
+
+int run_scan(const ScanOptions *options) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    ScanResult scan;
+    if (scan_processes(options, &scan) != 0)
+        return -1;
+    ProcEntry *entries = scan.entries;
+    int kept = scan.kept;
+
+    active_sort_key = options->sort_key;
+    qsort(entries, kept, sizeof(ProcEntry), compare_entries);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    static const char *sort_names[] = {"RSS", "PSS", "swap"};
+    int shown = (options->top > 0 && options->top < kept) ? options->top : kept;
+
+    int denied = scan.pss_denied;
+
+    if (output_structured()) {
+        for (int i = 0; i < shown; i++) {
+            const ProcEntry *e = &entries[i];
+            output_begin("process");
+            output_long("pid", e->pid);
+            output_string("name", e->name, strlen(e->name));
+            output_long("rss_kB", e->rss);
+            output_long("pss_kB", e->pss);
+            output_long("swap_kB", e->swap);
+            output_long("anon_kB", e->anon);
+            output_long("shared_kB", e->shared);
+            output_long("vsz_kB", e->vm_size);
+            output_end();
+        }
+        output_begin("scan_summary");
+        output_long("scanned", scan.count);
+        output_long("with_memory", kept);
+        output_long("workers", scan.workers);
+        output_double("elapsed_ms", elapsed_ms);
+        output_long("pss_denied", denied);
+        output_end();
+    } else {
+        print_scan_table(entries, shown, sort_names[options->sort_key]);
+        printf("\nScanned %d processes (%d with user memory) with %d workers in %.1f ms\n",
+               scan.count, kept, scan.workers, elapsed_ms);
+        if (denied > 0)
+            printf("PSS unavailable for %d processes (permission denied)\n", denied);
+    }
+
+    if (options->pids && kept == 0)
+        fprintf(stderr, "None of the requested processes could be read\n");
+
+    free(entries);
+    return (options->pids && kept == 0) ? -1 : 0;
+}
@@ -0,0 +1,50 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+// One row of a multi-process scan (kB unless noted)
+typedef struct {
+    int pid;
+    char name[16];
+    long rss;
+    long pss;        // -1 when smaps_rollup is not readable
+    long swap;
+    long anon;
+    long vm_size;
+    long shared;     // statm shared pages, in kB
+} ProcEntry;
+
+typedef enum {
+    SORT_RSS,
+    SORT_PSS,
+    SORT_SWAP
+} SortKey;
+
+typedef struct {
+    const int *pids;          // NULL = every process in /proc
+    int pid_count;
+    const char *name_filter;  // substring of the process name, or NULL
+    int top;                  // rows to print, 0 = all
+    SortKey sort_key;
+    int workers;
+} ScanOptions;
+
+// "rss", "pss" or "swap"; returns -1 for anything else
+int parse_sort_key(const char *text);
+
+// Parse "all" or a comma separated PID list; returns the count, 0 for "all", -1 on error
+int parse_pid_list(const char *text, int **pids);
+
+typedef struct {
+    ProcEntry *entries;   // the processes that were read, unsorted; free() it
+    int count;            // processes looked at
+    int kept;             // entries filled in
+    int workers;
+    int pss_denied;       // smaps_rollup was not readable
+} ScanResult;
+
+// Read every process in parallel without printing anything
+int scan_processes(const ScanOptions *options, ScanResult *result);
+
+int run_scan(const ScanOptions *options);
+
+#endif
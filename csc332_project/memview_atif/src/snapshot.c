@@ -0,0 +1,582 @@
+#include "snapshot.h"
+#include "helpers.h"
+#include "output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define SN_MAGIC "MVSN"
+#define SN_VERSION 1
+#define SN_HEADER_SIZE 32
+#define SN_ENTRY_SIZE 40
+#define SN_FLAG_DETAILED 0x1
+
+#define PERM_READ 0x1
+#define PERM_WRITE 0x2
+#define PERM_EXEC 0x4
+#define PERM_SHARED 0x8
+
+typedef enum {
+    CHANGE_APPEARED,
+    CHANGE_VANISHED,
+    CHANGE_GREW,
+    CHANGE_SHRANK,
+    CHANGE_COUNT
+} ChangeKind;
+
+static const char *change_names[CHANGE_COUNT] = {
+    "appeared", "vanished", "grew", "shrank"
+};
+
+typedef struct {
+    const Snapshot *after;
+    double seconds;           // between the snapshots, 0 if unknown
+    FILE *out;
+    int structured;
+    int changes[CHANGE_COUNT];
+    int unchanged;
+    long rss_delta[CHANGE_COUNT];     // RSS change summed by kind of change
+    long type_delta[REGION_TYPE_COUNT];
+} DiffReport;
+
+typedef struct {
+    Snapshot *snapshot;
+    int out_of_memory;
+} SnapshotBuilder;
+
+static int add_region(const Region *region, void *context) {
+    SnapshotBuilder *builder = context;
+    Snapshot *snapshot = builder->snapshot;
+
+    if (snapshot->count == snapshot->capacity) {
+        size_t capacity = snapshot->capacity ? snapshot->capacity * 2 : 256;
+        SnapshotRegion *grown = realloc(snapshot->regions, capacity * sizeof(SnapshotRegion));
+        if (!grown) {
+            builder->out_of_memory = 1;
+            return -1;
+        }
+        snapshot->regions = grown;
+        snapshot->capacity = capacity;
+    }
+
+    SnapshotRegion *entry = &snapshot->regions[snapshot->count];
+    size_t length = region->path_length < UINT16_MAX ? region->path_length : UINT16_MAX;
+
+    // the mappings of one file are usually next to each other: store the path once
+    const SnapshotRegion *previous = snapshot->count > 0 ? entry - 1 : NULL;
+    if (previous && previous->path_length == length &&
+        memcmp(snapshot->paths + previous->path_offset, region->path, length) == 0) {
+        entry->path_offset = previous->path_offset;
+    } else {
+        if (snapshot->paths_used + length > snapshot->paths_capacity) {
+            size_t capacity = snapshot->paths_capacity ? snapshot->paths_capacity * 2 : 16384;
+            while (capacity < snapshot->paths_used + length)
+                capacity *= 2;
+            char *grown = realloc(snapshot->paths, capacity);
+            if (!grown) {
+                builder->out_of_memory = 1;
+                return -1;
+            }
+            snapshot->paths = grown;
+            snapshot->paths_capacity = capacity;
+        }
+        memcpy(snapshot->paths + snapshot->paths_used, region->path, length);
+        entry->path_offset = (uint32_t)snapshot->paths_used;
+        snapshot->paths_used += length;
+    }
+
+    entry->start = region->start;
+    entry->end = region->end;
+    entry->rss = region->rss;
+    entry->pss = region->pss;
+    entry->dirty = region->dirty;
+    entry->swap = region->swap;
+    entry->path_length = (uint16_t)length;
+    memcpy(entry->perms, region->perms, sizeof(entry->perms));
+    entry->type = region->type;
+    snapshot->count++;
+    return 0;
+}
+
+int snapshot_take(int pid, Snapshot *snapshot) {
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+
+    snapshot->pid = pid;
+    snapshot->time_ns = (int64_t)wall.tv_sec * 1000000000LL + wall.tv_nsec;
+    snapshot->count = 0;
+    snapshot->paths_used = 0;
+    SnapshotBuilder builder = { snapshot, 0 };
+    if (stream_regions(pid, &snapshot->detailed, add_region, &builder) != 0)
+        return -1;
+    if (builder.out_of_memory) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    return 0;
+}
+
+void snapshot_free(Snapshot *snapshot) {
+    free(snapshot->regions);
+    free(snapshot->paths);
+    memset(snapshot, 0, sizeof(*snapshot));
+}
+
+static uint8_t encode_perms(const char *perms) {
+    uint8_t bits = 0;
+    if (perms[0] == 'r')
+        bits |= PERM_READ;
+    if (perms[1] == 'w')
+        bits |= PERM_WRITE;
+    if (perms[2] == 'x')
+        bits |= PERM_EXEC;
+    if (perms[3] == 's')
+        bits |= PERM_SHARED;
+    return bits;
+}
+
+static void decode_perms(uint8_t bits, char *perms) {
+    perms[0] = bits & PERM_READ ? 'r' : '-';
+    perms[1] = bits & PERM_WRITE ? 'w' : '-';
+    perms[2] = bits & PERM_EXEC ? 'x' : '-';
+    perms[3] = bits & PERM_SHARED ? 's' : 'p';
+    perms[4] = '\0';
+}
+
+static void put_u32(unsigned char *out, long value) {
+    uint32_t v = value < 0 ? 0 : (value > (long)UINT32_MAX ? UINT32_MAX : (uint32_t)value);
+    memcpy(out, &v, 4);
+}
+
+static long get_u32(const unsigned char *in) {
+    uint32_t v;
+    memcpy(&v, in, 4);
+    return (long)v;
+}
+
+static int write_all(int fd, const unsigned char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+int snapshot_save(const Snapshot *snapshot, const char *path) {
+    size_t size = SN_HEADER_SIZE + snapshot->count * SN_ENTRY_SIZE + snapshot->paths_used;
+    unsigned char *data = malloc(size);
+    if (!data) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    uint16_t format[2] = {SN_VERSION, SN_ENTRY_SIZE};
+    uint32_t counts[2] = {(uint32_t)snapshot->count, (uint32_t)snapshot->paths_used};
+    int32_t pid = snapshot->pid;
+    uint32_t flags = snapshot->detailed ? SN_FLAG_DETAILED : 0;
+    memcpy(data, SN_MAGIC, 4);
+    memcpy(data + 4, format, 4);
+    memcpy(data + 8, counts, 8);
+    memcpy(data + 16, &snapshot->time_ns, 8);
+    memcpy(data + 24, &pid, 4);
+    memcpy(data + 28, &flags, 4);
+
+    unsigned char *out = data + SN_HEADER_SIZE;
+    for (size_t i = 0; i < snapshot->count; i++, out += SN_ENTRY_SIZE) {
+        const SnapshotRegion *region = &snapshot->regions[i];
+        uint64_t range[2] = {region->start, region->end};
+        memcpy(out, range, 16);
+        put_u32(out + 16, region->rss);
+        put_u32(out + 20, region->pss);
+        put_u32(out + 24, region->dirty);
+        put_u32(out + 28, region->swap);
+        memcpy(out + 32, &region->path_offset, 4);
+        memcpy(out + 36, &region->path_length, 2);
+        out[38] = (unsigned char)region->type;
+        out[39] = encode_perms(region->perms);
+    }
+    memcpy(out, snapshot->paths, snapshot->paths_used);
+
+    // write a temporary file and rename it so a snapshot is never half written
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "Couldn't open %s: %s\n", temporary, strerror(errno));
+        free(data);
+        return -1;
+    }
+    int status = write_all(fd, data, size);
+    if (close(fd) != 0)
+        status = -1;
+    if (status == 0 && rename(temporary, path) != 0)
+        status = -1;
+    if (status != 0) {
+        fprintf(stderr, "Couldn't write %s: %s\n", path, strerror(errno));
+        unlink(temporary);
+    }
+    free(data);
+    return status;
+}
+
+static int compare_regions(const void *a, const void *b) {
+    const SnapshotRegion *ra = a, *rb = b;
+    if (ra->start != rb->start)
+        return ra->start < rb->start ? -1 : 1;
+    return 0;
+}
+
+int snapshot_load(const char *path, Snapshot *snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        fprintf(stderr, "Couldn't stat %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)info.st_size;
+    unsigned char *data = size >= SN_HEADER_SIZE ? malloc(size) : NULL;
+    size_t filled = 0;
+    while (data && filled < size) {
+        ssize_t n = read(fd, data + filled, size - filled);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        filled += n;
+    }
+    close(fd);
+    if (!data || filled != size || memcmp(data, SN_MAGIC, 4) != 0) {
+        fprintf(stderr, "%s is not a memview snapshot\n", path);
+        free(data);
+        return -1;
+    }
+
+    uint16_t format[2];
+    uint32_t counts[2];
+    int32_t pid;
+    uint32_t flags;
+    memcpy(format, data + 4, 4);
+    memcpy(counts, data + 8, 8);
+    memcpy(&snapshot->time_ns, data + 16, 8);
+    memcpy(&pid, data + 24, 4);
+    memcpy(&flags, data + 28, 4);
+    if (format[0] != SN_VERSION || format[1] != SN_ENTRY_SIZE) {
+        fprintf(stderr, "%s was written with an incompatible snapshot layout\n", path);
+        free(data);
+        return -1;
+    }
+    if (size != SN_HEADER_SIZE + (size_t)counts[0] * SN_ENTRY_SIZE + counts[1]) {
+        fprintf(stderr, "%s is truncated\n", path);
+        free(data);
+        return -1;
+    }
+
+    snapshot->pid = pid;
+    snapshot->detailed = (flags & SN_FLAG_DETAILED) != 0;
+    snapshot->count = snapshot->capacity = counts[0];
+    snapshot->paths_used = snapshot->paths_capacity = counts[1];
+    snapshot->regions = malloc((counts[0] ? counts[0] : 1) * sizeof(SnapshotRegion));
+    snapshot->paths = malloc(counts[1] ? counts[1] : 1);
+    if (!snapshot->regions || !snapshot->paths) {
+        fprintf(stderr, "Out of memory\n");
+        free(data);
+        snapshot_free(snapshot);
+        return -1;
+    }
+
+    const unsigned char *in = data + SN_HEADER_SIZE;
+    int sorted = 1;
+    for (size_t i = 0; i < snapshot->count; i++, in += SN_ENTRY_SIZE) {
+        SnapshotRegion *region = &snapshot->regions[i];
+        uint64_t range[2];
+        memcpy(range, in, 16);
+        region->start = range[0];
+        region->end = range[1];
+        region->rss = get_u32(in + 16);
+        region->pss = get_u32(in + 20);
+        region->dirty = get_u32(in + 24);
+        region->swap = get_u32(in + 28);
+        memcpy(&region->path_offset, in + 32, 4);
+        memcpy(&region->path_length, in + 36, 2);
+        region->type = in[38] < REGION_TYPE_COUNT ? (RegionType)in[38] : REGION_ANON;
+        decode_perms(in[39], region->perms);
+        if ((size_t)region->path_offset + region->path_length > counts[1]) {
+            fprintf(stderr, "%s has a region path outside the path table\n", path);
+            free(data);
+            snapshot_free(snapshot);
+            return -1;
+        }
+        if (i > 0 && region->start < region[-1].start)
+            sorted = 0;
+    }
+    memcpy(snapshot->paths, in, counts[1]);
+    free(data);
+
+    // the diff merges address-ordered tables; files written by memview already are
+    if (!sorted)
+        qsort(snapshot->regions, snapshot->count, sizeof(SnapshotRegion), compare_regions);
+    return 0;
+}
+
+static int same_path(const Snapshot *a, const SnapshotRegion *ra, const Snapshot *b, const SnapshotRegion *rb) {
+    return ra->path_length == rb->path_length &&
+           memcmp(a->paths + ra->path_offset, b->paths + rb->path_offset, ra->path_length) == 0;
+}
+
+static void report_change(DiffReport *report, ChangeKind kind, const Snapshot *owner,
+                          const SnapshotRegion *region, long size_delta, long rss_delta, long swap_delta) {
+    report->changes[kind]++;
+    report->rss_delta[kind] += rss_delta;
+    report->type_delta[region->type] += rss_delta;
+
+    long size = (long)((region->end - region->start) / 1024);
+    const char *path = owner->paths + region->path_offset;
+    double rate = report->seconds > 0 ? rss_delta / report->seconds : 0;
+
+    if (report->structured) {
+        char address[32];
+        snprintf(address, sizeof(address), "%lx-%lx", region->start, region->end);
+        output_begin("region_change");
+        output_long("pid", report->after->pid);
+        output_string("change", change_names[kind], strlen(change_names[kind]));
+        output_string("address", address, strlen(address));
+        output_string("perms", region->perms, strlen(region->perms));
+        output_long("size_kB", size);
+        output_long("size_delta_kB", size_delta);
+        output_long("rss_kB", region->rss);
+        output_long("rss_delta_kB", rss_delta);
+        output_long("swap_kB", region->swap);
+        output_long("swap_delta_kB", swap_delta);
+        output_double("rss_kB_per_s", rate);
+        output_string("type", region_type_name(region->type), strlen(region_type_name(region->type)));
+        output_string("path", path, region->path_length);
+        output_end();
+        return;
+    }
+
+    char rate_text[32] = "-";
+    if (report->seconds > 0)
+        snprintf(rate_text, sizeof(rate_text), "%+.1f", rate);
+    fprintf(report->out, "%-8s %012lx-%012lx %s %9ld %+9ld %9ld %+9ld %9ld %+9ld %10s %.*s\n",
+            change_names[kind], region->start, region->end, region->perms, size, size_delta,
+            region->rss, rss_delta, region->swap, swap_delta, rate_text,
+            (int)region->path_length, path);
+}
+
+static void compare_regions_pair(DiffReport *report, const SnapshotRegion *a, const SnapshotRegion *b) {
+    long size_delta = (long)((b->end - b->start) / 1024) - (long)((a->end - a->start) / 1024);
+    long rss_delta = b->rss - a->rss;
+    long swap_delta = b->swap - a->swap;
+
+    if (size_delta == 0 && rss_delta == 0 && swap_delta == 0) {
+        report->unchanged++;
+        return;
+    }
+    int grew = size_delta > 0 || (size_delta == 0 && rss_delta > 0) || (size_delta == 0 && rss_delta == 0 && swap_delta > 0);
+    report_change(report, grew ? CHANGE_GREW : CHANGE_SHRANK, report->after, b, size_delta, rss_delta, swap_delta);
+}
+
+static long total_rss(const Snapshot *snapshot) {
+    long total = 0;
+    for (size_t i = 0; i < snapshot->count; i++)
+        total += snapshot->regions[i].rss;
+    return total;
+}
+
+void snapshot_diff(const Snapshot *before, const Snapshot *after, const char *title) {
+    DiffReport report;
+    memset(&report, 0, sizeof(report));
+    report.after = after;
+    report.seconds = (after->time_ns - before->time_ns) / 1e9;
+    if (report.seconds < 0)
+        report.seconds = 0;
+    report.out = output_stream();
+    report.structured = output_structured();
+
+    if (!report.structured) {
+        fprintf(report.out, "\n---- %s ----\n", title);
+        fprintf(report.out, "%-8s %-25s %-4s %9s %9s %9s %9s %9s %9s %10s %s\n", "CHANGE", "ADDRESS", "PERM",
+                "SIZE_kB", "+SIZE_kB", "RSS_kB", "+RSS_kB", "SWAP_kB", "+SWAP_kB", "RSS_kB/s", "PATH");
+    }
+
+    // one merge pass: both tables are sorted by start address and regions
+    // never overlap within a table. A region that kept its start (heap,
+    // mmap growing up) or its end (stack growing down) and its path is the
+    // same region; anything else is a region that vanished or appeared.
+    const SnapshotRegion *a = before->regions, *a_end = before->regions + before->count;
+    const SnapshotRegion *b = after->regions, *b_end = after->regions + after->count;
+    while (a < a_end || b < b_end) {
+        if (b == b_end || (a < a_end && a->end <= b->start)) {
+            report_change(&report, CHANGE_VANISHED, before, a, -(long)((a->end - a->start) / 1024), -a->rss, -a->swap);
+            a++;
+        } else if (a == a_end || b->end <= a->start) {
+            report_change(&report, CHANGE_APPEARED, after, b, (long)((b->end - b->start) / 1024), b->rss, b->swap);
+            b++;
+        } else if ((a->start == b->start || a->end == b->end) && same_path(before, a, after, b)) {
+            compare_regions_pair(&report, a, b);
+            a++;
+            b++;
+        } else if (a->start <= b->start) {
+            report_change(&report, CHANGE_VANISHED, before, a, -(long)((a->end - a->start) / 1024), -a->rss, -a->swap);
+            a++;
+        } else {
+            report_change(&report, CHANGE_APPEARED, after, b, (long)((b->end - b->start) / 1024), b->rss, b->swap);
+            b++;
+        }
+    }
+
+    long rss_before = total_rss(before), rss_after = total_rss(after);
+    long rss_delta = rss_after - rss_before;
+
+    if (report.structured) {
+        output_begin("region_diff");
+        output_long("pid", after->pid);
+        output_double("seconds", report.seconds);
+        output_long("regions_before", (long)before->count);
+        output_long("regions_after", (long)after->count);
+        for (int i = 0; i < CHANGE_COUNT; i++)
+            output_long(change_names[i], report.changes[i]);
+        output_long("unchanged", report.unchanged);
+        output_long("rss_before_kB", rss_before);
+        output_long("rss_after_kB", rss_after);
+        output_long("rss_delta_kB", rss_delta);
+        output_double("rss_kB_per_s", report.seconds > 0 ? rss_delta / report.seconds : 0);
+        for (int i = 0; i < REGION_TYPE_COUNT; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "%s_delta_kB", region_type_name(i));
+            output_long(name, report.type_delta[i]);
+        }
+        output_end();
+        return;
+    }
+
+    FILE *out = report.out;
+    fprintf(out, "Regions: %zu -> %zu (", before->count, after->count);
+    for (int i = 0; i < CHANGE_COUNT; i++)
+        fprintf(out, "%d %s %+ld kB, ", report.changes[i], change_names[i], report.rss_delta[i]);
+    fprintf(out, "%d unchanged)\n", report.unchanged);
+    fprintf(out, "RSS: %ld kB -> %ld kB (%+ld kB", rss_before, rss_after, rss_delta);
+    if (report.seconds > 0)
+        fprintf(out, ", %+.1f kB/s over %.3f s", rss_delta / report.seconds, report.seconds);
+    fprintf(out, ")\n");
+    fprintf(out, "RSS change by type:");
+    for (int i = 0; i < REGION_TYPE_COUNT; i++)
+        fprintf(out, " %s %+ld kB", region_type_name(i), report.type_delta[i]);
+    fprintf(out, "\n");
+    if (!before->detailed || !after->detailed)
+        fprintf(out, "(a snapshot was taken without smaps: RSS and swap changes are not available)\n");
+}
+
+static void add_ms(struct timespec *t, int ms) {
+    t->tv_sec += ms / 1000;
+    t->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (t->tv_nsec >= 1000000000L) {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000L;
+    }
+}
+
+// --growth: a snapshot every interval, each diffed against the one before,
+// then the whole run diffed against the first snapshot
+static int track_growth(const SnapshotOptions *options, Snapshot *first, Snapshot *last) {
+    Snapshot buffers[2];
+    memset(buffers, 0, sizeof(buffers));
+    Snapshot *previous = first;
+    int next_buffer = 0, samples = 1;
+    char title[128];
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!interrupted && (options->count == 0 || samples < options->count)) {
+        add_ms(&next, options->interval_ms);
+        while (!interrupted && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+            ;
+        if (interrupted)
+            break;
+
+        Snapshot *current = &buffers[next_buffer];
+        if (snapshot_take(options->pid, current) != 0)
+            break;
+        snprintf(title, sizeof(title), "Region Changes (PID: %d, snapshot %d, +%.3f s)", options->pid,
+                 samples + 1, (current->time_ns - first->time_ns) / 1e9);
+        snapshot_diff(previous, current, title);
+        output_tick();
+        fflush(stdout);
+
+        previous = current;
+        next_buffer ^= 1;
+        samples++;
+    }
+
+    if (samples > 1) {
+        snprintf(title, sizeof(title), "Growth over %d snapshots (PID: %d)", samples, options->pid);
+        snapshot_diff(first, previous, title);
+    }
+
+    // hand the last snapshot back for --snapshot
+    if (previous != first) {
+        Snapshot kept = *previous;
+        *previous = *last;
+        *last = kept;
+    }
+    snapshot_free(&buffers[0]);
+    snapshot_free(&buffers[1]);
+    return 0;
+}
+
+int run_snapshot(const SnapshotOptions *options) {
+    Snapshot before, after;
+    memset(&before, 0, sizeof(before));
+    memset(&after, 0, sizeof(after));
+    int status = 0;
+
+    if (options->before_path) {
+        // --diff OLD [NEW]: NEW is another file, or the live process
+        if (snapshot_load(options->before_path, &before) != 0)
+            return -1;
+        if (options->after_path)
+            status = snapshot_load(options->after_path, &after);
+        else
+            status = snapshot_take(options->pid, &after);
+        if (status == 0) {
+            char title[128];
+            snprintf(title, sizeof(title), "Region Changes (PID: %d -> %d)", before.pid, after.pid);
+            snapshot_diff(&before, &after, title);
+        }
+    } else if (snapshot_take(options->pid, &before) != 0) {
+        return -1;
+    } else if (options->interval_ms > 0) {
+        status = track_growth(options, &before, &after);
+    }
+
+    if (status == 0 && options->save_path) {
+        const Snapshot *saved = after.count > 0 ? &after : &before;
+        status = snapshot_save(saved, options->save_path);
+        if (status == 0 && !output_structured())
+            printf("Saved %zu regions of PID %d to %s\n", saved->count, saved->pid, options->save_path);
+    }
+
+    snapshot_free(&before);
+    snapshot_free(&after);
+    return status;
+}
@@ -0,0 +1,65 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "regions.h"
+
+// One region of a snapshot (kB); path is an offset into the snapshot's paths
+typedef struct {
+    unsigned long start;
+    unsigned long end;
+    long rss;
+    long pss;
+    long dirty;
+    long swap;
+    uint32_t path_offset;
+    uint16_t path_length;
+    char perms[5];
+    RegionType type;
+} SnapshotRegion;
+
+// A process's region table at one point in time, sorted by address
+typedef struct {
+    int pid;
+    int detailed;             // usage came from smaps (0: maps only)
+    int64_t time_ns;          // CLOCK_REALTIME
+    SnapshotRegion *regions;
+    size_t count;
+    size_t capacity;
+    char *paths;              // consecutive regions of one file share a path
+    size_t paths_used;
+    size_t paths_capacity;
+} Snapshot;
+
+// Read the region table of a process; the snapshot's buffers are reused
+int snapshot_take(int pid, Snapshot *snapshot);
+
+// File format: a 32-byte header ("MVSN", u16 version, u16 entry size, u32
+// region count, u32 path bytes, i64 time_ns, i32 pid, u32 flags) followed
+// by 40-byte entries (u64 start, u64 end, u32 rss/pss/dirty/swap in kB,
+// u32 path offset, u16 path length, u8 type, u8 perms bits) and the path
+// bytes, all in host byte order
+int snapshot_save(const Snapshot *snapshot, const char *path);
+int snapshot_load(const char *path, Snapshot *snapshot);
+
+void snapshot_free(Snapshot *snapshot);
+
+// Print the regions that appeared, vanished, grew or shrank between two
+// snapshots of a process, with rates per second, and the totals. Regions
+// are matched by one merge pass over both address-sorted tables.
+void snapshot_diff(const Snapshot *before, const Snapshot *after, const char *title);
+
+typedef struct {
+    int pid;                  // -1: diff two files
+    const char *save_path;    // --snapshot: write the (last) snapshot here
+    const char *before_path;  // --diff: compare against this snapshot
+    const char *after_path;   // --diff OLD NEW: ... and this one instead of the live process
+    int interval_ms;          // --growth: take a snapshot every interval_ms
+    int count;                // ... this many times (0 = until interrupted)
+} SnapshotOptions;
+
+// --snapshot, --diff and --growth
+int run_snapshot(const SnapshotOptions *options);
+
+#endif
@@ -0,0 +1,194 @@
+#include "tasks.h"
+#include "pagemap.h"
+#include "output.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define MAX_TASKS 5
+
+typedef struct {
+    const char *name;
+    int (*collect)(const TaskArgs *args);
+    const TaskArgs *args;
+    OutputCapture *capture;
+    pthread_t thread;
+    int threaded;           // running on its own thread (pthread_create worked)
+    int status;
+    double ms;
+} Task;
+
+static int collect_meminfo(const TaskArgs *args) {
+    (void)args;
+    return read_system_meminfo();
+}
+
+static int collect_status(const TaskArgs *args) {
+    return read_process_status(args->pid);
+}
+
+static int collect_maps(const TaskArgs *args) {
+    return read_process_maps(args->pid, args->maps_summary);
+}
+
+static int collect_residency(const TaskArgs *args) {
+    return report_residency(args->pid, args->idle_ms);
+}
+
+static int collect_shm(const TaskArgs *args) {
+    (void)args;
+    return read_shared_memory();
+}
+
+// The selected collectors, in the order their output is emitted
+static int build_tasks(const TaskArgs *args, Task *tasks) {
+    int count = 0;
+    memset(tasks, 0, MAX_TASKS * sizeof(Task));
+    if (args->show_sysinfo)
+        tasks[count++] = (Task){ .name = "meminfo", .collect = collect_meminfo };
+    if (args->show_status)
+        tasks[count++] = (Task){ .name = "status", .collect = collect_status };
+    if (args->show_maps)
+        tasks[count++] = (Task){ .name = "maps", .collect = collect_maps };
+    if (args->show_residency)
+        tasks[count++] = (Task){ .name = "residency", .collect = collect_residency };
+    if (args->show_shm)
+        tasks[count++] = (Task){ .name = "shm", .collect = collect_shm };
+    for (int i = 0; i < count; i++)
+        tasks[i].args = args;
+    return count;
+}
+
+static double ms_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void run_task(Task *task) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    task->status = task->collect(task->args);
+    task->ms = ms_since(&start);
+}
+
+// Runs on the task's thread, or on the main thread if none could be created
+static void *captured_task(void *arg) {
+    Task *task = arg;
+    task->capture = output_capture_begin();
+    if (!task->capture) {
+        fprintf(stderr, "Out of memory buffering the %s output\n", task->name);
+        task->status = -1;
+        return NULL;
+    }
+    run_task(task);
+    output_capture_end(task->capture);
+    return NULL;
+}
+
+// Start every task, then emit the captures in order as each one finishes
+static double run_concurrent(Task *tasks, int count, int emit) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < count; i++)
+        tasks[i].threaded = pthread_create(&tasks[i].thread, NULL, captured_task, &tasks[i]) == 0;
+    for (int i = 0; i < count; i++) {
+        if (tasks[i].threaded)
+            pthread_join(tasks[i].thread, NULL);
+        else
+            captured_task(&tasks[i]);
+        if (emit && tasks[i].capture)
+            output_capture_emit(tasks[i].capture);
+        output_capture_free(tasks[i].capture);
+        tasks[i].capture = NULL;
+    }
+    return ms_since(&start);
+}
+
+// One task after the other on this thread; output is written directly
+// unless discarded, in which case it goes to a capture that is dropped
+static double run_serial(Task *tasks, int count, int discard) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < count; i++) {
+        if (discard) {
+            captured_task(&tasks[i]);
+            output_capture_free(tasks[i].capture);
+            tasks[i].capture = NULL;
+        } else {
+            run_task(&tasks[i]);
+        }
+    }
+    return ms_since(&start);
+}
+
+static void print_timing(const Task *tasks, const Task *serial, int count, double concurrent_ms, double serial_ms) {
+    double task_sum = 0;
+    for (int i = 0; i < count; i++)
+        task_sum += tasks[i].ms;
+
+    if (output_structured()) {
+        for (int i = 0; i < count; i++) {
+            output_begin("task");
+            output_string("name", tasks[i].name, strlen(tasks[i].name));
+            output_long("status", tasks[i].status);
+            output_double("ms", tasks[i].ms);
+            output_double("serial_ms", serial ? serial[i].ms : tasks[i].ms);
+            output_end();
+        }
+        output_begin("task_summary");
+        output_long("tasks", count);
+        output_long("threaded", serial != NULL);
+        output_double("task_sum_ms", task_sum);
+        output_double("end_to_end_ms", serial ? concurrent_ms : serial_ms);
+        output_double("serial_ms", serial_ms);
+        output_double("speedup", serial && concurrent_ms > 0 ? serial_ms / concurrent_ms : 1.0);
+        output_end();
+        return;
+    }
+
+    FILE *out = output_stream();
+    fprintf(out, "\n---- Timing ----\n");
+    if (serial) {
+        fprintf(out, "%-12s %7s %12s %12s\n", "TASK", "STATUS", "THREAD_ms", "SERIAL_ms");
+        for (int i = 0; i < count; i++)
+            fprintf(out, "%-12s %7s %12.3f %12.3f\n", tasks[i].name, tasks[i].status == 0 ? "ok" : "failed",
+                    tasks[i].ms, serial[i].ms);
+        fprintf(out, "Concurrent: %d tasks in %.3f ms end-to-end (tasks add up to %.3f ms)\n",
+                count, concurrent_ms, task_sum);
+        fprintf(out, "Serial:     %.3f ms end-to-end, %.2fx the concurrent time\n",
+                serial_ms, concurrent_ms > 0 ? serial_ms / concurrent_ms : 1.0);
+    } else {
+        fprintf(out, "%-12s %7s %12s\n", "TASK", "STATUS", "TIME_ms");
+        for (int i = 0; i < count; i++)
+            fprintf(out, "%-12s %7s %12.3f\n", tasks[i].name, tasks[i].status == 0 ? "ok" : "failed", tasks[i].ms);
+        fprintf(out, "Serial: %d tasks in %.3f ms end-to-end (run with -t to compare)\n", count, serial_ms);
+    }
+}
+
+int run_tasks(const TaskArgs *args, int threaded, int timing) {
+    Task tasks[MAX_TASKS];
+    int count = build_tasks(args, tasks);
+    if (count == 0)
+        return 0;
+
+    if (!threaded) {
+        double serial_ms = run_serial(tasks, count, 0);
+        if (timing)
+            print_timing(tasks, NULL, count, 0, serial_ms);
+        return 0;
+    }
+
+    double concurrent_ms = run_concurrent(tasks, count, 1);
+    if (timing) {
+        // the same tasks again, one after the other, for comparison
+        Task serial[MAX_TASKS];
+        build_tasks(args, serial);
+        double serial_ms = run_serial(serial, count, 1);
+        print_timing(tasks, serial, count, concurrent_ms, serial_ms);
+    }
+    return 0;
+}
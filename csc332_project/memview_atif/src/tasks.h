@@ -0,0 +1,14 @@
+#ifndef TASKS_H
+#define TASKS_H
+
+#include "helpers.h"
+
+// Run the collectors selected in args (meminfo, status, maps, residency,
+// shm). With threaded set each one runs on its own thread into its own
+// output capture, and the captures are emitted in that fixed order as the
+// tasks finish, so the output is the same as a serial run. With timing set,
+// a report of per-task and end-to-end latency follows; for a threaded run
+// the tasks are then run once more serially (output discarded) to compare.
+int run_tasks(const TaskArgs *args, int threaded, int timing);
+
+#endif
@@ -0,0 +1,278 @@
+#include "timeseries.h"
+#include "output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define TS_MAGIC "MVTS"
+#define TS_VERSION 1
+#define TS_HEADER_SIZE 16
+#define TS_STATUS_FIELDS ((int)(sizeof(StatusSample) / sizeof(long)))
+#define TS_MEMINFO_FIELDS ((int)(sizeof(MeminfoSample) / sizeof(long)))
+#define TS_RECORD_SIZE (16 + 8 * (TS_STATUS_FIELDS + TS_MEMINFO_FIELDS))
+#define TS_BUFFER_RECORDS 512
+#define TS_READ_RECORDS 512
+#define TS_FLAG_MEMINFO 0x1
+
+// the samples are stored field by field, so they must be nothing but longs
+_Static_assert(sizeof(StatusSample) % sizeof(long) == 0, "StatusSample must only hold longs");
+_Static_assert(sizeof(MeminfoSample) % sizeof(long) == 0, "MeminfoSample must only hold longs");
+
+struct TimeseriesWriter {
+    int fd;
+    int failed;
+    size_t used;
+    struct timespec last_write;
+    unsigned char buffer[TS_BUFFER_RECORDS * TS_RECORD_SIZE];
+};
+
+static void make_header(unsigned char *header) {
+    uint16_t values[4] = {TS_VERSION, TS_RECORD_SIZE, TS_STATUS_FIELDS, TS_MEMINFO_FIELDS};
+    memset(header, 0, TS_HEADER_SIZE);
+    memcpy(header, TS_MAGIC, 4);
+    memcpy(header + 4, values, sizeof(values));
+}
+
+static int check_header(const unsigned char *header, const char *path) {
+    unsigned char expected[TS_HEADER_SIZE];
+    make_header(expected);
+    if (memcmp(header, TS_MAGIC, 4) != 0) {
+        fprintf(stderr, "%s is not a memview time-series file\n", path);
+        return -1;
+    }
+    if (memcmp(header + 4, expected + 4, 8) != 0) {
+        fprintf(stderr, "%s was recorded with an incompatible record layout\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static void encode_record(const SampleRecord *record, unsigned char *out) {
+    int64_t time_ns = record->time_ns;
+    int32_t pid = record->pid;
+    uint32_t flags = record->has_meminfo ? TS_FLAG_MEMINFO : 0;
+    const long *status = (const long *)&record->status;
+    const long *meminfo = (const long *)&record->meminfo;
+
+    memcpy(out, &time_ns, 8);
+    memcpy(out + 8, &pid, 4);
+    memcpy(out + 12, &flags, 4);
+    out += 16;
+    for (int i = 0; i < TS_STATUS_FIELDS; i++, out += 8) {
+        int64_t value = status[i];
+        memcpy(out, &value, 8);
+    }
+    for (int i = 0; i < TS_MEMINFO_FIELDS; i++, out += 8) {
+        int64_t value = meminfo[i];
+        memcpy(out, &value, 8);
+    }
+}
+
+static void decode_record(const unsigned char *in, SampleRecord *record) {
+    int32_t pid;
+    uint32_t flags;
+    long *status = (long *)&record->status;
+    long *meminfo = (long *)&record->meminfo;
+
+    memcpy(&record->time_ns, in, 8);
+    memcpy(&pid, in + 8, 4);
+    memcpy(&flags, in + 12, 4);
+    record->pid = pid;
+    record->has_meminfo = (flags & TS_FLAG_MEMINFO) != 0;
+    in += 16;
+    for (int i = 0; i < TS_STATUS_FIELDS; i++, in += 8) {
+        int64_t value;
+        memcpy(&value, in, 8);
+        status[i] = (long)value;
+    }
+    for (int i = 0; i < TS_MEMINFO_FIELDS; i++, in += 8) {
+        int64_t value;
+        memcpy(&value, in, 8);
+        meminfo[i] = (long)value;
+    }
+}
+
+static int write_all(int fd, const unsigned char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+TimeseriesWriter *timeseries_open(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        fprintf(stderr, "Couldn't stat %s: %s\n", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    unsigned char header[TS_HEADER_SIZE];
+    if (info.st_size == 0) {
+        make_header(header);
+        if (write_all(fd, header, sizeof(header)) != 0) {
+            fprintf(stderr, "Couldn't write %s: %s\n", path, strerror(errno));
+            close(fd);
+            return NULL;
+        }
+    } else {
+        if (info.st_size < TS_HEADER_SIZE || pread(fd, header, sizeof(header), 0) != TS_HEADER_SIZE) {
+            fprintf(stderr, "%s is not a memview time-series file\n", path);
+            close(fd);
+            return NULL;
+        }
+        if (check_header(header, path) != 0) {
+            close(fd);
+            return NULL;
+        }
+        // drop a record cut short by a crash so new records stay aligned
+        off_t partial = (info.st_size - TS_HEADER_SIZE) % TS_RECORD_SIZE;
+        if (partial != 0 && ftruncate(fd, info.st_size - partial) != 0) {
+            fprintf(stderr, "Couldn't truncate %s: %s\n", path, strerror(errno));
+            close(fd);
+            return NULL;
+        }
+    }
+
+    TimeseriesWriter *writer = malloc(sizeof(TimeseriesWriter));
+    if (!writer) {
+        fprintf(stderr, "Out of memory\n");
+        close(fd);
+        return NULL;
+    }
+    writer->fd = fd;
+    writer->failed = 0;
+    writer->used = 0;
+    clock_gettime(CLOCK_MONOTONIC, &writer->last_write);
+    return writer;
+}
+
+static int flush_writer(TimeseriesWriter *writer) {
+    if (writer->used > 0 && !writer->failed) {
+        if (write_all(writer->fd, writer->buffer, writer->used) != 0) {
+            fprintf(stderr, "Couldn't write time-series file: %s\n", strerror(errno));
+            writer->failed = 1;
+        }
+    }
+    writer->used = 0;
+    clock_gettime(CLOCK_MONOTONIC, &writer->last_write);
+    return writer->failed ? -1 : 0;
+}
+
+int timeseries_append(TimeseriesWriter *writer, const SampleRecord *record) {
+    encode_record(record, writer->buffer + writer->used);
+    writer->used += TS_RECORD_SIZE;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (writer->used == sizeof(writer->buffer) || now.tv_sec - writer->last_write.tv_sec >= 1)
+        return flush_writer(writer);
+    return 0;
+}
+
+int timeseries_close(TimeseriesWriter *writer) {
+    int status = flush_writer(writer);
+    if (close(writer->fd) != 0)
+        status = -1;
+    free(writer);
+    return status;
+}
+
+int replay_timeseries(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    unsigned char header[TS_HEADER_SIZE];
+    if (read(fd, header, sizeof(header)) != TS_HEADER_SIZE) {
+        fprintf(stderr, "%s is not a memview time-series file\n", path);
+        close(fd);
+        return -1;
+    }
+    if (check_header(header, path) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    unsigned char *chunk = malloc(TS_READ_RECORDS * TS_RECORD_SIZE);
+    if (!chunk) {
+        fprintf(stderr, "Out of memory\n");
+        close(fd);
+        return -1;
+    }
+
+    SampleRecord first, previous, current;
+    int samples = 0, total = 0, status = 0;
+    size_t filled = 0;
+
+    for (;;) {
+        ssize_t n = read(fd, chunk + filled, TS_READ_RECORDS * TS_RECORD_SIZE - filled);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Couldn't read %s: %s\n", path, strerror(errno));
+            status = -1;
+            break;
+        }
+        filled += n;
+
+        size_t offset = 0;
+        for (; offset + TS_RECORD_SIZE <= filled; offset += TS_RECORD_SIZE) {
+            decode_record(chunk + offset, &current);
+
+            // a new PID (or a recording with different fields) starts a new table
+            if (samples > 0 && (current.pid != previous.pid || current.has_meminfo != previous.has_meminfo)) {
+                print_sample_summary(&first, &previous, samples, 0, -1);
+                samples = 0;
+            }
+            if (samples == 0) {
+                char title[64];
+                snprintf(title, sizeof(title), "Replaying PID %d", current.pid);
+                print_sample_header(title, current.has_meminfo);
+                first = previous = current;
+            }
+
+            print_sample_row(&current, &previous, (current.time_ns - first.time_ns) / 1e6);
+            previous = current;
+            samples++;
+            total++;
+        }
+
+        // keep a trailing partial record until the rest of it is read
+        memmove(chunk, chunk + offset, filled - offset);
+        filled -= offset;
+        if (n == 0)
+            break;
+    }
+
+    if (samples > 0)
+        print_sample_summary(&first, &previous, samples, 0, -1);
+    if (filled > 0)
+        fprintf(stderr, "Ignored a truncated record at the end of %s\n", path);
+    if (status == 0 && total == 0)
+        fprintf(stderr, "%s holds no samples\n", path);
+
+    free(chunk);
+    close(fd);
+    return status;
+}
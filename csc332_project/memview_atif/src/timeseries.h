@@ -0,0 +1,28 @@
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include "sampler.h"
+
+// Append-only binary file of sampler ticks (--record / --replay).
+//
+// A 16-byte header ("MVTS", u16 version, u16 record size, u16 status field
+// count, u16 meminfo field count, 4 reserved bytes) followed by fixed-size
+// records in host byte order: i64 time_ns, i32 pid, u32 flags (bit 0: has
+// meminfo), then the StatusSample and MeminfoSample fields as i64. Recording
+// into an existing file appends after its last complete record.
+typedef struct TimeseriesWriter TimeseriesWriter;
+
+TimeseriesWriter *timeseries_open(const char *path);
+
+// Records are buffered and written when the buffer fills or a second has
+// passed since the last write, so a crash loses at most about a second
+int timeseries_append(TimeseriesWriter *writer, const SampleRecord *record);
+
+// Flush, close and free; returns -1 if any write failed
+int timeseries_close(TimeseriesWriter *writer);
+
+// Print every record in the file with print_sample_row, one table and
+// summary per run of records from the same PID
+int replay_timeseries(const char *path);
+
+#endif
@@ -0,0 +1,488 @@
+#include "watch.h"
+#include "cgroup.h"
+#include "helpers.h"
+#include "output.h"
+#include "procfile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#define MAX_SOURCES 4
+#define V1_PRESSURE_LEVEL "low"
+
+typedef enum {
+    SOURCE_PSI,           // PSI trigger: EPOLLPRI when the stall threshold is crossed
+    SOURCE_EVENTS,        // cgroup v2 memory.events: EPOLLPRI when a counter changes
+    SOURCE_V1_PRESSURE,   // eventfd bound to memory.pressure_level
+    SOURCE_V1_OOM         // eventfd bound to memory.oom_control
+} SourceType;
+
+static const char *source_names[] = {"psi", "memory.events", "pressure_level", "oom_control"};
+#define SOURCE_TYPES ((int)(sizeof(source_names) / sizeof(source_names[0])))
+
+typedef struct {
+    SourceType type;
+    int fd;               // what epoll waits on
+    int file_fd;          // v1: the control file the eventfd is bound to
+    long fired;
+} WatchSource;
+
+// memory.events is "name value" per line
+static const char *event_names[] = {"low", "high", "max", "oom", "oom_kill"};
+#define EVENT_COUNT ((int)(sizeof(event_names) / sizeof(event_names[0])))
+
+typedef struct {
+    const WatchOptions *options;
+    char cgroup[4096];
+    int cgroup_version;       // 2, 1 or 0 when only system-wide pressure is watched
+    char pressure_path[4352]; // PSI file shown in snapshots
+
+    WatchSource sources[MAX_SOURCES];
+    int source_count;
+    int epoll_fd;
+    int events_fd;            // v2 memory.events, re-read on every change
+
+    long events[EVENT_COUNT];     // at the last snapshot
+    long seen_events[EVENT_COUNT];
+    long last_stall_us;
+    long last_failcnt;
+    unsigned fired_mask;      // sources seen since the last snapshot
+    int snapshots;
+} WatchState;
+
+static long elapsed_ms_between(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000L + (end->tv_nsec - start->tv_nsec) / 1000000L;
+}
+
+static int add_source(WatchState *state, SourceType type, int fd, int file_fd) {
+    struct epoll_event event = {
+        .events = (type == SOURCE_PSI || type == SOURCE_EVENTS) ? EPOLLPRI : EPOLLIN,
+        .data.u32 = (uint32_t)state->source_count
+    };
+    if (epoll_ctl(state->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        fprintf(stderr, "Couldn't watch %s: %s\n", source_names[type], strerror(errno));
+        return -1;
+    }
+    WatchSource *source = &state->sources[state->source_count++];
+    source->type = type;
+    source->fd = fd;
+    source->file_fd = file_fd;
+    source->fired = 0;
+    return 0;
+}
+
+// Writing "some <stall us> <window us>" to a pressure file arms a trigger on
+// that open file; it then polls with EPOLLPRI once per window at most.
+// Without CAP_SYS_RESOURCE the kernel only takes coarser windows (multiples
+// of 2 s), so on EINVAL the window is widened up to the 10 s maximum.
+static int register_psi(WatchState *state, const char *path) {
+    int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    int window_ms = state->options->window_ms;
+    for (;;) {
+        char trigger[64];
+        int length = snprintf(trigger, sizeof(trigger), "some %d %d", state->options->stall_us, window_ms * 1000);
+        if (write(fd, trigger, length + 1) >= 0)
+            break;
+        if (errno != EINVAL || window_ms >= 10000) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        window_ms = (window_ms / 2000 + 1) * 2000;
+    }
+
+    if (window_ms != state->options->window_ms)
+        fprintf(stderr, "PSI trigger armed with a %d ms window (the kernel refused %d ms)\n",
+                window_ms, state->options->window_ms);
+    return add_source(state, SOURCE_PSI, fd, -1);
+}
+
+// v1: an eventfd fires when the kernel signals the control file; the binding
+// is made by writing "<eventfd> <file fd> [args]" to cgroup.event_control
+static int register_v1(WatchState *state, SourceType type, const char *file, const char *args) {
+    char path[4352];
+    snprintf(path, sizeof(path), "%s/%s", state->cgroup, file);
+    int file_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (file_fd == -1)
+        return -1;
+
+    int event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (event_fd == -1) {
+        close(file_fd);
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/cgroup.event_control", state->cgroup);
+    int control_fd = open(path, O_WRONLY | O_CLOEXEC);
+    char line[64];
+    int length = snprintf(line, sizeof(line), "%d %d%s%s", event_fd, file_fd, args ? " " : "", args ? args : "");
+    if (control_fd == -1 || write(control_fd, line, length) < 0) {
+        int saved = errno;
+        if (control_fd != -1)
+            close(control_fd);
+        close(event_fd);
+        close(file_fd);
+        errno = saved;
+        return -1;
+    }
+    close(control_fd);
+    return add_source(state, type, event_fd, file_fd);
+}
+
+static void read_events(WatchState *state, long *events) {
+    ProcBuffer *buffer = proc_thread_buffer();
+    memset(events, 0, EVENT_COUNT * sizeof(long));
+    if (!buffer || proc_buffer_pread(buffer, state->events_fd) <= 0)
+        return;
+
+    const char *pos = buffer->data;
+    const char *end = buffer->data + buffer->length;
+    while (pos < end) {
+        const char *line_end = memchr(pos, '\n', end - pos);
+        if (!line_end)
+            line_end = end;
+        const char *space = memchr(pos, ' ', line_end - pos);
+        if (space) {
+            for (int i = 0; i < EVENT_COUNT; i++) {
+                size_t length = strlen(event_names[i]);
+                if ((size_t)(space - pos) == length && memcmp(pos, event_names[i], length) == 0)
+                    events[i] = strtol(space + 1, NULL, 10);
+            }
+        }
+        pos = line_end + 1;
+    }
+}
+
+// "some avg10=0.12 avg60=... total=<us>" -> avg10 and total
+static int read_pressure(const char *path, double *avg10, long *total_us) {
+    ProcBuffer *buffer = proc_thread_buffer();
+    *avg10 = 0;
+    *total_us = 0;
+    if (!buffer || proc_buffer_read_file(buffer, AT_FDCWD, path) <= 0)
+        return -1;
+    if (strncmp(buffer->data, "some ", 5) != 0)
+        return -1;
+
+    const char *avg = strstr(buffer->data, "avg10=");
+    const char *total = strstr(buffer->data, "total=");
+    if (avg)
+        *avg10 = strtod(avg + 6, NULL);
+    if (total)
+        *total_us = strtol(total + 6, NULL, 10);
+    return 0;
+}
+
+// A single number from a cgroup file; "max" and the v1 "unlimited" value give -1
+static long read_cgroup_number(const WatchState *state, const char *file) {
+    char path[4352];
+    ProcBuffer *buffer = proc_thread_buffer();
+    snprintf(path, sizeof(path), "%s/%s", state->cgroup, file);
+    if (!buffer || proc_buffer_read_file(buffer, AT_FDCWD, path) <= 0)
+        return -1;
+    if (strncmp(buffer->data, "max", 3) == 0)
+        return -1;
+    long long value = strtoll(buffer->data, NULL, 10);
+    if (value >= (1LL << 62))
+        return -1;
+    return (long)value;
+}
+
+static void take_snapshot(WatchState *state, const struct timespec *woke) {
+    char reasons[128] = "";
+    size_t used = 0;
+    for (int i = 0; i < SOURCE_TYPES; i++) {
+        if (state->fired_mask & (1u << i))
+            used += snprintf(reasons + used, sizeof(reasons) - used, "%s%s", used ? ", " : "", source_names[i]);
+    }
+    state->fired_mask = 0;
+
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    struct tm local;
+    localtime_r(&wall.tv_sec, &local);
+    char when[32];
+    strftime(when, sizeof(when), "%H:%M:%S", &local);
+
+    double avg10;
+    long stall_us;
+    int have_psi = read_pressure(state->pressure_path, &avg10, &stall_us) == 0;
+    long stall_delta = stall_us - state->last_stall_us;
+    state->last_stall_us = stall_us;
+
+    long usage = -1, limit = -1, deltas[EVENT_COUNT] = {0}, failcnt_delta = 0;
+    if (state->cgroup_version == 2) {
+        long events[EVENT_COUNT];
+        read_events(state, events);
+        for (int i = 0; i < EVENT_COUNT; i++)
+            deltas[i] = events[i] - state->events[i];
+        memcpy(state->events, events, sizeof(events));
+        usage = read_cgroup_number(state, "memory.current");
+        limit = read_cgroup_number(state, "memory.max");
+    } else if (state->cgroup_version == 1) {
+        long failcnt = read_cgroup_number(state, "memory.failcnt");
+        failcnt_delta = failcnt - state->last_failcnt;
+        state->last_failcnt = failcnt;
+        usage = read_cgroup_number(state, "memory.usage_in_bytes");
+        limit = read_cgroup_number(state, "memory.limit_in_bytes");
+    }
+
+    if (output_structured()) {
+        output_begin("pressure_event");
+        output_long("time_ns", (long)wall.tv_sec * 1000000000L + wall.tv_nsec);
+        output_string("reason", reasons, used);
+        output_double("psi_some_avg10", have_psi ? avg10 : -1);
+        output_long("psi_stall_delta_us", have_psi ? stall_delta : -1);
+        output_string("cgroup", state->cgroup, strlen(state->cgroup));
+        output_long("usage_kB", usage < 0 ? -1 : usage / 1024);
+        output_long("limit_kB", limit < 0 ? -1 : limit / 1024);
+        if (state->cgroup_version == 2) {
+            for (int i = 0; i < EVENT_COUNT; i++)
+                output_long(event_names[i], deltas[i]);
+        } else if (state->cgroup_version == 1) {
+            output_long("failcnt", failcnt_delta);
+        }
+        output_end();
+    } else {
+        printf("\n---- Memory Pressure at %s.%03ld (%s) ----\n", when, wall.tv_nsec / 1000000L, reasons);
+        if (have_psi)
+            printf("PSI some avg10: %.2f%%, stalled %ld us since the last snapshot\n", avg10, stall_delta);
+        if (state->cgroup_version > 0) {
+            printf("Cgroup %s: %ld kB used", state->cgroup, usage < 0 ? 0 : usage / 1024);
+            if (limit >= 0)
+                printf(" of %ld kB", limit / 1024);
+            if (state->cgroup_version == 2) {
+                for (int i = 0; i < EVENT_COUNT; i++)
+                    printf(", %s %+ld", event_names[i], deltas[i]);
+            } else {
+                printf(", failcnt %+ld", failcnt_delta);
+            }
+            printf("\n");
+        }
+    }
+
+    if (state->cgroup_version > 0) {
+        // only the processes in the watched cgroup
+        int *pids;
+        int count = cgroup_read_pids(state->cgroup, &pids);
+        if (count > 0) {
+            ScanOptions scan = state->options->snapshot;
+            scan.pids = pids;
+            scan.pid_count = count;
+            run_scan(&scan);
+        } else if (!output_structured()) {
+            printf("(no processes in the cgroup)\n");
+        }
+        free(pids);
+    } else {
+        run_scan(&state->options->snapshot);
+    }
+
+    struct timespec done;
+    clock_gettime(CLOCK_MONOTONIC, &done);
+    if (!output_structured())
+        printf("Snapshot taken %ld ms after the wakeup\n", elapsed_ms_between(woke, &done));
+    output_flush();
+    fflush(stdout);
+    state->snapshots++;
+}
+
+static int setup_sources(WatchState *state) {
+    const WatchOptions *options = state->options;
+
+    if (options->cgroup) {
+        state->cgroup_version = cgroup_resolve(options->cgroup, state->cgroup, sizeof(state->cgroup));
+        if (state->cgroup_version < 0) {
+            fprintf(stderr, "%s is not a memory cgroup\n", options->cgroup);
+            return -1;
+        }
+    } else if (options->pid > 0) {
+        state->cgroup_version = cgroup_memory_dir(options->pid, state->cgroup, sizeof(state->cgroup));
+        if (state->cgroup_version < 0) {
+            fprintf(stderr, "Couldn't find the memory cgroup of process %d\n", options->pid);
+            return -1;
+        }
+    }
+
+    // the cgroup's own pressure file when it has one, otherwise system-wide
+    snprintf(state->pressure_path, sizeof(state->pressure_path), "/proc/pressure/memory");
+    if (state->cgroup_version == 2) {
+        char path[4352];
+        snprintf(path, sizeof(path), "%s/memory.pressure", state->cgroup);
+        if (access(path, F_OK) == 0)
+            snprintf(state->pressure_path, sizeof(state->pressure_path), "%s", path);
+    }
+
+    if (register_psi(state, state->pressure_path) != 0)
+        fprintf(stderr, "PSI trigger on %s unavailable (%s)\n", state->pressure_path, strerror(errno));
+
+    if (state->cgroup_version == 2) {
+        char path[4352];
+        snprintf(path, sizeof(path), "%s/memory.events", state->cgroup);
+        state->events_fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (state->events_fd == -1 || add_source(state, SOURCE_EVENTS, state->events_fd, -1) != 0) {
+            fprintf(stderr, "Couldn't watch %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+        read_events(state, state->events);
+        memcpy(state->seen_events, state->events, sizeof(state->events));
+    }
+
+    // without PSI on a v1 host, memory pressure is reported per memory cgroup:
+    // the hierarchy root covers the whole system
+    if (state->cgroup_version == 0 && state->source_count == 0 &&
+        cgroup_v1_memory_mount(state->cgroup, sizeof(state->cgroup)) == 0 &&
+        cgroup_memory_version(state->cgroup) == 1) {
+        state->cgroup_version = 1;
+    }
+
+    if (state->cgroup_version == 1) {
+        if (register_v1(state, SOURCE_V1_PRESSURE, "memory.pressure_level", V1_PRESSURE_LEVEL) != 0)
+            fprintf(stderr, "Couldn't register for %s/memory.pressure_level: %s\n", state->cgroup, strerror(errno));
+        if (register_v1(state, SOURCE_V1_OOM, "memory.oom_control", NULL) != 0)
+            fprintf(stderr, "Couldn't register for %s/memory.oom_control: %s\n", state->cgroup, strerror(errno));
+        state->last_failcnt = read_cgroup_number(state, "memory.failcnt");
+    }
+
+    if (state->source_count == 0) {
+        fprintf(stderr, "No memory pressure notifications are available on this system\n");
+        return -1;
+    }
+
+    double avg10;
+    read_pressure(state->pressure_path, &avg10, &state->last_stall_us);
+    return 0;
+}
+
+int run_watch(const WatchOptions *options) {
+    WatchState *state = calloc(1, sizeof(WatchState));
+    if (!state) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    state->options = options;
+    state->events_fd = -1;
+
+    state->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (state->epoll_fd == -1) {
+        fprintf(stderr, "Couldn't create epoll instance: %s\n", strerror(errno));
+        free(state);
+        return -1;
+    }
+
+    int status = setup_sources(state);
+    if (status != 0)
+        goto done;
+
+    if (!output_structured()) {
+        printf("\n---- Watching memory pressure");
+        if (state->cgroup_version > 0)
+            printf(" of %s", state->cgroup);
+        printf(" (");
+        for (int i = 0; i < state->source_count; i++)
+            printf("%s%s", i ? ", " : "", source_names[state->sources[i].type]);
+        printf(") ----\n");
+        fflush(stdout);
+    }
+
+    struct rusage usage_start, usage_end;
+    struct timespec start, now, last_snapshot = {0, 0};
+    getrusage(RUSAGE_SELF, &usage_start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (!interrupted && (options->count == 0 || state->snapshots < options->count)) {
+        // block indefinitely unless a coalesced event is waiting for its window to pass
+        int timeout = -1;
+        if (state->fired_mask) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long waited = elapsed_ms_between(&last_snapshot, &now);
+            timeout = waited >= options->window_ms ? 0 : (int)(options->window_ms - waited);
+        }
+
+        struct epoll_event events[MAX_SOURCES];
+        int ready = epoll_wait(state->epoll_fd, events, MAX_SOURCES, timeout);
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "epoll_wait failed: %s\n", strerror(errno));
+            status = -1;
+            break;
+        }
+
+        struct timespec woke;
+        clock_gettime(CLOCK_MONOTONIC, &woke);
+
+        for (int i = 0; i < ready; i++) {
+            WatchSource *source = &state->sources[events[i].data.u32];
+            if (source->type == SOURCE_PSI && (events[i].events & EPOLLERR)) {
+                fprintf(stderr, "The PSI trigger was removed\n");
+                epoll_ctl(state->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+                continue;
+            }
+            if (source->type == SOURCE_V1_PRESSURE || source->type == SOURCE_V1_OOM) {
+                uint64_t hits;
+                if (read(source->fd, &hits, sizeof(hits)) != sizeof(hits))
+                    continue;
+            } else if (source->type == SOURCE_EVENTS) {
+                // memory.events wakes on every change, including ones we do not report
+                long current[EVENT_COUNT];
+                read_events(state, current);
+                if (memcmp(current, state->seen_events, sizeof(current)) == 0)
+                    continue;
+                memcpy(state->seen_events, current, sizeof(current));
+            }
+            source->fired++;
+            state->fired_mask |= 1u << source->type;
+        }
+
+        // at most one snapshot per window; later events are folded into the next one
+        if (state->fired_mask &&
+            (state->snapshots == 0 || elapsed_ms_between(&last_snapshot, &woke) >= options->window_ms)) {
+            take_snapshot(state, &woke);
+            clock_gettime(CLOCK_MONOTONIC, &last_snapshot);
+        }
+    }
+
+    getrusage(RUSAGE_SELF, &usage_end);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double cpu_ms = (usage_end.ru_utime.tv_sec - usage_start.ru_utime.tv_sec) * 1e3 +
+                    (usage_end.ru_utime.tv_usec - usage_start.ru_utime.tv_usec) / 1e3 +
+                    (usage_end.ru_stime.tv_sec - usage_start.ru_stime.tv_sec) * 1e3 +
+                    (usage_end.ru_stime.tv_usec - usage_start.ru_stime.tv_usec) / 1e3;
+
+    if (output_structured()) {
+        output_begin("watch_summary");
+        output_long("snapshots", state->snapshots);
+        for (int i = 0; i < state->source_count; i++)
+            output_long(source_names[state->sources[i].type], state->sources[i].fired);
+        output_double("watched_s", elapsed_ms_between(&start, &now) / 1000.0);
+        output_double("cpu_ms", cpu_ms);
+        output_end();
+    } else {
+        printf("\n---- Watch Summary ----\n");
+        printf("Snapshots: %d, notifications:", state->snapshots);
+        for (int i = 0; i < state->source_count; i++)
+            printf(" %s %ld", source_names[state->sources[i].type], state->sources[i].fired);
+        printf("\nWatched for %.1f s using %.1f ms of CPU\n", elapsed_ms_between(&start, &now) / 1000.0, cpu_ms);
+    }
+
+done:
+    for (int i = 0; i < state->source_count; i++) {
+        close(state->sources[i].fd);
+        if (state->sources[i].file_fd != -1)
+            close(state->sources[i].file_fd);
+    }
+    close(state->epoll_fd);
+    free(state);
+    return status;
+}
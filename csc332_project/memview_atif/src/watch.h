@@ -0,0 +1,24 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "scan.h"
+
+typedef struct {
+    const char *cgroup;     // cgroup directory or name to watch, or NULL
+    int pid;                // or the memory cgroup of this process (-1 = none)
+    int stall_us;           // PSI: stall time within the window that fires
+    int window_ms;          // PSI window, also the shortest gap between snapshots
+    int count;              // stop after this many snapshots (0 = until interrupted)
+    ScanOptions snapshot;   // top consumers to list when something fires
+} WatchOptions;
+
+// Block in epoll_wait on memory pressure notifications and print a snapshot
+// of the top consumers whenever one fires:
+//   - a PSI trigger on /proc/pressure/memory (or the cgroup's memory.pressure)
+//   - cgroup v2 memory.events changes (high/max/oom/oom_kill)
+//   - on v1 memory cgroups, memory.pressure_level and memory.oom_control
+//     eventfds registered through cgroup.event_control
+// Nothing is polled, so the process uses no CPU between events.
+int run_watch(const WatchOptions *options);
+
+#endif
@@ -15,4 +15,36 @@ echo ""
 echo "Test 5: Maps without PID"
 ../build/memview -m -s
 echo ""
+echo "Test 6: Sampling without PID"
+../build/memview -i 100 -n 3
+echo ""
+echo "Test 7: Invalid interval"
+../build/memview -p $$ -i 0
+echo ""
+echo "Test 8: Bad PID list and sort key"
+../build/memview -p 12,abc
+../build/memview -p all -r size
+echo ""
+echo "Test 9: Residency without PID"
+../build/memview -R
+echo ""
+echo "Test 10: Bad output format, --record without sampling, replaying a non-series file"
+../build/memview -p $$ -o xml
+../build/memview -p $$ --record /tmp/memview_series
+../build/memview --replay /etc/hostname
+echo ""
+echo "Test 11: Watching a missing cgroup, bad PSI window and stall threshold"
+../build/memview -W --cgroup no_such_cgroup
+../build/memview -W --window 100
+../build/memview -W --stall 5000000
+echo ""
+echo "Test 12: Cgroup view of a missing cgroup, --cgroup without a mode"
+../build/memview -C --cgroup no_such_cgroup
+../build/memview --cgroup no_such_cgroup
+echo ""
+echo "Test 13: Diffing a non-snapshot file, --snapshot without a PID, --growth with --diff"
+../build/memview --diff /etc/hostname -p $$
+../build/memview --snapshot /tmp/memview_snapshot
+../build/memview -p $$ --growth --diff /etc/hostname
+echo ""
 echo "--------All Error Tests Complete--------"
\ No newline at end of file
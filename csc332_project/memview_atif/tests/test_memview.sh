@@ -17,4 +17,56 @@ echo "Test 5: All options together"
 ../build/memview -p $$ -m -s -S
 echo "Test 6: Threading mode"
 ../build/memview -p $$ -s -t
+echo "Test 7: Sampling mode"
+../build/memview -p $$ -s -i 10 -n 5
+echo "Test 8: Top processes across the system"
+../build/memview -p all -N 5 -r pss
+echo "Test 9: Several PIDs and a name filter"
+../build/memview -p $$,$PPID
+../build/memview -f bash -N 3
+echo "Test 10: Region totals by type and path"
+../build/memview -p $$ -A
+echo "Test 11: Shared memory table larger than 4 KB is not truncated"
+shm_ids=""
+for i in $(seq 1 100); do
+    shm_ids="$shm_ids $(ipcmk -M 4096 2>/dev/null | awk '{print $NF}')"
+done
+expected=$(wc -l < /proc/sysvipc/shm)
+shown=$(../build/memview -S | sed -n '/Shared Memory Segments/,$p' | tail -n +3 | grep -c .)
+for id in $shm_ids; do ipcrm -m "$id" 2>/dev/null; done
+echo "segments in /proc: $((expected - 1)), shown: $shown"
+echo "Test 12: Page residency and working set"
+../build/memview -p $$ -R --idle 100 | sed -n '/Page Residency/,$p'
+echo "Test 13: JSON and CSV output"
+../build/memview -p $$ -s -o json
+../build/memview -p all -N 3 -o csv
+echo "Test 14: Record samples to a time-series file and replay them"
+series=$(mktemp)
+rm -f "$series"
+../build/memview -p $$ -s -i 10 -n 5 --record "$series"
+../build/memview --replay "$series"
+../build/memview --replay "$series" -o csv
+rm -f "$series"
+echo "Test 15: Watch for memory pressure (stopped after 1 s)"
+../build/memview -W -p $$ -N 3 &
+watcher=$!
+sleep 1
+kill -INT $watcher
+wait $watcher
+echo "Test 16: Memory per cgroup, three passes over the cached tree"
+../build/memview -C -N 5
+../build/memview -C -N 3 -i 100 -n 3
+echo "Test 17: Concurrent collectors give the same sections in the same order"
+../build/memview -p $$ -s -m -S | grep -e '^----' > /tmp/memview_serial.$$
+../build/memview -p $$ -s -m -S -t | grep -e '^----' > /tmp/memview_threaded.$$
+cmp /tmp/memview_serial.$$ /tmp/memview_threaded.$$ && echo "same order"
+rm -f /tmp/memview_serial.$$ /tmp/memview_threaded.$$
+../build/memview -p $$ -s -m -R -S -t --timing | sed -n '/---- Timing/,$p'
+echo "Test 18: Region snapshots, diffs and growth tracking"
+snapshot=$(mktemp)
+../build/memview -p $$ --snapshot "$snapshot"
+../build/memview -p $$ --diff "$snapshot"
+../build/memview --diff "$snapshot" "$snapshot" -o csv
+../build/memview -p $$ --growth -i 100 -n 3 | grep -e '^----' -e '^Regions' -e '^RSS:'
+rm -f "$snapshot"
 echo "---------------All Normal Tests Complete---------------"
@@ -0,0 +1,343 @@
+// timedexec_bench.c
+// Spawn latency benchmark for the timedexec runner.
+// Starts thousands of short commands through the same runner.c the tool
+// uses, for each spawn method, PATH lookup mode, pool size and parent size
+// (a "ballast" of touched heap pages, which is what fork() has to copy the
+// page tables of), and prints one CSV row per case.
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "runner.h"
+#include "cgroup.h"
+#include "limits.h"
+#include "spawn.h"
+
+#ifndef BENCH_TAG
+#define BENCH_TAG "unknown"
+#endif
+
+#define MAX_LIST 16
+
+/* Generous: a command that takes this long means something is wrong */
+#define BENCH_TIMEOUT_NS (10 * NSEC_PER_SEC)
+
+static const char *const method_names[] = { "vfork", "fork" };     // SpawnMethod order
+static const char *const lookup_names[] = { "cached", "execvp" };
+
+typedef struct {
+    long long items[MAX_LIST];
+    int count;
+} NumberList;
+
+typedef struct {
+    double spawn_us;            // time the parent spent in runner_spawn()
+    double cycle_us;            // start to reap
+} Sample;
+
+typedef struct {
+    int method;
+    int lookup;
+    int jobs;
+    long long ballast;
+    int cgroups;
+    int commands;
+    char **argv;
+} Case;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [OPTIONS] [-- command [args...]]\n"
+        "Start short commands (default: true) through the timedexec runner and\n"
+        "print spawn latency as CSV on stdout.\n"
+        "  -n N     : commands per case (default 1000)\n"
+        "  -s LIST  : spawn methods, vfork,fork (default both)\n"
+        "  -p LIST  : PATH lookup, cached,execvp (default both)\n"
+        "  -j LIST  : commands running at once (default 1,16)\n"
+        "  -m LIST  : parent heap to touch first, e.g. 0,256M,1G (default 0,256M)\n"
+        "  -g       : a cgroup per command, as -r and the limits do\n"
+        "  -r N     : repetitions per case, the median is reported (default 3)\n"
+        "  -t TAG   : version label for the tag column (default " BENCH_TAG ")\n",
+        prog);
+}
+
+/* Comma list of counts, or with sizes set of byte sizes (K, M, G) */
+static int parse_number_list(const char *text, NumberList *list, int sizes)
+{
+    char *copy = strdup(text);
+    if (!copy)
+        return -1;
+    list->count = 0;
+    for (char *token = strtok(copy, ","); token; token = strtok(NULL, ",")) {
+        long long value = -1;
+        if (!sizes)
+            value = atoll(token) > 0 ? atoll(token) : -1;
+        else if (strcmp(token, "0") == 0)
+            value = 0;              // no ballast, which parse_size() refuses
+        else if (parse_size(token, &value) != 0)
+            value = -1;
+        if (value < 0 || list->count == MAX_LIST) {
+            free(copy);
+            return -1;
+        }
+        list->items[list->count++] = value;
+    }
+    free(copy);
+    return list->count > 0 ? 0 : -1;
+}
+
+/* Comma list of names, stored as indexes into names */
+static int parse_name_list(const char *text, const char *const *names, int name_count, NumberList *list)
+{
+    char *copy = strdup(text);
+    if (!copy)
+        return -1;
+    list->count = 0;
+    for (char *token = strtok(copy, ","); token; token = strtok(NULL, ",")) {
+        int found = -1;
+        for (int i = 0; i < name_count; i++) {
+            if (strcmp(token, names[i]) == 0)
+                found = i;
+        }
+        if (found < 0 || list->count == MAX_LIST) {
+            free(copy);
+            return -1;
+        }
+        list->items[list->count++] = found;
+    }
+    free(copy);
+    return list->count > 0 ? 0 : -1;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* The p-th percentile of values (sorted in place) */
+static double percentile(double *values, int count, int p)
+{
+    qsort(values, count, sizeof(double), compare_double);
+    int index = (int)((long long)count * p / 100);
+    return values[index < count ? index : count - 1];
+}
+
+/* Run one case once: every command through the runner, up to jobs at a
+ * time. Returns the wall time in seconds, -1 on failure. */
+static double run_case(const Case *c, Sample *samples)
+{
+    Runner runner;
+    if (runner_init(&runner) != 0)
+        return -1;
+    runner.spawn_method = (SpawnMethod)c->method;
+    runner.null_stdin = 1;
+    if (c->lookup == 1) {
+        // a cache without a search path finds nothing, so every child
+        // walks $PATH itself in execvp() as it used to
+        path_cache_free(&runner.paths);
+    }
+
+    Job *jobs = calloc(c->commands, sizeof(Job));
+    JobCgroup *cgroups = c->cgroups ? calloc(c->commands, sizeof(JobCgroup)) : NULL;
+    if (!jobs || (c->cgroups && !cgroups)) {
+        fprintf(stderr, "timedexec_bench: out of memory\n");
+        free(jobs);
+        runner_close(&runner);
+        return -1;
+    }
+
+    int started = 0, finished = 0, failed = 0;
+    long long begin = now_ns();
+    while (finished < c->commands) {
+        while (started < c->commands && runner.running < c->jobs) {
+            Job *job = &jobs[started];
+            job->id = started;
+            job->argv = c->argv;
+            job->command = c->argv[0];
+            job->timeout_ns = BENCH_TIMEOUT_NS;
+            if (cgroups) {
+                char name[64];
+                snprintf(name, sizeof(name), "timedexec-bench-%d-%d", (int)getpid(), started);
+                if (cgroup_create(&cgroups[started], name, NULL) == 0)
+                    job->cgroup = &cgroups[started];
+            }
+            long long before = now_ns();
+            if (runner_spawn(&runner, job) != 0) {
+                failed = 1;
+                break;
+            }
+            samples[started].spawn_us = (now_ns() - before) / 1e3;
+            started++;
+        }
+        if (failed && runner.running == 0)
+            break;
+
+        for (Job *job = runner_wait(&runner, 1); job; job = job->done_next) {
+            if (!WIFEXITED(job->status) || WEXITSTATUS(job->status) == 127)
+                failed = 1;
+            samples[job->id].cycle_us = (job->end_ns - job->start_ns) / 1e3;
+            if (job->cgroup)
+                cgroup_destroy(&cgroups[job->id]);
+            finished++;
+        }
+        if (runner.interrupted)
+            break;
+    }
+    double wall = (now_ns() - begin) / 1e9;
+    runner_close(&runner);
+    free(jobs);
+    free(cgroups);
+    if (failed || finished < c->commands) {
+        fprintf(stderr, "timedexec_bench: %s did not run cleanly\n", c->argv[0]);
+        return -1;
+    }
+    return wall;
+}
+
+/* Run a case reps times and print the run with the median wall time */
+static int bench_case(const char *tag, const Case *c, int reps)
+{
+    Sample *runs[64];
+    double walls[64], sorted[64];
+    if (reps > 64)
+        reps = 64;
+
+    int status = 0;
+    for (int r = 0; r < reps; r++) {
+        runs[r] = malloc(c->commands * sizeof(Sample));
+        if (!runs[r] || (walls[r] = run_case(c, runs[r])) < 0) {
+            free(runs[r]);
+            reps = r;
+            status = -1;
+            break;
+        }
+        sorted[r] = walls[r];
+    }
+
+    if (status == 0) {
+        double median_wall = percentile(sorted, reps, 50);
+        int median = 0;
+        while (walls[median] != median_wall)
+            median++;
+
+        double *values = malloc(c->commands * sizeof(double));
+        if (!values) {
+            status = -1;
+        } else {
+            for (int i = 0; i < c->commands; i++)
+                values[i] = runs[median][i].spawn_us;
+            double spawn_median = percentile(values, c->commands, 50);
+            double spawn_p99 = percentile(values, c->commands, 99);
+            for (int i = 0; i < c->commands; i++)
+                values[i] = runs[median][i].cycle_us;
+            double cycle_median = percentile(values, c->commands, 50);
+            double cycle_p99 = percentile(values, c->commands, 99);
+            free(values);
+
+            printf("%s,%s,%s,%d,%lld,%d,%d,%d,%.1f,%.1f,%.1f,%.1f,%.6f,%.0f\n",
+                   tag, method_names[c->method], lookup_names[c->lookup], c->jobs,
+                   c->ballast >> 20, c->cgroups, c->commands, reps,
+                   spawn_median, spawn_p99, cycle_median, cycle_p99,
+                   median_wall, c->commands / median_wall);
+            fflush(stdout);
+        }
+    }
+    for (int r = 0; r < reps; r++)
+        free(runs[r]);
+    return status;
+}
+
+/* Grow the heap by size bytes and touch every page, so that each one has
+ * a page table entry for fork() to copy */
+static char *make_ballast(long long size)
+{
+    if (size == 0)
+        return NULL;
+    char *ballast = malloc(size);
+    if (ballast) {
+        long page = sysconf(_SC_PAGESIZE);
+        for (long long i = 0; i < size; i += page)
+            ballast[i] = 1;
+    }
+    return ballast;
+}
+
+int main(int argc, char *argv[])
+{
+    NumberList methods, lookups, pools, ballasts;
+    int commands = 1000, reps = 3, cgroups = 0;
+    const char *tag = BENCH_TAG;
+    char *default_argv[] = { "true", NULL };
+    char **command = default_argv;
+
+    parse_name_list("vfork,fork", method_names, 2, &methods);
+    parse_name_list("cached,execvp", lookup_names, 2, &lookups);
+    parse_number_list("1,16", &pools, 0);
+    parse_number_list("0,256M", &ballasts, 1);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:p:j:m:gr:t:h")) != -1) {
+        int bad = 0;
+        switch (opt) {
+        case 'n': commands = atoi(optarg); bad = commands <= 0; break;
+        case 's': bad = parse_name_list(optarg, method_names, 2, &methods); break;
+        case 'p': bad = parse_name_list(optarg, lookup_names, 2, &lookups); break;
+        case 'j': bad = parse_number_list(optarg, &pools, 0); break;
+        case 'm': bad = parse_number_list(optarg, &ballasts, 1); break;
+        case 'g': cgroups = 1; break;
+        case 'r': reps = atoi(optarg); bad = reps <= 0; break;
+        case 't': tag = optarg; break;
+        case 'h': usage(argv[0]); return 0;
+        default: usage(argv[0]); return 1;
+        }
+        if (bad) {
+            fprintf(stderr, "Error: invalid value for -%c: %s\n", opt, optarg);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        command = &argv[optind];
+
+    printf("tag,method,path_lookup,jobs,ballast_mb,cgroup,commands,reps,"
+           "spawn_us,spawn_p99_us,cycle_us,cycle_p99_us,wall_s,commands_per_s\n");
+
+    int status = 0;
+    for (int m = 0; m < ballasts.count && status == 0; m++) {
+        char *ballast = make_ballast(ballasts.items[m]);
+        if (ballasts.items[m] && !ballast) {
+            fprintf(stderr, "timedexec_bench: cannot allocate %lld bytes\n", ballasts.items[m]);
+            status = 1;
+            break;
+        }
+        fprintf(stderr, "timedexec_bench: %lld MB ballast\n", ballasts.items[m] >> 20);
+
+        for (int s = 0; s < methods.count && status == 0; s++) {
+            for (int p = 0; p < lookups.count && status == 0; p++) {
+                for (int j = 0; j < pools.count && status == 0; j++) {
+                    Case c = {
+                        .method = (int)methods.items[s],
+                        .lookup = (int)lookups.items[p],
+                        .jobs = (int)pools.items[j],
+                        .ballast = ballasts.items[m],
+                        .cgroups = cgroups,
+                        .commands = commands,
+                        .argv = command
+                    };
+                    if (bench_case(tag, &c, reps) != 0)
+                        status = 1;
+                }
+            }
+        }
+        free(ballast);
+    }
+    return status;
+}
@@ -0,0 +1,475 @@
+// batch.c
+// Batch mode: a bounded pool of jobs fed from a command file.
+
+#define _GNU_SOURCE
+
+#include "batch.h"
+#include "runner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/* Jobs started between two passes over the event loop, so that filling a
+ * large pool does not hold up the deadlines of the jobs already running */
+#define SPAWN_BURST 32
+
+typedef struct BatchJob {
+    Job job;                    // first, so a Job * is a BatchJob *
+    char *line;                 // the words of argv point into this copy
+    char *text;                 // the command as written, for the report
+    JobCgroup cgroup;           // only with a structured report
+    Capture capture;            // only with --tail or --output-dir
+    struct BatchJob *twin;      // the other copy of this attempt, while there is one
+    long long first_start_ns;   // when the line's first attempt started
+    int superseded;             // ended in the same round its twin settled the line
+    char *argv_storage[];
+} BatchJob;
+
+typedef struct {
+    int total;
+    int ok;
+    int failed;
+    int timed_out;
+    int limited;                // ended by --cpu, --mem or --pids
+    unsigned first_limit;
+    int retried;                // lines that needed more than one attempt
+    int retry_wins;             // ... and succeeded in the end
+    int hedges;                 // hedged copies that were started
+    int hedge_wins;             // ... and finished first
+    int peak;                   // most jobs running at once
+    long long fastest_ns;
+    long long slowest_ns;
+    long long sum_ns;
+} BatchStats;
+
+/* Split line in place into words; returns the word count, or -1 on an
+ * unterminated quote. words must have room for strlen(line)/2 + 2 entries. */
+static int split_words(char *line, char **words)
+{
+    int count = 0;
+    char *in = line;
+
+    for (;;) {
+        while (*in == ' ' || *in == '\t')
+            in++;
+        if (*in == '\0')
+            break;
+
+        char *out = in;
+        words[count++] = out;
+        while (*in != '\0' && *in != ' ' && *in != '\t') {
+            if (*in == '\'' || *in == '"') {
+                char quote = *in++;
+                while (*in != quote) {
+                    if (*in == '\0')
+                        return -1;
+                    if (quote == '"' && *in == '\\' && (in[1] == '"' || in[1] == '\\'))
+                        in++;
+                    *out++ = *in++;
+                }
+                in++;
+            } else if (*in == '\\' && in[1] != '\0') {
+                in++;
+                *out++ = *in++;
+            } else {
+                *out++ = *in++;
+            }
+        }
+        int at_end = *in == '\0';
+        *out = '\0';
+        if (at_end)
+            break;
+        in++;
+    }
+    words[count] = NULL;
+    return count;
+}
+
+/* A job for the command text (the part of the line that is kept), NULL
+ * with *bad_quote set if it does not split into words, or out of memory */
+static BatchJob *make_job(const char *text, int id, long long timeout_ns, int *bad_quote)
+{
+    size_t max_words = strlen(text) / 2 + 2;
+    BatchJob *batch_job = calloc(1, sizeof(BatchJob) + max_words * sizeof(char *));
+    char *line = batch_job ? strdup(text) : NULL;
+    char *copy = line ? strdup(text) : NULL;
+    *bad_quote = 0;
+    if (!copy) {
+        fprintf(stderr, "timedexec: out of memory\n");
+        free(line);
+        free(batch_job);
+        return NULL;
+    }
+    if (split_words(line, batch_job->argv_storage) <= 0) {
+        *bad_quote = 1;
+        free(copy);
+        free(line);
+        free(batch_job);
+        return NULL;
+    }
+
+    batch_job->line = line;
+    batch_job->text = copy;
+    batch_job->job.attempt = 1;
+    batch_job->job.id = id;
+    batch_job->job.argv = batch_job->argv_storage;
+    batch_job->job.command = copy;
+    batch_job->job.timeout_ns = timeout_ns;
+    return batch_job;
+}
+
+/* Next runnable line as a job, NULL at the end of the input */
+static BatchJob *next_job(FILE *input, int *line_number, long long timeout_ns)
+{
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    BatchJob *batch_job = NULL;
+
+    while ((length = getline(&line, &capacity, input)) != -1) {
+        (*line_number)++;
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+            line[--length] = '\0';
+
+        const char *start = line + strspn(line, " \t");
+        if (*start == '\0' || *start == '#')
+            continue;
+
+        int bad_quote;
+        batch_job = make_job(start, *line_number, timeout_ns, &bad_quote);
+        if (batch_job || !bad_quote)
+            break;
+        fprintf(stderr, "timedexec: line %d: unterminated quote, skipped\n", *line_number);
+    }
+    free(line);
+    return batch_job;
+}
+
+/* Another run of the same line: a retry, or the hedged copy */
+static BatchJob *copy_job(const BatchJob *from)
+{
+    int bad_quote;
+    BatchJob *batch_job = make_job(from->text, from->job.id, from->job.timeout_ns, &bad_quote);
+    if (batch_job) {
+        batch_job->job.limits = from->job.limits;
+        batch_job->job.attempt = from->job.attempt;
+        batch_job->first_start_ns = from->first_start_ns;
+    }
+    return batch_job;
+}
+
+static void free_job(BatchJob *batch_job)
+{
+    if (batch_job->job.cgroup)
+        cgroup_destroy(&batch_job->cgroup);
+    if (batch_job->job.capture)
+        capture_close(&batch_job->capture);
+    free(batch_job->line);
+    free(batch_job->text);
+    free(batch_job);
+}
+
+/* Give the job its cgroup and pipes, then start it at start_ns (now, or
+ * later for a retry or a hedge) */
+static int start_job(Runner *runner, BatchJob *batch_job, const BatchOptions *options, long long start_ns)
+{
+    // job-12, job-12.hedge, job-12.retry2, ...
+    char suffix[32] = "";
+    if (batch_job->job.attempt > 1)
+        snprintf(suffix, sizeof(suffix), ".retry%d", batch_job->job.attempt);
+    if (batch_job->job.hedge)
+        strcat(suffix, ".hedge");
+
+    if (options->report || limits_requested(options->limits)) {
+        char name[96];
+        snprintf(name, sizeof(name), "timedexec-%d-%d%s", (int)getpid(), batch_job->job.id, suffix);
+        unsigned enforced = 0;
+        if (cgroup_create(&batch_job->cgroup, name, options->limits) == 0) {
+            batch_job->job.cgroup = &batch_job->cgroup;
+            enforced = batch_job->cgroup.enforced;
+        }
+        limits_warn_fallback(options->limits, enforced);
+    }
+    if (capture_requested(options->capture)) {
+        char name[64];
+        snprintf(name, sizeof(name), "job-%d%s", batch_job->job.id, suffix);
+        if (capture_open(&batch_job->capture, options->capture, name) != 0)
+            return -1;
+        batch_job->job.capture = &batch_job->capture;
+    }
+    return runner_spawn_at(runner, &batch_job->job, start_ns);
+}
+
+/* Start an attempt at start_ns and, with --hedge, its second copy once
+ * the attempt has run for the hedge delay */
+static int start_attempt(Runner *runner, BatchJob *batch_job, const BatchOptions *options, long long start_ns)
+{
+    if (start_job(runner, batch_job, options, start_ns) != 0)
+        return -1;
+    if (batch_job->job.attempt == 1)
+        batch_job->first_start_ns = batch_job->job.start_ns;
+
+    long long delay = options->retry ? hedge_delay(options->retry) : -1;
+    if (delay < 0 || delay >= batch_job->job.timeout_ns)
+        return 0;
+    BatchJob *hedge = copy_job(batch_job);
+    if (!hedge)
+        return 0;               // no hedge is not worth failing the line for
+    hedge->job.hedge = 1;
+    long long begin = start_ns > batch_job->job.start_ns ? start_ns : batch_job->job.start_ns;
+    if (start_job(runner, hedge, options, begin + delay) != 0) {
+        free_job(hedge);
+        return 0;
+    }
+    batch_job->twin = hedge;
+    hedge->twin = batch_job;
+    return 0;
+}
+
+/* The row for a line, once its outcome is settled: job is the attempt
+ * that won, or the last one that failed */
+static void print_job(BatchJob *batch_job, BatchStats *stats)
+{
+    Job *job = &batch_job->job;
+    char status_text[32];
+    char run[16];
+    long long elapsed = job->end_ns - batch_job->first_start_ns;
+
+    describe_attempt(job, status_text, sizeof(status_text));
+    if (job->limit_hit == LIMIT_WALL) {
+        stats->timed_out++;
+    } else if (job->limit_hit) {
+        stats->limited++;
+        if (!stats->first_limit)
+            stats->first_limit = job->limit_hit;
+    } else if (WIFEXITED(job->status) && WEXITSTATUS(job->status) == 0) {
+        stats->ok++;
+    } else {
+        stats->failed++;
+    }
+    if (batch_job->job.attempt > 1) {
+        stats->retried++;
+        stats->retry_wins += attempt_succeeded(job);
+    }
+    if (batch_job->job.hedge && attempt_succeeded(job))
+        stats->hedge_wins++;
+
+    stats->total++;
+    stats->sum_ns += elapsed;
+    if (stats->total == 1 || elapsed < stats->fastest_ns)
+        stats->fastest_ns = elapsed;
+    if (elapsed > stats->slowest_ns)
+        stats->slowest_ns = elapsed;
+
+    // the attempt that settled it, with an h if it was the hedged copy
+    snprintf(run, sizeof(run), "%d%s", batch_job->job.attempt, batch_job->job.hedge ? "h" : "");
+    printf("%-6d %-12s %-4s %12.3f  %s\n", job->id, status_text, run, elapsed / 1e6, job->command);
+}
+
+/* One attempt is over: record it, then either settle its line (print the
+ * row) or leave that to the other copy or to a retry. Returns 1 when the
+ * line is settled. */
+static int attempt_done(Runner *runner, BatchJob *batch_job, const BatchOptions *options, BatchStats *stats)
+{
+    Job *job = &batch_job->job;
+    CgroupStats cgroup_stats;
+    if (job->cgroup)
+        cgroup_read_stats(job->cgroup, &cgroup_stats);
+    if (!job->cancelled && !job->start_failed)
+        runner_classify(job, job->cgroup ? &cgroup_stats : NULL);
+    if (batch_job->job.hedge)
+        stats->hedges++;
+    // a record per run, the cancelled loser of a hedge included
+    if (options->report)
+        report_job(options->report, job, job->cgroup ? &cgroup_stats : NULL);
+
+    if (job->cancelled || batch_job->superseded) {
+        free_job(batch_job);
+        return 0;               // its twin has settled the line
+    }
+
+    BatchJob *twin = batch_job->twin;
+    if (twin) {
+        twin->twin = NULL;
+        batch_job->twin = NULL;
+    }
+    RetryPolicy *policy = options->retry;
+    int settled = 1;
+
+    if (attempt_succeeded(job)) {
+        // the other copy lost: it either never started, gets killed or
+        // has ended too and is further down the done list
+        if (twin) {
+            int state = runner_cancel(runner, &twin->job);
+            if (state == 0)
+                free_job(twin);
+            else if (state < 0)
+                twin->superseded = 1;
+        }
+        if (policy)
+            hedge_record(policy, job->end_ns - job->start_ns);
+    } else if (twin && !twin->job.waiting) {
+        settled = 0;            // the other copy is still running and may succeed
+    } else {
+        if (twin) {
+            // this one failed before the hedge was due: no point in it now
+            if (runner_cancel(runner, &twin->job) == 0)
+                free_job(twin);
+        }
+        if (policy && retry_wanted(policy, job, batch_job->job.attempt)) {
+            BatchJob *retry = copy_job(batch_job);
+            long long delay = retry_backoff(policy, batch_job->job.attempt);
+            if (retry) {
+                retry->job.attempt = batch_job->job.attempt + 1;
+                if (start_attempt(runner, retry, options, now_ns() + delay) == 0) {
+                    char status_text[32];
+                    describe_attempt(job, status_text, sizeof(status_text));
+                    fprintf(stderr, "timedexec: line %d: attempt %d: %s, retrying in %.0f ms\n",
+                            job->id, batch_job->job.attempt, status_text, delay / 1e6);
+                    settled = 0;
+                } else {
+                    free_job(retry);
+                }
+            }
+        }
+    }
+
+    if (settled)
+        print_job(batch_job, stats);
+    // in one piece under its row (or the retry note), not interleaved with
+    // other jobs' output
+    if (job->capture && !(twin && !settled))
+        capture_print(job->capture, stdout, stderr);
+    free_job(batch_job);
+    return settled;
+}
+
+/* Every child holds a pidfd: allow as many open files as the hard limit */
+static void raise_file_limit(void)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int run_batch(const BatchOptions *options)
+{
+    FILE *input = stdin;
+    if (strcmp(options->path, "-") != 0) {
+        input = fopen(options->path, "r");
+        if (!input) {
+            perror(options->path);
+            return 1;
+        }
+    }
+
+    raise_file_limit();
+
+    Runner runner;
+    if (runner_init(&runner) != 0)
+        return 1;
+    // the children must not read the command list (or the terminal)
+    runner.null_stdin = 1;
+    runner.spawn_method = options->spawn_method;
+    if (options->escalation_count > 0) {
+        runner.escalation = options->escalation;
+        runner.escalation_count = options->escalation_count;
+    }
+
+    BatchStats stats;
+    memset(&stats, 0, sizeof(stats));
+    int line_number = 0;
+    int input_done = 0;
+    int spawn_failed = 0;
+    int lines_open = 0;         // started and not settled, retries included
+    long long started = now_ns();
+
+    printf("%-6s %-12s %-4s %12s  %s\n", "JOB", "STATUS", "RUN", "TIME_ms", "COMMAND");
+    fflush(stdout);
+
+    for (;;) {
+        // keep the pool full; hedged copies come on top
+        int spawned = 0;
+        while (!input_done && lines_open < options->jobs && spawned++ < SPAWN_BURST) {
+            BatchJob *batch_job = next_job(input, &line_number, options->timeout_ns);
+            if (!batch_job) {
+                input_done = 1;
+                break;
+            }
+            batch_job->job.limits = options->limits;
+            if (start_attempt(&runner, batch_job, options, 0) != 0) {
+                // out of processes (or pipes): report it and let the running jobs drain
+                fprintf(stderr, "timedexec: line %d: could not start %s\n", batch_job->job.id, batch_job->text);
+                free_job(batch_job);
+                spawn_failed++;
+                if (lines_open == 0)
+                    input_done = 1;
+                break;
+            }
+            lines_open++;
+            if (runner.running > stats.peak)
+                stats.peak = runner.running;
+        }
+        if (runner.running == 0 && runner.waiting == 0)
+            break;
+
+        int more = !input_done && lines_open < options->jobs;
+        Job *done = runner_wait(&runner, !more);
+        if (runner.interrupted) {
+            for (Job *job = runner_kill_all(&runner), *next; job; job = next) {
+                next = job->done_next;
+                free_job((BatchJob *)job);
+            }
+            for (Job *job = done, *next; job; job = next) {
+                next = job->done_next;
+                free_job((BatchJob *)job);
+            }
+            fprintf(stderr, "\ntimedexec: interrupted by user\n");
+            runner_close(&runner);
+            return 1;
+        }
+        while (done) {
+            Job *next = done->done_next;
+            lines_open -= attempt_done(&runner, (BatchJob *)done, options, &stats);
+            done = next;
+        }
+        // hedges and retries that have started since
+        if (runner.running > stats.peak)
+            stats.peak = runner.running;
+        fflush(stdout);
+    }
+
+    long long wall = now_ns() - started;
+    printf("timedexec: %d jobs in %.3f ms, up to %d at once: %d ok, %d failed, %d timed out",
+           stats.total, wall / 1e6, stats.peak, stats.ok, stats.failed, stats.timed_out);
+    if (stats.limited > 0)
+        printf(", %d over a resource limit", stats.limited);
+    if (spawn_failed > 0)
+        printf(", %d not started", spawn_failed);
+    printf("\n");
+    if (stats.total > 0)
+        printf("timedexec: job time min %.3f ms, mean %.3f ms, max %.3f ms\n",
+               stats.fastest_ns / 1e6, stats.sum_ns / 1e6 / stats.total, stats.slowest_ns / 1e6);
+    if (stats.retried > 0)
+        printf("timedexec: %d jobs retried, %d of them succeeded on a later attempt\n",
+               stats.retried, stats.retry_wins);
+    if (stats.hedges > 0)
+        printf("timedexec: %d hedged copies started, %d finished first\n",
+               stats.hedges, stats.hedge_wins);
+
+    runner_close(&runner);
+    if (input != stdin)
+        fclose(input);
+
+    if (stats.timed_out > 0)
+        return EXIT_WALL_LIMIT;
+    if (stats.limited > 0)
+        return limit_exit_code(stats.first_limit);
+    return stats.failed > 0 || spawn_failed > 0 ? 1 : 0;
+}
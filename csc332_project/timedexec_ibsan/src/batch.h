@@ -0,0 +1,32 @@
+// batch.h
+// Run many commands, each under its own time limit, from one event loop.
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "report.h"
+#include "retry.h"
+
+typedef struct {
+    const char *path;           // command file, "-" for stdin
+    int jobs;                   // how many run at once
+    long long timeout_ns;       // per job, from its own start
+    Report *report;             // a record per job, NULL for none
+    const Limits *limits;       // --cpu, --mem, ...; NULL for none
+    const KillStage *escalation;    // signals for a job over a limit
+    int escalation_count;           // 0 for the runner's default
+    SpawnMethod spawn_method;       // how the children are started
+    const CaptureOptions *capture;  // --tail, --spill, --output-dir; NULL for none
+    RetryPolicy *retry;             // --retries, --hedge; NULL for neither
+} BatchOptions;
+
+/* One command per line (blank lines and lines starting with '#' are
+ * skipped), split into words on blanks with '...', "..." and \ quoting but
+ * no other shell syntax. Prints a line per job as it finishes and a
+ * summary. A line that fails is run again under --retries, and with
+ * --hedge a second copy races a slow one; the row is for the run that
+ * settled the line. Returns 0 if every job exited 0, 124 if any timed out, else the
+ * exit code of the first other limit a job hit, else 1. */
+int run_batch(const BatchOptions *options);
+
+#endif
@@ -0,0 +1,292 @@
+// capture.c
+// Output capture through pipes, ring buffers and spill files: see capture.h.
+
+#define _GNU_SOURCE
+
+#include "capture.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+
+static const char *const labels[2] = { "stdout", "stderr" };
+static const char *const suffixes[2] = { "out", "err" };
+
+int capture_requested(const CaptureOptions *options)
+{
+    return options && (options->tail_bytes > 0 || options->dir);
+}
+
+static int write_all(int fd, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+int capture_open(Capture *capture, const CaptureOptions *options, const char *name)
+{
+    memset(capture, 0, sizeof(*capture));
+    capture->options = options;
+    for (int i = 0; i < 2; i++) {
+        CaptureStream *stream = &capture->streams[i];
+        stream->capture = capture;
+        stream->label = labels[i];
+        stream->fd = stream->child_fd = stream->spill_fd = stream->log_fd = -1;
+        stream->at_line_start = 1;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        CaptureStream *stream = &capture->streams[i];
+        int fds[2];
+        // close-on-exec, so that other jobs' children do not hold our pipes
+        if (pipe2(fds, O_CLOEXEC) == -1) {
+            perror("timedexec: pipe");
+            capture_close(capture);
+            return -1;
+        }
+        stream->fd = fds[0];
+        stream->child_fd = fds[1];
+        fcntl(stream->fd, F_SETFL, O_NONBLOCK);
+        fcntl(stream->fd, F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);     // best effort
+
+        if (options->dir) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s.%s", options->dir, name, suffixes[i]);
+            stream->log_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (stream->log_fd == -1) {
+                perror(path);
+                capture_close(capture);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+void capture_child(const Capture *capture)
+{
+    for (int i = 0; i < 2; i++) {
+        int fd = capture->streams[i].child_fd;
+        int target = i == 0 ? STDOUT_FILENO : STDERR_FILENO;
+        if (fd == target)
+            fcntl(fd, F_SETFD, 0);      // dup2() would leave close-on-exec set
+        else
+            dup2(fd, target);
+    }
+}
+
+void capture_started(Capture *capture, long long start_ns)
+{
+    capture->start_ns = start_ns;
+    for (int i = 0; i < 2; i++) {
+        CaptureStream *stream = &capture->streams[i];
+        if (stream->child_fd >= 0) {
+            close(stream->child_fd);
+            stream->child_fd = -1;
+        }
+    }
+}
+
+/* Something leaves the ring (or never fits in it): into the spill file
+ * with --spill, otherwise it is gone */
+static void evict(CaptureStream *stream, const char *data, long long length)
+{
+    if (stream->capture->options->spill && stream->spill_fd == -1) {
+        const char *dir = getenv("TMPDIR");
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/timedexec-spill-XXXXXX", dir && *dir ? dir : "/tmp");
+        stream->spill_fd = mkostemp(path, O_CLOEXEC);
+        if (stream->spill_fd >= 0)
+            unlink(path);       // gone with the last descriptor
+        else
+            perror("timedexec: spill file");
+    }
+    if (stream->spill_fd >= 0 && write_all(stream->spill_fd, data, (size_t)length) == 0)
+        stream->spilled += length;
+    else
+        stream->dropped += length;
+}
+
+static void ring_append(CaptureStream *stream, const char *data, long long length)
+{
+    long long size = stream->capture->options->tail_bytes;
+    if (!stream->ring) {
+        stream->ring = malloc((size_t)size);
+        if (!stream->ring) {
+            stream->dropped += length;
+            return;
+        }
+    }
+
+    // make room, oldest first: from the ring, then from the front of data
+    long long overflow = stream->ring_used + length - size;
+    if (overflow > 0) {
+        long long from_ring = overflow < stream->ring_used ? overflow : stream->ring_used;
+        while (from_ring > 0) {
+            long long piece = size - stream->ring_start;
+            if (piece > from_ring)
+                piece = from_ring;
+            evict(stream, stream->ring + stream->ring_start, piece);
+            stream->ring_start = (stream->ring_start + piece) % size;
+            stream->ring_used -= piece;
+            from_ring -= piece;
+            overflow -= piece;
+        }
+        if (overflow > 0) {
+            evict(stream, data, overflow);
+            data += overflow;
+            length -= overflow;
+        }
+    }
+
+    while (length > 0) {
+        long long end = (stream->ring_start + stream->ring_used) % size;
+        long long piece = size - end;
+        if (piece > length)
+            piece = length;
+        memcpy(stream->ring + end, data, (size_t)piece);
+        stream->ring_used += piece;
+        data += piece;
+        length -= piece;
+    }
+}
+
+/* Copy data to the log file with "[seconds since start] " before each line */
+static void log_lines(CaptureStream *stream, const char *data, size_t length, long long now)
+{
+    char out[CAPTURE_CHUNK + 1024];
+    size_t used = 0;
+    char stamp[32];
+    int stamp_length = snprintf(stamp, sizeof(stamp), "[%10.3f] ",
+                                (now - stream->capture->start_ns) / 1e9);
+
+    while (length > 0) {
+        if (stream->at_line_start) {
+            if (used + (size_t)stamp_length > sizeof(out)) {
+                write_all(stream->log_fd, out, used);
+                used = 0;
+            }
+            memcpy(out + used, stamp, (size_t)stamp_length);
+            used += (size_t)stamp_length;
+            stream->at_line_start = 0;
+        }
+        const char *newline = memchr(data, '\n', length);
+        size_t line = newline ? (size_t)(newline - data) + 1 : length;
+        if (used + line > sizeof(out)) {
+            write_all(stream->log_fd, out, used);
+            used = 0;
+        }
+        if (line > sizeof(out)) {
+            write_all(stream->log_fd, data, line);
+        } else {
+            memcpy(out + used, data, line);
+            used += line;
+        }
+        data += line;
+        length -= line;
+        if (newline)
+            stream->at_line_start = 1;
+    }
+    if (used > 0)
+        write_all(stream->log_fd, out, used);
+}
+
+/* Bytes read (and stored), 0 at EOF or on an error, -1 if the pipe is
+ * empty for now */
+static ssize_t read_once(CaptureStream *stream, long long now)
+{
+    char buf[CAPTURE_CHUNK];
+    ssize_t n = read(stream->fd, buf, sizeof(buf));
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return -1;
+    if (n <= 0)
+        return 0;
+
+    stream->total += n;
+    if (stream->log_fd >= 0)
+        log_lines(stream, buf, (size_t)n, now);
+    if (stream->capture->options->tail_bytes > 0)
+        ring_append(stream, buf, n);
+    return n;
+}
+
+int capture_read(CaptureStream *stream, long long now)
+{
+    return read_once(stream, now) != 0;
+}
+
+void capture_drain(Capture *capture, long long now)
+{
+    for (int i = 0; i < 2; i++) {
+        CaptureStream *stream = &capture->streams[i];
+        if (stream->fd < 0)
+            continue;
+        long long got = 0;
+        ssize_t n;
+        while (got < 4 * CAPTURE_PIPE_SIZE && (n = read_once(stream, now)) > 0)
+            got += n;
+        close(stream->fd);
+        stream->fd = -1;
+    }
+}
+
+static void copy_out(const char *data, long long length, FILE *fp)
+{
+    if (length > 0)
+        fwrite(data, 1, (size_t)length, fp);
+}
+
+void capture_print(const Capture *capture, FILE *out, FILE *err)
+{
+    long long size = capture->options->tail_bytes;
+    if (size <= 0)
+        return;
+    fflush(stdout);
+    for (int i = 0; i < 2; i++) {
+        const CaptureStream *stream = &capture->streams[i];
+        FILE *fp = i == 0 ? out : err;
+        if (stream->dropped > 0)
+            fprintf(stderr, "timedexec: %s: %lld of %lld bytes not kept, the last %lld follow\n",
+                    stream->label, stream->dropped, stream->total, stream->total - stream->dropped);
+
+        if (stream->spill_fd >= 0) {
+            char buf[CAPTURE_CHUNK];
+            ssize_t n;
+            for (off_t offset = 0; (n = pread(stream->spill_fd, buf, sizeof(buf), offset)) > 0; offset += n)
+                copy_out(buf, n, fp);
+        }
+        if (stream->ring) {
+            long long first = size - stream->ring_start;
+            if (first > stream->ring_used)
+                first = stream->ring_used;
+            copy_out(stream->ring + stream->ring_start, first, fp);
+            copy_out(stream->ring, stream->ring_used - first, fp);
+        }
+        fflush(fp);
+    }
+}
+
+void capture_close(Capture *capture)
+{
+    for (int i = 0; i < 2; i++) {
+        CaptureStream *stream = &capture->streams[i];
+        int *fds[] = { &stream->fd, &stream->child_fd, &stream->spill_fd, &stream->log_fd };
+        for (int k = 0; k < 4; k++) {
+            if (*fds[k] >= 0)
+                close(*fds[k]);
+            *fds[k] = -1;
+        }
+        free(stream->ring);
+        stream->ring = NULL;
+    }
+}
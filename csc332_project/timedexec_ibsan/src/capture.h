@@ -0,0 +1,82 @@
+// capture.h
+// Capture a child's stdout and stderr through pipes that the runner's
+// event loop drains as data arrives, so a chatty child never blocks on a
+// full pipe and the deadline handling never waits behind it. What is read
+// goes into a bounded ring buffer (the last --tail bytes), to an unlinked
+// spill file for what falls out of the ring (--spill), and/or to
+// timestamped log files (--output-dir).
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+
+/* Read at most this much from one pipe per wakeup, so that a stream that
+ * never runs dry cannot hold up timers or other jobs */
+#define CAPTURE_CHUNK (64 * 1024)
+
+/* Pipe capacity asked for, so bursts fit while the loop is busy */
+#define CAPTURE_PIPE_SIZE (256 * 1024)
+
+typedef struct {
+    long long tail_bytes;       // ring per stream, 0 to keep nothing in memory
+    int spill;                  // keep what the ring drops in a temporary file
+    const char *dir;            // timestamped <name>.out/.err logs, NULL for none
+} CaptureOptions;
+
+struct Capture;
+
+typedef struct {
+    struct Capture *capture;
+    int fd;                     // read end, -1 once closed
+    int child_fd;               // write end until the child has it, then -1
+    const char *label;          // "stdout" or "stderr"
+    char *ring;                 // allocated on the first byte
+    long long ring_start;       // offset of the oldest byte kept
+    long long ring_used;
+    long long total;            // bytes read
+    long long dropped;          // bytes neither in the ring nor spilled
+    int spill_fd;               // -1 until the ring first overflows
+    long long spilled;
+    int log_fd;                 // -1 without --output-dir
+    int at_line_start;          // the next byte logged gets a timestamp
+} CaptureStream;
+
+typedef struct Capture {
+    const CaptureOptions *options;
+    long long start_ns;         // timestamps are relative to this
+    CaptureStream streams[2];   // the child's stdout and stderr
+} Capture;
+
+/* Whether options ask for anything to be captured at all */
+int capture_requested(const CaptureOptions *options);
+
+/* Make the pipes (and the log files, named after name, in options->dir).
+ * Returns 0, or -1 with a message printed. */
+int capture_open(Capture *capture, const CaptureOptions *options, const char *name);
+
+/* In the child, between clone and exec: put the write ends on stdout and
+ * stderr. Only system calls. */
+void capture_child(const Capture *capture);
+
+/* In the parent, once the child exists: close our copy of the write ends,
+ * so that the pipes report EOF when the child's side is gone */
+void capture_started(Capture *capture, long long start_ns);
+
+/* Read what one stream has (up to CAPTURE_CHUNK) and store it. Returns 1
+ * while the stream is open, 0 at EOF or on an error; the fd stays open
+ * either way (the caller stops watching it, capture_drain closes it). */
+int capture_read(CaptureStream *stream, long long now);
+
+/* After the reap: read what is left in the pipes (at most one pipe's
+ * worth, in case something the child started is still writing), then
+ * close them */
+void capture_drain(Capture *capture, long long now);
+
+/* Write what was kept of each stream (spilled part first) to out and err */
+void capture_print(const Capture *capture, FILE *out, FILE *err);
+
+/* Close everything and free the rings */
+void capture_close(Capture *capture);
+
+#endif
@@ -0,0 +1,504 @@
+// cgroup.c
+// Transient per-child cgroups: see cgroup.h.
+
+#define _GNU_SOURCE
+
+#include "cgroup.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#define MAX_BLOCK_DEVICES 64
+
+/* How long cgroup_kill() waits for killed processes to leave */
+#define DRAIN_TIMEOUT_MS 200
+
+static const char *const v1_controllers[V1_COUNT] = { "memory", "pids", "blkio" };
+
+/* Where new cgroups go: the directory of the cgroup we run in, per
+ * hierarchy, or NULL when that hierarchy is missing or not writable */
+static char *v2_base;
+static char *v1_base[V1_COUNT];
+static int discovered;
+
+/* Is token one of the comma-separated words in list? */
+static int has_token(const char *list, const char *token)
+{
+    size_t length = strlen(token);
+    for (const char *p = list; p; p = strchr(p, ',')) {
+        if (*p == ',')
+            p++;
+        if (strncmp(p, token, length) == 0 && (p[length] == ',' || p[length] == '\0'))
+            return 1;
+    }
+    return 0;
+}
+
+/* Our path in each hierarchy, from /proc/self/cgroup */
+static void own_cgroups(char **v2_path, char **v1_paths)
+{
+    FILE *fp = fopen("/proc/self/cgroup", "r");
+    if (!fp)
+        return;
+
+    char line[4096];
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        char *controllers = strchr(line, ':');
+        char *path = controllers ? strchr(controllers + 1, ':') : NULL;
+        if (!path)
+            continue;
+        *controllers++ = '\0';
+        *path++ = '\0';
+
+        if (strcmp(line, "0") == 0 && *controllers == '\0') {
+            *v2_path = strdup(path);
+            continue;
+        }
+        for (int i = 0; i < V1_COUNT; i++) {
+            if (has_token(controllers, v1_controllers[i]))
+                v1_paths[i] = strdup(path);
+        }
+    }
+    fclose(fp);
+}
+
+/* mountpoint + path, where path is relative to the root of the mount */
+static char *join_mount(const char *root, const char *mountpoint, const char *path)
+{
+    size_t root_length = strcmp(root, "/") == 0 ? 0 : strlen(root);
+    if (root_length > 0 && strncmp(path, root, root_length) == 0)
+        path += root_length;
+    if (strcmp(path, "/") == 0)
+        path = "";
+
+    char *joined = malloc(strlen(mountpoint) + strlen(path) + 1);
+    if (joined)
+        sprintf(joined, "%s%s", mountpoint, path);
+    return joined;
+}
+
+/* Find the cgroup2 mount and the v1 mounts in /proc/self/mountinfo */
+static void discover(void)
+{
+    discovered = 1;
+
+    char *v2_path = NULL;
+    char *v1_paths[V1_COUNT] = { NULL };
+    own_cgroups(&v2_path, v1_paths);
+
+    FILE *fp = fopen("/proc/self/mountinfo", "r");
+    if (fp) {
+        // id parent major:minor root mountpoint options [optional...] - type source superoptions
+        char line[4096];
+        while (fgets(line, sizeof(line), fp)) {
+            line[strcspn(line, "\n")] = '\0';
+            char *fields[16];
+            int count = 0;
+            for (char *word = strtok(line, " "); word && count < 16; word = strtok(NULL, " "))
+                fields[count++] = word;
+
+            int dash = 6;
+            while (dash < count && strcmp(fields[dash], "-") != 0)
+                dash++;
+            if (dash + 3 >= count)
+                continue;
+            const char *type = fields[dash + 1];
+            const char *superoptions = fields[dash + 3];
+
+            if (strcmp(type, "cgroup2") == 0 && v2_path && !v2_base) {
+                v2_base = join_mount(fields[3], fields[4], v2_path);
+                continue;
+            }
+            if (strcmp(type, "cgroup") != 0)
+                continue;
+            for (int i = 0; i < V1_COUNT; i++) {
+                if (v1_paths[i] && !v1_base[i] && has_token(superoptions, v1_controllers[i]))
+                    v1_base[i] = join_mount(fields[3], fields[4], v1_paths[i]);
+            }
+        }
+        fclose(fp);
+    }
+
+    free(v2_path);
+    for (int i = 0; i < V1_COUNT; i++)
+        free(v1_paths[i]);
+}
+
+/* mkdir base/name and open it; on EACCES and the like, forget the base */
+static int make_group(char **base, const char *name, char **path)
+{
+    if (!*base)
+        return -1;
+
+    char *dir = malloc(strlen(*base) + strlen(name) + 2);
+    if (!dir)
+        return -1;
+    sprintf(dir, "%s/%s", *base, name);
+
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+        free(dir);
+        free(*base);
+        *base = NULL;
+        return -1;
+    }
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        rmdir(dir);
+        free(dir);
+        return -1;
+    }
+    *path = dir;
+    return fd;
+}
+
+/* Read a small file relative to dir_fd; returns its length or -1 */
+static int read_at(int dir_fd, const char *name, char *buf, size_t size)
+{
+    if (dir_fd < 0)
+        return -1;
+    int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return (int)n;
+}
+
+static int write_at(int dir_fd, const char *name, const char *text)
+{
+    if (dir_fd < 0)
+        return -1;
+    int fd = openat(dir_fd, name, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = write(fd, text, strlen(text));
+    close(fd);
+    return n == (ssize_t)strlen(text) ? 0 : -1;
+}
+
+/* The value after key in a "key value" per line file, or -1 */
+static long long read_key(int dir_fd, const char *name, const char *key)
+{
+    char buf[4096];
+    if (read_at(dir_fd, name, buf, sizeof(buf)) <= 0)
+        return -1;
+
+    size_t length = strlen(key);
+    for (const char *line = buf; line; line = strchr(line, '\n')) {
+        if (*line == '\n')
+            line++;
+        if (strncmp(line, key, length) == 0 && line[length] == ' ')
+            return atoll(line + length + 1);
+    }
+    return -1;
+}
+
+/* A controller only shows up in our children once it is in the parent's
+ * cgroup.subtree_control; try to enable it there, once */
+static void enable_v2_controller(const char *controller, unsigned limit)
+{
+    static unsigned tried;
+    if (tried & limit)
+        return;
+    tried |= limit;
+
+    int base_fd = open(v2_base, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (base_fd < 0)
+        return;
+    char request[32];
+    snprintf(request, sizeof(request), "+%s", controller);
+    // EBUSY when our own cgroup has processes and is not the root
+    write_at(base_fd, "cgroup.subtree_control", request);
+    close(base_fd);
+}
+
+/* "major:minor" of every block device, for io.max and blkio throttling */
+static char block_devices[MAX_BLOCK_DEVICES][16];
+static int block_device_count = -1;
+
+static void find_block_devices(void)
+{
+    int count = 0;
+    DIR *dir = opendir("/sys/block");
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) && count < MAX_BLOCK_DEVICES) {
+        if (entry->d_name[0] == '.')
+            continue;
+        char path[300], number[sizeof(block_devices[0])];
+        snprintf(path, sizeof(path), "/sys/block/%s/dev", entry->d_name);
+        FILE *fp = fopen(path, "r");
+        if (!fp)
+            continue;
+        if (fgets(number, sizeof(number), fp)) {
+            number[strcspn(number, "\n")] = '\0';
+            snprintf(block_devices[count++], sizeof(block_devices[0]), "%s", number);
+        }
+        fclose(fp);
+    }
+    if (dir)
+        closedir(dir);
+    block_device_count = count;
+}
+
+/* Throttle reads and writes on every block device; 0 if any took */
+static int limit_io(JobCgroup *cgroup, const char *name, long long bps)
+{
+    if (block_device_count < 0)
+        find_block_devices();
+    int applied = 0;
+    // "major:minor rbps=N wbps=N": a 15 character device and two 20 digit
+    // values fit with room to spare; anything cut short is skipped
+    char value[128];
+    int length;
+
+    if (cgroup->v2_fd >= 0) {
+        enable_v2_controller("io", LIMIT_IO);
+        for (int i = 0; i < block_device_count; i++) {
+            length = snprintf(value, sizeof(value), "%.15s rbps=%lld wbps=%lld", block_devices[i], bps, bps);
+            if (length < 0 || (size_t)length >= sizeof(value))
+                continue;
+            applied |= write_at(cgroup->v2_fd, "io.max", value) == 0;
+        }
+        if (applied)
+            return 0;
+    }
+
+    cgroup->v1_fd[V1_BLKIO] = make_group(&v1_base[V1_BLKIO], name, &cgroup->v1_path[V1_BLKIO]);
+    for (int i = 0; i < block_device_count && cgroup->v1_fd[V1_BLKIO] >= 0; i++) {
+        length = snprintf(value, sizeof(value), "%.15s %lld", block_devices[i], bps);
+        if (length < 0 || (size_t)length >= sizeof(value))
+            continue;
+        applied |= write_at(cgroup->v1_fd[V1_BLKIO], "blkio.throttle.read_bps_device", value) == 0;
+        applied |= write_at(cgroup->v1_fd[V1_BLKIO], "blkio.throttle.write_bps_device", value) == 0;
+    }
+    return applied ? 0 : -1;
+}
+
+/* Apply what the cgroups can enforce; returns the LIMIT_* bits that took */
+static unsigned apply_limits(JobCgroup *cgroup, const char *name, const Limits *limits)
+{
+    unsigned enforced = 0;
+    char value[32];
+    char buf[256];
+
+    // CPU time is watched by the runner through cpu.stat, which cgroup2
+    // has even without the cpu controller
+    if (limits->cpu_ns > 0 && read_at(cgroup->v2_fd, "cpu.stat", buf, sizeof(buf)) > 0)
+        enforced |= LIMIT_CPU;
+
+    if (limits->memory_bytes > 0) {
+        snprintf(value, sizeof(value), "%lld", limits->memory_bytes);
+        if (cgroup->v2_fd >= 0)
+            enable_v2_controller("memory", LIMIT_MEMORY);
+        if (write_at(cgroup->v2_fd, "memory.max", value) == 0) {
+            // no swapping instead of OOM, and OOM takes down the whole command
+            write_at(cgroup->v2_fd, "memory.swap.max", "0");
+            write_at(cgroup->v2_fd, "memory.oom.group", "1");
+            enforced |= LIMIT_MEMORY;
+        } else if (write_at(cgroup->v1_fd[V1_MEMORY], "memory.limit_in_bytes", value) == 0) {
+            write_at(cgroup->v1_fd[V1_MEMORY], "memory.memsw.limit_in_bytes", value);
+            enforced |= LIMIT_MEMORY;
+        }
+    }
+
+    if (limits->pids > 0) {
+        snprintf(value, sizeof(value), "%lld", limits->pids);
+        if (cgroup->v2_fd >= 0)
+            enable_v2_controller("pids", LIMIT_PIDS);
+        if (write_at(cgroup->v2_fd, "pids.max", value) == 0) {
+            enforced |= LIMIT_PIDS;
+        } else {
+            cgroup->v1_fd[V1_PIDS] = make_group(&v1_base[V1_PIDS], name, &cgroup->v1_path[V1_PIDS]);
+            if (write_at(cgroup->v1_fd[V1_PIDS], "pids.max", value) == 0)
+                enforced |= LIMIT_PIDS;
+        }
+    }
+
+    if (limits->io_bps > 0 && limit_io(cgroup, name, limits->io_bps) == 0)
+        enforced |= LIMIT_IO;
+
+    return enforced;
+}
+
+int cgroup_create(JobCgroup *cgroup, const char *name, const Limits *limits)
+{
+    cgroup->v2_fd = -1;
+    cgroup->v2_path = NULL;
+    for (int i = 0; i < V1_COUNT; i++) {
+        cgroup->v1_fd[i] = -1;
+        cgroup->v1_path[i] = NULL;
+    }
+    cgroup->enforced = 0;
+    if (!discovered)
+        discover();
+
+    cgroup->v2_fd = make_group(&v2_base, name, &cgroup->v2_path);
+    // memory.peak needs the memory controller; on a hybrid system that is v1
+    cgroup->v1_fd[V1_MEMORY] = make_group(&v1_base[V1_MEMORY], name, &cgroup->v1_path[V1_MEMORY]);
+    if (cgroup->v2_fd < 0 && cgroup->v1_fd[V1_MEMORY] < 0)
+        return -1;
+
+    if (limits)
+        cgroup->enforced = apply_limits(cgroup, name, limits);
+    return 0;
+}
+
+static void enter_group(int dir_fd)
+{
+    if (dir_fd < 0)
+        return;
+    int procs = openat(dir_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+    if (procs >= 0) {
+        // "0" means the writing process
+        if (write(procs, "0", 1) != 1) {
+            // stats will just cover less; not worth failing the command
+        }
+        close(procs);
+    }
+}
+
+void cgroup_enter(const JobCgroup *cgroup)
+{
+    // a no-op for cgroup2 when clone3() already put us there
+    enter_group(cgroup->v2_fd);
+    for (int i = 0; i < V1_COUNT; i++)
+        enter_group(cgroup->v1_fd[i]);
+}
+
+/* Signal each process listed in cgroup.procs; returns how many there were */
+static int signal_procs(int dir_fd, int sig)
+{
+    int fd = dir_fd >= 0 ? openat(dir_fd, "cgroup.procs", O_RDONLY | O_CLOEXEC) : -1;
+    if (fd < 0)
+        return 0;
+    FILE *fp = fdopen(fd, "r");
+    if (!fp) {
+        close(fd);
+        return 0;
+    }
+    int pid, count = 0;
+    while (fscanf(fp, "%d", &pid) == 1) {
+        kill(pid, sig);
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+void cgroup_signal(const JobCgroup *cgroup, int sig)
+{
+    if (sig == SIGKILL && write_at(cgroup->v2_fd, "cgroup.kill", "1") == 0)
+        return;
+
+    // the same processes are in every hierarchy: any one of them will do
+    int dir_fd = cgroup->v2_fd;
+    for (int i = 0; i < V1_COUNT && dir_fd < 0; i++)
+        dir_fd = cgroup->v1_fd[i];
+    signal_procs(dir_fd, sig);
+}
+
+long long cgroup_cpu_usage_us(const JobCgroup *cgroup)
+{
+    return read_key(cgroup->v2_fd, "cpu.stat", "usage_usec");
+}
+
+void cgroup_read_stats(const JobCgroup *cgroup, CgroupStats *stats)
+{
+    int v2 = cgroup->v2_fd;
+    int memory = cgroup->v1_fd[V1_MEMORY];
+
+    stats->cpu_usage_us = read_key(v2, "cpu.stat", "usage_usec");
+    stats->cpu_user_us = read_key(v2, "cpu.stat", "user_usec");
+    stats->cpu_system_us = read_key(v2, "cpu.stat", "system_usec");
+
+    // memory.peak is cgroup2 with the memory controller enabled (Linux 5.19+)
+    char buf[64];
+    stats->memory_peak_bytes = -1;
+    if (read_at(v2, "memory.peak", buf, sizeof(buf)) > 0 ||
+        read_at(memory, "memory.max_usage_in_bytes", buf, sizeof(buf)) > 0)
+        stats->memory_peak_bytes = atoll(buf);
+
+    stats->oom_kills = read_key(v2, "memory.events", "oom_kill");
+    if (stats->oom_kills < 0)
+        stats->oom_kills = read_key(memory, "memory.oom_control", "oom_kill");
+
+    stats->pids_denied = read_key(v2, "pids.events", "max");
+    if (stats->pids_denied < 0)
+        stats->pids_denied = read_key(cgroup->v1_fd[V1_PIDS], "pids.events", "max");
+}
+
+static void remove_group(int *fd, char **path)
+{
+    if (*fd >= 0)
+        close(*fd);
+    if (*path) {
+        // EBUSY only if something outlived cgroup_kill(); leave it then
+        rmdir(*path);
+        free(*path);
+    }
+    *fd = -1;
+    *path = NULL;
+}
+
+/* Kill everything in one group and wait until it is empty. cgroup2 kills
+ * the lot with cgroup.kill and flags a change of "populated" in
+ * cgroup.events with POLLPRI; a v1 group is signalled again from
+ * cgroup.procs until nothing is left, which also catches forks that raced
+ * the first pass. */
+static void empty_group(int dir_fd)
+{
+    int events = openat(dir_fd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+    if (events >= 0 && write_at(dir_fd, "cgroup.kill", "1") != 0)
+        signal_procs(dir_fd, SIGKILL);      // cgroup2 before Linux 5.14
+
+    for (int waited = 0; waited < DRAIN_TIMEOUT_MS; waited += 10) {
+        if (events >= 0) {
+            char buf[256];
+            ssize_t n = pread(events, buf, sizeof(buf) - 1, 0);
+            if (n <= 0)
+                break;
+            buf[n] = '\0';
+            if (strstr(buf, "populated 0"))
+                break;
+            struct pollfd pfd = { .fd = events, .events = POLLPRI };
+            poll(&pfd, 1, 10);
+        } else {
+            if (signal_procs(dir_fd, SIGKILL) == 0)
+                break;
+            poll(NULL, 0, 10);
+        }
+    }
+    if (events >= 0)
+        close(events);
+}
+
+void cgroup_kill(const JobCgroup *cgroup)
+{
+    if (cgroup->v2_fd >= 0)
+        empty_group(cgroup->v2_fd);
+    for (int i = 0; i < V1_COUNT; i++) {
+        if (cgroup->v1_fd[i] >= 0)
+            empty_group(cgroup->v1_fd[i]);
+    }
+}
+
+void cgroup_destroy(JobCgroup *cgroup)
+{
+    // a non-empty group cannot be removed
+    cgroup_kill(cgroup);
+    remove_group(&cgroup->v2_fd, &cgroup->v2_path);
+    for (int i = 0; i < V1_COUNT; i++)
+        remove_group(&cgroup->v1_fd[i], &cgroup->v1_path[i]);
+}
@@ -0,0 +1,60 @@
+// cgroup.h
+// A transient cgroup per child, so that what the whole process tree cost
+// (cpu.stat, peak memory) can be read back after it has been reaped, and
+// so that --mem, --pids and --io-bps apply to the whole tree. Uses the
+// cgroup2 hierarchy and, on hybrid systems, the v1 memory, pids and blkio
+// hierarchies for controllers that are not on cgroup2.
+
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include "limits.h"
+
+enum { V1_MEMORY, V1_PIDS, V1_BLKIO, V1_COUNT };
+
+typedef struct {
+    int v2_fd;                  // directory in the cgroup2 hierarchy, -1 if none
+    char *v2_path;
+    int v1_fd[V1_COUNT];        // directories in v1 hierarchies, -1 if none
+    char *v1_path[V1_COUNT];
+    unsigned enforced;          // LIMIT_* bits taken care of by the cgroups
+} JobCgroup;
+
+typedef struct {
+    // -1 when the hierarchy or the file is not there
+    long long cpu_usage_us;
+    long long cpu_user_us;
+    long long cpu_system_us;
+    long long memory_peak_bytes;
+    long long oom_kills;        // processes the OOM killer took
+    long long pids_denied;      // forks refused by pids.max
+} CgroupStats;
+
+/* Create the cgroup(s) for one child under the cgroup timedexec runs in
+ * and apply limits (may be NULL). Returns 0 if at least one hierarchy
+ * could be used, -1 otherwise (no cgroupfs, no permission); after the
+ * first failure it stops trying. */
+int cgroup_create(JobCgroup *cgroup, const char *name, const Limits *limits);
+
+/* Move the calling process into the cgroup(s). Called in the child between
+ * fork and exec, so it only uses async-signal-safe calls. */
+void cgroup_enter(const JobCgroup *cgroup);
+
+/* Send sig to every process in the cgroup: SIGKILL through cgroup.kill
+ * (cgroup2, Linux 5.14+) when it can, otherwise one by one from
+ * cgroup.procs */
+void cgroup_signal(const JobCgroup *cgroup, int sig);
+
+/* usage_usec from cgroup2 cpu.stat, -1 if unavailable */
+long long cgroup_cpu_usage_us(const JobCgroup *cgroup);
+
+void cgroup_read_stats(const JobCgroup *cgroup, CgroupStats *stats);
+
+/* SIGKILL every process in the cgroup(s), in each hierarchy, and wait
+ * (briefly) until they have all left */
+void cgroup_kill(const JobCgroup *cgroup);
+
+/* Kill whatever is still in the cgroup(s), remove them and free the paths */
+void cgroup_destroy(JobCgroup *cgroup);
+
+#endif
@@ -1,147 +1,641 @@
 // timedexec.c
 // Run a command with a wall-clock time limit.
 // Usage:
-//   timedexec -t SECONDS -- command [args...]
+//   timedexec -t DURATION [LIMITS] [-r json|csv [-o FILE]] -- command [args...]
+//   timedexec -t DURATION [LIMITS] [-r json|csv [-o FILE]] -f FILE [-j N]
 
-#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <string.h>
-#include <errno.h>
 
-static pid_t child_pid = -1;  // child process ID
+#include "runner.h"
+#include "batch.h"
+#include "report.h"
+#include "limits.h"
+#include "retry.h"
 
-/* Handle SIGALRM when time limit expires */
-static void alarm_handler(int sig)
+/* Print usage help */
+static void usage(const char *prog)
 {
-    (void)sig;                 // unused parameter
-    if (child_pid > 0) {
-        kill(child_pid, SIGKILL);  // forcefully kill child
+    fprintf(stderr,
+        "Usage: %s -t DURATION [LIMITS] [-r json|csv [-o FILE]] -- command [args...]\n"
+        "       %s -t DURATION [LIMITS] [-r json|csv [-o FILE]] -f FILE [-j N]\n"
+        "  -t DURATION : required time limit, e.g. 5, 2.5, 1.5s, 150ms, 500us\n"
+        "  -f FILE     : run the commands in FILE (one per line, - for stdin),\n"
+        "                each under its own time limit\n"
+        "  -j N        : with -f, run up to N commands at once (default: CPUs)\n"
+        "  -r FORMAT   : print a resource usage record per command, json or csv\n"
+        "  -o FILE     : append the records to FILE instead of stderr\n"
+        "LIMITS (a cgroup per command when possible, setrlimit otherwise):\n"
+        "  --cpu DURATION : CPU time of the command and its children (exit 123)\n"
+        "  --mem SIZE     : memory, e.g. 512M or 2G (exit 122)\n"
+        "  --pids N       : processes/threads at once (exit 121)\n"
+        "  --io-bps SIZE  : read and write bytes per second per disk (throttles)\n"
+        "On a limit, the child's whole process tree is signalled:\n"
+        "  --escalate SEQ : signals and grace periods, e.g. TERM,2s,KILL (default: KILL)\n"
+        "  --foreground   : keep the child in our process group, so it can use the\n"
+        "                   terminal; only a cgroup then reaches its children\n"
+        "  --spawn METHOD : vfork (default) or fork, how children are started\n"
+        "OUTPUT (the command's stdout and stderr go through pipes instead):\n"
+        "  --tail SIZE      : keep the last SIZE of each, printed when the command ends\n"
+        "  --spill          : with --tail, keep what does not fit in a temporary file\n"
+        "  --output-dir DIR : write them to DIR/NAME.out and .err as they arrive,\n"
+        "                     each line timestamped (NAME is job-LINE with -f)\n"
+        "FLAKY COMMANDS:\n"
+        "  --retries N        : run a failed command up to N more times\n"
+        "  --backoff DURATION : wait before the first retry (default 200ms), doubled\n"
+        "                       for each one after, with random jitter\n"
+        "  --hedge DELAY|pNN  : start a second copy of a command still running after\n"
+        "                       DELAY, or (with -f) after the NNth percentile of the\n"
+        "                       successful runs so far; the first to succeed wins\n",
+        prog, prog);
+}
+
+/* Parse "1", "2.5", "1.5s", "150ms", "250.5us" into nanoseconds without
+ * going through floating point, so "0.1" is exactly 100000000 ns.
+ * Returns 0 on success, -1 for anything malformed or out of range. */
+static int parse_duration(const char *text, long long *ns)
+{
+    const char *p = text;
+    long long whole = 0;
+    long long fraction = 0;     // fractional digits, scaled to 1e9 below
+    long long fraction_scale = 1;
+    int digits = 0;
+
+    while (*p >= '0' && *p <= '9') {
+        if (whole > (LLONG_MAX - 9) / 10)
+            return -1;          // too many digits for any unit
+        whole = whole * 10 + (*p++ - '0');
+        digits++;
     }
+    if (*p == '.') {
+        p++;
+        while (*p >= '0' && *p <= '9') {
+            // digits beyond nanosecond precision are ignored
+            if (fraction_scale < NSEC_PER_SEC) {
+                fraction = fraction * 10 + (*p - '0');
+                fraction_scale *= 10;
+            }
+            p++;
+            digits++;
+        }
+    }
+    if (digits == 0)
+        return -1;
+
+    long long unit;
+    if (*p == '\0' || strcmp(p, "s") == 0)
+        unit = NSEC_PER_SEC;
+    else if (strcmp(p, "ms") == 0)
+        unit = 1000000LL;
+    else if (strcmp(p, "us") == 0)
+        unit = 1000LL;
+    else
+        return -1;
+
+    // at most LLONG_MAX / 2 ns (~146 years), so a deadline made by adding it
+    // to a clock reading cannot overflow either
+    long long fraction_part = fraction * unit / fraction_scale;
+    if (whole > (LLONG_MAX / 2 - fraction_part) / unit)
+        return -1;
+    *ns = whole * unit + fraction_part;
+    return *ns > 0 ? 0 : -1;
 }
 
-/* Handle Ctrl-C so parent also kills child */
-static void sigint_handler(int sig)
+/* "TERM", "SIGTERM", "term" or "15" */
+static int parse_signal(const char *text)
 {
-    (void)sig;
-    if (child_pid > 0) {
-        kill(child_pid, SIGKILL);
+    char *end;
+    long number = strtol(text, &end, 10);
+    if (end != text && *end == '\0')
+        return number > 0 && number < NSIG ? (int)number : -1;
+
+    if (strncasecmp(text, "SIG", 3) == 0)
+        text += 3;
+    for (int sig = 1; sig < NSIG; sig++) {
+        const char *name = sigabbrev_np(sig);
+        if (name && strcasecmp(text, name) == 0)
+            return sig;
     }
-    write(STDERR_FILENO, "\ntimedexec: interrupted by user\n", 32);
-    _exit(1);
+    return -1;
 }
 
-/* Print usage help */
-static void usage(const char *prog)
+/* "TERM,2s,INT,1s,KILL": a signal, the grace period to wait after it, the
+ * next signal, ... A trailing grace period gets SIGKILL after it; anything
+ * else must end with KILL. Returns the number of stages, or -1. */
+static int parse_escalation(const char *text, KillStage *stages)
 {
-    fprintf(stderr,
-        "Usage: %s -t SECONDS -- command [args...]\n"
-        "  -t SECONDS : required time limit\n",
-        prog);
+    char *copy = strdup(text);
+    int count = 0;
+    int want_signal = 1;
+    int ok = copy != NULL;
+
+    for (char *token = ok ? strtok(copy, ",") : NULL; token && ok; token = strtok(NULL, ",")) {
+        if (want_signal) {
+            // nothing can follow SIGKILL
+            ok = count < MAX_KILL_STAGES && (count == 0 || stages[count - 1].signal != SIGKILL);
+            if (ok) {
+                stages[count].signal = parse_signal(token);
+                stages[count].grace_ns = 0;
+                ok = stages[count++].signal > 0;
+            }
+        } else {
+            ok = stages[count - 1].signal != SIGKILL &&
+                 parse_duration(token, &stages[count - 1].grace_ns) == 0;
+        }
+        want_signal = !want_signal;
+    }
+    free(copy);
+
+    if (!ok || count == 0)
+        return -1;
+    if (want_signal) {
+        // ended with a grace period
+        if (count == MAX_KILL_STAGES)
+            return -1;
+        stages[count].signal = SIGKILL;
+        stages[count++].grace_ns = 0;
+    } else if (stages[count - 1].signal != SIGKILL) {
+        return -1;
+    }
+    return count;
+}
+
+/* "250ms" (a fixed delay) or "p95" (a percentile of past runs) */
+static int parse_hedge(const char *text, RetryPolicy *policy)
+{
+    if (text[0] == 'p') {
+        char *end;
+        long percentile = strtol(text + 1, &end, 10);
+        if (end == text + 1 || *end != '\0' || percentile <= 0 || percentile >= 100)
+            return -1;
+        policy->hedge_percentile = (int)percentile;
+        policy->hedge_ns = 0;
+        return 0;
+    }
+    policy->hedge_percentile = 0;
+    return parse_duration(text, &policy->hedge_ns);
+}
+
+/* One run of the single command: the first, a retry, or the hedged copy */
+typedef struct {
+    Job job;                    // first, so a Job * is an Attempt *
+    JobCgroup cgroup;
+    Capture capture;
+    int pending;                // started (or waiting to) and not back yet
+} Attempt;
+
+/* Copy command into run, give it its cgroup and pipes, named after name,
+ * and start it at start_ns. Returns 0, or -1 with nothing left open. */
+static int attempt_start(Runner *runner, Attempt *run, const Job *command, const char *name,
+                         int want_cgroup, const CaptureOptions *capture_options, long long start_ns)
+{
+    memset(run, 0, sizeof(*run));
+    run->job = *command;
+
+    // a cgroup of its own counts (and limits) grandchildren too
+    if (want_cgroup) {
+        unsigned enforced = 0;
+        if (cgroup_create(&run->cgroup, name, command->limits) == 0) {
+            run->job.cgroup = &run->cgroup;
+            enforced = run->cgroup.enforced;
+        }
+        limits_warn_fallback(command->limits, enforced);
+    }
+
+    // pipes instead of our stdout and stderr, emptied by the event loop
+    if (capture_requested(capture_options)) {
+        if (capture_open(&run->capture, capture_options, name) != 0) {
+            if (run->job.cgroup)
+                cgroup_destroy(&run->cgroup);
+            return -1;
+        }
+        run->job.capture = &run->capture;
+    }
+
+    if (runner_spawn_at(runner, &run->job, start_ns) != 0) {
+        if (run->job.cgroup)
+            cgroup_destroy(&run->cgroup);
+        if (run->job.capture)
+            capture_close(&run->capture);
+        return -1;
+    }
+    run->pending = 1;
+    return 0;
+}
+
+/* A run is back from the runner (or was cancelled before it started):
+ * work out what ended it, write its record and remove its cgroup */
+static void attempt_finish(Attempt *run, Report *reporting)
+{
+    CgroupStats cgroup_stats;
+    run->pending = 0;
+    if (run->job.cgroup)
+        cgroup_read_stats(run->job.cgroup, &cgroup_stats);
+    if (!run->job.cancelled && !run->job.start_failed)
+        runner_classify(&run->job, run->job.cgroup ? &cgroup_stats : NULL);
+    if (reporting)
+        report_job(reporting, &run->job, run->job.cgroup ? &cgroup_stats : NULL);
+    if (run->job.cgroup) {
+        cgroup_destroy(&run->cgroup);
+        run->job.cgroup = NULL;
+    }
 }
 
 int main(int argc, char *argv[])
 {
     int opt;
-    long time_limit = -1;  // time limit in seconds
+    long long time_limit_ns = -1;  // time limit in nanoseconds
+    const char *batch_path = NULL;
+    int batch_jobs = 0;
+    ReportFormat report_format = REPORT_NONE;
+    const char *report_path = NULL;
+    Limits limits;
+    memset(&limits, 0, sizeof(limits));
+    KillStage escalation[MAX_KILL_STAGES];
+    int escalation_count = 0;     // 0: the runner's default, SIGKILL
+    int foreground = 0;
+    SpawnMethod spawn_method = SPAWN_VFORK;
+    CaptureOptions capture_options;
+    memset(&capture_options, 0, sizeof(capture_options));
+    RetryPolicy retry;
+    memset(&retry, 0, sizeof(retry));
+    retry.backoff_ns = RETRY_BACKOFF_NS;
+
+    enum { OPT_CPU = 256, OPT_MEM, OPT_PIDS, OPT_IO_BPS, OPT_ESCALATE, OPT_FOREGROUND, OPT_SPAWN,
+           OPT_TAIL, OPT_SPILL, OPT_OUTPUT_DIR, OPT_RETRIES, OPT_BACKOFF, OPT_HEDGE };
+    const struct option long_options[] = {
+        {"cpu", required_argument, NULL, OPT_CPU},
+        {"mem", required_argument, NULL, OPT_MEM},
+        {"pids", required_argument, NULL, OPT_PIDS},
+        {"io-bps", required_argument, NULL, OPT_IO_BPS},
+        {"escalate", required_argument, NULL, OPT_ESCALATE},
+        {"foreground", no_argument, NULL, OPT_FOREGROUND},
+        {"spawn", required_argument, NULL, OPT_SPAWN},
+        {"tail", required_argument, NULL, OPT_TAIL},
+        {"spill", no_argument, NULL, OPT_SPILL},
+        {"output-dir", required_argument, NULL, OPT_OUTPUT_DIR},
+        {"retries", required_argument, NULL, OPT_RETRIES},
+        {"backoff", required_argument, NULL, OPT_BACKOFF},
+        {"hedge", required_argument, NULL, OPT_HEDGE},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
 
     // --- command-line parsing and validation (like professor's example) ---
-    while ((opt = getopt(argc, argv, "t:")) != -1) {
+    while ((opt = getopt_long(argc, argv, "t:f:j:r:o:h", long_options, NULL)) != -1) {
         switch (opt) {
         case 't':
-            time_limit = strtol(optarg, NULL, 10);
-            if (time_limit <= 0) {
+            if (parse_duration(optarg, &time_limit_ns) != 0) {
                 fprintf(stderr, "Invalid time limit: %s\n", optarg);
                 return 1;
             }
             break;
+        case 'f':
+            batch_path = optarg;
+            break;
+        case 'j':
+            batch_jobs = atoi(optarg);
+            if (batch_jobs <= 0) {
+                fprintf(stderr, "Invalid job count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'r':
+            if (report_parse_format(optarg, &report_format) != 0) {
+                fprintf(stderr, "Invalid report format: %s (use json or csv)\n", optarg);
+                return 1;
+            }
+            break;
+        case 'o':
+            report_path = optarg;
+            break;
+        case OPT_CPU:
+            if (parse_duration(optarg, &limits.cpu_ns) != 0) {
+                fprintf(stderr, "Invalid CPU time limit: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_MEM:
+            if (parse_size(optarg, &limits.memory_bytes) != 0) {
+                fprintf(stderr, "Invalid memory limit: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_PIDS:
+            limits.pids = atoll(optarg);
+            if (limits.pids <= 0) {
+                fprintf(stderr, "Invalid process limit: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_IO_BPS:
+            if (parse_size(optarg, &limits.io_bps) != 0) {
+                fprintf(stderr, "Invalid I/O limit: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_ESCALATE:
+            escalation_count = parse_escalation(optarg, escalation);
+            if (escalation_count < 0) {
+                fprintf(stderr, "Invalid escalation: %s (e.g. TERM,2s,KILL)\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_FOREGROUND:
+            foreground = 1;
+            break;
+        case OPT_SPAWN:
+            if (spawn_parse_method(optarg, &spawn_method) != 0) {
+                fprintf(stderr, "Invalid spawn method: %s (use vfork or fork)\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_TAIL:
+            if (parse_size(optarg, &capture_options.tail_bytes) != 0) {
+                fprintf(stderr, "Invalid output size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_SPILL:
+            capture_options.spill = 1;
+            break;
+        case OPT_OUTPUT_DIR:
+            capture_options.dir = optarg;
+            break;
+        case OPT_RETRIES:
+            retry.retries = atoi(optarg);
+            if (retry.retries <= 0) {
+                fprintf(stderr, "Invalid retry count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_BACKOFF:
+            if (parse_duration(optarg, &retry.backoff_ns) != 0) {
+                fprintf(stderr, "Invalid backoff: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_HEDGE:
+            if (parse_hedge(optarg, &retry) != 0) {
+                fprintf(stderr, "Invalid hedge delay: %s (e.g. 500ms or p95)\n", optarg);
+                return 1;
+            }
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
         default:
             usage(argv[0]);
             return 1;
         }
     }
 
-    if (time_limit <= 0) {
-        fprintf(stderr, "Error: -t SECONDS is required.\n");
+    if (time_limit_ns <= 0) {
+        fprintf(stderr, "Error: -t DURATION is required.\n");
         usage(argv[0]);
         return 1;
     }
 
-    if (optind >= argc) {
-        fprintf(stderr, "Error: no command specified.\n");
+    if (capture_options.spill && capture_options.tail_bytes == 0) {
+        fprintf(stderr, "Error: --spill needs --tail.\n");
         usage(argv[0]);
         return 1;
     }
 
-    char **cmd_argv = &argv[optind];
+    if (report_path && report_format == REPORT_NONE) {
+        fprintf(stderr, "Error: -o needs -r.\n");
+        usage(argv[0]);
+        return 1;
+    }
 
-    // --- install signal handlers (professor-style, simple error checks) ---
-    struct sigaction sa;
+    if (foreground && batch_path) {
+        fprintf(stderr, "Error: --foreground is for a single command.\n");
+        usage(argv[0]);
+        return 1;
+    }
 
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = alarm_handler;
-    if (sigaction(SIGALRM, &sa, NULL) == -1) {
-        perror("sigaction(SIGALRM)");
+    Report report;
+    Report *reporting = NULL;
+    if (report_format != REPORT_NONE) {
+        if (report_open(&report, report_format, report_path) != 0)
+            return 1;
+        reporting = &report;
+    }
+
+    if (batch_path) {
+        if (optind < argc) {
+            fprintf(stderr, "Error: -f takes its commands from the file, not the command line.\n");
+            usage(argv[0]);
+            return 1;
+        }
+        BatchOptions batch = {
+            .path = batch_path,
+            .jobs = batch_jobs > 0 ? batch_jobs : (int)sysconf(_SC_NPROCESSORS_ONLN),
+            .timeout_ns = time_limit_ns,
+            .report = reporting,
+            .limits = &limits,
+            .escalation = escalation,
+            .escalation_count = escalation_count,
+            .spawn_method = spawn_method,
+            .capture = &capture_options,
+            .retry = retry.retries > 0 || retry.hedge_ns > 0 || retry.hedge_percentile > 0 ? &retry : NULL
+        };
+        if (batch.jobs <= 0)
+            batch.jobs = 1;
+        int code = run_batch(&batch);
+        if (reporting)
+            report_close(reporting);
+        retry_policy_free(&retry);
+        return code;
+    }
+
+    if (batch_jobs > 0) {
+        fprintf(stderr, "Error: -j needs -f.\n");
+        usage(argv[0]);
         return 1;
     }
 
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = sigint_handler;
-    if (sigaction(SIGINT, &sa, NULL) == -1) {
-        perror("sigaction(SIGINT)");
+    if (optind >= argc) {
+        fprintf(stderr, "Error: no command specified.\n");
+        usage(argv[0]);
+        return 1;
+    }
+    if (retry.hedge_percentile > 0) {
+        // one command has no past runs to take a percentile of
+        fprintf(stderr, "Error: --hedge pNN needs -f; use a fixed delay for one command.\n");
+        usage(argv[0]);
         return 1;
     }
 
-    // --- create child (like open() in the snippet: check, perror, return 1) ---
-    child_pid = fork();
-    if (child_pid < 0) {
-        perror("fork");
+    // --- one job on the same event loop that batch mode uses ---
+    Runner runner;
+    if (runner_init(&runner) != 0)
         return 1;
+    runner.own_group = !foreground;
+    runner.spawn_method = spawn_method;
+    if (escalation_count > 0) {
+        runner.escalation = escalation;
+        runner.escalation_count = escalation_count;
     }
 
-    if (child_pid == 0) {
-        // Child: replace with requested command
-        execvp(cmd_argv[0], cmd_argv);
-        // Only reached on error
-        perror("execvp");
-        _exit(127);
+    Job command;
+    memset(&command, 0, sizeof(command));
+    command.argv = &argv[optind];
+    command.command = argv[optind];
+    command.timeout_ns = time_limit_ns;
+    command.limits = &limits;
+
+    // the record names the whole command line
+    char *command_line = NULL;
+    if (reporting) {
+        size_t length = 1;
+        for (int i = optind; i < argc; i++)
+            length += strlen(argv[i]) + 1;
+        command_line = calloc(1, length);
+        for (int i = optind; command_line && i < argc; i++) {
+            if (i > optind)
+                strcat(command_line, " ");
+            strcat(command_line, argv[i]);
+        }
+        if (command_line)
+            command.command = command_line;
     }
 
-    // Parent: start the timer
-    alarm((unsigned int)time_limit);
+    // each attempt, and its hedged copy, gets a cgroup and pipes of its own
+    int want_cgroup = reporting || limits_requested(&limits);
+    Attempt runs[2];            // the attempt and its hedged copy
+    Job job;                    // the run that settled it, for the messages below
+    long long start_at = 0;
 
-    // Wait for child; handle EINTR if a signal arrives
-    int status;
-    for (;;) {
-        int r = waitpid(child_pid, &status, 0);
-        if (r == -1) {
-            if (errno == EINTR) {
-                continue;      // interrupted by signal, try again
-            }
-            perror("waitpid");
+    for (command.attempt = 1; ; command.attempt++) {
+        char name[64];
+        int length = snprintf(name, sizeof(name), "timedexec-%d", (int)getpid());
+        if (command.attempt > 1)
+            snprintf(name + length, sizeof(name) - length, ".retry%d", command.attempt);
+        memset(&runs[1], 0, sizeof(runs[1]));
+        if (attempt_start(&runner, &runs[0], &command, name, want_cgroup, &capture_options, start_at) != 0)
             return 1;
+        if (retry.hedge_ns > 0 && retry.hedge_ns < time_limit_ns) {
+            Job hedge = command;
+            long long begin = start_at > runs[0].job.start_ns ? start_at : runs[0].job.start_ns;
+            hedge.hedge = 1;
+            strcat(name, ".hedge");
+            attempt_start(&runner, &runs[1], &hedge, name, want_cgroup, &capture_options, begin + retry.hedge_ns);
+        }
+
+        // the first copy to succeed wins; a failure waits for the other copy
+        Attempt *settled = NULL;
+        while (runs[0].pending || runs[1].pending) {
+            Job *done = runner_wait(&runner, 1);
+            if (runner.interrupted) {
+                // Ctrl-C or SIGTERM: take the children down with us
+                runner_kill_all(&runner);
+                for (int i = 0; i < 2; i++) {
+                    if (runs[i].job.cgroup)
+                        cgroup_destroy(&runs[i].cgroup);
+                    if (runs[i].job.capture) {
+                        if (runs[i].job.pid > 0)
+                            capture_print(&runs[i].capture, stdout, stderr);
+                        capture_close(&runs[i].capture);
+                    }
+                }
+                fprintf(stderr, "\ntimedexec: interrupted by user\n");
+                return 1;
+            }
+            for (; done; done = done->done_next) {
+                Attempt *run = (Attempt *)done;
+                Attempt *other = run == &runs[0] ? &runs[1] : &runs[0];
+                attempt_finish(run, reporting);
+                if (run->job.cancelled)
+                    continue;
+                if (!settled || !attempt_succeeded(&settled->job))
+                    settled = run;
+                // the other copy is not needed once this one has succeeded,
+                // nor if it has not even started
+                if (other->pending && (attempt_succeeded(&run->job) || other->job.waiting) &&
+                    runner_cancel(&runner, &other->job) == 0)
+                    attempt_finish(other, reporting);
+            }
         }
-        break;                 // child reaped successfully
+
+        for (int i = 0; i < 2; i++) {
+            if (runs[i].job.capture && &runs[i] != settled)
+                capture_close(&runs[i].capture);
+        }
+        if (settled->job.capture) {
+            capture_print(&settled->capture, stdout, stderr);
+            capture_close(&settled->capture);
+        }
+        job = settled->job;
+        if (!retry_wanted(&retry, &job, command.attempt))
+            break;
+
+        char status_text[32];
+        long long delay = retry_backoff(&retry, command.attempt);
+        describe_attempt(&job, status_text, sizeof(status_text));
+        fprintf(stderr, "timedexec: attempt %d: %s, retrying in %.0f ms\n",
+                command.attempt, status_text, delay / 1e6);
+        start_at = now_ns() + delay;
     }
+    runner_close(&runner);
+    if (reporting) {
+        report_close(reporting);
+        free(command_line);
+    }
+    if (command.attempt > 1 || job.hedge)
+        fprintf(stderr, "timedexec: settled by attempt %d%s\n", job.attempt,
+                job.hedge ? ", the hedged copy" : "");
 
-    // Disable any pending alarm (not strictly required but nice)
-    alarm(0);
+    int status = job.status;
 
     // --- interpret child's termination status ---
-    if (WIFSIGNALED(status)) {
-        int sig = WTERMSIG(status);
+    // with more than one stage, say when each went out
+    if (job.kill_stage > 1) {
+        char stages[256];
+        describe_escalation(&job, stages, sizeof(stages));
+        fprintf(stderr, "timedexec: escalation, ms after the limit: %s\n", stages);
+    }
 
-        if (sig == SIGKILL) {
-            fprintf(stderr,
-                "timedexec: process killed (time limit exceeded).\n");
-            return 124;        // timeout-style exit code
-        }
+    if (job.limit_hit == LIMIT_WALL) {
+        fprintf(stderr,
+            "timedexec: process killed (time limit exceeded).\n");
+        fprintf(stderr,
+            "timedexec: limit %.3f ms; SIG%s sent %.3f ms after the deadline, "
+            "child reaped %.3f ms after the deadline\n",
+            time_limit_ns / 1e6, sigabbrev_np(job.stage_signal[0]),
+            (job.killed_ns - job.deadline_ns) / 1e6, (job.end_ns - job.deadline_ns) / 1e6);
+        return EXIT_WALL_LIMIT;     // timeout-style exit code
+    }
+    if (job.limit_hit == LIMIT_CPU) {
+        fprintf(stderr,
+            "timedexec: process killed (CPU time limit of %.3f ms exceeded).\n",
+            limits.cpu_ns / 1e6);
+        return EXIT_CPU_LIMIT;
+    }
+    if (job.limit_hit == LIMIT_MEMORY) {
+        fprintf(stderr,
+            "timedexec: process failed after the OOM killer hit the %lld byte memory limit.\n",
+            limits.memory_bytes);
+        return EXIT_MEMORY_LIMIT;
+    }
+    if (job.limit_hit == LIMIT_PIDS) {
+        fprintf(stderr,
+            "timedexec: process failed after forks were refused at the %lld process limit.\n",
+            limits.pids);
+        return EXIT_PIDS_LIMIT;
+    }
 
+    if (WIFSIGNALED(status)) {
+        int sig = WTERMSIG(status);
         printf("timedexec: process killed by signal %d\n", sig);
         return 128 + sig;
     }
@@ -154,4 +648,4 @@ int main(int argc, char *argv[])
 
     printf("timedexec: unknown termination.\n");
     return 1;
-}
\ No newline at end of file
+}
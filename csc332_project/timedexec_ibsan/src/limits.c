@@ -0,0 +1,115 @@
+// limits.c
+// Limit parsing and the setrlimit fallback: see limits.h.
+
+#define _GNU_SOURCE
+
+#include "limits.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <sys/resource.h>
+
+int parse_size(const char *text, long long *value)
+{
+    char *end;
+    long long number = strtoll(text, &end, 10);
+    if (end == text || number <= 0)
+        return -1;
+
+    int shift = 0;
+    switch (toupper((unsigned char)*end)) {
+    case 'K': shift = 10; end++; break;
+    case 'M': shift = 20; end++; break;
+    case 'G': shift = 30; end++; break;
+    case 'T': shift = 40; end++; break;
+    }
+    if (toupper((unsigned char)*end) == 'B')
+        end++;
+    if (*end != '\0' || number > (1LL << (62 - shift)))
+        return -1;
+
+    *value = number << shift;
+    return 0;
+}
+
+unsigned limits_requested(const Limits *limits)
+{
+    unsigned requested = 0;
+    if (!limits)
+        return 0;
+    if (limits->cpu_ns > 0)
+        requested |= LIMIT_CPU;
+    if (limits->memory_bytes > 0)
+        requested |= LIMIT_MEMORY;
+    if (limits->pids > 0)
+        requested |= LIMIT_PIDS;
+    if (limits->io_bps > 0)
+        requested |= LIMIT_IO;
+    return requested;
+}
+
+static void set_limit(int resource, rlim_t soft, rlim_t hard)
+{
+    struct rlimit limit = { soft, hard };
+    setrlimit(resource, &limit);
+}
+
+void limits_apply_fallback(const Limits *limits, unsigned enforced)
+{
+    unsigned missing = limits_requested(limits) & ~enforced;
+
+    if (missing & LIMIT_CPU) {
+        // whole seconds: SIGXCPU at the soft limit, SIGKILL a second later
+        rlim_t seconds = (limits->cpu_ns + 999999999LL) / 1000000000LL;
+        set_limit(RLIMIT_CPU, seconds, seconds + 1);
+    }
+    if (missing & LIMIT_MEMORY)
+        set_limit(RLIMIT_AS, limits->memory_bytes, limits->memory_bytes);
+    if (missing & LIMIT_PIDS)
+        set_limit(RLIMIT_NPROC, limits->pids, limits->pids);
+}
+
+void limits_warn_fallback(const Limits *limits, unsigned enforced)
+{
+    static int warned;
+    unsigned missing = limits_requested(limits) & ~enforced;
+    if (warned || !missing)
+        return;
+    warned = 1;
+
+    if (missing & LIMIT_CPU)
+        fprintf(stderr, "timedexec: --cpu: no cgroup cpu.stat, using RLIMIT_CPU "
+                "(whole seconds, per process)\n");
+    if (missing & LIMIT_MEMORY)
+        fprintf(stderr, "timedexec: --mem: no cgroup memory controller, using RLIMIT_AS "
+                "(address space, per process)\n");
+    if (missing & LIMIT_PIDS)
+        fprintf(stderr, "timedexec: --pids: no cgroup pids controller, using RLIMIT_NPROC "
+                "(counts all of this user's processes, ignored for root)\n");
+    if (missing & LIMIT_IO)
+        fprintf(stderr, "timedexec: --io-bps: no cgroup io/blkio controller, not enforced\n");
+}
+
+const char *limit_name(unsigned limit)
+{
+    switch (limit) {
+    case LIMIT_WALL:   return "timeout";
+    case LIMIT_CPU:    return "cpu_limit";
+    case LIMIT_MEMORY: return "memory_limit";
+    case LIMIT_PIDS:   return "pids_limit";
+    default:           return "none";
+    }
+}
+
+int limit_exit_code(unsigned limit)
+{
+    switch (limit) {
+    case LIMIT_WALL:   return EXIT_WALL_LIMIT;
+    case LIMIT_CPU:    return EXIT_CPU_LIMIT;
+    case LIMIT_MEMORY: return EXIT_MEMORY_LIMIT;
+    case LIMIT_PIDS:   return EXIT_PIDS_LIMIT;
+    default:           return 1;
+    }
+}
@@ -0,0 +1,47 @@
+// limits.h
+// Resource limits beyond wall-clock time (--cpu, --mem, --pids, --io-bps)
+// and the exit codes that tell which one ended a command.
+
+#ifndef LIMITS_H
+#define LIMITS_H
+
+/* Which limit ended a command (Job.limit_hit), also used as bit flags for
+ * the limits a cgroup enforces */
+#define LIMIT_WALL      0x01
+#define LIMIT_CPU       0x02
+#define LIMIT_MEMORY    0x04
+#define LIMIT_PIDS      0x08
+#define LIMIT_IO        0x10    // throttles, never ends a command
+
+/* Exit codes, one per limit; 124 is the traditional timeout code */
+#define EXIT_WALL_LIMIT     124
+#define EXIT_CPU_LIMIT      123
+#define EXIT_MEMORY_LIMIT   122
+#define EXIT_PIDS_LIMIT     121
+
+typedef struct {
+    // 0 means no limit
+    long long cpu_ns;           // CPU time of the command and its children
+    long long memory_bytes;
+    long long pids;             // processes and threads at once
+    long long io_bps;           // read and write bytes/s, per block device
+} Limits;
+
+/* "4096", "64k", "512M", "2G" (powers of 1024, optional trailing B) */
+int parse_size(const char *text, long long *value);
+
+/* LIMIT_* bits for the limits that are set */
+unsigned limits_requested(const Limits *limits);
+
+/* In the child: setrlimit() for every requested limit the cgroups do not
+ * enforce (RLIMIT_CPU, RLIMIT_AS, RLIMIT_NPROC; nothing for I/O) */
+void limits_apply_fallback(const Limits *limits, unsigned enforced);
+
+/* Tell the user, once, which limits fall back to setrlimit or are not
+ * enforced at all */
+void limits_warn_fallback(const Limits *limits, unsigned enforced);
+
+const char *limit_name(unsigned limit);
+int limit_exit_code(unsigned limit);
+
+#endif
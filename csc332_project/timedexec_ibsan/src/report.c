@@ -0,0 +1,195 @@
+// report.c
+// Structured per-command records: see report.h.
+
+#define _GNU_SOURCE
+
+#include "report.h"
+
+#include <string.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* Columns, in order; the JSON keys are the same names */
+static const char *const columns[] = {
+    "job", "command", "status", "exit_code", "signal", "limit_ms", "wall_ms",
+    "user_ms", "sys_ms", "max_rss_kb", "minor_faults", "major_faults",
+    "voluntary_switches", "involuntary_switches",
+    "cgroup_cpu_ms", "cgroup_user_ms", "cgroup_sys_ms", "cgroup_memory_peak_kb",
+    "escalation", "stdout_bytes", "stderr_bytes", "attempt", "hedge"
+};
+#define COLUMN_COUNT (int)(sizeof(columns) / sizeof(columns[0]))
+
+int report_parse_format(const char *text, ReportFormat *format)
+{
+    if (strcmp(text, "json") == 0)
+        *format = REPORT_JSON;
+    else if (strcmp(text, "csv") == 0)
+        *format = REPORT_CSV;
+    else
+        return -1;
+    return 0;
+}
+
+int report_open(Report *report, ReportFormat format, const char *path)
+{
+    report->format = format;
+    report->out = stderr;
+    if (path) {
+        report->out = fopen(path, "a");
+        if (!report->out) {
+            perror(path);
+            return -1;
+        }
+    }
+
+    // appending to an existing CSV file keeps its header
+    struct stat st;
+    int has_lines = path && fstat(fileno(report->out), &st) == 0 && st.st_size > 0;
+    if (format == REPORT_CSV && !has_lines) {
+        for (int i = 0; i < COLUMN_COUNT; i++)
+            fprintf(report->out, "%s%s", i ? "," : "", columns[i]);
+        fprintf(report->out, "\n");
+        fflush(report->out);
+    }
+    return 0;
+}
+
+void report_close(Report *report)
+{
+    if (report->out && report->out != stderr)
+        fclose(report->out);
+    report->out = NULL;
+}
+
+static void put_string(const Report *report, const char *text)
+{
+    FILE *out = report->out;
+    if (report->format == REPORT_CSV) {
+        // quoted, with embedded quotes doubled (RFC 4180)
+        fputc('"', out);
+        for (const char *p = text; *p; p++) {
+            if (*p == '"')
+                fputc('"', out);
+            fputc(*p, out);
+        }
+        fputc('"', out);
+        return;
+    }
+
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\')
+            fprintf(out, "\\%c", *p);
+        else if (*p == '\n')
+            fputs("\\n", out);
+        else if (*p == '\t')
+            fputs("\\t", out);
+        else if (*p < 0x20)
+            fprintf(out, "\\u%04x", *p);
+        else
+            fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+/* Start field number index: separator, and the key for JSON */
+static void begin_field(const Report *report, int index)
+{
+    if (report->format == REPORT_CSV) {
+        if (index > 0)
+            fputc(',', report->out);
+    } else {
+        fprintf(report->out, "%s\"%s\":", index ? "," : "{", columns[index]);
+    }
+}
+
+/* Negative means unknown: null in JSON, an empty CSV field */
+static void put_integer(const Report *report, int index, long long value)
+{
+    begin_field(report, index);
+    if (value >= 0)
+        fprintf(report->out, "%lld", value);
+    else if (report->format == REPORT_JSON)
+        fputs("null", report->out);
+}
+
+static void put_ms(const Report *report, int index, double ms)
+{
+    begin_field(report, index);
+    if (ms >= 0)
+        fprintf(report->out, "%.3f", ms);
+    else if (report->format == REPORT_JSON)
+        fputs("null", report->out);
+}
+
+static double timeval_ms(struct timeval tv)
+{
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+void report_job(Report *report, const Job *job, const CgroupStats *cgroup)
+{
+    const char *status;
+    long long exit_code = -1, signal = -1;
+    if (WIFEXITED(job->status)) {
+        exit_code = WEXITSTATUS(job->status);
+        status = exit_code == 0 ? "ok" : "exit";
+    } else {
+        signal = WTERMSIG(job->status);
+        status = "signal";
+    }
+    // timeout, cpu_limit, memory_limit or pids_limit
+    if (job->limit_hit)
+        status = limit_name(job->limit_hit);
+    // the losing copy of a hedged command, or a delayed start that failed
+    if (job->cancelled)
+        status = "cancelled";
+    else if (job->start_failed)
+        status = "not_started";
+
+    const struct rusage *ru = &job->usage;
+    int i = 0;
+    put_integer(report, i++, job->id);
+    begin_field(report, i++);
+    put_string(report, job->command);
+    begin_field(report, i++);
+    put_string(report, status);
+    put_integer(report, i++, exit_code);
+    put_integer(report, i++, signal);
+    put_ms(report, i++, job->timeout_ns / 1e6);
+    put_ms(report, i++, (job->end_ns - job->start_ns) / 1e6);
+    put_ms(report, i++, timeval_ms(ru->ru_utime));
+    put_ms(report, i++, timeval_ms(ru->ru_stime));
+    put_integer(report, i++, ru->ru_maxrss);    // already in KiB on Linux
+    put_integer(report, i++, ru->ru_minflt);
+    put_integer(report, i++, ru->ru_majflt);
+    put_integer(report, i++, ru->ru_nvcsw);
+    put_integer(report, i++, ru->ru_nivcsw);
+
+    // cgroup counters cover everything the command started, not just its pid
+    put_ms(report, i++, cgroup && cgroup->cpu_usage_us >= 0 ? cgroup->cpu_usage_us / 1e3 : -1);
+    put_ms(report, i++, cgroup && cgroup->cpu_user_us >= 0 ? cgroup->cpu_user_us / 1e3 : -1);
+    put_ms(report, i++, cgroup && cgroup->cpu_system_us >= 0 ? cgroup->cpu_system_us / 1e3 : -1);
+    put_integer(report, i++, cgroup && cgroup->memory_peak_bytes >= 0 ? cgroup->memory_peak_bytes / 1024 : -1);
+
+    // each signal sent, and the reap, in ms after the limit was reached
+    char stages[256];
+    describe_escalation(job, stages, sizeof(stages));
+    begin_field(report, i++);
+    if (stages[0])
+        put_string(report, stages);
+    else if (report->format == REPORT_JSON)
+        fputs("null", report->out);
+
+    // only known when the output was captured
+    put_integer(report, i++, job->capture ? job->capture->streams[0].total : -1);
+    put_integer(report, i++, job->capture ? job->capture->streams[1].total : -1);
+    put_integer(report, i++, job->attempt > 0 ? job->attempt : 1);
+    put_integer(report, i++, job->hedge);
+
+    if (report->format == REPORT_JSON)
+        fputc('}', report->out);
+    fputc('\n', report->out);
+    fflush(report->out);
+}
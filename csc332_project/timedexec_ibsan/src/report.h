@@ -0,0 +1,35 @@
+// report.h
+// One machine-readable line per finished command (JSON or CSV): wall time,
+// rusage from wait4() and, when the child had its own cgroup, cgroup stats.
+
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdio.h>
+
+#include "runner.h"
+#include "cgroup.h"
+
+typedef enum {
+    REPORT_NONE,
+    REPORT_JSON,
+    REPORT_CSV
+} ReportFormat;
+
+typedef struct {
+    ReportFormat format;
+    FILE *out;
+} Report;
+
+/* "json" or "csv"; returns -1 for anything else */
+int report_parse_format(const char *text, ReportFormat *format);
+
+/* Append to path, or write to stderr when path is NULL (stdout belongs to
+ * the command). A CSV header is written unless the file already has lines. */
+int report_open(Report *report, ReportFormat format, const char *path);
+void report_close(Report *report);
+
+/* cgroup may be NULL when the job had no cgroup */
+void report_job(Report *report, const Job *job, const CgroupStats *cgroup);
+
+#endif
@@ -0,0 +1,116 @@
+// retry.c
+// Retry backoff and hedge delays: see retry.h.
+
+#define _GNU_SOURCE
+
+#include "retry.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* Work out the percentile again after this many new samples, not on every
+ * job: a sort per start would be most of what a short job costs */
+#define HEDGE_REFRESH 16
+
+int attempt_succeeded(const Job *job)
+{
+    return !job->start_failed && !job->cancelled && !job->limit_hit &&
+           WIFEXITED(job->status) && WEXITSTATUS(job->status) == 0;
+}
+
+void describe_attempt(const Job *job, char *text, size_t size)
+{
+    if (job->limit_hit)
+        snprintf(text, size, "%s", limit_name(job->limit_hit));
+    else if (WIFEXITED(job->status) && WEXITSTATUS(job->status) == 0)
+        snprintf(text, size, "ok");
+    else if (WIFEXITED(job->status))
+        snprintf(text, size, "exit %d", WEXITSTATUS(job->status));
+    else
+        snprintf(text, size, "signal %d", WTERMSIG(job->status));
+}
+
+int retry_wanted(const RetryPolicy *policy, const Job *job, int attempt)
+{
+    if (attempt > policy->retries || attempt_succeeded(job) || job->cancelled)
+        return 0;
+    // not found or not executable: another go will not change that (but
+    // one that could not be started for lack of processes may well start later)
+    if (!job->start_failed && WIFEXITED(job->status) && !job->limit_hit &&
+        (WEXITSTATUS(job->status) == 126 || WEXITSTATUS(job->status) == 127))
+        return 0;
+    return 1;
+}
+
+/* xorshift64*, seeded once from the pid and the clock */
+static unsigned long long next_random(void)
+{
+    static unsigned long long state;
+    if (state == 0)
+        state = ((unsigned long long)getpid() << 32) ^ (unsigned long long)now_ns() ^ 0x9e3779b97f4a7c15ULL;
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+long long retry_backoff(const RetryPolicy *policy, int retry)
+{
+    long long delay = policy->backoff_ns;
+    for (int i = 1; i < retry && delay < RETRY_BACKOFF_MAX_NS; i++)
+        delay *= 2;
+    if (delay > RETRY_BACKOFF_MAX_NS)
+        delay = RETRY_BACKOFF_MAX_NS;
+    // "equal jitter": at least half the backoff, the rest at random
+    long long half = delay / 2;
+    return half + (half > 0 ? (long long)(next_random() % (unsigned long long)(half + 1)) : 0);
+}
+
+void hedge_record(RetryPolicy *policy, long long elapsed_ns)
+{
+    if (policy->hedge_percentile <= 0)
+        return;
+    if (policy->sample_count == policy->sample_capacity) {
+        int capacity = policy->sample_capacity ? policy->sample_capacity * 2 : 64;
+        long long *grown = realloc(policy->samples, capacity * sizeof(long long));
+        if (!grown)
+            return;
+        policy->samples = grown;
+        policy->sample_capacity = capacity;
+    }
+    policy->samples[policy->sample_count++] = elapsed_ns;
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+long long hedge_delay(RetryPolicy *policy)
+{
+    if (policy->hedge_ns > 0)
+        return policy->hedge_ns;
+    if (policy->hedge_percentile <= 0 || policy->sample_count < HEDGE_MIN_SAMPLES)
+        return -1;
+
+    if (policy->cached_count == 0 || policy->sample_count - policy->cached_count >= HEDGE_REFRESH) {
+        qsort(policy->samples, policy->sample_count, sizeof(long long), compare_ns);
+        int index = (int)((long long)policy->sample_count * policy->hedge_percentile / 100);
+        if (index >= policy->sample_count)
+            index = policy->sample_count - 1;
+        policy->cached_delay = policy->samples[index];
+        policy->cached_count = policy->sample_count;
+    }
+    return policy->cached_delay;
+}
+
+void retry_policy_free(RetryPolicy *policy)
+{
+    free(policy->samples);
+    policy->samples = NULL;
+    policy->sample_count = policy->sample_capacity = 0;
+}
@@ -0,0 +1,58 @@
+// retry.h
+// Policies for flaky commands: retries with exponential backoff and
+// jitter (--retries), and hedging (--hedge): a second copy of a command
+// that is taking unusually long, started after a fixed delay or after a
+// percentile of how long the command has taken so far; whichever copy
+// succeeds first wins and the other is cancelled.
+
+#ifndef RETRY_H
+#define RETRY_H
+
+#include "runner.h"
+
+/* Default delay before the first retry, and the most any retry waits */
+#define RETRY_BACKOFF_NS        (200 * 1000000LL)
+#define RETRY_BACKOFF_MAX_NS    (30 * NSEC_PER_SEC)
+
+/* Successful runs seen before a percentile hedge delay is trusted */
+#define HEDGE_MIN_SAMPLES 20
+
+typedef struct {
+    int retries;                // extra attempts after a failed one
+    long long backoff_ns;       // before the first retry, doubled for each one after
+    long long hedge_ns;         // fixed hedge delay, 0 for none
+    int hedge_percentile;       // or this percentile of past runs, 0 for none
+
+    // how long successful runs took, for hedge_percentile
+    long long *samples;
+    int sample_count;
+    int sample_capacity;
+    long long cached_delay;     // percentile as of cached_count samples
+    int cached_count;
+} RetryPolicy;
+
+/* Ended with exit code 0 and within its limits */
+int attempt_succeeded(const Job *job);
+
+/* "ok", "exit 2", "signal 9", "timeout", "cpu_limit", ... */
+void describe_attempt(const Job *job, char *text, size_t size);
+
+/* Whether a failed attempt (attempt 1 is the first run) gets another go:
+ * retries are left and the command could be run at all (not 126 or 127) */
+int retry_wanted(const RetryPolicy *policy, const Job *job, int attempt);
+
+/* How long to wait before retry number retry (1 for the first): the
+ * backoff for that retry, capped, with the upper half randomized so that
+ * many failing commands do not all come back at the same moment */
+long long retry_backoff(const RetryPolicy *policy, int retry);
+
+/* Remember how long a successful run took */
+void hedge_record(RetryPolicy *policy, long long elapsed_ns);
+
+/* How long after its start a second copy of a command should be started,
+ * or -1 for no hedging (not asked for, or not enough samples yet) */
+long long hedge_delay(RetryPolicy *policy);
+
+void retry_policy_free(RetryPolicy *policy);
+
+#endif
@@ -0,0 +1,774 @@
+// runner.c
+// One epoll loop for any number of children: see runner.h.
+
+#define _GNU_SOURCE
+
+#include "runner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/prctl.h>
+#include <linux/sched.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define MAX_EVENTS 64
+
+/* Never poll a job's CPU time more often than this */
+#define CPU_CHECK_MIN_NS 1000000LL
+
+/* epoll_event.data.ptr for the two fds that are not children */
+static char timer_tag, signal_tag;
+
+/* A captured stream's pipe is registered as its CaptureStream with the low
+ * bit set (the struct is aligned, so the bit is free), a child's pidfd as
+ * its Job */
+#define STREAM_TAG(stream) ((void *)((uintptr_t)(stream) | 1))
+#define TAGGED_STREAM(tag) ((uintptr_t)(tag) & 1 ? (CaptureStream *)((uintptr_t)(tag) & ~(uintptr_t)1) : NULL)
+
+long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int pidfd_open(pid_t pid)
+{
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+static int pidfd_send_signal(int pidfd, int sig)
+{
+    return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+}
+
+static const KillStage default_escalation[] = { { SIGKILL, 0 } };
+
+/* Signal the whole tree. The child itself goes through the pidfd when
+ * there is one, so the signal can never reach an unrelated process that
+ * reused the PID; its process group and its cgroup catch whatever it
+ * started (the group is safe to signal while the child is unreaped, since
+ * its ID cannot be reused until then). */
+static void signal_job(Job *job, int sig)
+{
+    if (job->pidfd >= 0)
+        pidfd_send_signal(job->pidfd, sig);
+    else
+        kill(job->pid, sig);
+    if (job->pgid > 0)
+        kill(-job->pgid, sig);
+    if (job->cgroup)
+        cgroup_signal(job->cgroup, sig);
+}
+
+static void kill_job(Job *job)
+{
+    signal_job(job, SIGKILL);
+}
+
+static int watches_cpu(const Job *job)
+{
+    return job->limits && job->limits->cpu_ns > 0 && job->cgroup &&
+           (job->cgroup->enforced & LIMIT_CPU);
+}
+
+/* ---- timer wheel ---- */
+
+static void wheel_insert(TimerWheel *wheel, Job *job)
+{
+    long long tick = job->wake_ns / WHEEL_TICK_NS;
+    if (tick < wheel->current_tick)
+        tick = wheel->current_tick;
+    int slot = (int)(tick & WHEEL_MASK);
+
+    job->wheel_prev = NULL;
+    job->wheel_next = wheel->slots[slot];
+    if (job->wheel_next)
+        job->wheel_next->wheel_prev = job;
+    wheel->slots[slot] = job;
+    wheel->occupied[slot / 64] |= 1ULL << (slot % 64);
+    job->wheel_slot = slot;
+}
+
+static void wheel_remove(TimerWheel *wheel, Job *job)
+{
+    int slot = job->wheel_slot;
+    if (slot < 0)
+        return;
+    if (job->wheel_prev) {
+        job->wheel_prev->wheel_next = job->wheel_next;
+    } else {
+        wheel->slots[slot] = job->wheel_next;
+        if (!job->wheel_next)
+            wheel->occupied[slot / 64] &= ~(1ULL << (slot % 64));
+    }
+    if (job->wheel_next)
+        job->wheel_next->wheel_prev = job->wheel_prev;
+    job->wheel_next = job->wheel_prev = NULL;
+    job->wheel_slot = -1;
+}
+
+/* Offset (0 .. WHEEL_SLOTS-1) of the first occupied slot at or after
+ * start, wrapping around, or -1 if the wheel is empty */
+static int next_occupied(const TimerWheel *wheel, int start)
+{
+    for (int k = 0; k < WHEEL_SLOTS; ) {
+        int slot = (start + k) & WHEEL_MASK;
+        uint64_t word = wheel->occupied[slot / 64] >> (slot % 64);
+        if (word) {
+            k += __builtin_ctzll(word);
+            return k < WHEEL_SLOTS ? k : -1;
+        }
+        k += 64 - slot % 64;
+    }
+    return -1;
+}
+
+/* Earliest wake time on the wheel, or -1 if it is empty. Only slots in the
+ * current revolution count; if every job is further away than that, wake
+ * up after one revolution and look again. */
+static long long wheel_next_deadline(const TimerWheel *wheel)
+{
+    long long best = -1;
+    int offset = 0;
+    int any = 0;
+
+    while (offset < WHEEL_SLOTS) {
+        int k = next_occupied(wheel, (int)((wheel->current_tick + offset) & WHEEL_MASK));
+        if (k < 0)
+            break;
+        offset += k;
+        if (offset >= WHEEL_SLOTS)
+            break;
+        any = 1;
+        long long tick = wheel->current_tick + offset;
+        for (const Job *job = wheel->slots[tick & WHEEL_MASK]; job; job = job->wheel_next) {
+            if (job->wake_ns / WHEEL_TICK_NS <= tick && (best < 0 || job->wake_ns < best))
+                best = job->wake_ns;
+        }
+        if (best >= 0)
+            return best;
+        offset++;
+    }
+    if (!any)
+        return -1;
+    return (wheel->current_tick + WHEEL_SLOTS) * WHEEL_TICK_NS;
+}
+
+/* Send the job's next stage, and come back after its grace period unless
+ * it was the last one */
+static void escalate(Runner *runner, Job *job)
+{
+    const KillStage *stage = &runner->escalation[job->kill_stage];
+    signal_job(job, stage->signal);
+    long long sent = now_ns();
+    if (job->kill_stage == 0)
+        job->killed_ns = sent;
+    job->stage_signal[job->kill_stage] = stage->signal;
+    job->stage_ns[job->kill_stage++] = sent;
+
+    if (job->kill_stage < runner->escalation_count) {
+        job->wake_ns = sent + stage->grace_ns;
+        wheel_insert(&runner->wheel, job);
+    }
+}
+
+/* A job's CPU time check is due: kill it if it has used up its limit,
+ * otherwise look again when it could have at the earliest, with every
+ * CPU busy */
+static void check_cpu(Runner *runner, Job *job, long long now)
+{
+    long long used = cgroup_cpu_usage_us(job->cgroup) * 1000;
+    long long left = job->limits->cpu_ns - used;
+    if (used >= 0 && left <= 0) {
+        job->limit_hit = LIMIT_CPU;
+        job->limit_ns = now;
+        escalate(runner, job);
+        return;
+    }
+
+    long long wait = used >= 0 ? left / runner->cpus : CPU_CHECK_MIN_NS;
+    if (wait < CPU_CHECK_MIN_NS)
+        wait = CPU_CHECK_MIN_NS;
+    job->wake_ns = now + wait < job->deadline_ns ? now + wait : job->deadline_ns;
+    wheel_insert(&runner->wheel, job);
+}
+
+static void start_waiting(Runner *runner, Job *job, Job **done);
+
+/* Start the jobs whose start time has come, start (or continue) the
+ * escalation for every job whose deadline has passed, and check the CPU
+ * time of those that are due for it */
+static void wheel_expire(Runner *runner, long long now, Job **done)
+{
+    TimerWheel *wheel = &runner->wheel;
+    long long now_tick = now / WHEEL_TICK_NS;
+    long long last = now_tick;
+    if (last - wheel->current_tick >= WHEEL_SLOTS)
+        last = wheel->current_tick + WHEEL_SLOTS - 1;   // every slot once is enough
+
+    for (long long tick = wheel->current_tick; tick <= last; tick++) {
+        Job *job = wheel->slots[tick & WHEEL_MASK];
+        while (job) {
+            Job *next = job->wheel_next;
+            if (job->waiting) {
+                if (job->wake_ns <= now) {
+                    wheel_remove(wheel, job);
+                    start_waiting(runner, job, done);
+                }
+            } else if (job->kill_stage > 0 && job->wake_ns <= now) {
+                // grace period over and still running
+                wheel_remove(wheel, job);
+                escalate(runner, job);
+            } else if (job->kill_stage == 0 && job->deadline_ns <= now) {
+                wheel_remove(wheel, job);
+                job->timed_out = 1;
+                job->limit_hit = LIMIT_WALL;
+                job->limit_ns = job->deadline_ns;
+                escalate(runner, job);
+            } else if (job->wake_ns <= now) {
+                // lands in a later tick, so this loop will not see it again
+                wheel_remove(wheel, job);
+                check_cpu(runner, job, now);
+            }
+            job = next;
+        }
+    }
+    wheel->current_tick = now_tick;
+}
+
+static void arm_timer(Runner *runner)
+{
+    long long next = wheel_next_deadline(&runner->wheel);
+    if (next < 0)
+        next = 0;
+    if (next == runner->armed_ns)
+        return;
+
+    struct itimerspec timer;
+    memset(&timer, 0, sizeof(timer));
+    timer.it_value.tv_sec = next / NSEC_PER_SEC;
+    timer.it_value.tv_nsec = next % NSEC_PER_SEC;
+    if (next > 0 && timer.it_value.tv_sec == 0 && timer.it_value.tv_nsec == 0)
+        timer.it_value.tv_nsec = 1;
+    timerfd_settime(runner->timerfd, TFD_TIMER_ABSTIME, &timer, NULL);
+    runner->armed_ns = next;
+}
+
+/* ---- runner ---- */
+
+static int watch_fd(int epfd, int fd, void *tag)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = tag;
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int runner_init(Runner *runner)
+{
+    memset(runner, 0, sizeof(*runner));
+    runner->epfd = runner->timerfd = runner->sigfd = -1;
+    runner->wheel.current_tick = now_ns() / WHEEL_TICK_NS;
+    runner->use_clone3 = 1;
+    runner->spawn_method = SPAWN_VFORK;
+    path_cache_init(&runner->paths);
+    runner->own_group = 1;
+    runner->escalation = default_escalation;
+    runner->escalation_count = 1;
+    runner->cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (runner->cpus <= 0)
+        runner->cpus = 1;
+
+    // pidfds exist since Linux 5.3; without them SIGCHLD says a child exited
+    int probe = pidfd_open(getpid());
+    runner->use_pidfd = probe >= 0;
+    if (probe >= 0)
+        close(probe);
+
+    // Ctrl-C and SIGTERM arrive on a signalfd instead of a handler
+    sigset_t blocked;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    if (!runner->use_pidfd)
+        sigaddset(&blocked, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &blocked, &runner->original_mask) == -1) {
+        perror("sigprocmask");
+        return -1;
+    }
+
+    runner->sigfd = signalfd(-1, &blocked, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (runner->sigfd == -1) {
+        perror("signalfd");
+        return -1;
+    }
+    runner->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (runner->timerfd == -1) {
+        perror("timerfd_create");
+        return -1;
+    }
+    runner->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (runner->epfd == -1) {
+        perror("epoll_create1");
+        return -1;
+    }
+    if (watch_fd(runner->epfd, runner->timerfd, &timer_tag) == -1 ||
+        watch_fd(runner->epfd, runner->sigfd, &signal_tag) == -1) {
+        perror("epoll_ctl");
+        return -1;
+    }
+
+    // the default 50 us timer slack would be most of the error budget
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+    return 0;
+}
+
+void runner_close(Runner *runner)
+{
+    if (runner->epfd >= 0)
+        close(runner->epfd);
+    if (runner->timerfd >= 0)
+        close(runner->timerfd);
+    if (runner->sigfd >= 0)
+        close(runner->sigfd);
+    free(runner->active);
+    path_cache_free(&runner->paths);
+    sigprocmask(SIG_SETMASK, &runner->original_mask, NULL);
+}
+
+static int add_active(Runner *runner, Job *job)
+{
+    if (runner->running == runner->active_capacity) {
+        int capacity = runner->active_capacity ? runner->active_capacity * 2 : 64;
+        Job **grown = realloc(runner->active, capacity * sizeof(Job *));
+        if (!grown)
+            return -1;
+        runner->active = grown;
+        runner->active_capacity = capacity;
+    }
+    job->active_index = runner->running;
+    runner->active[runner->running++] = job;
+    return 0;
+}
+
+static void remove_active(Runner *runner, Job *job)
+{
+    Job *last = runner->active[--runner->running];
+    runner->active[job->active_index] = last;
+    last->active_index = job->active_index;
+}
+
+/* fork() straight into the job's cgroup2 group, with the pidfd from the
+ * same call. Returns like fork(); -1 with errno ENOSYS etc. when clone3 or
+ * CLONE_INTO_CGROUP is not available. */
+static pid_t clone_into_cgroup(Runner *runner, Job *job)
+{
+#ifdef CLONE_INTO_CGROUP
+    struct clone_args args;
+    int pidfd = -1;
+    memset(&args, 0, sizeof(args));
+    args.flags = CLONE_INTO_CGROUP;
+    if (runner->use_pidfd) {
+        args.flags |= CLONE_PIDFD;
+        args.pidfd = (uint64_t)(uintptr_t)&pidfd;
+    }
+    args.exit_signal = SIGCHLD;
+    args.cgroup = (uint64_t)job->cgroup->v2_fd;
+
+    // like fork(), but without glibc's bookkeeping: the child may only make
+    // plain system calls (and execvp) before it execs
+    pid_t pid = (pid_t)syscall(SYS_clone3, &args, sizeof(args));
+    if (pid > 0)
+        job->pidfd = pidfd;
+    return pid;
+#else
+    (void)runner;
+    (void)job;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* What the child needs between clone and exec */
+typedef struct {
+    const Runner *runner;
+    const Job *job;
+    const char *path;           // from the PATH cache, NULL to let execvp search
+} ChildSetup;
+
+/* The child side of both spawn methods. After spawn_vfork() it runs in
+ * our memory with us suspended, so everything here is a plain system call
+ * on its own stack, and it must exec or _exit, never return. */
+static int run_child(void *arg)
+{
+    const ChildSetup *setup = arg;
+    const Runner *runner = setup->runner;
+    const Job *job = setup->job;
+
+    // restore the signal mask, then replace with requested command
+    sigprocmask(SIG_SETMASK, &runner->original_mask, NULL);
+    // a group of its own, so that a kill reaches what it starts
+    if (runner->own_group)
+        setpgid(0, 0);
+    if (job->cgroup)
+        cgroup_enter(job->cgroup);
+    limits_apply_fallback(job->limits, job->cgroup ? job->cgroup->enforced : 0);
+    if (runner->null_stdin) {
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDIN_FILENO);
+            close(null_fd);
+        }
+    }
+    if (job->capture)
+        capture_child(job->capture);
+    if (setup->path)
+        execve(setup->path, job->argv, environ);
+    // gone since the lookup, or a script without #!: execvp() sorts it out
+    execvp(job->argv[0], job->argv);
+    // Only reached on error
+    perror("execvp");
+    _exit(127);
+}
+
+int runner_spawn(Runner *runner, Job *job)
+{
+    job->pidfd = -1;
+    job->pgid = 0;
+    job->timed_out = 0;
+    job->limit_hit = 0;
+    job->waiting = job->cancelled = job->start_failed = 0;
+    job->kill_stage = 0;
+    job->killed_ns = job->end_ns = 0;
+    job->wheel_slot = -1;
+    job->done_next = NULL;
+
+    if (add_active(runner, job) != 0) {
+        fprintf(stderr, "timedexec: out of memory\n");
+        return -1;
+    }
+
+    job->start_ns = now_ns();
+    job->deadline_ns = job->start_ns + job->timeout_ns;
+    job->wake_ns = job->deadline_ns;
+    if (watches_cpu(job)) {
+        // the soonest the limit can run out is with every CPU busy
+        long long first_check = job->start_ns + job->limits->cpu_ns / runner->cpus;
+        if (first_check < job->wake_ns)
+            job->wake_ns = first_check;
+    }
+
+    ChildSetup setup = { runner, job, path_cache_lookup(&runner->paths, job->argv[0]) };
+    job->pid = -1;
+    if (runner->spawn_method == SPAWN_VFORK) {
+        // returns once the child has exec'd (or failed to), having made its
+        // own group and joined its cgroups on the way
+        job->pid = spawn_vfork(run_child, &setup, runner->use_pidfd ? &job->pidfd : NULL);
+        if (job->pid < 0 && errno != EAGAIN && errno != ENOMEM)
+            runner->spawn_method = SPAWN_FORK;  // e.g. CLONE_PIDFD unknown
+    }
+    if (job->pid < 0 && runner->use_clone3 && job->cgroup && job->cgroup->v2_fd >= 0) {
+        job->pid = clone_into_cgroup(runner, job);
+        if (job->pid < 0 && errno != EAGAIN && errno != ENOMEM)
+            runner->use_clone3 = 0;     // older kernel: fork and join instead
+    }
+    if (job->pid < 0)
+        job->pid = fork();
+    if (job->pid < 0) {
+        perror("fork");
+        remove_active(runner, job);
+        return -1;
+    }
+
+    if (job->pid == 0)
+        run_child(&setup);
+
+    // after fork() both sides set the group, so it exists before either
+    // relies on it; a vfork child has made it before we got here
+    if (runner->own_group) {
+        if (runner->spawn_method == SPAWN_FORK)
+            setpgid(job->pid, job->pid);
+        job->pgid = job->pid;
+    }
+
+    // a pidfd becomes readable when the child exits
+    if (runner->use_pidfd) {
+        if (job->pidfd < 0)
+            job->pidfd = pidfd_open(job->pid);
+        if (job->pidfd >= 0 && watch_fd(runner->epfd, job->pidfd, job) == -1) {
+            // e.g. out of file descriptors: fall back to polling this child
+            close(job->pidfd);
+            job->pidfd = -1;
+        }
+        if (job->pidfd < 0) {
+            perror("timedexec: pidfd");
+            kill(job->pid, SIGKILL);
+            waitpid(job->pid, NULL, 0);
+            remove_active(runner, job);
+            return -1;
+        }
+    }
+
+    if (job->capture) {
+        capture_started(job->capture, job->start_ns);
+        for (int i = 0; i < 2; i++) {
+            if (watch_fd(runner->epfd, job->capture->streams[i].fd, STREAM_TAG(&job->capture->streams[i])) == -1) {
+                // nobody would empty the pipe, and a chatty child would hang
+                perror("timedexec: epoll_ctl");
+                for (int k = 0; k < i; k++)
+                    epoll_ctl(runner->epfd, EPOLL_CTL_DEL, job->capture->streams[k].fd, NULL);
+                if (job->pidfd >= 0) {
+                    epoll_ctl(runner->epfd, EPOLL_CTL_DEL, job->pidfd, NULL);
+                    close(job->pidfd);
+                    job->pidfd = -1;
+                }
+                kill_job(job);
+                waitpid(job->pid, NULL, 0);
+                remove_active(runner, job);
+                return -1;
+            }
+        }
+    }
+
+    wheel_insert(&runner->wheel, job);
+    return 0;
+}
+
+int runner_spawn_at(Runner *runner, Job *job, long long start_ns)
+{
+    if (start_ns <= now_ns())
+        return runner_spawn(runner, job);
+
+    job->pid = -1;
+    job->pidfd = -1;
+    job->waiting = 1;
+    job->cancelled = job->start_failed = 0;
+    job->wake_ns = start_ns;
+    wheel_insert(&runner->wheel, job);
+    runner->waiting++;
+    return 0;
+}
+
+/* A waiting job's start time has come */
+static void start_waiting(Runner *runner, Job *job, Job **done)
+{
+    runner->waiting--;
+    if (runner_spawn(runner, job) == 0)
+        return;
+    // report it like a command that could not be run
+    job->start_failed = 1;
+    job->status = 127 << 8;
+    memset(&job->usage, 0, sizeof(job->usage));
+    job->start_ns = job->end_ns = now_ns();
+    job->done_next = *done;
+    *done = job;
+}
+
+int runner_cancel(Runner *runner, Job *job)
+{
+    if (job->waiting) {
+        wheel_remove(&runner->wheel, job);
+        job->waiting = 0;
+        job->cancelled = 1;
+        runner->waiting--;
+        return 0;
+    }
+    // already reaped (e.g. earlier in the same done list): its pid, group
+    // and cgroup may belong to someone else by now
+    if (job->active_index < 0 || job->active_index >= runner->running ||
+        runner->active[job->active_index] != job)
+        return -1;
+    job->cancelled = 1;
+    // no escalation: nobody wants its result, and it has no limit to report
+    wheel_remove(&runner->wheel, job);
+    kill_job(job);
+    return 1;
+}
+
+static void finish_job(Runner *runner, Job *job, int status, const struct rusage *usage, Job **done)
+{
+    job->status = status;
+    job->usage = *usage;
+    if (job->cgroup)
+        cgroup_signal(job->cgroup, SIGKILL);     // what it left behind, see runner_wait
+    job->end_ns = now_ns();
+    if (job->capture) {
+        // whatever the child wrote last may still be in the pipes
+        for (int i = 0; i < 2; i++)
+            epoll_ctl(runner->epfd, EPOLL_CTL_DEL, job->capture->streams[i].fd, NULL);
+        capture_drain(job->capture, job->end_ns);
+    }
+    wheel_remove(&runner->wheel, job);
+    if (job->pidfd >= 0) {
+        epoll_ctl(runner->epfd, EPOLL_CTL_DEL, job->pidfd, NULL);
+        close(job->pidfd);
+        job->pidfd = -1;
+    }
+    remove_active(runner, job);
+    job->done_next = *done;
+    *done = job;
+}
+
+/* Without pidfds: reap whatever has exited and match it to a job */
+static void reap_children(Runner *runner, Job **done)
+{
+    int status;
+    struct rusage usage;
+    siginfo_t info;
+    for (;;) {
+        // peek first, so that the group can be killed while it is still ours
+        info.si_pid = 0;
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) == -1 || info.si_pid == 0)
+            break;
+        Job *job = NULL;
+        for (int i = 0; i < runner->running; i++) {
+            if (runner->active[i]->pid == info.si_pid) {
+                job = runner->active[i];
+                break;
+            }
+        }
+        if (job && job->pgid > 0)
+            kill(-job->pgid, SIGKILL);
+        if (wait4(info.si_pid, &status, 0, &usage) != info.si_pid)
+            break;
+        if (job)
+            finish_job(runner, job, status, &usage, done);
+    }
+}
+
+Job *runner_wait(Runner *runner, int block)
+{
+    while ((runner->running > 0 || runner->waiting > 0) && !runner->interrupted) {
+        arm_timer(runner);
+
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(runner->epfd, events, MAX_EVENTS, block ? -1 : 0);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            runner->interrupted = 1;
+            break;
+        }
+
+        Job *done = NULL;
+        for (int i = 0; i < n; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &timer_tag) {
+                uint64_t expirations;
+                if (read(runner->timerfd, &expirations, sizeof(expirations)) == sizeof(expirations))
+                    runner->armed_ns = 0;
+                wheel_expire(runner, now_ns(), &done);
+            } else if (tag == &signal_tag) {
+                struct signalfd_siginfo info;
+                while (read(runner->sigfd, &info, sizeof(info)) == sizeof(info)) {
+                    if (info.ssi_signo == SIGCHLD)
+                        reap_children(runner, &done);
+                    else
+                        runner->interrupted = 1;
+                }
+            } else if (TAGGED_STREAM(tag)) {
+                CaptureStream *stream = TAGGED_STREAM(tag);
+                // at EOF the pipe stays readable; it is closed at the reap
+                if (!capture_read(stream, now_ns()))
+                    epoll_ctl(runner->epfd, EPOLL_CTL_DEL, stream->fd, NULL);
+            } else {
+                Job *job = tag;
+                int status;
+                struct rusage usage;
+                // nothing the child started outlives it: not the
+                // stragglers of a killed tree, nor what a child that exited
+                // on its own left running. The group ID is still ours
+                // until the reap.
+                if (job->pgid > 0)
+                    kill(-job->pgid, SIGKILL);
+                if (wait4(job->pid, &status, WNOHANG, &usage) == job->pid)
+                    finish_job(runner, job, status, &usage, &done);
+            }
+        }
+        if (done || !block)
+            return done;
+    }
+    return NULL;
+}
+
+void runner_classify(Job *job, const CgroupStats *cgroup)
+{
+    if (job->limit_hit)
+        return;                 // timeout or CPU limit: the runner killed it
+
+    int failed = !WIFEXITED(job->status) || WEXITSTATUS(job->status) != 0;
+    if (!failed)
+        return;                 // whatever happened inside, it coped
+    if (WIFSIGNALED(job->status) && WTERMSIG(job->status) == SIGXCPU)
+        job->limit_hit = LIMIT_CPU;     // RLIMIT_CPU soft limit
+    else if (cgroup && cgroup->oom_kills > 0)
+        job->limit_hit = LIMIT_MEMORY;
+    else if (cgroup && cgroup->pids_denied > 0)
+        job->limit_hit = LIMIT_PIDS;
+    else if (job->limits && job->limits->cpu_ns > 0 && WIFSIGNALED(job->status) &&
+             WTERMSIG(job->status) == SIGKILL) {
+        // RLIMIT_CPU hard limit: SIGKILL once the CPU time is used up
+        long long cpu_ns = (job->usage.ru_utime.tv_sec + job->usage.ru_stime.tv_sec) * NSEC_PER_SEC +
+                           (job->usage.ru_utime.tv_usec + job->usage.ru_stime.tv_usec) * 1000LL;
+        if (cpu_ns >= job->limits->cpu_ns)
+            job->limit_hit = LIMIT_CPU;
+    }
+    // reported as ended by the limit: the rest of the tree must be gone too
+    if ((job->limit_hit & (LIMIT_MEMORY | LIMIT_PIDS)) && job->cgroup)
+        cgroup_kill(job->cgroup);
+}
+
+void describe_escalation(const Job *job, char *buf, size_t size)
+{
+    size_t used = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < job->kill_stage && used < size; i++) {
+        used += snprintf(buf + used, size - used, "%sSIG%s@%.3f", i ? "," : "",
+                         sigabbrev_np(job->stage_signal[i]), (job->stage_ns[i] - job->limit_ns) / 1e6);
+    }
+    if (job->kill_stage > 0 && used < size)
+        snprintf(buf + used, size - used, ",reaped@%.3f", (job->end_ns - job->limit_ns) / 1e6);
+}
+
+Job *runner_kill_all(Runner *runner)
+{
+    Job *done = NULL;
+    // the ones that never started are only on the wheel
+    for (int slot = 0; slot < WHEEL_SLOTS && runner->waiting > 0; slot++) {
+        for (Job *job = runner->wheel.slots[slot], *next; job; job = next) {
+            next = job->wheel_next;
+            if (job->waiting) {
+                runner_cancel(runner, job);
+                job->done_next = done;
+                done = job;
+            }
+        }
+    }
+    for (int i = 0; i < runner->running; i++) {
+        kill_job(runner->active[i]);
+        runner->active[i]->kill_stage = 0;  // not an escalation to report
+    }
+    while (runner->running > 0) {
+        Job *job = runner->active[runner->running - 1];
+        int status = 0;
+        struct rusage usage;
+        memset(&usage, 0, sizeof(usage));
+        wait4(job->pid, &status, 0, &usage);
+        finish_job(runner, job, status, &usage, &done);
+    }
+    return done;
+}
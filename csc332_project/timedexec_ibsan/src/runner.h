@@ -0,0 +1,152 @@
+// runner.h
+// Supervise child processes from one epoll loop: a pidfd per child, one
+// timerfd driven by a timer wheel for every deadline (and CPU time check),
+// and a signalfd for SIGINT/SIGTERM (and SIGCHLD on kernels without pidfds).
+
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <stdint.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include "cgroup.h"
+#include "spawn.h"
+#include "capture.h"
+
+#define NSEC_PER_SEC 1000000000LL
+
+/* Timer wheel: 4096 slots of 1 ms, so one revolution is about 4 s. A job
+ * whose deadline is further away sits in its slot until the revolution it
+ * belongs to; the timerfd is always armed for the exact earliest deadline. */
+#define WHEEL_SLOTS 4096
+#define WHEEL_TICK_NS 1000000LL
+
+/* Escalation: when a limit is hit, each stage's signal goes to the whole
+ * process tree, then the runner waits up to grace_ns for it to exit before
+ * the next stage. The last stage is always SIGKILL. */
+#define MAX_KILL_STAGES 8
+
+typedef struct {
+    int signal;
+    long long grace_ns;
+} KillStage;
+
+typedef struct Job {
+    // filled in by the caller
+    int id;
+    char **argv;
+    const char *command;        // for reports
+    long long timeout_ns;
+    const JobCgroup *cgroup;    // child joins it before exec; NULL for none
+    const Limits *limits;       // beyond timeout_ns; NULL for none
+    Capture *capture;           // pipes for stdout/stderr; NULL to inherit ours
+    int attempt;                // 1, or 2... for retries (for reports); 0 counts as 1
+    int hedge;                  // the second copy started by --hedge (for reports)
+
+    // filled in by the runner
+    pid_t pid;
+    pid_t pgid;                 // its own process group, 0 if it has none
+    int pidfd;                  // -1 when SIGCHLD is used instead
+    long long start_ns;         // CLOCK_MONOTONIC, just before the fork
+    long long deadline_ns;
+    long long wake_ns;          // wheel key: deadline or next CPU time check
+    long long limit_ns;         // when the limit was reached (deadline, CPU check)
+    long long killed_ns;        // when the first stage's signal was sent
+    int kill_stage;             // stages sent so far
+    int stage_signal[MAX_KILL_STAGES];
+    long long stage_ns[MAX_KILL_STAGES];
+    long long end_ns;           // when the child was reaped
+    int status;                 // as returned by wait4
+    struct rusage usage;        // the child's (and its reaped children's)
+    int timed_out;
+    unsigned limit_hit;         // LIMIT_* that ended the job, 0 if none
+    int waiting;                // on the wheel until its start time
+    int cancelled;              // stopped by runner_cancel(), not by a limit
+    int start_failed;           // a delayed start could not create the process
+
+    struct Job *wheel_next;
+    struct Job *wheel_prev;
+    struct Job *done_next;
+    int wheel_slot;             // -1 when not on the wheel
+    int active_index;
+} Job;
+
+typedef struct {
+    Job *slots[WHEEL_SLOTS];
+    uint64_t occupied[WHEEL_SLOTS / 64];
+    long long current_tick;     // every slot before this tick has been expired
+} TimerWheel;
+
+typedef struct {
+    int epfd;
+    int timerfd;
+    int sigfd;
+    int use_pidfd;
+    int use_clone3;             // clone3(CLONE_INTO_CGROUP) works
+    SpawnMethod spawn_method;   // SPAWN_VFORK unless asked for fork()
+    PathCache paths;            // argv[0] -> executable, searched once
+    int cpus;                   // for how soon a CPU time limit can run out
+    int own_group;              // start each child in a process group of its own
+    const KillStage *escalation;
+    int escalation_count;
+    int null_stdin;             // give children /dev/null as stdin
+    int running;
+    int waiting;                // jobs waiting for their start time
+    int interrupted;            // SIGINT or SIGTERM arrived
+    long long armed_ns;         // what the timerfd is set to, 0 = disarmed
+    sigset_t original_mask;     // restored in the children
+    Job **active;               // running jobs (for SIGCHLD matching and kill_all)
+    int active_capacity;
+    TimerWheel wheel;
+} Runner;
+
+long long now_ns(void);
+
+int runner_init(Runner *runner);
+void runner_close(Runner *runner);
+
+/* Start job->argv (vfork-style by default, see spawn.h) with its deadline
+ * on the wheel; returns -1 if no process could be created (an exec failure
+ * shows up as exit code 127 instead) */
+int runner_spawn(Runner *runner, Job *job);
+
+/* Like runner_spawn(), but not before start_ns (CLOCK_MONOTONIC): until
+ * then the job waits on the timer wheel, which is how retries back off and
+ * hedged copies are held back. If the process cannot be created when the
+ * time comes, the job comes back from runner_wait() with start_failed set
+ * and an exit status of 127. */
+int runner_spawn_at(Runner *runner, Job *job, long long start_ns);
+
+/* Stop a job that is no longer wanted (e.g. the other copy of a hedged
+ * command won). Returns 0 if it had not started yet and is now the
+ * caller's again, 1 if it was running: its tree gets SIGKILL and it comes
+ * back from runner_wait() with cancelled set, -1 if it has already been
+ * reaped, in which case it is left as it ended. */
+int runner_cancel(Runner *runner, Job *job);
+
+/* Wait until at least one job has been reaped and return them as a list
+ * linked through done_next, or NULL when interrupted (runner->interrupted)
+ * or when nothing is running or waiting. Children past their deadline get
+ * SIGKILL. With block == 0, handle whatever is pending and return right
+ * away. */
+Job *runner_wait(Runner *runner, int block);
+
+/* After the reap: work out which limit, if any, ended the job (for those
+ * the runner cannot see itself, from the cgroup's OOM and pids events).
+ * Sets job->limit_hit; cgroup may be NULL. A job ended by --mem or --pids
+ * has its whole cgroup killed before this returns. */
+void runner_classify(Job *job, const CgroupStats *cgroup);
+
+/* "SIGTERM@0.120,SIGKILL@2000.312,reaped@2000.540": when each stage went out
+ * and when the job was reaped, in ms after the limit was reached. Empty
+ * if no stage was needed. */
+void describe_escalation(const Job *job, char *buf, size_t size);
+
+/* SIGKILL every running job and reap them all; returns them like
+ * runner_wait() does, together with the jobs still waiting to start
+ * (marked cancelled) */
+Job *runner_kill_all(Runner *runner);
+
+#endif
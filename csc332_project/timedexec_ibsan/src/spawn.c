@@ -0,0 +1,158 @@
+// spawn.c
+// PATH cache and vfork-style spawning: see spawn.h.
+
+#define _GNU_SOURCE
+
+#include "spawn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* The vfork child runs on this while the parent waits; execvp() needs a
+ * few KB for its path buffer and, for scripts without #!, a copy of argv */
+#define CHILD_STACK_SIZE (256 * 1024)
+
+/* What execvp() searches when $PATH is not set */
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+int spawn_parse_method(const char *text, SpawnMethod *method)
+{
+    if (strcmp(text, "vfork") == 0)
+        *method = SPAWN_VFORK;
+    else if (strcmp(text, "fork") == 0)
+        *method = SPAWN_FORK;
+    else
+        return -1;
+    return 0;
+}
+
+void path_cache_init(PathCache *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+    const char *search = getenv("PATH");
+    cache->search = strdup(search ? search : DEFAULT_PATH);
+}
+
+void path_cache_free(PathCache *cache)
+{
+    for (int i = 0; i < cache->capacity; i++) {
+        free(cache->entries[i].name);
+        free(cache->entries[i].path);
+    }
+    free(cache->entries);
+    free(cache->search);
+    memset(cache, 0, sizeof(*cache));
+}
+
+/* FNV-1a */
+static uint32_t hash_name(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+        hash = (hash ^ *p) * 16777619u;
+    return hash;
+}
+
+static PathEntry *find_slot(PathEntry *entries, int capacity, const char *name)
+{
+    int mask = capacity - 1;
+    for (int i = (int)(hash_name(name) & (uint32_t)mask);; i = (i + 1) & mask) {
+        if (!entries[i].name || strcmp(entries[i].name, name) == 0)
+            return &entries[i];
+    }
+}
+
+static int grow(PathCache *cache)
+{
+    int capacity = cache->capacity ? cache->capacity * 2 : 64;
+    PathEntry *entries = calloc(capacity, sizeof(PathEntry));
+    if (!entries)
+        return -1;
+    for (int i = 0; i < cache->capacity; i++) {
+        if (cache->entries[i].name)
+            *find_slot(entries, capacity, cache->entries[i].name) = cache->entries[i];
+    }
+    free(cache->entries);
+    cache->entries = entries;
+    cache->capacity = capacity;
+    return 0;
+}
+
+/* The same search execvp() makes: each $PATH entry in order (an empty one
+ * is the current directory), the first regular file we may execute */
+static char *search_path(const char *search, const char *name)
+{
+    size_t name_length = strlen(name);
+    for (const char *dir = search;; dir++) {
+        const char *end = strchrnul(dir, ':');
+        size_t dir_length = (size_t)(end - dir);
+        char *candidate = malloc(dir_length + name_length + 3);
+        if (!candidate)
+            return NULL;
+        if (dir_length == 0)
+            strcpy(candidate, "./");
+        else
+            sprintf(candidate, "%.*s/", (int)dir_length, dir);
+        strcat(candidate, name);
+
+        struct stat st;
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0)
+            return candidate;
+        free(candidate);
+        if (*end == '\0')
+            return NULL;
+        dir = end;
+    }
+}
+
+const char *path_cache_lookup(PathCache *cache, const char *name)
+{
+    if (strchr(name, '/'))
+        return name;
+    if (!cache->search || name[0] == '\0')
+        return NULL;
+
+    if (cache->capacity) {
+        PathEntry *entry = find_slot(cache->entries, cache->capacity, name);
+        if (entry->name)
+            return entry->path;
+    }
+    // keep the table at most 3/4 full; without memory, execvp() searches
+    if ((cache->count + 1) * 4 > cache->capacity * 3 && grow(cache) != 0)
+        return NULL;
+
+    PathEntry *entry = find_slot(cache->entries, cache->capacity, name);
+    entry->name = strdup(name);
+    if (!entry->name)
+        return NULL;
+    entry->path = search_path(cache->search, name);
+    cache->count++;
+    return entry->path;
+}
+
+pid_t spawn_vfork(int (*fn)(void *), void *arg, int *pidfd)
+{
+    // the parent is suspended while the child runs, so one stack does
+    static char *stack;
+    if (!stack) {
+        void *mapped = mmap(NULL, CHILD_STACK_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (mapped == MAP_FAILED)
+            return -1;
+        stack = mapped;
+    }
+
+    int flags = CLONE_VM | CLONE_VFORK | SIGCHLD;
+    if (pidfd)
+        flags |= CLONE_PIDFD;
+    // clone() takes the top of the child's stack
+    return clone(fn, stack + CHILD_STACK_SIZE, flags, arg, pidfd);
+}
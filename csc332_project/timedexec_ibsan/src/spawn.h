@@ -0,0 +1,47 @@
+// spawn.h
+// Starting children cheaply. fork() copies the parent's page tables, which
+// for a big parent (or thousands of short commands) is most of what a spawn
+// costs; a vfork-style clone() shares the parent's memory until the child
+// execs instead. The PATH cache looks each command name up once, so the
+// children do not all walk $PATH with failing execve() calls like execvp().
+
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <sys/types.h>
+
+typedef enum {
+    SPAWN_VFORK,                // clone(CLONE_VM | CLONE_VFORK), the default
+    SPAWN_FORK                  // fork(), or clone3() into the job's cgroup
+} SpawnMethod;
+
+typedef struct {
+    char *name;                 // as given in argv[0]
+    char *path;                 // where $PATH found it, NULL if nowhere
+} PathEntry;
+
+typedef struct {
+    char *search;               // $PATH when the cache was set up
+    PathEntry *entries;         // open addressing, capacity is a power of 2
+    int capacity;
+    int count;
+} PathCache;
+
+/* "vfork" or "fork"; -1 for anything else */
+int spawn_parse_method(const char *text, SpawnMethod *method);
+
+void path_cache_init(PathCache *cache);
+void path_cache_free(PathCache *cache);
+
+/* The executable execvp() would run for name: name itself if it has a '/',
+ * NULL if no directory in $PATH has it (execvp() then reports the error in
+ * the child as before). The string lives as long as the cache. */
+const char *path_cache_lookup(PathCache *cache, const char *name);
+
+/* Run fn(arg) in a child that shares our memory until it execs or exits;
+ * we are suspended until then, so fn may only make system calls, use its
+ * own stack and exec. Returns the child's pid (with its pidfd in *pidfd
+ * unless pidfd is NULL), or -1 with errno set. */
+pid_t spawn_vfork(int (*fn)(void *), void *arg, int *pidfd);
+
+#endif
@@ -1,5 +1,8 @@
 #!/bin/bash
 
+# checks that must hold; any miss makes the script exit 1
+failures=0
+
 echo " TEST 1: TIME LIMIT EXCEEDED"
 echo " Command: ./timedexec -t 2 -- sleep 10"
 echo " Expected: Child process should be killed after 2 seconds"
@@ -44,4 +47,174 @@ echo " Expected: Press Ctrl-C → parent kills child and prints message"
  
 ./timedexec -t 20 -- sleep 30
 echo
-echo
\ No newline at end of file
+echo
+
+echo " TEST 6: SUB-SECOND TIME LIMIT"
+echo " Command: ./timedexec -t 150ms -- sleep 10"
+echo " Expected: Child killed after 150 ms, kill latency after the deadline reported"
+
+./timedexec -t 150ms -- sleep 10
+echo
+echo
+
+
+echo " TEST 7: FRACTIONAL AND MICROSECOND LIMITS, BAD UNIT"
+echo " Command: ./timedexec -t 0.25 -- sleep 10; ./timedexec -t 500000us -- sleep 0.1; ./timedexec -t 5m -- ls"
+echo "          ./timedexec -t 20000000000 -- ls"
+echo " Expected: First is killed after 250 ms, second exits normally, third and fourth"
+echo "           (about 634 years, out of range) are rejected"
+
+./timedexec -t 0.25 -- sleep 10
+./timedexec -t 500000us -- sleep 0.1
+./timedexec -t 5m -- ls
+./timedexec -t 20000000000 -- ls
+echo "exit code: $?"
+echo
+echo
+
+
+echo " TEST 8: BATCH MODE (COMMAND FILE AND STDIN)"
+echo " Command: ./timedexec -t 300ms -f jobs.txt -j 2; printf 'echo one\\nfalse\\n' | ./timedexec -t 1 -f -"
+echo " Expected: One row per job as it finishes (sleep 5 times out), summary lines, exit code 124 then 1"
+
+printf '# comment lines and blank lines are skipped\n\necho "hello batch"\nsleep 5\ntrue\n' > /tmp/timedexec_jobs.txt
+./timedexec -t 300ms -f /tmp/timedexec_jobs.txt -j 2
+echo "exit code: $?"
+printf 'echo one\nfalse\n' | ./timedexec -t 1 -f -
+echo "exit code: $?"
+rm -f /tmp/timedexec_jobs.txt
+echo
+echo
+
+
+echo " TEST 9: RESOURCE USAGE RECORDS (JSON, CSV FILE)"
+echo " Command: ./timedexec -t 1 -r json -- sh -c 'head -c 5000000 /dev/zero | wc -c'; ./timedexec -t 200ms -r csv -o usage.csv -- sleep 5"
+echo " Expected: A JSON line on stderr with wall/user/sys time, max RSS, faults and"
+echo "           context switches (plus cgroup cpu/memory when cgroups are writable),"
+echo "           then a CSV file with a header and one timeout row"
+
+./timedexec -t 1 -r json -- sh -c 'head -c 5000000 /dev/zero | wc -c'
+rm -f /tmp/timedexec_usage.csv
+./timedexec -t 200ms -r csv -o /tmp/timedexec_usage.csv -- sleep 5
+cat /tmp/timedexec_usage.csv
+rm -f /tmp/timedexec_usage.csv
+echo
+echo
+
+
+echo " TEST 10: RESOURCE LIMITS (CPU TIME, MEMORY, PROCESSES)"
+echo " Command: ./timedexec -t 10 --cpu 300ms -- sh -c 'while :; do :; done'"
+echo "          ./timedexec -t 10 --mem 50M -- python3 -c 'x = bytearray(200 << 20)'"
+echo "          ./timedexec -t 10 --pids 4 -- sh -c 'for i in 1 2 3 4 5 6; do sleep 30 & done; wait'"
+echo " Expected: exit codes 123 (CPU), 122 (memory), 121 (processes) with cgroups (as root);"
+echo "           without them, a note about the setrlimit fallback is printed first."
+echo "           As root, none of the sleeps is left in the job's cgroup or anywhere else"
+
+./timedexec -t 10 --cpu 300ms -- sh -c 'while :; do :; done'
+echo "exit code: $?"
+./timedexec -t 10 --mem 50M -- python3 -c 'x = bytearray(200 << 20)'
+echo "exit code: $?"
+./timedexec -t 10 --pids 4 -- sh -c 'for i in 1 2 3 4 5 6; do sleep 30 & done; wait' &
+limited=$!
+wait $limited
+echo "exit code: $?"
+if [ "$(id -u)" -eq 0 ]; then
+    in_cgroup=$(find /sys/fs/cgroup -name "timedexec-$limited" -type d -exec cat {}/cgroup.procs \; 2>/dev/null | wc -l)
+    left=$(ps -C sleep -o stat= | grep -vc Z)
+    echo "processes left in the job's cgroup: $in_cgroup, sleep processes left: $left"
+    if [ "$in_cgroup" -ne 0 ] || [ "$left" -ne 0 ]; then
+        echo "FAIL: expected the whole tree to be gone"
+        failures=$((failures + 1))
+    fi
+fi
+echo
+echo
+
+
+echo " TEST 11: WHOLE-TREE KILL AND ESCALATION"
+echo " Command: ./timedexec -t 300ms -- sh -c 'sleep 30 & sleep 30 & wait'"
+echo "          ./timedexec -t 300ms --escalate TERM,500ms,KILL -- sh -c 'trap \"\" TERM; sleep 30'"
+echo " Expected: no sleep survives the first; the second ignores SIGTERM and gets"
+echo "           SIGKILL 500 ms later, with the time of each stage printed"
+
+./timedexec -t 300ms -- sh -c 'sleep 30 & sleep 30 & wait'
+sleep 0.2
+left=$(ps -C sleep -o stat= | grep -vc Z)
+echo "sleep processes left (not counting zombies): $left"
+if [ "$left" -ne 0 ]; then
+    echo "FAIL: expected no sleep processes left"
+    failures=$((failures + 1))
+fi
+./timedexec -t 300ms --escalate TERM,500ms,KILL -- sh -c 'trap "" TERM; sleep 30'
+echo "exit code: $?"
+echo
+echo
+
+
+echo " TEST 12: SPAWN METHODS (VFORK AND FORK)"
+echo " Command: ./timedexec -t 5 [--spawn fork] -- echo ..."
+echo "          yes true | head -500 | ./timedexec -t 5 [--spawn fork] -f - -j 8"
+echo " Expected: both methods run the command and report exec failure as 127;"
+echo "           vfork (the default) gets through the 500 commands sooner"
+
+./timedexec -t 5 -- echo "started with vfork"
+./timedexec -t 5 --spawn fork -- echo "started with fork"
+./timedexec -t 5 -- does_not_exist
+echo "exit code: $?"
+yes true | head -500 | ./timedexec -t 5 -f - -j 8 | tail -2
+yes true | head -500 | ./timedexec -t 5 --spawn fork -f - -j 8 | tail -2
+echo
+echo
+
+
+echo " TEST 13: OUTPUT CAPTURE (TAIL, SPILL, TIMESTAMPED FILES)"
+echo " Command: ./timedexec -t 5 --tail 10 -- seq 1 100"
+echo "          ./timedexec -t 5 --tail 10 --spill -- seq 1 100000 | grep -c '^[0-9]*$'"
+echo "          ./timedexec -t 300ms --tail 1K -- yes"
+echo "          ./timedexec -t 2 --output-dir DIR -- sh -c 'echo a; sleep 0.2; echo b >&2'"
+echo " Expected: only the last 10 bytes (with a note of how much was dropped);"
+echo "           all 100000 lines; yes is killed on time despite flooding its pipe;"
+echo "           DIR holds the .out and .err files with a timestamp per line"
+
+./timedexec -t 5 --tail 10 -- seq 1 100
+./timedexec -t 5 --tail 10 --spill -- seq 1 100000 | grep -c '^[0-9]*$'
+./timedexec -t 300ms --tail 1K -- yes | tail -1
+capture_dir=$(mktemp -d)
+./timedexec -t 2 --output-dir "$capture_dir" -- sh -c 'echo a; sleep 0.2; echo b >&2'
+cat "$capture_dir"/*.out "$capture_dir"/*.err
+rm -rf "$capture_dir"
+echo
+echo
+
+
+echo " TEST 14: RETRIES AND HEDGING"
+echo " Command: ./timedexec -t 2 --retries 2 --backoff 50ms -- sh -c 'exit 3'"
+echo "          ./timedexec -t 2 --retries 3 --backoff 20ms -- (fails once, then succeeds)"
+echo "          ./timedexec -t 3 --hedge 100ms -- (slow the first time, fast the second)"
+echo "          ./timedexec -t 3 -j 4 --hedge p90 -f - (mostly fast jobs, every 10th slow once)"
+echo " Expected: exit 3 after 3 attempts with growing waits; exit 0 on attempt 2;"
+echo "           the hedged copy wins in about 100 ms; in batch mode the slow"
+echo "           jobs after the first 20 finish through their hedged copy (RUN 1h)"
+
+./timedexec -t 2 --retries 2 --backoff 50ms -- sh -c 'exit 3'
+echo "exit code: $?"
+retry_flag=$(mktemp -u)
+./timedexec -t 2 --retries 3 --backoff 20ms -- sh -c "[ -e $retry_flag ] && exit 0; touch $retry_flag; exit 1"
+echo "exit code: $?"
+rm -f "$retry_flag"
+./timedexec -t 3 --hedge 100ms -r csv -- sh -c "[ -e $retry_flag ] && exit 0; touch $retry_flag; sleep 2"
+echo "exit code: $?"
+rm -f "$retry_flag"
+hedge_dir=$(mktemp -d)
+for i in $(seq 1 60); do
+    if [ $((i % 10)) -eq 0 ]; then
+        echo "sh -c '[ -e $hedge_dir/$i ] && exec sleep 0.05; touch $hedge_dir/$i; sleep 1.5'"
+    else
+        echo "sleep 0.05"
+    fi
+done | ./timedexec -t 3 -j 4 --hedge p90 -f - | grep -v ' sleep 0.05$'
+rm -rf "$hedge_dir"
+echo
+echo
+
+exit $((failures > 0))